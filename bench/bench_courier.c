@@ -0,0 +1,572 @@
+// =============================
+// File: bench/bench_courier.c
+// =============================
+// Courier micro-benchmarks. Prints one JSON document so runs can be compared
+// across backends and commits:
+//
+//   build/bench_courier [-n messages] [-w workers] [-o out.json]
+//
+// -w N runs the actors on the M:N scheduler with N workers instead of one
+// thread per actor.
+//
+// Sends within the process go to in-process mailboxes when COURIER_INPROC is
+// set. The platform_* results send through a backend writer instead, so they
+// compare backends in every build.
+#include "courier.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef COURIER_MAX_MSG_SIZE
+#define COURIER_MAX_MSG_SIZE 256
+#endif /* ifndef COURIER_MAX_MSG_SIZE */
+
+#ifndef COURIER_INPROC
+#define COURIER_INPROC 1
+#endif /* ifndef COURIER_INPROC */
+
+#ifdef COURIER_PLATFORM_LINUX_SHM
+#define BENCH_BACKEND "linux_shm"
+#else
+#define BENCH_BACKEND "linux_mq"
+#endif // ifdef COURIER_PLATFORM_LINUX_SHM
+
+#define BENCH_FAN 4
+#define BENCH_TYPES 16
+#define BENCH_QUEUE_DEPTH 10
+#define BENCH_TOPIC_NOISE 10000
+
+#define Q_SINK "/courier_bench_sink"
+#define Q_PING "/courier_bench_ping"
+#define Q_PONG "/courier_bench_pong"
+#define Q_FAN_OUT "/courier_bench_fan_%d"
+#define Q_TYPE "/courier_bench_type_%d"
+#define Q_CHANNEL "/courier_bench_channel"
+
+// Unlike BENCH_CHECK(), still checked with NDEBUG: the checked calls do the work
+#define BENCH_CHECK(expr)                                                                          \
+    do                                                                                             \
+    {                                                                                              \
+        if(!(expr))                                                                                \
+        {                                                                                          \
+            fprintf(stderr, "bench: %s failed (line %d): %s\n", #expr, __LINE__, strerror(errno)); \
+            exit(1);                                                                               \
+        }                                                                                          \
+    } while(0)
+
+typedef struct
+{
+    uint64_t seq;
+    uint64_t sent_ns;
+} BenchMsg;
+
+// Counts received messages and posts done once target is reached
+typedef struct
+{
+    atomic_size_t received;
+    size_t target;
+    sem_t done;
+} Sink;
+
+static size_t nb_messages = 100000;
+static size_t nb_workers  = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void handle_sink(void *user_data, void *msg)
+{
+    Sink *sink = (Sink *)user_data;
+    (void)msg;
+
+    if(atomic_fetch_add_explicit(&sink->received, 1, memory_order_relaxed) + 1 == sink->target)
+    {
+        sem_post(&sink->done);
+    }
+}
+
+static void handle_echo(void *user_data, void *msg)
+{
+    (void)user_data;
+
+    if(courier_send_to(Q_PONG, msg, sizeof(BenchMsg)) < 0)
+    {
+        perror("courier_send_to(pong)");
+    }
+}
+
+static void sink_init(Sink *sink, size_t target)
+{
+    atomic_store(&sink->received, 0);
+    sink->target = target;
+    sem_init(&sink->done, 0, 0);
+}
+
+static void sink_wait(Sink *sink)
+{
+    while(sem_wait(&sink->done) < 0)
+    {
+    }
+    sem_destroy(&sink->done);
+}
+
+static double msgs_per_sec(size_t count, uint64_t elapsed_ns)
+{
+    return (elapsed_ns > 0) ? (double)count * 1e9 / (double)elapsed_ns : 0.0;
+}
+
+// Where a benchmark sends: by queue name, or through a backend writer that
+// bypasses in-process mailboxes
+typedef struct
+{
+    const char *queue;
+    courrier_mq_t mq;
+} Sender;
+
+static Sender sender_open(const char *queue, size_t msg_size, int platform)
+{
+    Sender s = { .queue = queue, .mq = (courrier_mq_t)-1 };
+
+    if(platform)
+    {
+        s.mq = courier_queue_open_writer(queue, msg_size, BENCH_QUEUE_DEPTH);
+        BENCH_CHECK(s.mq != (courrier_mq_t)-1);
+    }
+
+    return s;
+}
+
+static void sender_send(const Sender *s, const void *msg, size_t msg_size)
+{
+    if(s->mq != (courrier_mq_t)-1)
+    {
+        BENCH_CHECK(courier_send_mq(s->mq, msg, msg_size) == 0);
+    }
+    else
+    {
+        BENCH_CHECK(courier_send_to(s->queue, msg, msg_size) == 0);
+    }
+}
+
+static void sender_close(Sender *s)
+{
+    if(s->mq != (courrier_mq_t)-1)
+    {
+        courier_queue_close(s->mq);
+        s->mq = (courrier_mq_t)-1;
+    }
+}
+
+// ----- Throughput: 1 producer -> 1 consumer actor, per message size -----
+static double bench_throughput(size_t msg_size, size_t count, int platform)
+{
+    char *payload = calloc(1, msg_size);
+    Sink sink;
+    BENCH_CHECK(payload);
+    sink_init(&sink, count);
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_SINK, .msg_size = msg_size, .handler = handle_sink, .mq = (courrier_mq_t)-1},
+    };
+    CourierActor actor;
+    BENCH_CHECK(courier_actor_init(&actor, "BenchSink", defs, 1, &sink) == 0);
+    Sender sender = sender_open(Q_SINK, msg_size, platform);
+
+    const uint64_t t0 = now_ns();
+
+    for(size_t i = 0; i < count; i++)
+    {
+        memcpy(payload, &i, sizeof(i) < msg_size ? sizeof(i) : msg_size);
+        sender_send(&sender, payload, msg_size);
+    }
+    sink_wait(&sink);
+    const uint64_t elapsed = now_ns() - t0;
+
+    sender_close(&sender);
+    courier_actor_close(&actor);
+    free(payload);
+
+    return msgs_per_sec(count, elapsed);
+}
+
+// ----- Ping-pong: round-trip latency through an echo actor -----
+static int cmp_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p)
+{
+    size_t idx = (size_t)(p * (double)(n - 1) + 0.5);
+
+    return sorted[idx < n ? idx : n - 1];
+}
+
+// The pong leg always crosses the backend: its reader is a plain queue
+static void bench_ping_pong(FILE *out, const char *label, size_t rounds, int platform)
+{
+    uint64_t *rtt = malloc(rounds * sizeof(*rtt));
+    BENCH_CHECK(rtt);
+
+    courrier_mq_t pong = courier_queue_open_reader(Q_PONG, sizeof(BenchMsg), BENCH_QUEUE_DEPTH);
+    BENCH_CHECK(pong != (courrier_mq_t)-1);
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_PING, .msg_size = sizeof(BenchMsg), .handler = handle_echo, .mq = (courrier_mq_t)-1},
+    };
+    CourierActor actor;
+    BENCH_CHECK(courier_actor_init(&actor, "BenchEcho", defs, 1, NULL) == 0);
+    Sender ping = sender_open(Q_PING, sizeof(BenchMsg), platform);
+
+    struct pollfd pfd = { .fd = courier_queue_fd(pong), .events = POLLIN };
+
+    for(size_t i = 0; i < rounds; i++)
+    {
+        BenchMsg m = { .seq = i, .sent_ns = now_ns() };
+        sender_send(&ping, &m, sizeof(m));
+
+        while(courier_queue_receive(pong, &m, sizeof(m), NULL) != (ssize_t)sizeof(m))
+        {
+            poll(&pfd, 1, -1);
+        }
+        BENCH_CHECK(m.seq == i);
+        rtt[i] = now_ns() - m.sent_ns;
+    }
+    sender_close(&ping);
+
+    courier_actor_close(&actor);
+    courier_queue_close(pong);
+    courier_queue_unlink(Q_PONG);
+
+    qsort(rtt, rounds, sizeof(*rtt), cmp_u64);
+    uint64_t sum = 0;
+
+    for(size_t i = 0; i < rounds; i++)
+    {
+        sum += rtt[i];
+    }
+
+    fprintf(out, "  \"%s\": {\"rounds\": %zu, \"rtt_ns\": {\"min\": %llu, \"mean\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}},\n", label, rounds,
+            (unsigned long long)rtt[0], (unsigned long long)(sum / rounds), (unsigned long long)percentile(rtt, rounds, 0.50), (unsigned long long)percentile(rtt, rounds, 0.90),
+            (unsigned long long)percentile(rtt, rounds, 0.99), (unsigned long long)percentile(rtt, rounds, 0.999), (unsigned long long)rtt[rounds - 1]);
+    free(rtt);
+}
+
+// ----- Fan-in: N producer threads -> 1 consumer actor -----
+typedef struct
+{
+    size_t count;
+    int platform;
+    pthread_barrier_t *start;
+} Producer;
+
+static void* producer_loop(void *arg)
+{
+    Producer *p   = (Producer *)arg;
+    BenchMsg m    = { 0 };
+    Sender sender = sender_open(Q_SINK, sizeof(m), p->platform);
+
+    pthread_barrier_wait(p->start);
+
+    for(size_t i = 0; i < p->count; i++)
+    {
+        m.seq = i;
+        sender_send(&sender, &m, sizeof(m));
+    }
+    sender_close(&sender);
+    courier_writer_cache_flush();
+
+    return NULL;
+}
+
+static double bench_fan_in(size_t producers, size_t count, int platform)
+{
+    const size_t per_producer = count / producers;
+    Sink sink;
+    sink_init(&sink, per_producer * producers);
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_SINK, .msg_size = sizeof(BenchMsg), .handler = handle_sink, .mq = (courrier_mq_t)-1},
+    };
+    CourierActor actor;
+    BENCH_CHECK(courier_actor_init(&actor, "BenchFanIn", defs, 1, &sink) == 0);
+
+    pthread_t threads[BENCH_FAN];
+    Producer prod = { .count = per_producer, .platform = platform };
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)producers + 1);
+    prod.start = &start;
+
+    for(size_t i = 0; i < producers; i++)
+    {
+        BENCH_CHECK(pthread_create(&threads[i], NULL, producer_loop, &prod) == 0);
+    }
+    pthread_barrier_wait(&start);
+    const uint64_t t0 = now_ns();
+    sink_wait(&sink);
+    const uint64_t elapsed = now_ns() - t0;
+
+    for(size_t i = 0; i < producers; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&start);
+    courier_actor_close(&actor);
+
+    return msgs_per_sec(per_producer * producers, elapsed);
+}
+
+// ----- Fan-out: 1 producer -> N consumer actors, every message to all -----
+// FAN_PUBLISH shares one pooled buffer between all consumers instead of one
+// copy per send; FAN_TOPIC publishes it on a topic the consumers subscribed
+// to, next to BENCH_TOPIC_NOISE subscriptions that never match.
+enum
+{
+    FAN_SEND,
+    FAN_PUBLISH,
+    FAN_TOPIC,
+};
+
+static double bench_fan_out(size_t consumers, size_t count, int mode)
+{
+    const char *queue_names[BENCH_FAN];
+    const size_t per_consumer = count / consumers;
+    CourierActorMsgDef defs[BENCH_FAN][1];
+    CourierActor actors[BENCH_FAN];
+    Sink sinks[BENCH_FAN];
+    char names[BENCH_FAN][32];
+
+    for(size_t i = 0; i < consumers; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), Q_FAN_OUT, (int)i);
+        queue_names[i] = names[i];
+        sink_init(&sinks[i], per_consumer);
+        defs[i][0] = (CourierActorMsgDef){.queue_name = names[i], .msg_size = sizeof(BenchMsg), .handler = handle_sink, .mq = (courrier_mq_t)-1};
+        BENCH_CHECK(courier_actor_init(&actors[i], names[i], defs[i], 1, &sinks[i]) == 0);
+
+        if(mode == FAN_TOPIC)
+        {
+            BENCH_CHECK(courier_subscribe("bench/+/reading", names[i]) == 0);
+        }
+    }
+
+    for(int i = 0; (mode == FAN_TOPIC) && (i < BENCH_TOPIC_NOISE); i++)
+    {
+        char pattern[64];
+        snprintf(pattern, sizeof(pattern), "bench/%d/+/#", i);
+        BENCH_CHECK(courier_subscribe(pattern, Q_SINK) == 0);
+    }
+
+    const uint64_t t0 = now_ns();
+    BenchMsg m        = { 0 };
+
+    for(size_t i = 0; i < per_consumer; i++)
+    {
+        m.seq = i;
+
+        if(mode == FAN_TOPIC)
+        {
+            BenchMsg *buf = courier_msg_alloc(sizeof(*buf));
+            BENCH_CHECK(buf);
+            *buf = m;
+            BENCH_CHECK(courier_publish_msg("bench/fan/reading", buf) == (int)consumers);
+            continue;
+        }
+
+        if(mode == FAN_PUBLISH)
+        {
+            BenchMsg *buf = courier_msg_alloc(sizeof(*buf));
+            BENCH_CHECK(buf);
+            *buf = m;
+            BENCH_CHECK(courier_msg_publish(buf, queue_names, consumers) == 0);
+            continue;
+        }
+
+        for(size_t c = 0; c < consumers; c++)
+        {
+            BENCH_CHECK(courier_send_to(names[c], &m, sizeof(m)) == 0);
+        }
+    }
+
+    for(size_t i = 0; i < consumers; i++)
+    {
+        sink_wait(&sinks[i]);
+    }
+    const uint64_t elapsed = now_ns() - t0;
+
+    for(size_t i = 0; i < consumers; i++)
+    {
+        courier_actor_close(&actors[i]);
+    }
+    courier_topics_clear();
+
+    return msgs_per_sec(per_consumer * consumers, elapsed);
+}
+
+// ----- Message types: BENCH_TYPES types to one actor, round-robin -----
+// Either one queue (and descriptor) per type, or one multiplexed channel.
+static double bench_types(size_t count, int multiplexed)
+{
+    CourierActorMsgDef defs[BENCH_TYPES];
+    CourierMsgType types[BENCH_TYPES];
+    char names[BENCH_TYPES][40];
+    Sink sink;
+    sink_init(&sink, count);
+
+    for(int i = 0; i < BENCH_TYPES; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), Q_TYPE, i);
+        types[i] = (CourierMsgType){.type = (uint16_t)i, .msg_size = sizeof(BenchMsg), .handler = handle_sink};
+        defs[i]  = (CourierActorMsgDef){.queue_name = names[i], .msg_size = sizeof(BenchMsg), .handler = handle_sink, .mq = (courrier_mq_t)-1};
+    }
+    CourierActorMsgDef channel[] = {
+        {.queue_name = Q_CHANNEL, .mq = (courrier_mq_t)-1, .depth = BENCH_TYPES * BENCH_QUEUE_DEPTH, .types = types, .nb_types = BENCH_TYPES},
+    };
+    CourierActor actor;
+    BENCH_CHECK(courier_actor_init(&actor, "BenchTypes", multiplexed ? channel : defs, multiplexed ? 1 : BENCH_TYPES, &sink) == 0);
+
+    const uint64_t t0 = now_ns();
+    BenchMsg m        = { 0 };
+
+    for(size_t i = 0; i < count; i++)
+    {
+        m.seq = i;
+
+        if(multiplexed)
+        {
+            BENCH_CHECK(courier_send_typed(Q_CHANNEL, (uint16_t)(i % BENCH_TYPES), &m, sizeof(m)) == 0);
+        }
+        else
+        {
+            BENCH_CHECK(courier_send_to(names[i % BENCH_TYPES], &m, sizeof(m)) == 0);
+        }
+    }
+    sink_wait(&sink);
+    const uint64_t elapsed = now_ns() - t0;
+
+    courier_actor_close(&actor);
+
+    return msgs_per_sec(count, elapsed);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n messages] [-w workers] [-o out.json]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *out_path = NULL;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:w:o:h")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': nb_messages = strtoul(optarg, NULL, 10); break;
+            case 'w': nb_workers  = strtoul(optarg, NULL, 10); break;
+            case 'o': out_path    = optarg; break;
+            default:
+                usage(argv[0]);
+
+                return 2;
+        }
+    }
+
+    if(nb_messages < BENCH_FAN)
+    {
+        usage(argv[0]);
+
+        return 2;
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+
+    if(!out)
+    {
+        perror("fopen");
+
+        return 1;
+    }
+
+    if(nb_workers > 0 && courier_scheduler_start(nb_workers) < 0)
+    {
+        perror("courier_scheduler_start");
+
+        return 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"backend\": \"%s\",\n", BENCH_BACKEND);
+    fprintf(out, "  \"inproc\": %s,\n", COURIER_INPROC ? "true" : "false");
+    fprintf(out, "  \"workers\": %zu,\n", nb_workers);
+    fprintf(out, "  \"messages\": %zu,\n", nb_messages);
+    fprintf(out, "  \"throughput\": {\"msg_size\": %zu, \"msgs_per_sec\": %.0f},\n", sizeof(BenchMsg), bench_throughput(sizeof(BenchMsg), nb_messages, 0));
+
+    size_t rounds = nb_messages / 10;
+    rounds        = (rounds > 0) ? rounds : 1;
+    bench_ping_pong(out, "ping_pong", rounds, 0);
+
+    fprintf(out, "  \"fan_in\": {\"producers\": %d, \"msgs_per_sec\": %.0f},\n", BENCH_FAN, bench_fan_in(BENCH_FAN, nb_messages, 0));
+
+    // The same three through the backend queue
+    fprintf(out, "  \"platform_throughput\": {\"msg_size\": %zu, \"msgs_per_sec\": %.0f},\n", sizeof(BenchMsg), bench_throughput(sizeof(BenchMsg), nb_messages, 1));
+    bench_ping_pong(out, "platform_ping_pong", rounds, 1);
+    fprintf(out, "  \"platform_fan_in\": {\"producers\": %d, \"msgs_per_sec\": %.0f},\n", BENCH_FAN, bench_fan_in(BENCH_FAN, nb_messages, 1));
+
+    fprintf(out, "  \"fan_out\": {\"consumers\": %d, \"msgs_per_sec\": %.0f},\n", BENCH_FAN, bench_fan_out(BENCH_FAN, nb_messages, FAN_SEND));
+    fprintf(out, "  \"fan_out_publish\": {\"consumers\": %d, \"msgs_per_sec\": %.0f},\n", BENCH_FAN, bench_fan_out(BENCH_FAN, nb_messages, FAN_PUBLISH));
+    fprintf(out, "  \"fan_out_topic\": {\"consumers\": %d, \"subscriptions\": %d, \"msgs_per_sec\": %.0f},\n", BENCH_FAN, BENCH_FAN + BENCH_TOPIC_NOISE, bench_fan_out(BENCH_FAN, nb_messages, FAN_TOPIC));
+    fprintf(out, "  \"types_per_queue\": {\"types\": %d, \"msgs_per_sec\": %.0f},\n", BENCH_TYPES, bench_types(nb_messages, 0));
+    fprintf(out, "  \"types_multiplexed\": {\"types\": %d, \"msgs_per_sec\": %.0f},\n", BENCH_TYPES, bench_types(nb_messages, 1));
+
+    // Message size scaling, powers of two up to COURIER_MAX_MSG_SIZE
+    fprintf(out, "  \"msg_size\": [");
+
+    for(size_t size = 8; size <= COURIER_MAX_MSG_SIZE; size *= 2)
+    {
+        const double rate = bench_throughput(size, nb_messages, 0);
+        fprintf(out, "%s\n    {\"msg_size\": %zu, \"msgs_per_sec\": %.0f, \"mb_per_sec\": %.1f}", (size > 8) ? "," : "", size, rate, rate * (double)size / 1e6);
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Large messages go through shared memory: fewer of them, 4 KiB to 1 MiB
+    const size_t large_count = (nb_messages / 100 > 10) ? nb_messages / 100 : 10;
+    fprintf(out, "  \"large_msg_size\": [");
+
+    for(size_t size = 4096; size <= (1u << 20); size *= 4)
+    {
+        const double rate = bench_throughput(size, large_count, 0);
+        fprintf(out, "%s\n    {\"msg_size\": %zu, \"msgs_per_sec\": %.0f, \"mb_per_sec\": %.1f}", (size > 4096) ? "," : "", size, rate, rate * (double)size / 1e6);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if(nb_workers > 0)
+    {
+        courier_scheduler_stop();
+    }
+    courier_writer_cache_flush();
+
+    if(out != stdout)
+    {
+        fclose(out);
+    }
+
+    return 0;
+}
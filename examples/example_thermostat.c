@@ -28,11 +28,12 @@ static int g_heater_state = 0;
 void sensor_handle_tick(void *user_data, void *msg)
 {
     (void)user_data;
-    TickMsg *tick = (TickMsg *)msg;
+    (void)msg;
+    static int tick = 0; /* the timer resends the same TickMsg: count here */
     /* simulate a temperature reading (18.0 .. 25.0) */
     TempMsg t;
     t.value = 18.0f + (rand() % 70) / 10.0f;
-    printf("[Sensor] tick=%d -> temp=%.1f°C\n", tick->tick, t.value);
+    printf("[Sensor] tick=%d -> temp=%.1f°C\n", tick++, t.value);
 
     if (courier_send_to("/supervisor_temp", &t, sizeof(t)) != 0)
     {
@@ -78,11 +79,11 @@ int main(void)
 
     /* Define message queues for each actor (these are reader-side definitions) */
     CourierActorMsgDef sensor_defs[] = {
-        {"/sensor_tick", sizeof(TickMsg), sensor_handle_tick, (mqd_t)-1}};
+        {.queue_name = "/sensor_tick", .msg_size = sizeof(TickMsg), .handler = sensor_handle_tick, .mq = (courrier_mq_t)-1}};
     CourierActorMsgDef supervisor_defs[] = {
-        {"/supervisor_temp", sizeof(TempMsg), supervisor_handle_temp, (mqd_t)-1}};
+        {.queue_name = "/supervisor_temp", .msg_size = sizeof(TempMsg), .handler = supervisor_handle_temp, .mq = (courrier_mq_t)-1}};
     CourierActorMsgDef heater_defs[] = {
-        {"/heater_cmd", sizeof(HeaterCmdMsg), heater_handle_cmd, (mqd_t)-1}};
+        {.queue_name = "/heater_cmd", .msg_size = sizeof(HeaterCmdMsg), .handler = heater_handle_cmd, .mq = (courrier_mq_t)-1}};
 
     /* Actors (structs) */
     CourierActor sensor = {.name = "Sensor", .msgs = sensor_defs, .nb_msgs = 1, .user_data = NULL};
@@ -109,19 +110,17 @@ int main(void)
         return 1;
     }
 
-    /* Drive the sensor by sending TickMsg to /sensor_tick (writer opens on-demand) */
-    const int N = 20;
-    for (int i = 0; i < N; ++i)
+    /* Drive the sensor with a periodic TickMsg to /sensor_tick, one per second */
+    TickMsg tm = {.tick = 0};
+    CourierTimerId ticker = courier_send_every("/sensor_tick", &tm, sizeof(tm), 1000);
+    if (ticker == 0)
     {
-        TickMsg tm = {.tick = i};
-        if (courier_send_to("/sensor_tick", &tm, sizeof(tm)) != 0)
-        {
-            fprintf(stderr, "failed to send tick %d\n", i);
-        }
-        sleep(1);
+        fprintf(stderr, "failed to start the sensor ticker\n");
     }
+    sleep(20);
 
     /* Shutdown */
+    courier_timer_cancel(ticker);
     courier_actor_close(&sensor);
     courier_actor_close(&heater);
     courier_actor_close(&sup);
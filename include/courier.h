@@ -3,24 +3,74 @@
 // =============================
 #pragma once
 #include "platform.h"
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif // ifdef __cplusplus
 
+// Largest message carried inline; bigger ones travel through shared memory
+#ifndef COURIER_MAX_MSG_SIZE
+#define COURIER_MAX_MSG_SIZE 256
+#endif /* ifndef COURIER_MAX_MSG_SIZE */
+
+// Wire layout of multiplexed channels: every payload follows a 16-byte envelope
+// header, which keeps it as aligned as a plain message's.
+#define COURIER_ENVELOPE_HDR 16
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t size; // payload bytes
+    uint64_t ask;  // request: where the reply goes (CourierAskToken), 0 otherwise
+} CourierEnvelope;
+
 // --- Message handler signature ---
 typedef void (*CourierMessageHandler)(void *user_data, void *msg);
 
+// --- Raw descriptor callback: events is the epoll event mask that fired ---
+typedef void (*CourierFdHandler)(void *user_data, int fd, uint32_t events);
+
+// --- Batch handler: msgs is a contiguous array of count messages of msg_size bytes ---
+typedef void (*CourierBatchHandler)(void *user_data, void *msgs, size_t count);
+
+// --- One message type of a multiplexed channel (see CourierActorMsgDef.types) ---
+typedef struct
+{
+    uint16_t type;                 // compact id, unique within the channel
+    size_t   msg_size;             // sizeof(payload), at most COURIER_MAX_MSG_SIZE - 16 (240 bytes)
+    CourierMessageHandler handler; // called with the payload (in actor thread)
+} CourierMsgType;
+
 // --- Per-message definition owned by an Actor ---
 typedef struct
 {
     const char *queue_name;        // e.g. "/sensor_tick"
-    size_t     msg_size;           // sizeof(payload)
+    size_t     msg_size;           // sizeof(payload); above COURIER_MAX_MSG_SIZE, sent via shared memory
     CourierMessageHandler handler; // called on receive (in actor thread)
-    mqd_t mq;                      // reader descriptor (opened by courier_actor_init)
+    courrier_mq_t mq;              // reader descriptor (opened by courier_actor_init)
+    CourierBatchHandler batch_handler; // optional: replaces handler, called with up to batch_max messages
+    size_t batch_max;                  // batch size K (0 = COURIER_BATCH_DEFAULT)
+    unsigned priority;                 // service order when several queues are ready (higher first)
+    long depth;                        // messages queued before senders wait (0 = 10 on the platform queue,
+                                       // 256 in the in-process mailbox); if nonzero, set on init to the platform
+                                       // queue's depth, which system limits may lower. The mailbox rounds the depth
+                                       // asked for up to a power of two (see courier_queue_capacity)
+    long depth_max;                    // adaptive: the in-process mailbox grows up to this under bursts (0 = fixed)
+    const CourierMsgType *types;       // optional: one channel for nb_types message types sent with
+    size_t nb_types;                   // courier_send_typed (msg_size and handler are then unused)
+    size_t conflate;                   // latest value only: 1 = a send replaces the message still pending,
+                                       // N > 1 = one pending message per key, for N keys at least (0 = FIFO);
+                                       // a new key past that fails with errno ENOSPC (keys are never released)
+    size_t key_offset;                 // conflate > 1: the key is the key_size bytes (1 to 8) at key_offset
+    size_t key_size;
+    int envelopes;                     // handler takes whole envelopes sent with courier_send_typed, which are
+                                       // as long as their payload: msg_size is the largest (no size warning)
 } CourierActorMsgDef;
 
 // --- Actor ---
+struct CourierActorRuntime; // internal, allocated by courier_actor_init
+
 typedef struct
 {
     const char *name;
@@ -28,33 +78,389 @@ typedef struct
     size_t    nb_msgs;        // length of msgs[]
     void      *user_data;     // opaque pointer passed to handlers
     pthread_t thread;         // actor thread
+    int       epfd;           // epoll set over the msgs[] queues (edge-triggered)
+    struct CourierActorRuntime *rt;
 } CourierActor;
 
 // ===== Queue helpers (safe building blocks) =====
-// Open a queue for reading (creates if needed). Returns (mqd_t)-1 on error.
-// mqd_t courier_queue_open_reader(const char *queue_name, size_t msg_size, long maxmsg);
+// Open a queue for reading (creates if needed). Returns (courrier_mq_t)-1 on error.
+courrier_mq_t courier_queue_open_reader(const char *queue_name, size_t msg_size, long maxmsg);
 
-// Open a queue for writing (creates if needed). Returns (mqd_t)-1 on error.
-// mqd_t courier_queue_open_writer(const char *queue_name, size_t msg_size, long maxmsg);
+// Open a queue for writing (creates if needed). Returns (courrier_mq_t)-1 on error.
+courrier_mq_t courier_queue_open_writer(const char *queue_name, size_t msg_size, long maxmsg);
 
 // Send using an already-opened writer descriptor.
-int courier_send_mq(mqd_t mq, const void *msg, size_t msg_size);
+int courier_send_mq(courrier_mq_t mq, const void *msg, size_t msg_size);
 
-// Convenience: open-on-demand writer, send, then close. Returns 0 on success.
+// Convenience: send through a cached writer descriptor (opened on first use). When the reader is an
+// actor of this process, the message goes to its in-process mailbox instead: one copy into a pooled
+// slot, no syscall unless the actor sleeps. Returns 0 on success.
 int courier_send_to(const char *queue_name, const void *msg, size_t msg_size);
 
-// Close/unlink helpers
-int courier_queue_close(mqd_t mq);
+// Priority-aware variants (0 .. MQ_PRIO_MAX-1, higher is received first within a POSIX mqueue;
+// the shm backend and in-process mailboxes stay FIFO and only report it via courier_msg_priority).
+int courier_send_mq_prio(courrier_mq_t mq, const void *msg, size_t msg_size, unsigned prio);
+int courier_send_to_prio(const char *queue_name, const void *msg, size_t msg_size, unsigned prio);
+
+// Non-blocking receive on a reader. Returns bytes received, or -1 (errno EAGAIN when empty).
+ssize_t courier_queue_receive(courrier_mq_t mq, void *buf, size_t buf_size, unsigned *prio);
+
+// Pollable descriptor for a reader.
+int courier_queue_fd(courrier_mq_t mq);
+
+// Close/unlink helpers. Unlinking also evicts the queue from the writer cache.
+int courier_queue_close(courrier_mq_t mq);
 int courier_queue_unlink(const char *queue_name);
 
+// Close every cached writer descriptor used by courier_send_to.
+void courier_writer_cache_flush(void);
+
+// ===== Backpressure =====
+// The sends above wait as long as the queue is full. These variants give up instead and return
+// -1 with errno EAGAIN ("queue full", never reported on stderr) so the producer can drop, retry
+// later or slow down; any other errno is a real failure.
+int courier_try_send_to(const char *queue_name, const void *msg, size_t msg_size);
+
+// Wait at most timeout_ms for room (0 = do not wait, < 0 = no limit).
+int courier_send_to_timed(const char *queue_name, const void *msg, size_t msg_size, int timeout_ms);
+int courier_send_mq_timed(courrier_mq_t mq, const void *msg, size_t msg_size, int timeout_ms);
+
+// Messages waiting in queue_name (in the reader's mailbox when it is an actor of this process).
+// Opens the queue like courier_send_to. Returns -1 on error.
+long courier_queue_depth(const char *queue_name);
+
+// Messages queue_name holds before senders wait: the current size of the reader's mailbox when it
+// is an actor of this process (adaptive mailboxes grow), of the platform queue otherwise.
+long courier_queue_capacity(const char *queue_name);
+
+// above is 1 when the queue reached its high mark, 0 when it is back down to its low mark.
+typedef void (*CourierWatermarkHandler)(void *user_data, const char *queue_name, int above);
+
+// Call handler once each time sends of this process fill queue_name up to high messages, and once
+// when it falls back to low (0 <= low < high) afterwards. The high side runs on the sending
+// thread right after the send; the low side on the reading actor when it lives in this process,
+// else on the next send. Keep it short: it runs inside a send. Replaces earlier marks; a NULL
+// handler turns them off. Returns 0 on success.
+int courier_queue_watermarks(const char *queue_name, long high, long low, CourierWatermarkHandler handler, void *user_data);
+
+// ===== Pooled messages (write once, deliver to many) =====
+// Allocate a message buffer of size bytes (<= COURIER_MAX_MSG_SIZE) from the calling thread's
+// pool. Returns NULL on error. The caller owns one reference.
+void* courier_msg_alloc(size_t size);
+
+// Deliver msg to every queue in queue_names and drop the caller's reference. Actors of this
+// process receive the buffer itself (one reference each, recycled when the last handler returns,
+// so handlers must treat it as read-only); other readers get a copy through their queue.
+// Returns 0 when every queue got the message, -1 otherwise (errno of the last failure).
+int courier_msg_publish(void *msg, const char *const *queue_names, size_t count);
+
+// Drop a reference without sending.
+void courier_msg_release(void *msg);
+
+// ===== Large messages (above COURIER_MAX_MSG_SIZE) =====
+// A definition whose msg_size exceeds COURIER_MAX_MSG_SIZE (256) receives its messages through
+// shared memory: only a small handle goes through the queue, and the handler runs on a read-write
+// mapping of the sender's buffer, valid until it returns. courier_send_to copies larger payloads
+// into such a buffer; build them in place with courier_blob_alloc to avoid that copy.
+
+// Allocate a shared buffer of size bytes (<= COURIER_MAX_BLOB_SIZE, 64 MiB by default).
+// Returns NULL on error.
+void* courier_blob_alloc(size_t size);
+
+// Send a buffer from courier_blob_alloc to a large-message queue. The buffer is handed over
+// whether or not the send succeeds: do not touch it afterwards. Returns 0 on success.
+int courier_blob_send(const char *queue_name, void *blob);
+
+// Release a buffer that was never sent.
+void courier_blob_free(void *blob);
+
+// ===== Timers =====
+// Delayed and periodic sends, driven by one timer wheel for the whole process (no thread per
+// timer). Timer resolution is 1 ms; a message is never sent early. A timer never waits for room:
+// a message whose queue is full when it is due is dropped (see courier_timer_dropped).
+typedef uint64_t CourierTimerId; // 0 = invalid
+
+// Copy msg and send it to queue_name after delay_ms. Returns the timer, or 0 on error.
+CourierTimerId courier_send_after(const char *queue_name, const void *msg, size_t msg_size, uint64_t delay_ms);
+
+// Copy msg and send it to queue_name every period_ms (first send after one period). Missed
+// periods are skipped rather than sent in a burst. Returns the timer, or 0 on error.
+CourierTimerId courier_send_every(const char *queue_name, const void *msg, size_t msg_size, uint64_t period_ms);
+
+// Stop a pending timer; a message already being sent is not recalled. Returns 0 on success,
+// -1 with errno ENOENT when the timer already fired (one-shot) or was cancelled.
+int courier_timer_cancel(CourierTimerId id);
+
+// Timer messages dropped so far because their queue was full.
+size_t courier_timer_dropped(void);
+
 // ===== Actor API =====
-// Initialize: synchronously create/open all actor queues for reading and start the actor thread.
+// Initialize: synchronously create/open all actor queues for reading (non-blocking, registered
+// in an edge-triggered epoll set) and start the actor thread.
 // Returns 0 on success, <0 on error.
 int courier_actor_init(CourierActor *actor, const char *name, CourierActorMsgDef *msgs, size_t nb_msgs, void *user_data);
 
-// Graceful close: cancels and joins the thread; closes & unlinks queues.
+// Watch a raw descriptor (socket, pipe, signalfd, inotify, ...) from the actor's own epoll set:
+// handler runs on the actor thread with actor->user_data, between message handlers, whenever one
+// of events (EPOLLIN, EPOLLOUT, ... level-triggered unless EPOLLET is given) is raised. The fd
+// stays owned by the caller. Any thread may add or remove. Returns 0 on success, <0 on error.
+int courier_actor_add_fd(CourierActor *actor, int fd, uint32_t events, CourierFdHandler handler);
+
+// Stop watching fd (typically from its own handler, before closing it). No callback for fd starts
+// after this returns; one already running on the actor thread may finish. Returns 0, or <0
+// (errno ENOENT) when fd was not registered.
+int courier_actor_remove_fd(CourierActor *actor, int fd);
+
+// Priority of the message currently being handled on this thread (highest of
+// the batch for batch handlers). Only meaningful inside a handler.
+unsigned courier_msg_priority(void);
+
+// ===== Multiplexed channels =====
+// A definition with a types table carries many message types on one queue: one descriptor in the
+// actor's epoll set however many types it accepts, and messages of different types are handled
+// in the order they were sent. Each message travels in an envelope naming its type, and the actor
+// dispatches it to that type's handler through a table indexed by type id. Messages of unknown
+// types are dropped with a warning.
+
+// Send msg as a message of the given type to a channel. Returns 0 on success, -1 with errno
+// EMSGSIZE when msg_size does not fit an envelope.
+int courier_send_typed(const char *queue_name, uint16_t type, const void *msg, size_t msg_size);
+
+// Type id of the message currently being handled on this thread (0 outside multiplexed channels).
+uint16_t courier_msg_type(void);
+
+// ===== Request/reply =====
+// An ask sends a request to a multiplexed channel and gets one reply back: two message hops. The
+// asker's reply channel is a queue created on its first ask and reused afterwards, one per actor
+// for continuations and one per thread for blocking waits. Requests carry a token naming that
+// channel and a correlation id, which the responder hands back with courier_reply.
+typedef uint64_t CourierAskToken; // 0 = not a request
+
+// Reply continuation, called on the asking actor's thread. error is 0 with the reply, or ETIMEDOUT
+// (reply NULL) when none arrived in time; a late reply is then dropped.
+typedef void (*CourierReplyHandler)(void *user_data, const void *reply, size_t reply_size, int error);
+
+// From an actor handler: send msg as a request of the given type to a channel, and run on_reply
+// on this actor once it is answered or timeout_ms expired (< 0 = wait forever; the timeout is a
+// timer message on the reply channel). Returns 0, or -1 with errno EPERM outside an actor
+// handler, EAGAIN when the actor already waits for as many replies as its reply channel
+// holds: COURIER_ASK_PENDING_MAX, or half the queue depth the platform granted.
+int courier_ask(const char *queue_name, uint16_t type, const void *msg, size_t msg_size, int timeout_ms,
+                CourierReplyHandler on_reply, void *user_data);
+
+// Blocking form for threads that are not actors: send the request and wait for its reply, copied
+// into reply (truncated to reply_size). Returns the reply size, or -1 with errno ETIMEDOUT.
+ssize_t courier_ask_wait(const char *queue_name, uint16_t type, const void *msg, size_t msg_size, void *reply,
+                         size_t reply_size, int timeout_ms);
+
+// Token of the request being handled on this thread (0 when the message is not a request). Keep it
+// to answer later with courier_reply_to.
+CourierAskToken courier_msg_ask(void);
+
+// Answer a request; never waits: a reply the asker has no room for fails with errno EAGAIN and the
+// asker times out. courier_reply answers the request being handled (errno EINVAL if none).
+int courier_reply_to(CourierAskToken token, const void *reply, size_t reply_size);
+int courier_reply(const void *reply, size_t reply_size);
+
+// ===== Ports =====
+// A port is a small integer bound once to a queue. Sends through it index a process-wide table
+// instead of hashing and comparing the queue name, which is what static graphs compile down to
+// (courier_graph.h). Like the writer cache, a port resolves the in-process mailbox when it is
+// bound, so bind it after the reading actor has started. Bind and unbind while nothing sends
+// through the port.
+#ifndef COURIER_PORTS_MAX
+#define COURIER_PORTS_MAX 64
+#endif /* ifndef COURIER_PORTS_MAX */
+
+// Bind port (0 .. COURIER_PORTS_MAX - 1) to queue_name, for messages of up to msg_size bytes
+// (at most COURIER_MAX_MSG_SIZE). Returns -1 with errno EBUSY when the port is already bound.
+int courier_port_bind(int port, const char *queue_name, size_t msg_size);
+int courier_port_unbind(int port);
+
+// Same as courier_send_to and courier_send_typed; errno EBADF when port is not bound.
+int courier_port_send(int port, const void *msg, size_t msg_size);
+int courier_port_send_typed(int port, uint16_t type, const void *msg, size_t msg_size);
+
+// ===== Topics (publish/subscribe) =====
+// Topics are '/' separated levels ("sensors/kitchen/temp"). A subscription pattern may use '+'
+// for exactly one level and '#', as its last level, for any number of them including none
+// ("sensors/+/temp", "sensors/#"). Subscriptions are process-wide and name queues, so any reader
+// can subscribe, local or not. A publish resolves its topic once, then reuses the cached list of
+// queues until the subscriptions change, and sends one pooled buffer to all of them
+// (courier_msg_publish). Unsubscribe a queue before closing its actor.
+#ifndef COURIER_TOPIC_MAX
+#define COURIER_TOPIC_MAX 128 // bytes, terminator included
+#endif /* ifndef COURIER_TOPIC_MAX */
+
+#ifndef COURIER_TOPIC_LEVELS_MAX
+#define COURIER_TOPIC_LEVELS_MAX 16
+#endif /* ifndef COURIER_TOPIC_LEVELS_MAX */
+
+// Deliver messages published on topics matching pattern to queue_name. A queue matched by several
+// of its patterns receives one copy. Returns -1 with errno EINVAL on a malformed pattern, EEXIST
+// when the subscription is already there.
+int courier_subscribe(const char *pattern, const char *queue_name);
+
+// errno ENOENT when queue_name is not subscribed to pattern.
+int courier_unsubscribe(const char *pattern, const char *queue_name);
+
+// Drop every subscription.
+void courier_topics_clear(void);
+
+// Send a copy of msg to every queue subscribed to topic (no wildcards). Returns the number of
+// queues, 0 when nobody listens, or -1 when a send failed (errno of the last failure).
+int courier_publish(const char *topic, const void *msg, size_t msg_size);
+
+// Same for a buffer from courier_msg_alloc, without the copy; takes over the caller's reference.
+int courier_publish_msg(const char *topic, void *msg);
+
+// Outcome of a cooperative close.
+typedef struct
+{
+    size_t processed; // queued messages dispatched after the close request
+    size_t dropped;   // messages discarded when the deadline expired
+} CourierCloseStats;
+
+// Cooperative close: raises the actor's stop signal (an eventfd in its epoll set), lets it
+// dispatch the messages already queued for up to deadline_ms (<0 = no deadline, 0 = drop
+// them), waits for the actor to stop, then closes & unlinks its queues. The actor is never
+// interrupted inside a handler. Returns 0 on success, <0 on error.
+int courier_actor_close_drain(CourierActor *actor, int deadline_ms, CourierCloseStats *stats);
+
+// Graceful close: stops the actor without draining its queues; closes & unlinks queues.
 void courier_actor_close(CourierActor *actor);
 
+// ===== Actor pools (competing consumers) =====
+// nb_workers identical actors reading the same queues, so a CPU-heavy handler scales across
+// cores while producers keep sending to the same queue names. In-process sends go to the less
+// loaded of two workers' private mailboxes; messages from other processes go through the one
+// platform queue, drained by whichever worker is free (by worker 0 alone on the shm backend,
+// whose rings have a single consumer). Messages are spread over workers, so ordering only
+// holds per worker.
+struct CourierActorPoolRuntime; // internal, allocated by courier_actor_pool_init
+
+typedef struct
+{
+    const char *name;
+    CourierActorMsgDef *msgs; // definitions shared by every worker (mq and depth filled in)
+    size_t nb_msgs;
+    size_t nb_workers;
+    CourierActor *workers;    // nb_workers actors, owned by the pool
+    struct CourierActorPoolRuntime *rt;
+} CourierActorPool;
+
+// Start nb_workers actors over msgs, worker i with user_data[i] (user_data NULL = all NULL).
+// Returns 0, or -1 with nothing left running (errno EINVAL for conflating definitions).
+int courier_actor_pool_init(CourierActorPool *pool, const char *name, CourierActorMsgDef *msgs, size_t nb_msgs, size_t nb_workers,
+                            void *const *user_data);
+
+// Like courier_actor_close_drain for every worker, once the queues stopped taking in-process
+// sends; stats are summed over workers.
+int courier_actor_pool_close_drain(CourierActorPool *pool, int deadline_ms, CourierCloseStats *stats);
+void courier_actor_pool_close(CourierActorPool *pool);
+
+// ===== Sharded routing =====
+// A router spreads keyed messages (one sensor, one account...) over a fixed set of shard queues
+// so that every message of a key reaches the same shard, in send order. The key is read from the
+// message at a fixed offset or returned by a callback, hashed, and mapped to a shard with a jump
+// consistent hash: a send costs that hash and an array index. Going from n to n + 1 shards moves
+// about 1/(n + 1) of the keys, all of them to the new shard; dropping the last shard only moves
+// its own keys. Like ports, shards resolve their in-process mailbox when the router is set up,
+// so start the shard actors first.
+struct CourierRouterRuntime; // internal, allocated by courier_router_init
+
+// Key of a message, for routers that do not read it at a fixed offset
+typedef uint64_t (*CourierKeyFn)(const void *msg, size_t msg_size);
+
+typedef struct
+{
+    size_t msg_size;    // largest message routed (at most COURIER_MAX_MSG_SIZE)
+    size_t key_offset;  // key bytes in the message, when key_fn is NULL
+    size_t key_size;
+    CourierKeyFn key_fn;
+    struct CourierRouterRuntime *rt;
+} CourierRouter;
+
+// Route messages of up to msg_size bytes over nb_shards queues. The key is the key_size bytes at
+// key_offset, or key_fn(msg, msg_size) when key_fn is set (key_offset and key_size ignored).
+// Returns -1 with errno EINVAL when the key does not fit in msg_size.
+int courier_router_init(CourierRouter *router, const char *const *shards, size_t nb_shards, size_t msg_size,
+                        size_t key_offset, size_t key_size, CourierKeyFn key_fn);
+
+// Replace the shard list, keeping shard i's keys on index i where possible (append to grow,
+// drop from the end to shrink). Safe while other threads send; messages of a moved key that
+// are still queued on its old shard may be handled after newer ones on the new shard.
+int courier_router_resize(CourierRouter *router, const char *const *shards, size_t nb_shards);
+
+// Index of the shard msg goes to, or -1 with errno EINVAL when msg is too short for its key.
+int courier_router_shard(const CourierRouter *router, const void *msg, size_t msg_size);
+
+// Same as courier_send_to on the shard of msg's key. Shard writers that went stale (the shard actor
+// started again, or watermarks were registered since) are resolved again and the send retried.
+int courier_router_send(const CourierRouter *router, const void *msg, size_t msg_size);
+
+// Release the shards; nothing may send through the router any more.
+void courier_router_close(CourierRouter *router);
+
+// ===== Scheduler API (M:N mode) =====
+// Start nb_workers threads (0 = one per online CPU). While the scheduler runs,
+// courier_actor_init attaches actors to the pool instead of spawning one thread
+// per actor. An actor runs on at most one worker at a time.
+// Returns 0 on success, <0 on error.
+int courier_scheduler_start(size_t nb_workers);
+
+// Stop and join the workers. Close the scheduled actors first.
+void courier_scheduler_stop(void);
+
+// Per-worker load-balancing counters (work-stealing run queues).
+typedef struct
+{
+    uint64_t local_pops;     // actors taken from the worker's own deque
+    uint64_t steals;         // actors stolen from another worker
+    uint64_t steal_attempts; // victims probed, successful or not
+    uint64_t idle_ns;        // time spent blocked waiting for ready actors
+    uint64_t wakeups;        // returns from the shared epoll wait
+} CourierWorkerStats;
+
+size_t courier_scheduler_nb_workers(void);
+
+// Snapshot the counters of one worker. Returns 0 on success, <0 on error.
+int courier_scheduler_stats(size_t worker, CourierWorkerStats *out);
+
+// ===== Latency instrumentation (build with COURIER_STATS) =====
+// Log-linear histograms: values below 2^(SUB_BITS+1) ns get exact buckets, above that each
+// power of two is split into 2^SUB_BITS linear sub-buckets (relative error <= 12.5%).
+// Values from 2^MAX_BITS ns (~18 min) on land in the last bucket.
+#define COURIER_HIST_SUB_BITS 3
+#define COURIER_HIST_MAX_BITS 40
+#define COURIER_HIST_BUCKETS  ((COURIER_HIST_MAX_BITS - COURIER_HIST_SUB_BITS + 1) << COURIER_HIST_SUB_BITS)
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[COURIER_HIST_BUCKETS];
+} CourierHistogram;
+
+typedef struct
+{
+    CourierHistogram queue_wait; // send timestamp -> dequeued by the actor
+    CourierHistogram handler;    // handler execution, per call (per batch for batch handlers)
+} CourierMsgStats;
+
+// Snapshot the histograms of actor->msgs[msg_idx]. Returns 0 on success, <0 on error
+// (errno ENOTSUP when the library was built without COURIER_STATS).
+int courier_actor_stats(const CourierActor *actor, size_t msg_idx, CourierMsgStats *stats);
+
+// Value (ns) at a percentile in [0, 100]: the upper bound of the bucket that contains it.
+uint64_t courier_histogram_percentile(const CourierHistogram *hist, double percentile);
+
+// Bucket index of a value, and the largest value that maps to a bucket.
+size_t courier_histogram_bucket(uint64_t value_ns);
+uint64_t courier_histogram_bucket_max(size_t bucket);
+
 #ifdef __cplusplus
 }
 #endif // ifdef __cplusplus
@@ -0,0 +1,383 @@
+// =============================
+// File: include/courier.hpp
+// =============================
+// Header-only C++17 layer over courier.h. Message types carry their queue in
+// a traits specialization, so sends are sized and addressed at compile time,
+// and actors bind handlers by type: each definition's handler is a function
+// template instantiated for one (state, message, handler) triple, which the
+// compiler can inline into. Nothing here allocates or dispatches virtually;
+// errors are reported like the C API, -1 with errno set.
+//
+//   struct TempMsg { float value; };
+//   COURIER_MESSAGE(TempMsg, "/supervisor_temp");
+//
+//   struct Supervisor
+//   {
+//       void handle(const TempMsg &t);   // plain message types call handle()
+//       void reset(const ResetMsg &r);
+//   };
+//
+//   Supervisor state;
+//   courier::Actor<Supervisor, TempMsg, courier::on<ResetMsg, &Supervisor::reset>> actor(state);
+//   actor.start("Supervisor");
+//   courier::send(TempMsg{ 21.5f });
+#pragma once
+#include "courier.h"
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+namespace courier
+{
+// ----- Message traits -----
+// Specialize for every message type, or use COURIER_MESSAGE. Required:
+//   static constexpr const char *queue;  where the message is sent and read
+// Optional, applied where an actor reads the queue (see CourierActorMsgDef):
+//   static constexpr unsigned priority;
+//   static constexpr long depth;
+//   static constexpr long depth_max;
+//   static constexpr std::size_t conflate;   latest value only, per queue (1) or per key
+//   static constexpr std::size_t key_offset; with key_size, where the key is (conflate > 1)
+//   static constexpr std::size_t key_size;
+template <typename T>
+struct message_traits;
+
+namespace detail
+{
+template <typename T, typename = void>
+struct has_queue : std::false_type
+{
+};
+
+template <typename T>
+struct has_queue<T, std::void_t<decltype(message_traits<T>::queue)>> : std::true_type
+{
+};
+
+template <typename Tr, typename = void>
+struct priority_of
+{
+    static constexpr unsigned value = 0;
+};
+
+template <typename Tr>
+struct priority_of<Tr, std::void_t<decltype(Tr::priority)>>
+{
+    static constexpr unsigned value = Tr::priority;
+};
+
+template <typename Tr, typename = void>
+struct depth_of
+{
+    static constexpr long value = 0;
+};
+
+template <typename Tr>
+struct depth_of<Tr, std::void_t<decltype(Tr::depth)>>
+{
+    static constexpr long value = Tr::depth;
+};
+
+template <typename Tr, typename = void>
+struct depth_max_of
+{
+    static constexpr long value = 0;
+};
+
+template <typename Tr>
+struct depth_max_of<Tr, std::void_t<decltype(Tr::depth_max)>>
+{
+    static constexpr long value = Tr::depth_max;
+};
+
+template <typename Tr, typename = void>
+struct conflate_of
+{
+    static constexpr std::size_t value = 0;
+};
+
+template <typename Tr>
+struct conflate_of<Tr, std::void_t<decltype(Tr::conflate)>>
+{
+    static constexpr std::size_t value = Tr::conflate;
+};
+
+template <typename Tr, typename = void>
+struct key_offset_of
+{
+    static constexpr std::size_t value = 0;
+};
+
+template <typename Tr>
+struct key_offset_of<Tr, std::void_t<decltype(Tr::key_offset)>>
+{
+    static constexpr std::size_t value = Tr::key_offset;
+};
+
+template <typename Tr, typename = void>
+struct key_size_of
+{
+    static constexpr std::size_t value = 0;
+};
+
+template <typename Tr>
+struct key_size_of<Tr, std::void_t<decltype(Tr::key_size)>>
+{
+    static constexpr std::size_t value = Tr::key_size;
+};
+
+// Messages are copied byte for byte onto the queue
+template <typename T>
+constexpr bool check_message()
+{
+    static_assert(std::is_trivially_copyable_v<T>, "courier messages are copied as bytes: use a trivially copyable type");
+    static_assert(!std::is_pointer_v<T>, "send the message, not a pointer to it");
+
+    return true;
+}
+
+template <typename T>
+constexpr bool check_addressed()
+{
+    static_assert(has_queue<T>::value, "no queue for this message type: specialize courier::message_traits or use COURIER_MESSAGE");
+
+    return check_message<T>();
+}
+} // namespace detail
+
+// Compile-time description of a message type
+template <typename T>
+struct message
+{
+    static constexpr const char *queue      = message_traits<T>::queue;
+    static constexpr std::size_t size       = sizeof(T);
+    static constexpr unsigned priority      = detail::priority_of<message_traits<T>>::value;
+    static constexpr long depth             = detail::depth_of<message_traits<T>>::value;
+    static constexpr long depth_max         = detail::depth_max_of<message_traits<T>>::value;
+    static constexpr std::size_t conflate   = detail::conflate_of<message_traits<T>>::value;
+    static constexpr std::size_t key_offset = detail::key_offset_of<message_traits<T>>::value;
+    static constexpr std::size_t key_size   = detail::key_size_of<message_traits<T>>::value;
+};
+
+// ----- Sending -----
+template <typename T>
+inline int send(const T &msg)
+{
+    static_assert(detail::check_addressed<T>());
+
+    return courier_send_to(message<T>::queue, &msg, sizeof(T));
+}
+
+template <typename T>
+inline int send_prio(const T &msg, unsigned prio)
+{
+    static_assert(detail::check_addressed<T>());
+
+    return courier_send_to_prio(message<T>::queue, &msg, sizeof(T), prio);
+}
+
+// -1 with errno EAGAIN instead of waiting for room
+template <typename T>
+inline int try_send(const T &msg)
+{
+    static_assert(detail::check_addressed<T>());
+
+    return courier_try_send_to(message<T>::queue, &msg, sizeof(T));
+}
+
+template <typename T>
+inline int send_timed(const T &msg, int timeout_ms)
+{
+    static_assert(detail::check_addressed<T>());
+
+    return courier_send_to_timed(message<T>::queue, &msg, sizeof(T), timeout_ms);
+}
+
+template <typename T>
+inline CourierTimerId send_after(const T &msg, uint64_t delay_ms)
+{
+    static_assert(detail::check_addressed<T>());
+
+    return courier_send_after(message<T>::queue, &msg, sizeof(T), delay_ms);
+}
+
+template <typename T>
+inline CourierTimerId send_every(const T &msg, uint64_t period_ms)
+{
+    static_assert(detail::check_addressed<T>());
+
+    return courier_send_every(message<T>::queue, &msg, sizeof(T), period_ms);
+}
+
+// Explicit destinations, for message types read on several queues
+template <typename T>
+inline int send_to(const char *queue_name, const T &msg)
+{
+    static_assert(detail::check_message<T>());
+
+    return courier_send_to(queue_name, &msg, sizeof(T));
+}
+
+template <typename T>
+inline int send_port(int port, const T &msg)
+{
+    static_assert(detail::check_message<T>());
+
+    return courier_port_send(port, &msg, sizeof(T));
+}
+
+// ----- Actors -----
+// Handler binding for an actor's message list: T is handled by Fn, either a
+// member function of the state taking const T & or a free function taking
+// (State &, const T &). In C++20 Fn can also be a captureless lambda.
+template <typename T, auto Fn>
+struct on
+{
+    using message_type = T;
+};
+
+namespace detail
+{
+// A bare message type is handled by the state's handle(const T &) overload
+template <typename State, typename Binding>
+struct binding
+{
+    using message_type = Binding;
+
+    static void call(void *user_data, void *msg)
+    {
+        static_cast<State *>(user_data)->handle(*static_cast<const Binding *>(msg));
+    }
+};
+
+template <typename State, typename T, auto Fn>
+struct binding<State, on<T, Fn>>
+{
+    using message_type = T;
+
+    static void call(void *user_data, void *msg)
+    {
+        State &state   = *static_cast<State *>(user_data);
+        const T &typed = *static_cast<const T *>(msg);
+
+        if constexpr(std::is_member_function_pointer_v<decltype(Fn)>)
+        {
+            (state.*Fn)(typed);
+        }
+        else
+        {
+            Fn(state, typed);
+        }
+    }
+};
+} // namespace detail
+
+// Typed actor over a State object: one queue per message type of Bindings,
+// each a message type or an on<T, Fn> binding, read by one actor thread that
+// calls the handlers on state. Declared after its state, the actor is closed
+// before the state goes away.
+template <typename State, typename... Bindings>
+class Actor
+{
+public:
+    static constexpr std::size_t nb_msgs = sizeof...(Bindings);
+
+    static_assert(nb_msgs > 0, "an actor handles at least one message type");
+
+    explicit Actor(State &state) : state_(state)
+    {
+    }
+
+    Actor(const Actor &)            = delete;
+    Actor &operator=(const Actor &) = delete;
+
+    ~Actor()
+    {
+        close();
+    }
+
+    int start(const char *name)
+    {
+        defs_ = { { def<Bindings>()... } };
+
+        const int ret = courier_actor_init(&actor_, name, defs_.data(), nb_msgs, &state_);
+        started_      = (ret == 0);
+
+        return ret;
+    }
+
+    int close_drain(int deadline_ms, CourierCloseStats *stats = nullptr)
+    {
+        if(!started_)
+        {
+            return 0;
+        }
+        started_ = false;
+
+        return courier_actor_close_drain(&actor_, deadline_ms, stats);
+    }
+
+    void close()
+    {
+        if(started_)
+        {
+            courier_actor_close(&actor_);
+            started_ = false;
+        }
+    }
+
+    State &state()
+    {
+        return state_;
+    }
+
+    // The underlying actor, for the rest of the C API (descriptor sources, stats)
+    CourierActor *c_actor()
+    {
+        return &actor_;
+    }
+
+    // Platform queue depth each definition obtained, for senders in other processes; the
+    // in-process mailbox may hold more (see CourierActorMsgDef.depth)
+    long depth(std::size_t idx) const
+    {
+        return defs_[idx].depth;
+    }
+
+private:
+    template <typename Binding>
+    static CourierActorMsgDef def()
+    {
+        using B = detail::binding<State, Binding>;
+        using T = typename B::message_type;
+        static_assert(detail::check_addressed<T>());
+
+        CourierActorMsgDef d{};
+        d.queue_name = message<T>::queue;
+        d.msg_size   = sizeof(T);
+        d.handler    = &B::call;
+        d.mq         = static_cast<courrier_mq_t>(-1);
+        d.priority   = message<T>::priority;
+        d.depth      = message<T>::depth;
+        d.depth_max  = message<T>::depth_max;
+        d.conflate   = message<T>::conflate;
+        d.key_offset = message<T>::key_offset;
+        d.key_size   = message<T>::key_size;
+
+        return d;
+    }
+
+    State &state_;
+    CourierActor actor_{};
+    std::array<CourierActorMsgDef, nb_msgs> defs_{};
+    bool started_ = false;
+};
+} // namespace courier
+
+// Address a message type: COURIER_MESSAGE(TempMsg, "/supervisor_temp"); at global scope
+#define COURIER_MESSAGE(type, queue_name)                    \
+    template <>                                              \
+    struct courier::message_traits<type>                     \
+    {                                                        \
+        static constexpr const char *queue = queue_name;     \
+    }
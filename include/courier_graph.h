@@ -0,0 +1,236 @@
+// =============================
+// File: include/courier_graph.h
+// =============================
+// Static actor graphs. A topology fixed at build time is declared once, as an
+// X-macro list, and including this header turns it into code:
+//
+//   #define COURIER_GRAPH_NAME thermo
+//   #define COURIER_GRAPH(ACTOR, MSG, EDGE)
+//       ACTOR(SENSOR,     "/thermo_sensor",     16)
+//       ACTOR(SUPERVISOR, "/thermo_supervisor", 16)
+//       MSG(SENSOR,     TICK, TickMsg, sensor_on_tick)
+//       MSG(SUPERVISOR, TEMP, TempMsg, supervisor_on_temp)
+//       EDGE(MAIN,   TICK)
+//       EDGE(SENSOR, TEMP)
+//   #include "courier_graph.h"
+//
+// (COURIER_GRAPH is a single macro: continue its lines with backslashes)
+//
+//   ACTOR(name, queue_name, depth)   an actor and the queue it reads, depth messages deep
+//   MSG(actor, name, type, handler)  a message the actor accepts, handled (in the actor
+//                                    thread) by void handler(void *user_data, const type *msg)
+//   EDGE(from, msg)                  from sends msg: an actor, or any other name for senders
+//                                    outside the graph
+//
+// Generated, for the graph named thermo:
+//   thermo_ACTOR_SENSOR, ...         actor addresses, constant integers; actor i reads its
+//                                    messages from port COURIER_GRAPH_PORT_BASE + i
+//   thermo_MSG_TICK, ...             message ids, the envelope type on the wire
+//   thermo_SENSOR_send_TEMP(msg)     one typed sender per edge: a constant port, no queue name
+//   thermo_dispatch                  the handler of every actor queue: a switch on message ids
+//   thermo_Graph, thermo_start(),    one CourierActor per actor, started with its user_data
+//   thermo_stop()                    and its port bound
+//
+// Sending along an undeclared edge, passing the wrong payload type, defining a
+// handler with the wrong signature or declaring a payload too large for an
+// envelope all fail to compile. Actor queues are ordinary multiplexed channels,
+// so processes built without the graph can still feed them with
+// courier_send_typed. Several graphs can share a process as long as their
+// port ranges (COURIER_GRAPH_PORT_BASE, defined before the include) do not
+// overlap.
+#include "courier.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef COURIER_GRAPH_H
+#define COURIER_GRAPH_H
+
+#define COURIER_GRAPH_CAT_(a, b) a##b
+#define COURIER_GRAPH_CAT(a, b)  COURIER_GRAPH_CAT_(a, b)
+#define COURIER_GRAPH_ID(suffix) COURIER_GRAPH_CAT(COURIER_GRAPH_NAME, suffix)
+#define COURIER_GRAPH_SKIP(...)
+
+// ----- Addresses -----
+#define COURIER_GRAPH_ACTOR_ENUM(name, queue_name, depth) COURIER_GRAPH_ID(_ACTOR_##name),
+#define COURIER_GRAPH_MSG_ENUM(actor, name, type, handler) COURIER_GRAPH_ID(_MSG_##name),
+
+// ----- Per-message declarations -----
+// Payload type and receiving actor of a message, the handler prototype, and
+// the compile-time checks of its size and actor.
+#define COURIER_GRAPH_MSG_DECL(actor, name, type, handler)                                               \
+    typedef type COURIER_GRAPH_ID(_TYPE_##name);                                                         \
+    enum { COURIER_GRAPH_ID(_DEST_##name) = COURIER_GRAPH_ID(_ACTOR_##actor) };                          \
+    void handler(void *user_data, const type *msg);                                                     \
+    _Static_assert(sizeof(type) <= COURIER_MAX_MSG_SIZE - COURIER_ENVELOPE_HDR, #type " does not fit an envelope");
+
+#define COURIER_GRAPH_MSG_SIZE(actor, name, type, handler) { COURIER_GRAPH_ID(_ACTOR_##actor), sizeof(type) },
+
+// ----- Senders -----
+#define COURIER_GRAPH_EDGE_SEND(from, msg)                                                                    \
+    static inline int COURIER_GRAPH_ID(_##from##_send_##msg)(const COURIER_GRAPH_ID(_TYPE_##msg) *payload)   \
+    {                                                                                                         \
+        return courier_port_send_typed(COURIER_GRAPH_PORT_BASE + COURIER_GRAPH_ID(_DEST_##msg),             \
+                                       COURIER_GRAPH_ID(_MSG_##msg), payload, sizeof(*payload));             \
+    }
+
+// ----- Dispatch -----
+#define COURIER_GRAPH_MSG_CASE(actor, name, type, handler) \
+    case COURIER_GRAPH_ID(_MSG_##name):                    \
+        if(env.size == sizeof(type))                       \
+        {                                                  \
+            handler(user_data, (const type *)payload);     \
+                                                           \
+            return;                                        \
+        }                                                  \
+        break;
+
+// ----- Start -----
+#define COURIER_GRAPH_ACTOR_DEF(name, queue_name, depth) \
+    { queue_name, #name, depth },
+
+#endif // ifndef COURIER_GRAPH_H
+
+#ifndef COURIER_GRAPH
+#error "define COURIER_GRAPH(ACTOR, MSG, EDGE) before including courier_graph.h"
+#endif // ifndef COURIER_GRAPH
+
+#ifndef COURIER_GRAPH_NAME
+#error "define COURIER_GRAPH_NAME before including courier_graph.h"
+#endif // ifndef COURIER_GRAPH_NAME
+
+#ifndef COURIER_GRAPH_PORT_BASE
+#define COURIER_GRAPH_PORT_BASE 0
+#endif /* ifndef COURIER_GRAPH_PORT_BASE */
+
+enum
+{
+    COURIER_GRAPH(COURIER_GRAPH_ACTOR_ENUM, COURIER_GRAPH_SKIP, COURIER_GRAPH_SKIP)
+    COURIER_GRAPH_ID(_NB_ACTORS)
+};
+
+// Id 0 is left out: courier_msg_type() returns it outside multiplexed channels
+enum
+{
+    COURIER_GRAPH_ID(_MSG_NONE_),
+    COURIER_GRAPH(COURIER_GRAPH_SKIP, COURIER_GRAPH_MSG_ENUM, COURIER_GRAPH_SKIP)
+    COURIER_GRAPH_ID(_MSG_END_)
+};
+
+_Static_assert(COURIER_GRAPH_PORT_BASE + COURIER_GRAPH_ID(_NB_ACTORS) <= COURIER_PORTS_MAX, "graph needs more than COURIER_PORTS_MAX ports");
+_Static_assert(COURIER_GRAPH_ID(_MSG_END_) <= UINT16_MAX, "too many message types");
+
+COURIER_GRAPH(COURIER_GRAPH_SKIP, COURIER_GRAPH_MSG_DECL, COURIER_GRAPH_SKIP)
+COURIER_GRAPH(COURIER_GRAPH_SKIP, COURIER_GRAPH_SKIP, COURIER_GRAPH_EDGE_SEND)
+
+static inline void COURIER_GRAPH_ID(_dispatch)(void *user_data, void *msg)
+{
+    CourierEnvelope env;
+    memcpy(&env, msg, sizeof(env));
+    const void *payload = (const char *)msg + COURIER_ENVELOPE_HDR;
+
+    switch(env.type)
+    {
+        COURIER_GRAPH(COURIER_GRAPH_SKIP, COURIER_GRAPH_MSG_CASE, COURIER_GRAPH_SKIP)
+
+        default:
+            break;
+    }
+    fprintf(stderr, "[Courier] Warn: dropped message of type %u (%u bytes)\n", env.type, env.size);
+}
+
+typedef struct
+{
+    CourierActor actors[COURIER_GRAPH_ID(_NB_ACTORS)];
+    CourierActorMsgDef defs[COURIER_GRAPH_ID(_NB_ACTORS)];
+} COURIER_GRAPH_ID(_Graph);
+
+// Start every actor of the graph, actor i with user_data[i] (or NULL), then
+// bind their ports. Returns 0, or -1 with nothing left running.
+static inline int COURIER_GRAPH_ID(_start)(COURIER_GRAPH_ID(_Graph) *graph, void *const *user_data)
+{
+    static const struct
+    {
+        const char *queue_name;
+        const char *name;
+        long depth;
+    } actors[] = { COURIER_GRAPH(COURIER_GRAPH_ACTOR_DEF, COURIER_GRAPH_SKIP, COURIER_GRAPH_SKIP) };
+
+    static const struct
+    {
+        int actor;
+        size_t size;
+    } msgs[] = { COURIER_GRAPH(COURIER_GRAPH_SKIP, COURIER_GRAPH_MSG_SIZE, COURIER_GRAPH_SKIP) };
+
+    int started = 0;
+    int bound   = 0;
+
+    for(; started < COURIER_GRAPH_ID(_NB_ACTORS); started++)
+    {
+        // A queue carries the largest message of its actor
+        size_t largest = 1;
+
+        for(size_t m = 0; m < sizeof(msgs) / sizeof(msgs[0]); m++)
+        {
+            if((msgs[m].actor == started) && (msgs[m].size > largest))
+            {
+                largest = msgs[m].size;
+            }
+        }
+        CourierActorMsgDef *def = &graph->defs[started];
+        memset(def, 0, sizeof(*def));
+        def->queue_name = actors[started].queue_name;
+        def->msg_size   = COURIER_ENVELOPE_HDR + largest;
+        def->handler    = COURIER_GRAPH_ID(_dispatch);
+        def->envelopes  = 1;
+        def->mq         = (courrier_mq_t)-1;
+        def->depth      = actors[started].depth;
+
+        if(courier_actor_init(&graph->actors[started], actors[started].name, def, 1, user_data ? user_data[started] : NULL) < 0)
+        {
+            goto fail;
+        }
+    }
+
+    for(; bound < COURIER_GRAPH_ID(_NB_ACTORS); bound++)
+    {
+        if(courier_port_bind(COURIER_GRAPH_PORT_BASE + bound, graph->defs[bound].queue_name, graph->defs[bound].msg_size) < 0)
+        {
+            goto fail;
+        }
+    }
+
+    return 0;
+
+fail:
+    perror("[Courier] graph start");
+
+    while(started-- > 0)
+    {
+        courier_actor_close(&graph->actors[started]);
+    }
+
+    while(bound-- > 0)
+    {
+        courier_port_unbind(COURIER_GRAPH_PORT_BASE + bound);
+    }
+
+    return -1;
+}
+
+// Close the actors, then release their ports
+static inline void COURIER_GRAPH_ID(_stop)(COURIER_GRAPH_ID(_Graph) *graph)
+{
+    for(int i = 0; i < COURIER_GRAPH_ID(_NB_ACTORS); i++)
+    {
+        courier_actor_close(&graph->actors[i]);
+    }
+
+    for(int i = 0; i < COURIER_GRAPH_ID(_NB_ACTORS); i++)
+    {
+        courier_port_unbind(COURIER_GRAPH_PORT_BASE + i);
+    }
+}
+
+#undef COURIER_GRAPH
+#undef COURIER_GRAPH_NAME
+#undef COURIER_GRAPH_PORT_BASE
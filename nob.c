@@ -6,21 +6,91 @@
 Nob_Procs Procs;
 
 const char *tests[] = {
-    TEST_DIR "/test_queue_basic.c", //
-    TEST_DIR "/test_actor_basic.c", //
+    TEST_DIR "/test_queue_basic.c",   //
+    TEST_DIR "/test_actor_basic.c",   //
+    TEST_DIR "/test_writer_cache.c",  //
+    TEST_DIR "/test_scheduler.c",     //
+    TEST_DIR "/test_batch_handler.c", //
+    TEST_DIR "/test_priority.c",      //
+    TEST_DIR "/test_shutdown.c",      //
+    TEST_DIR "/test_stats.c",         //
+    TEST_DIR "/test_inproc.c",        //
+    TEST_DIR "/test_publish.c",       //
+    TEST_DIR "/test_blob.c",          //
+    TEST_DIR "/test_timer.c",         //
+    TEST_DIR "/test_fd_source.c",     //
+    TEST_DIR "/test_backpressure.c",  //
+    TEST_DIR "/test_queue_depth.c",   //
+    TEST_DIR "/test_typed.c",         //
+    TEST_DIR "/test_graph.c",         //
+    TEST_DIR "/test_cpp.cpp",         //
+    TEST_DIR "/test_ask.c",           //
+    TEST_DIR "/test_topics.c",        //
+    TEST_DIR "/test_pool.c",          //
+    TEST_DIR "/test_router.c",        //
+    TEST_DIR "/test_conflate.c",      //
+};
+
+// Library translation units, each built into BUILD_DIR/<name>.o
+const char *lib_srcs[] = {
+    SRC "/courier.c",      //
+    SRC "/writer_cache.c", //
+    SRC "/scheduler.c",    //
+    SRC "/stats.c",        //
+    SRC "/msg_pool.c",     //
+    SRC "/mailbox.c",      //
+    SRC "/blob.c",         //
+    SRC "/timer.c",        //
+    SRC "/backpressure.c", //
+    SRC "/ask.c",          //
+    SRC "/topics.c",       //
+    SRC "/pool.c",         //
+    SRC "/router.c",       //
 };
 
 const char *examples[] = {
     EXAMPLE_DIR "/example_thermostat.c", //
 };
 
-static void append_compiler(Nob_Cmd *cmd)
+const char *benches[] = {
+    BENCH_DIR "/bench_courier.c", //
+};
+
+#ifdef COURIER_PLATFORM_LINUX_SHM
+#define PLATFORM_SRC SRC "/platform/platform_linux_shm"
+#else
+#define PLATFORM_SRC SRC "/platform/platform_linux_mq"
+#endif // ifdef COURIER_PLATFORM_LINUX_SHM
+
+// C++ sources (the courier.hpp binding) go through the C++ compiler
+static bool is_cxx(const char *src)
 {
-    nob_cc(cmd);
+    return nob_sv_end_with(nob_sv_from_cstr(src), ".cpp");
+}
+
+static void append_compiler(Nob_Cmd *cmd, bool cxx)
+{
+    if(cxx)
+    {
+        nob_cmd_append(cmd, "c++", "-std=c++17");
+    }
+    else
+    {
+        nob_cc(cmd);
+    }
     nob_cc_flags(cmd);
 
     // TODO Get the platform specific flags
     nob_cmd_append(cmd, "-Wpedantic", "-Os", "-Iinclude", "-Isrc/platform");
+#ifdef COURIER_PLATFORM_LINUX_SHM
+    nob_cmd_append(cmd, "-DCOURIER_PLATFORM_LINUX_SHM");
+#endif // ifdef COURIER_PLATFORM_LINUX_SHM
+#ifdef COURIER_STATS
+    nob_cmd_append(cmd, "-DCOURIER_STATS");
+#endif // ifdef COURIER_STATS
+#if defined(COURIER_INPROC) && !COURIER_INPROC
+    nob_cmd_append(cmd, "-DCOURIER_INPROC=0");
+#endif // if defined(COURIER_INPROC) && !COURIER_INPROC
 }
 
 static bool build_exe(const char *src, const char *out, const char *dep_paths[], size_t dep_paths_count)
@@ -45,7 +115,7 @@ static bool build_exe(const char *src, const char *out, const char *dep_paths[],
     }
 
     Nob_Cmd cmd = { 0 };
-    append_compiler(&cmd);
+    append_compiler(&cmd, is_cxx(src));
     nob_cmd_append(&cmd, "-lrt", "-lpthread");
     nob_cmd_append(&cmd, src,    BUILD_DIR "/libcourier.a", "-o", out); // TODO abstract courier.o dependency
 
@@ -65,7 +135,7 @@ static bool build_obj(const char *output_path, const char **input_paths, size_t
     }
 
     Nob_Cmd cmd = { 0 };
-    append_compiler(&cmd);
+    append_compiler(&cmd, false);
     nob_cmd_append(&cmd, "-lrt", "-lpthread");
 
     for(size_t i = 0; i < input_paths_count; i++)
@@ -189,6 +259,7 @@ static bool build_tests(void)
         nob_sb_append_cstr(&sb_out, tests[i]);
 
         nob_sb_find_and_replace(&sb_out, TEST_DIR, BUILD_DIR);
+        nob_sb_find_and_replace(&sb_out, ".cpp",   "");
         nob_sb_find_and_replace(&sb_out, ".c",     "");
 
         const char *source_paths[] = { BUILD_DIR "/libcourier.a" };
@@ -214,6 +285,7 @@ static bool run_tests(void)
         nob_sb_append_cstr(&sb_out, tests[i]);
 
         nob_sb_find_and_replace(&sb_out, TEST_DIR, BUILD_DIR);
+        nob_sb_find_and_replace(&sb_out, ".cpp",   "");
         nob_sb_find_and_replace(&sb_out, ".c",     "");
 
         nob_cmd_append(&cmd, nob_temp_sv_to_cstr(nob_sb_to_sv(sb_out)));
@@ -256,6 +328,93 @@ static bool build_examples(void)
     return ret;
 }
 
+static bool build_benches(void)
+{
+    bool ret = true;
+    Nob_String_Builder sb_out = { 0 };
+
+    for(size_t i = 0; (i < NOB_ARRAY_LEN(benches) && ret); i++)
+    {
+        nob_sb_append_cstr(&sb_out, benches[i]);
+
+        nob_sb_find_and_replace(&sb_out, BENCH_DIR "/", BUILD_DIR "/");
+        nob_sb_find_and_replace(&sb_out, ".c",            "");
+
+        const char *source_paths[] = { benches[i], BUILD_DIR "/libcourier.a" };
+
+        ret = build_exe(benches[i], nob_temp_sv_to_cstr(nob_sb_to_sv(sb_out)), source_paths, NOB_ARRAY_LEN(source_paths));
+
+        sb_out.count = 0;
+    }
+
+    nob_sb_free(sb_out);
+
+    return ret;
+}
+
+// Each benchmark writes its JSON results to BUILD_DIR/<bench>.json
+static bool run_benches(void)
+{
+    Nob_Cmd cmd = { 0 };
+    Nob_String_Builder sb_out = { 0 };
+    bool result = true;
+
+    for(size_t i = 0; i < NOB_ARRAY_LEN(benches); i++)
+    {
+        nob_sb_append_cstr(&sb_out, benches[i]);
+
+        nob_sb_find_and_replace(&sb_out, BENCH_DIR "/", BUILD_DIR "/");
+        nob_sb_find_and_replace(&sb_out, ".c",            "");
+
+        const char *exe = nob_temp_sv_to_cstr(nob_sb_to_sv(sb_out));
+        nob_cmd_append(&cmd, exe, "-o", nob_temp_sprintf("%s.json", exe));
+
+        if(!nob_cmd_run(&cmd))
+        {
+            nob_return_defer(false);
+        }
+        nob_log(NOB_INFO, "results: %s.json", exe);
+
+        sb_out.count = 0;
+    }
+
+    defer: nob_sb_free(sb_out);
+    nob_cmd_free(cmd);
+
+    return result;
+}
+
+static bool build_lib_objs(Nob_File_Paths *objs)
+{
+    bool result = true;
+    Nob_String_Builder sb_out = { 0 };
+
+    for(size_t i = 0; (i < NOB_ARRAY_LEN(lib_srcs) && result); i++)
+    {
+        nob_sb_append_cstr(&sb_out, lib_srcs[i]);
+
+        nob_sb_find_and_replace(&sb_out, SRC,  BUILD_DIR);
+        nob_sb_find_and_replace(&sb_out, ".c", ".o");
+
+        const char *obj = nob_temp_sv_to_cstr(nob_sb_to_sv(sb_out));
+        const char *deps[] = {
+            lib_srcs[i],                //
+            INC "/courier.h",           //
+            SRC "/courier_internal.h",  //
+            SRC "/platform/platform.h", //
+        };
+
+        result = build_obj(obj, deps, NOB_ARRAY_LEN(deps));
+        nob_da_append(objs, obj);
+
+        sb_out.count = 0;
+    }
+
+    nob_sb_free(sb_out);
+
+    return result;
+}
+
 static void handle_clean(void)
 {
     Nob_File_Paths files_to_clean = { 0 };
@@ -294,7 +453,8 @@ int main(int argc, char **argv)
 {
     NOB_GO_REBUILD_URSELF(argc, argv);
 
-    bool need_run_tests = false;
+    bool need_run_tests   = false;
+    bool need_run_benches = false;
 
     if(argc >= 2)
     {
@@ -324,6 +484,12 @@ int main(int argc, char **argv)
             {
                 need_run_tests = true;
             }
+
+            // Benchmarks
+            if(nob_sv_eq(sv, nob_sv_from_cstr("bench")))
+            {
+                need_run_benches = true;
+            }
         }
     }
 
@@ -334,8 +500,9 @@ int main(int argc, char **argv)
     }
 
     const char *platform_srcs[] = {
-        SRC "/platform/platform_linux_mq.c", //
-        SRC "/platform/platform_linux_mq.h"  //
+        PLATFORM_SRC ".c",            //
+        PLATFORM_SRC ".h",            //
+        SRC "/platform/platform.h"    //
     };
 
     if(!build_obj(BUILD_DIR "/platform.o", platform_srcs, NOB_ARRAY_LEN(platform_srcs)))
@@ -343,22 +510,14 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    // Build Courier object file
-    const char *courier_srcs[] = {
-        SRC "/courier.c",        //
-        BUILD_DIR "/platform.o", //
-        INC "/courier.h"         //
-    };
+    // Build Courier object files
+    Nob_File_Paths libcourier_deps = { 0 };
+    nob_da_append(&libcourier_deps, BUILD_DIR "/platform.o");
 
-    if(build_obj(BUILD_DIR "/courier.o", courier_srcs, NOB_ARRAY_LEN(courier_srcs)))
+    if(build_lib_objs(&libcourier_deps))
     {
         // Build Courier static library
-        const char *libcourier_deps[] = {
-            BUILD_DIR "/courier.o",  //
-            BUILD_DIR "/platform.o", //
-        };
-
-        if(!build_lib(BUILD_DIR "/libcourier.a", libcourier_deps, NOB_ARRAY_LEN(libcourier_deps)))
+        if(!build_lib(BUILD_DIR "/libcourier.a", libcourier_deps.items, libcourier_deps.count))
         {
             return 1;
         }
@@ -382,6 +541,14 @@ int main(int argc, char **argv)
             }
         }
 
+        if(need_run_benches)
+        {
+            if(!build_benches() || !run_benches())
+            {
+                return 1;
+            }
+        }
+
         return 0;
     }
 
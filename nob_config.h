@@ -13,6 +13,7 @@
 #define INC "include"
 #define TEST_DIR "tests"
 #define EXAMPLE_DIR "examples"
+#define BENCH_DIR "bench"
 
 // Handle platform specifics
 // #define PLATFORM_LINUX
@@ -20,6 +21,15 @@
 // #define PLATFORM_MACOS
 // #define PLATFORM_EMBEDDED
 
+// Transport backend (POSIX mqueues by default)
+// #define COURIER_PLATFORM_LINUX_SHM
+
+// Per-queue latency histograms (courier_actor_stats); timestamps every message on the wire
+// #define COURIER_STATS
+
+// Always go through the platform queue, even to actors of the sending process
+// #define COURIER_INPROC 0
+
 // #ifdef PLATFORM_LINUX
 // #define PLATFORM_LIBS "-lrt", "-lpthread"
 // #endif
@@ -0,0 +1,556 @@
+// =============================
+// File: src/ask.c
+// =============================
+#include "courier_internal.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+// Request/reply over multiplexed channels. A request is an ordinary envelope
+// whose ask field holds a token: the asker's pid, the index of its reply
+// channel and a correlation id. The responder rebuilds the channel's name
+// from the token and sends the reply envelope there, so a round trip is two
+// sends through cached writers and no queue is ever created per exchange.
+//
+// A reply channel is an in-process mailbox plus a platform queue, like an
+// actor's queue, and is owned by a single reader: an actor (watched as two
+// fd sources in its epoll set, so replies run as continuations between its
+// other messages) or a thread blocked in courier_ask_wait. Pending asks sit in
+// a small table indexed by correlation id; timeouts of continuations are
+// timer messages sent to the channel itself, which keeps all completions on
+// the owner's thread without locks.
+
+#define ASK_CHANNELS     1024 // reply channels per process
+#define ASK_CHANNEL_BITS 10
+#define ASK_PID_SHIFT    (32 + ASK_CHANNEL_BITS)
+#define ASK_NAME_MAX     48
+
+_Static_assert((COURIER_ASK_PENDING_MAX & (COURIER_ASK_PENDING_MAX - 1)) == 0, "COURIER_ASK_PENDING_MAX must be a power of two");
+
+enum
+{
+    ASK_REPLY = 1,
+    ASK_TIMEOUT,
+};
+
+typedef struct
+{
+    uint32_t id; // 0 = free
+    CourierTimerId timer;
+    CourierReplyHandler handler;
+    void *user_data;
+} AskPending;
+
+// Reply of a blocking ask, filled when it arrives
+typedef struct
+{
+    uint32_t id;
+    void *reply;
+    size_t reply_size;
+    ssize_t size; // -1 until answered
+} AskWait;
+
+struct CourierReplyChannel
+{
+    char name[ASK_NAME_MAX];
+    unsigned pid;
+    unsigned index;
+    CourierMailbox *mbox; // NULL when COURIER_INPROC is off
+    courrier_mq_t mq;
+    uint32_t next_id;
+    unsigned nb_pending;
+    unsigned max_pending; // asks whose reply and timeout fit in the granted queue depth
+    AskPending pending[COURIER_ASK_PENDING_MAX];
+};
+
+static uint32_t channels_used[ASK_CHANNELS / 32];
+static pthread_mutex_t channels_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// ----- Tokens -----
+static CourierAskToken token_make(const CourierReplyChannel *ch, uint32_t id)
+{
+    return ((uint64_t)ch->pid << ASK_PID_SHIFT) | ((uint64_t)ch->index << 32) | id;
+}
+
+static void token_name(CourierAskToken token, char *name)
+{
+    snprintf(name, ASK_NAME_MAX, "/courier_reply_%u_%u", (unsigned)(token >> ASK_PID_SHIFT), (unsigned)(token >> 32) & (ASK_CHANNELS - 1));
+}
+
+// ----- Channels -----
+static int index_alloc(void)
+{
+    int index = -1;
+
+    pthread_mutex_lock(&channels_lock);
+
+    for(unsigned i = 0; (i < ASK_CHANNELS) && (index < 0); i++)
+    {
+        if(!(channels_used[i / 32] & (1u << (i % 32))))
+        {
+            channels_used[i / 32] |= 1u << (i % 32);
+            index                  = (int)i;
+        }
+    }
+    pthread_mutex_unlock(&channels_lock);
+
+    if(index < 0)
+    {
+        errno = EMFILE;
+    }
+
+    return index;
+}
+
+static void index_free(unsigned index)
+{
+    pthread_mutex_lock(&channels_lock);
+    channels_used[index / 32] &= ~(1u << (index % 32));
+    pthread_mutex_unlock(&channels_lock);
+}
+
+static CourierReplyChannel* channel_create(void)
+{
+    const int index = index_alloc();
+
+    if(index < 0)
+    {
+        return NULL;
+    }
+    CourierReplyChannel *ch = calloc(1, sizeof(*ch));
+
+    if(!ch)
+    {
+        index_free((unsigned)index);
+
+        return NULL;
+    }
+    ch->pid     = (unsigned)getpid();
+    ch->index   = (unsigned)index;
+    ch->mq      = (courrier_mq_t)-1;
+    ch->next_id = 1;
+    token_name(token_make(ch, 0), ch->name);
+
+    // A queue left behind by an earlier process with our pid is stale
+    courier_queue_unlink(ch->name);
+
+    if(COURIER_INPROC)
+    {
+        ch->mbox = courier_mailbox_create(ch->name, COURIER_MAX_MSG_SIZE, 2 * COURIER_ASK_PENDING_MAX, 0);
+
+        if(!ch->mbox)
+        {
+            courier_reply_channel_destroy(ch);
+
+            return NULL;
+        }
+    }
+    // Room for a reply and a timeout per pending ask, so replies sent with
+    // try_send are not lost while the owner is busy. mq may grant less, and
+    // then fewer asks may be pending.
+    ch->mq = courier_queue_open_reader(ch->name, COURIER_MAX_MSG_SIZE, 2 * COURIER_ASK_PENDING_MAX);
+
+    if(ch->mq == (courrier_mq_t)-1)
+    {
+        courier_reply_channel_destroy(ch);
+
+        return NULL;
+    }
+    const long granted = platform_queue_capacity(ch->mq);
+    ch->max_pending    = COURIER_ASK_PENDING_MAX;
+
+    if((granted > 0) && (granted / 2 < COURIER_ASK_PENDING_MAX))
+    {
+        ch->max_pending = (granted >= 2) ? (unsigned)(granted / 2) : 1;
+    }
+
+    return ch;
+}
+
+void courier_reply_channel_destroy(CourierReplyChannel *ch)
+{
+    for(size_t i = 0; i < COURIER_ASK_PENDING_MAX; i++)
+    {
+        if(ch->pending[i].id && ch->pending[i].timer)
+        {
+            courier_timer_cancel(ch->pending[i].timer);
+        }
+    }
+
+    if(ch->mbox)
+    {
+        courier_mailbox_unregister(ch->mbox);
+    }
+    courier_writer_cache_evict(ch->name);
+
+    if(ch->mq != (courrier_mq_t)-1)
+    {
+        courier_queue_close(ch->mq);
+        courier_queue_unlink(ch->name);
+    }
+    index_free(ch->index);
+    free(ch);
+}
+
+// Reserve an entry for a new ask. NULL with errno EAGAIN when max_pending
+// asks are pending, or its slot is still taken by an ask
+// COURIER_ASK_PENDING_MAX ids older.
+static AskPending* pending_alloc(CourierReplyChannel *ch)
+{
+    const uint32_t id = ch->next_id;
+    AskPending *p     = &ch->pending[id & (COURIER_ASK_PENDING_MAX - 1)];
+
+    if(p->id || (ch->nb_pending >= ch->max_pending))
+    {
+        errno = EAGAIN;
+
+        return NULL;
+    }
+    ch->next_id = (id == UINT32_MAX) ? 1 : id + 1;
+    memset(p, 0, sizeof(*p));
+    p->id = id;
+    ch->nb_pending++;
+
+    return p;
+}
+
+static void pending_free(CourierReplyChannel *ch, AskPending *p)
+{
+    p->id = 0;
+    ch->nb_pending--;
+}
+
+// Next message of the channel into buf, mailbox first. Returns its size, or
+// 0 once both are drained.
+static size_t channel_receive(CourierReplyChannel *ch, char *buf)
+{
+    CourierMsgSlot *slot = ch->mbox ? courier_mailbox_pop(ch->mbox) : NULL;
+
+    if(slot)
+    {
+        const size_t size = slot->size;
+        memcpy(buf, slot->payload, size);
+        courier_slot_release(slot);
+
+        return size;
+    }
+
+    for(;;)
+    {
+        const ssize_t r = courier_queue_receive(ch->mq, buf, COURIER_MAX_MSG_SIZE, NULL);
+
+        if(r >= 0)
+        {
+            return (size_t)r;
+        }
+
+        if(errno != EINTR)
+        {
+            return 0;
+        }
+    }
+}
+
+// Complete the asks answered by everything queued on the channel. A reply
+// for wait is copied out instead of running a continuation.
+static void channel_drain(CourierReplyChannel *ch, AskWait *wait)
+{
+    alignas(max_align_t) char buf[COURIER_MAX_MSG_SIZE];
+    size_t size;
+
+    while((size = channel_receive(ch, buf)) > 0)
+    {
+        CourierEnvelope env;
+
+        if(size < COURIER_ENVELOPE_HDR)
+        {
+            continue;
+        }
+        memcpy(&env, buf, sizeof(env));
+
+        const uint32_t id = (uint32_t)env.ask;
+        AskPending *p     = &ch->pending[id & (COURIER_ASK_PENDING_MAX - 1)];
+
+        if(!id || (p->id != id) || (env.size > size - COURIER_ENVELOPE_HDR))
+        {
+            continue; // answered or timed out already
+        }
+        const AskPending done = *p;
+        const int error       = (env.type == ASK_TIMEOUT) ? ETIMEDOUT : 0;
+        pending_free(ch, p);
+
+        if(!error && done.timer)
+        {
+            courier_timer_cancel(done.timer);
+        }
+
+        if(wait && (wait->id == id))
+        {
+            wait->size = env.size;
+            memcpy(wait->reply, buf + COURIER_ENVELOPE_HDR, (env.size < wait->reply_size) ? env.size : wait->reply_size);
+        }
+        else if(done.handler)
+        {
+            done.handler(done.user_data, error ? NULL : buf + COURIER_ENVELOPE_HDR, error ? 0 : env.size, error);
+        }
+    }
+}
+
+// fd source handler of an actor's reply channel
+static void actor_on_replies(void *user_data, int fd, uint32_t events)
+{
+    (void)user_data;
+    (void)fd;
+    (void)events;
+
+    channel_drain(courier_current_actor()->rt->replies, NULL);
+}
+
+static CourierReplyChannel* actor_channel(CourierActor *actor)
+{
+    if(actor->rt->replies)
+    {
+        return actor->rt->replies;
+    }
+    CourierReplyChannel *ch = channel_create();
+
+    if(!ch)
+    {
+        return NULL;
+    }
+
+    if((ch->mbox && (courier_actor_add_fd(actor, courier_mailbox_fd(ch->mbox), EPOLLIN | EPOLLET, actor_on_replies) < 0)) ||
+       (courier_actor_add_fd(actor, courier_queue_fd(ch->mq), EPOLLIN | EPOLLET, actor_on_replies) < 0))
+    {
+        const int err = errno;
+
+        if(ch->mbox)
+        {
+            courier_actor_remove_fd(actor, courier_mailbox_fd(ch->mbox));
+        }
+        courier_reply_channel_destroy(ch);
+        errno = err;
+
+        return NULL;
+    }
+    actor->rt->replies = ch;
+
+    return ch;
+}
+
+// ----- Blocking asks -----
+static pthread_key_t thread_channel_key;
+static pthread_once_t thread_channel_once = PTHREAD_ONCE_INIT;
+static _Thread_local CourierReplyChannel *thread_channel;
+
+static void thread_channel_release(void *ch)
+{
+    courier_reply_channel_destroy((CourierReplyChannel *)ch);
+}
+
+// The main thread exits without running key destructors
+static void thread_channel_exit(void)
+{
+    if(thread_channel)
+    {
+        pthread_setspecific(thread_channel_key, NULL);
+        courier_reply_channel_destroy(thread_channel);
+        thread_channel = NULL;
+    }
+}
+
+static void thread_channel_init(void)
+{
+    pthread_key_create(&thread_channel_key, thread_channel_release);
+    atexit(thread_channel_exit);
+}
+
+static CourierReplyChannel* thread_channel_get(void)
+{
+    if(!thread_channel)
+    {
+        pthread_once(&thread_channel_once, thread_channel_init);
+        thread_channel = channel_create();
+
+        if(thread_channel)
+        {
+            pthread_setspecific(thread_channel_key, thread_channel);
+        }
+    }
+
+    return thread_channel;
+}
+
+// ----- Requests -----
+static int request_send(const char *queue_name, uint16_t type, const void *msg, size_t msg_size, CourierAskToken token)
+{
+    alignas(max_align_t) char envelope[COURIER_MAX_MSG_SIZE];
+    const CourierEnvelope env = { .type = type, .size = (uint32_t)msg_size, .ask = token };
+
+    if(!queue_name || !msg || (msg_size == 0) || (msg_size > sizeof(envelope) - COURIER_ENVELOPE_HDR))
+    {
+        errno = (msg && msg_size) ? EMSGSIZE : EINVAL;
+
+        return -1;
+    }
+    memcpy(envelope, &env, sizeof(env));
+    memcpy(envelope + COURIER_ENVELOPE_HDR, msg, msg_size);
+
+    return courier_send_to(queue_name, envelope, COURIER_ENVELOPE_HDR + msg_size);
+}
+
+int courier_ask(const char *queue_name, uint16_t type, const void *msg, size_t msg_size, int timeout_ms,
+                CourierReplyHandler on_reply, void *user_data)
+{
+    CourierActor *actor = courier_current_actor();
+
+    if(!on_reply)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    if(!actor)
+    {
+        errno = EPERM;
+
+        return -1;
+    }
+    CourierReplyChannel *ch = actor_channel(actor);
+    AskPending *p           = ch ? pending_alloc(ch) : NULL;
+
+    if(!p)
+    {
+        return -1;
+    }
+    p->handler   = on_reply;
+    p->user_data = user_data;
+
+    if(timeout_ms >= 0)
+    {
+        const CourierEnvelope expired = { .type = ASK_TIMEOUT, .ask = p->id };
+        p->timer                      = courier_send_after(ch->name, &expired, sizeof(expired), (uint64_t)timeout_ms);
+
+        if(!p->timer)
+        {
+            pending_free(ch, p);
+
+            return -1;
+        }
+    }
+
+    if(request_send(queue_name, type, msg, msg_size, token_make(ch, p->id)) < 0)
+    {
+        const int err = errno;
+
+        if(p->timer)
+        {
+            courier_timer_cancel(p->timer);
+        }
+        pending_free(ch, p);
+        errno = err;
+
+        return -1;
+    }
+
+    return 0;
+}
+
+ssize_t courier_ask_wait(const char *queue_name, uint16_t type, const void *msg, size_t msg_size, void *reply,
+                         size_t reply_size, int timeout_ms)
+{
+    if(!reply && (reply_size > 0))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    CourierReplyChannel *ch = thread_channel_get();
+    AskPending *p           = ch ? pending_alloc(ch) : NULL;
+
+    if(!p)
+    {
+        return -1;
+    }
+    AskWait wait = { .id = p->id, .reply = reply, .reply_size = reply_size, .size = -1 };
+
+    if(request_send(queue_name, type, msg, msg_size, token_make(ch, p->id)) < 0)
+    {
+        pending_free(ch, p);
+
+        return -1;
+    }
+    const uint64_t deadline = (timeout_ms < 0) ? COURIER_NO_DEADLINE : courier_now_ns() + (uint64_t)timeout_ms * 1000000ull;
+
+    for(;;)
+    {
+        channel_drain(ch, &wait);
+
+        if(wait.size >= 0)
+        {
+            return wait.size;
+        }
+        const uint64_t now = courier_now_ns();
+
+        if(now >= deadline)
+        {
+            pending_free(ch, p); // a late reply is dropped
+            errno = ETIMEDOUT;
+
+            return -1;
+        }
+        struct pollfd fds[2] = {
+            {.fd = courier_queue_fd(ch->mq), .events = POLLIN},
+            {.fd = ch->mbox ? courier_mailbox_fd(ch->mbox) : -1, .events = POLLIN},
+        };
+        const int wait_ms = (deadline == COURIER_NO_DEADLINE) ? -1 : (int)((deadline - now + 999999ull) / 1000000ull);
+
+        if((poll(fds, 2, wait_ms) < 0) && (errno != EINTR))
+        {
+            pending_free(ch, p);
+
+            return -1;
+        }
+    }
+}
+
+// ----- Replies -----
+int courier_reply_to(CourierAskToken token, const void *reply, size_t reply_size)
+{
+    alignas(max_align_t) char envelope[COURIER_MAX_MSG_SIZE];
+    const CourierEnvelope env = { .type = ASK_REPLY, .size = (uint32_t)reply_size, .ask = token };
+    char name[ASK_NAME_MAX];
+
+    if(!token || (!reply && (reply_size > 0)))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    if(reply_size > sizeof(envelope) - COURIER_ENVELOPE_HDR)
+    {
+        errno = EMSGSIZE;
+
+        return -1;
+    }
+    memcpy(envelope, &env, sizeof(env));
+
+    if(reply_size > 0)
+    {
+        memcpy(envelope + COURIER_ENVELOPE_HDR, reply, reply_size);
+    }
+    token_name(token, name);
+
+    return courier_try_send_to(name, envelope, COURIER_ENVELOPE_HDR + reply_size);
+}
+
+int courier_reply(const void *reply, size_t reply_size)
+{
+    return courier_reply_to(courier_msg_ask(), reply, reply_size);
+}
@@ -0,0 +1,142 @@
+// =============================
+// File: src/backpressure.c
+// =============================
+#include "courier_internal.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Per-queue high/low watermarks. Entries are keyed by queue name, created on
+// the first registration and never freed: writers in the cache and actors
+// keep a pointer to them. A registration swaps in a new immutable config, so
+// a check reads high, low, handler and user_data as one consistent set
+// without a lock; replaced configs stay chained to the entry.
+//
+// The entry remembers whether the queue is above its high mark, and only a
+// change of that state calls the handler: producers see one "high" per
+// episode however many sends hit the full queue, then one "low" once the
+// reader has drained it.
+
+#ifndef COURIER_WATERMARK_NAME_MAX
+#define COURIER_WATERMARK_NAME_MAX 64
+#endif /* ifndef COURIER_WATERMARK_NAME_MAX */
+
+typedef struct WatermarkCfg
+{
+    struct WatermarkCfg *replaced; // previous config, kept for late readers
+    long high;
+    long low;
+    CourierWatermarkHandler handler; // NULL = disabled
+    void *user_data;
+} WatermarkCfg;
+
+struct CourierWatermark
+{
+    CourierWatermark *next;
+    char name[COURIER_WATERMARK_NAME_MAX];
+    _Atomic(WatermarkCfg *) cfg;
+    _Atomic int above;
+};
+
+static _Atomic(CourierWatermark *) entries;
+static _Atomic unsigned generation;
+static pthread_mutex_t entries_lock = PTHREAD_MUTEX_INITIALIZER;
+
+CourierWatermark* courier_watermark_lookup(const char *queue_name)
+{
+    for(CourierWatermark *wm = atomic_load_explicit(&entries, memory_order_acquire); wm; wm = wm->next)
+    {
+        if(strcmp(wm->name, queue_name) == 0)
+        {
+            return wm;
+        }
+    }
+
+    return NULL;
+}
+
+unsigned courier_watermark_generation(void)
+{
+    return atomic_load_explicit(&generation, memory_order_acquire);
+}
+
+void courier_watermark_check(CourierWatermark *wm, long depth)
+{
+    const WatermarkCfg *cfg = atomic_load_explicit(&wm->cfg, memory_order_acquire);
+
+    if(!cfg->handler || (depth < 0))
+    {
+        return;
+    }
+
+    if((depth >= cfg->high) && !atomic_exchange(&wm->above, 1))
+    {
+        cfg->handler(cfg->user_data, wm->name, 1);
+    }
+    else if((depth <= cfg->low) && atomic_load_explicit(&wm->above, memory_order_relaxed) && atomic_exchange(&wm->above, 0))
+    {
+        cfg->handler(cfg->user_data, wm->name, 0);
+    }
+}
+
+int courier_watermark_above(const CourierWatermark *wm)
+{
+    return atomic_load_explicit(&wm->above, memory_order_relaxed) && atomic_load_explicit(&wm->cfg, memory_order_acquire)->handler;
+}
+
+int courier_queue_watermarks(const char *queue_name, long high, long low, CourierWatermarkHandler handler, void *user_data)
+{
+    if(!queue_name || (strlen(queue_name) >= COURIER_WATERMARK_NAME_MAX) || (handler && ((low < 0) || (high <= low))))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    WatermarkCfg *cfg = calloc(1, sizeof(*cfg));
+
+    if(!cfg)
+    {
+        return -1;
+    }
+    cfg->high      = high;
+    cfg->low       = low;
+    cfg->handler   = handler;
+    cfg->user_data = user_data;
+
+    pthread_mutex_lock(&entries_lock);
+    CourierWatermark *wm = courier_watermark_lookup(queue_name);
+
+    if(!wm)
+    {
+        wm = calloc(1, sizeof(*wm));
+
+        if(!wm)
+        {
+            pthread_mutex_unlock(&entries_lock);
+            free(cfg);
+
+            return -1;
+        }
+        strcpy(wm->name, queue_name);
+        wm->next = atomic_load_explicit(&entries, memory_order_relaxed);
+        atomic_store_explicit(&wm->cfg, cfg, memory_order_relaxed);
+        atomic_store_explicit(&entries, wm, memory_order_release);
+    }
+    else
+    {
+        cfg->replaced = atomic_load_explicit(&wm->cfg, memory_order_relaxed);
+        atomic_store_explicit(&wm->cfg, cfg, memory_order_release);
+    }
+    // A new episode starts with the new marks
+    atomic_store(&wm->above, 0);
+    pthread_mutex_unlock(&entries_lock);
+
+    // Cached writers resolved the entry when they were opened. Bumped once
+    // they are gone, so whoever sees the new generation and re-acquires a
+    // writer gets the entry.
+    courier_writer_cache_evict(queue_name);
+    atomic_fetch_add_explicit(&generation, 1, memory_order_release);
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+// =============================
+// File: src/blob.c
+// =============================
+#include "courier_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Large messages: the payload lives in its own POSIX shared memory object
+// and only a CourierBlobHandle (name + size) travels through the queue. The
+// sender maps the object, fills it and unmaps it after the send; the reader
+// opens it by name, unlinks it right away (it is the only consumer) and
+// runs the handler on its own mapping, so the body is never copied.
+//
+// Every mapping starts with a CourierBlobHdr; the payload follows at
+// COURIER_BLOB_HDR so it is suitably aligned for any type.
+
+#define COURIER_BLOB_HDR 64
+
+typedef struct
+{
+    uint64_t size;                    // payload bytes written by the sender
+    char name[COURIER_BLOB_NAME_MAX]; // shm object, for courier_blob_send
+} CourierBlobHdr;
+
+_Static_assert(sizeof(CourierBlobHdr) <= COURIER_BLOB_HDR, "blob header does not fit its reserved space");
+
+static _Atomic unsigned long blob_seq;
+
+static CourierBlobHdr* blob_hdr(void *blob)
+{
+    return (CourierBlobHdr *)((unsigned char *)blob - COURIER_BLOB_HDR);
+}
+
+static void* blob_map(int fd, size_t size)
+{
+    void *base = mmap(NULL, COURIER_BLOB_HDR + size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    return (base == MAP_FAILED) ? NULL : (unsigned char *)base + COURIER_BLOB_HDR;
+}
+
+// ----- Sender side -----
+void* courier_blob_alloc(size_t size)
+{
+    if((size == 0) || (size > COURIER_MAX_BLOB_SIZE))
+    {
+        errno = (size == 0) ? EINVAL : EMSGSIZE;
+
+        return NULL;
+    }
+    char name[COURIER_BLOB_NAME_MAX];
+    snprintf(name, sizeof(name), "/courier_blob_%d_%lu", (int)getpid(), atomic_fetch_add(&blob_seq, 1));
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    void *blob = NULL;
+
+    if(ftruncate(fd, (off_t)(COURIER_BLOB_HDR + size)) == 0)
+    {
+        blob = blob_map(fd, size);
+    }
+    close(fd);
+
+    if(!blob)
+    {
+        shm_unlink(name);
+
+        return NULL;
+    }
+    CourierBlobHdr *hdr = blob_hdr(blob);
+    hdr->size           = size;
+    strcpy(hdr->name, name);
+
+    return blob;
+}
+
+void courier_blob_handle(void *blob, CourierBlobHandle *handle)
+{
+    const CourierBlobHdr *hdr = blob_hdr(blob);
+
+    memset(handle, 0, sizeof(*handle));
+    handle->size = hdr->size;
+    strcpy(handle->name, hdr->name);
+}
+
+void courier_blob_detach(void *blob, int sent)
+{
+    CourierBlobHdr *hdr = blob_hdr(blob);
+    const size_t size   = hdr->size;
+
+    if(!sent)
+    {
+        shm_unlink(hdr->name);
+    }
+    munmap(hdr, COURIER_BLOB_HDR + size);
+}
+
+void courier_blob_free(void *blob)
+{
+    if(blob)
+    {
+        courier_blob_detach(blob, 0);
+    }
+}
+
+// ----- Reader side -----
+void* courier_blob_open(const CourierBlobHandle *handle, size_t msg_size)
+{
+    char name[COURIER_BLOB_NAME_MAX];
+
+    memcpy(name, handle->name, sizeof(name));
+    name[sizeof(name) - 1] = '\0';
+
+    if((strncmp(name, "/courier_blob_", 14) != 0) || (handle->size == 0) || (handle->size > msg_size))
+    {
+        errno = EBADMSG;
+
+        return NULL;
+    }
+    int fd = shm_open(name, O_RDWR, 0);
+
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    // Ours now: the name goes away with the last mapping
+    shm_unlink(name);
+
+    void *blob = NULL;
+    struct stat st;
+
+    if(fstat(fd, &st) == 0 && ((size_t)st.st_size >= COURIER_BLOB_HDR + handle->size))
+    {
+        // Short messages read as zero-padded up to msg_size, like small ones
+        if(((size_t)st.st_size >= COURIER_BLOB_HDR + msg_size) || (ftruncate(fd, (off_t)(COURIER_BLOB_HDR + msg_size)) == 0))
+        {
+            blob = blob_map(fd, msg_size);
+        }
+    }
+    else
+    {
+        errno = EBADMSG;
+    }
+    close(fd);
+
+    return blob;
+}
+
+void courier_blob_close(void *blob, size_t msg_size)
+{
+    munmap(blob_hdr(blob), COURIER_BLOB_HDR + msg_size);
+}
+
+void courier_blob_discard(const CourierBlobHandle *handle)
+{
+    char name[COURIER_BLOB_NAME_MAX];
+
+    memcpy(name, handle->name, sizeof(name));
+    name[sizeof(name) - 1] = '\0';
+
+    if(strncmp(name, "/courier_blob_", 14) == 0)
+    {
+        shm_unlink(name);
+    }
+}
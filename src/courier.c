@@ -1,80 +1,1568 @@
 // =============================
 // File: src/courier.c
 // =============================
-#include "courier.h"
+#include "courier_internal.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-#ifndef COURIER_MAX_MSG_SIZE
-#define COURIER_MAX_MSG_SIZE 256
-#endif /* ifndef COURIER_MAX_MSG_SIZE */
+#ifndef COURIER_BATCH_DEFAULT
+#define COURIER_BATCH_DEFAULT 32
+#endif /* ifndef COURIER_BATCH_DEFAULT */
+
+#ifndef COURIER_EPOLL_BATCH
+#define COURIER_EPOLL_BATCH 64
+#endif /* ifndef COURIER_EPOLL_BATCH */
+
+#ifndef COURIER_PRIO_BUDGET
+#define COURIER_PRIO_BUDGET 16
+#endif /* ifndef COURIER_PRIO_BUDGET */
+
+#ifndef COURIER_POLL_BUDGET
+#define COURIER_POLL_BUDGET 64 // messages per queue and poll before other sources get a turn
+#endif /* ifndef COURIER_POLL_BUDGET */
+
+uint64_t courier_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Priority of the message being dispatched on this thread
+static _Thread_local unsigned current_msg_prio;
+
+unsigned courier_msg_priority(void)
+{
+    return current_msg_prio;
+}
+
+// Type of the message being dispatched on this thread (multiplexed channels)
+static _Thread_local uint16_t current_msg_type;
+
+uint16_t courier_msg_type(void)
+{
+    return current_msg_type;
+}
+
+// Ask token of the request being dispatched on this thread (multiplexed channels)
+static _Thread_local CourierAskToken current_msg_ask;
+
+CourierAskToken courier_msg_ask(void)
+{
+    return current_msg_ask;
+}
+
+// Actor being polled on this thread
+static _Thread_local CourierActor *current_actor;
+
+CourierActor* courier_current_actor(void)
+{
+    return current_actor;
+}
+
+// ----- Wire format -----
+// COURIER_STATS builds prefix every message with its send timestamp; other
+// builds send the payload as is. A full queue is waited on until deadline_ns.
+static int wire_send(courrier_mq_t mq, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns)
+{
+#ifdef COURIER_STATS
+    char wire[COURIER_WIRE_HDR + COURIER_MAX_MSG_SIZE];
+
+    if(!msg || (msg_size > COURIER_MAX_MSG_SIZE))
+    {
+        errno = msg ? EMSGSIZE : EINVAL;
+
+        return -1;
+    }
+    const uint64_t sent_ns = courier_now_ns();
+    memcpy(wire, &sent_ns, sizeof(sent_ns));
+    memcpy(wire + COURIER_WIRE_HDR, msg, msg_size);
+
+    return platform_queue_send_until(mq, wire, COURIER_WIRE_HDR + msg_size, prio, deadline_ns);
+#else
+    return platform_queue_send_until(mq, msg, msg_size, prio, deadline_ns);
+#endif // ifdef COURIER_STATS
+}
+
+// Returns the payload size like platform_queue_receive; *sent_ns is 0 when unknown.
+static ssize_t wire_receive(courrier_mq_t mq, void *buf, size_t buf_size, unsigned *prio, uint64_t *sent_ns)
+{
+#ifdef COURIER_STATS
+    char wire[COURIER_WIRE_HDR + COURIER_MAX_MSG_SIZE];
+    const size_t cap = (buf_size < COURIER_MAX_MSG_SIZE) ? buf_size : COURIER_MAX_MSG_SIZE;
+    ssize_t r        = platform_queue_receive(mq, wire, COURIER_WIRE_HDR + cap, prio);
+
+    if(r < (ssize_t)COURIER_WIRE_HDR)
+    {
+        if(r >= 0)
+        {
+            errno = EBADMSG;
+            r     = -1;
+        }
+
+        return r;
+    }
+    r -= (ssize_t)COURIER_WIRE_HDR;
+    memcpy(buf, wire + COURIER_WIRE_HDR, (size_t)r);
+
+    if(sent_ns)
+    {
+        memcpy(sent_ns, wire, sizeof(*sent_ns));
+    }
+
+    return r;
+#else
+    if(sent_ns)
+    {
+        *sent_ns = 0;
+    }
+
+    return platform_queue_receive(mq, buf, buf_size, prio);
+#endif // ifdef COURIER_STATS
+}
+
+// ----- Backpressure -----
+// Messages waiting behind a writer
+static long writer_depth(const CourierWriter *w)
+{
+    return w->mbox ? courier_mailbox_depth(w->mbox) : platform_queue_depth(w->mq);
+}
+
+static long writer_capacity(const CourierWriter *w)
+{
+    return w->mbox ? courier_mailbox_capacity(w->mbox) : platform_queue_capacity(w->mq);
+}
+
+// After a send (or a failed one) to a queue with watermarks: report a crossing
+static void writer_check(const CourierWriter *w)
+{
+    const int err = errno;
+    courier_watermark_check(w->wm, writer_depth(w));
+
+    if(courier_watermark_above(w->wm))
+    {
+        // The reader may have drained it all before the state flipped
+        courier_watermark_check(w->wm, writer_depth(w));
+    }
+    errno = err;
+}
+
+int courier_writer_send(const CourierWriter *w, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns)
+{
+    int ret = w->mbox ? courier_mailbox_send(w->mbox, msg, msg_size, prio, deadline_ns) : wire_send(w->mq, msg, msg_size, prio, deadline_ns);
+
+    if(w->wm)
+    {
+        writer_check(w);
+    }
+
+    return ret;
+}
+
+// Absolute deadline of a send waiting at most timeout_ms (< 0 = no limit)
+static uint64_t send_deadline(int timeout_ms)
+{
+    if(timeout_ms < 0)
+    {
+        return COURIER_NO_DEADLINE;
+    }
+
+    return (timeout_ms == 0) ? 0 : courier_now_ns() + (uint64_t)timeout_ms * 1000000ull;
+}
+
+// ----- Large messages -----
+// Above COURIER_MAX_MSG_SIZE a definition's queue carries blob handles.
+static int def_is_blob(const CourierActorMsgDef *def)
+{
+    return def->msg_size > COURIER_MAX_MSG_SIZE;
+}
+
+// Messages of the definition are envelopes, shorter than msg_size when
+// their payload is smaller than the largest
+static int def_is_channel(const CourierActorMsgDef *def)
+{
+    return def->types || def->envelopes;
+}
+
+// Bytes per message on the definition's queue and mailbox
+size_t courier_def_queue_size(const CourierActorMsgDef *def)
+{
+    return def_is_blob(def) ? sizeof(CourierBlobHandle) : def->msg_size;
+}
+
+// Hand a blob over to queue_name: it is unmapped either way, and unlinked
+// unless the handle was sent.
+static int blob_send(const char *queue_name, void *blob, unsigned prio, uint64_t deadline_ns)
+{
+    CourierBlobHandle handle;
+    courier_blob_handle(blob, &handle);
+
+    CourierWriter w;
+    int ret  = -1;
+    int slot = courier_writer_cache_acquire(queue_name, sizeof(handle), &w);
+
+    if(slot != -1)
+    {
+        ret = courier_writer_send(&w, &handle, sizeof(handle), prio, deadline_ns);
+        courier_writer_cache_release(slot, &w);
+    }
+    const int err = errno;
+    courier_blob_detach(blob, ret == 0);
+    errno = err;
+
+    return ret;
+}
+
+// ----- Actor dispatch -----
+static void actor_record_wait(CourierActor *actor, size_t idx, uint64_t sent_ns)
+{
+#ifdef COURIER_STATS
+    const uint64_t now = courier_now_ns();
+    courier_histogram_record(&actor->rt->stats[idx].queue_wait, (now > sent_ns) ? now - sent_ns : 0);
+#else
+    (void)actor;
+    (void)idx;
+    (void)sent_ns;
+#endif // ifdef COURIER_STATS
+}
+
+// Move what waits on a conflating definition's platform queue into its
+// mailbox, where each message replaces the pending one of its key, so the
+// next pop gets the latest value whichever path it came by.
+static void actor_conflate_platform(CourierActor *actor, size_t idx)
+{
+    CourierActorMsgDef *def = &actor->msgs[idx];
+
+    while(def->mq != (courrier_mq_t)-1)
+    {
+        CourierMsgSlot *s = courier_slot_alloc();
+
+        if(!s)
+        {
+            return;
+        }
+        uint64_t sent_ns = 0;
+        ssize_t r        = wire_receive(def->mq, s->payload, def->msg_size, &s->prio, &sent_ns);
+
+        if(r < 0)
+        {
+            courier_slot_release(s);
+
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            if(errno == EMSGSIZE) // the backend dropped it, the next one may fit
+            {
+                fprintf(stderr, "[Courier %s] Warn: dropped oversized message on %s\n", actor->name, def->queue_name);
+                continue;
+            }
+
+            if(errno != EAGAIN)
+            {
+                perror("courier_queue_receive");
+            }
+
+            return;
+        }
+        s->size    = (uint32_t)r;
+        s->sent_ns = sent_ns;
+
+        if(courier_mailbox_push(actor->rt->mboxes[idx], s, 0) < 0)
+        {
+            fprintf(stderr, "[Courier %s] Warn: dropped message on %s: %s\n", actor->name, def->queue_name, strerror(errno));
+            courier_slot_release(s);
+        }
+    }
+}
+
+// Receive one message of def, from its in-process mailbox first, then from
+// its platform queue into dst. Returns the message, or NULL once both are
+// drained. A mailbox message is read in place from *slot, which the caller
+// releases after use (*slot is NULL for platform messages).
+static void* actor_receive(CourierActor *actor, size_t idx, char *dst, unsigned *prio, CourierMsgSlot **slot)
+{
+    CourierActorMsgDef *def = &actor->msgs[idx];
+    CourierMailbox *mb      = actor->rt->mboxes[idx];
+    const size_t sz         = courier_def_queue_size(def);
+    uint64_t sent_ns;
+
+    if(def->conflate && mb)
+    {
+        actor_conflate_platform(actor, idx);
+    }
+    *slot = mb ? courier_mailbox_pop(mb) : NULL;
+
+    if(*slot)
+    {
+        CourierMsgSlot *s = *slot;
+
+        if(prio)
+        {
+            *prio = s->prio;
+        }
+
+        if(s->size != sz)
+        {
+            if(!def_is_channel(def)) // envelopes are as long as their payload
+            {
+                fprintf(stderr, "[Courier %s] Warn: received %u bytes on %s (expected %zu)\n", actor->name, s->size, def->queue_name, sz);
+            }
+
+            // Published buffers are shared and already zero-filled
+            if(atomic_load_explicit(&s->refs, memory_order_relaxed) == 1)
+            {
+                memset(s->payload + s->size, 0, sz - s->size);
+            }
+        }
+        actor_record_wait(actor, idx, s->sent_ns);
+
+        return s->payload;
+    }
+
+    for(;;)
+    {
+        if(def->mq == (courrier_mq_t)-1)
+        {
+            errno = EAGAIN;
+
+            return NULL;
+        }
+        ssize_t r = wire_receive(def->mq, dst, sz, prio, &sent_ns);
+
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            if(errno == EMSGSIZE) // the backend dropped it, the next one may fit
+            {
+                fprintf(stderr, "[Courier %s] Warn: dropped oversized message on %s\n", actor->name, def->queue_name);
+                continue;
+            }
+
+            if(errno != EAGAIN)
+            {
+                perror("courier_queue_receive");
+            }
+
+            return NULL;
+        }
+
+        // Optional size check
+        if((size_t)r != sz)
+        {
+            if(!def_is_channel(def))
+            {
+                fprintf(stderr, "[Courier %s] Warn: received %zd bytes on %s (expected %zu)\n", actor->name, r, def->queue_name, sz);
+            }
+            memset(dst + r, 0, sz - (size_t)r);
+        }
+        actor_record_wait(actor, idx, sent_ns);
+
+        return dst;
+    }
+}
+
+// Map the payload of a large message. NULL (and the message is dropped)
+// when the handle is invalid or the blob cannot be mapped.
+static void* actor_blob_open(CourierActor *actor, size_t idx, const void *msg)
+{
+    CourierBlobHandle handle;
+    memcpy(&handle, msg, sizeof(handle));
+
+    void *blob = courier_blob_open(&handle, actor->msgs[idx].msg_size);
+
+    if(!blob)
+    {
+        fprintf(stderr, "[Courier %s] Warn: dropped large message on %s: %s\n", actor->name, actor->msgs[idx].queue_name, strerror(errno));
+        courier_blob_discard(&handle);
+    }
+
+    return blob;
+}
+
+// A close request preempts regular dispatch between two messages; the
+// remaining backlog is then handled by actor_shutdown under its deadline.
+static int actor_close_pending(const CourierActor *actor)
+{
+    return !actor->rt->draining && atomic_load_explicit(&actor->rt->closing, memory_order_relaxed);
+}
+
+// Run a handler call, recording its execution time in COURIER_STATS builds
+#ifdef COURIER_STATS
+#define ACTOR_TIMED(actor, idx, call)                                                        \
+    do                                                                                       \
+    {                                                                                        \
+        const uint64_t t0_ = courier_now_ns();                                               \
+        call;                                                                                \
+        courier_histogram_record(&(actor)->rt->stats[idx].handler, courier_now_ns() - t0_); \
+    } while(0)
+#else
+#define ACTOR_TIMED(actor, idx, call) call
+#endif // ifdef COURIER_STATS
+
+// Hand an envelope of a multiplexed channel to the handler of its type
+static void actor_dispatch_typed(CourierActor *actor, size_t idx, void *msg)
+{
+    const CourierTypeTable *table = &actor->rt->types[idx];
+    CourierEnvelope env;
+    memcpy(&env, msg, sizeof(env));
+
+    const CourierMsgType *type = (env.type < table->nb) ? table->by_type[env.type] : NULL;
+
+    if(!type || (env.size > type->msg_size))
+    {
+        fprintf(stderr, "[Courier %s] Warn: dropped message of type %u (%u bytes) on %s\n", actor->name, env.type, env.size, actor->msgs[idx].queue_name);
+
+        return;
+    }
+    current_msg_type = (uint16_t)env.type;
+    current_msg_ask  = env.ask;
+    ACTOR_TIMED(actor, idx, type->handler(actor->user_data, (char *)msg + COURIER_ENVELOPE_HDR));
+    current_msg_type = 0;
+    current_msg_ask  = 0;
+}
+
+// Queues are registered edge-triggered, so a ready queue must be drained
+// until EAGAIN before it can be forgotten. Dispatches at most budget messages
+// and returns 1 once the queue is drained, 0 if the budget ran out first.
+static int actor_drain(CourierActor *actor, size_t idx, char *buf, size_t budget)
+{
+    CourierActorMsgDef *def = &actor->msgs[idx];
+    size_t done = 0;
+    unsigned prio;
+
+    if(def->batch_handler)
+    {
+        // Fill a contiguous array of up to batch_max messages per call
+        char *batch = actor->rt->batch_bufs[idx];
+        CourierMsgSlot *slot;
+
+        while(done < budget && !actor_close_pending(actor))
+        {
+            size_t count = 0;
+            current_msg_prio = 0;
+
+            while(count < def->batch_max)
+            {
+                char *dst = batch + count * def->msg_size;
+                void *msg = actor_receive(actor, idx, dst, &prio, &slot);
+
+                if(!msg)
+                {
+                    break;
+                }
+
+                if(slot)
+                {
+                    memcpy(dst, msg, def->msg_size);
+                    courier_slot_release(slot);
+                }
+                current_msg_prio = (prio > current_msg_prio) ? prio : current_msg_prio;
+                count++;
+            }
+
+            if(count > 0)
+            {
+                ACTOR_TIMED(actor, idx, def->batch_handler(actor->user_data, batch, count));
+            }
+            done                  += count;
+            actor->rt->dispatched += count;
+
+            if(count < def->batch_max)
+            {
+                return 1; // hit EAGAIN
+            }
+        }
+
+        return 0;
+    }
+
+    while(done < budget && !actor_close_pending(actor))
+    {
+        CourierMsgSlot *slot;
+        void *msg = actor_receive(actor, idx, buf, &current_msg_prio, &slot);
+
+        if(!msg)
+        {
+            return 1;
+        }
+        // Dispatch, in place for in-process messages and large ones
+        void *blob = def_is_blob(def) ? actor_blob_open(actor, idx, msg) : NULL;
+
+        if(def->types)
+        {
+            actor_dispatch_typed(actor, idx, msg);
+        }
+        else if(blob || !def_is_blob(def))
+        {
+            ACTOR_TIMED(actor, idx, def->handler(actor->user_data, blob ? blob : msg));
+        }
+
+        if(blob)
+        {
+            courier_blob_close(blob, def->msg_size);
+        }
+
+        if(slot)
+        {
+            courier_slot_release(slot);
+        }
+        done++;
+        actor->rt->dispatched++;
+    }
+
+    return 0;
+}
+
+// ----- Raw descriptor sources -----
+static void actor_dispatch_fd(CourierActor *actor, const struct epoll_event *ev)
+{
+    CourierFdSource *src = (CourierFdSource *)(uintptr_t)(ev->data.u64 & ~COURIER_EV_FD);
+
+    // Removed since this batch was collected, or closing: the event is stale
+    if(!atomic_load_explicit(&src->removed, memory_order_acquire) && !actor_close_pending(actor))
+    {
+        src->handler(actor->user_data, src->fd, ev->events);
+    }
+}
+
+static void fd_sources_free(CourierFdSource *src)
+{
+    while(src)
+    {
+        CourierFdSource *next = src->next;
+        free(src);
+        src = next;
+    }
+}
+
+// Free the sources removed during the last batch: no event of theirs is left
+static void actor_free_retired(struct CourierActorRuntime *rt)
+{
+    if(!atomic_load_explicit(&rt->has_retired, memory_order_acquire))
+    {
+        return;
+    }
+    pthread_mutex_lock(&rt->fd_lock);
+    CourierFdSource *src = rt->fd_retired;
+    rt->fd_retired       = NULL;
+    atomic_store(&rt->has_retired, 0);
+    pthread_mutex_unlock(&rt->fd_lock);
+    fd_sources_free(src);
+}
+
+// Record ready sources from an epoll batch. Control and fd events are consumed here.
+static void actor_mark_ready(CourierActor *actor, const struct epoll_event *events, int n)
+{
+    struct CourierActorRuntime *rt = actor->rt;
+
+    for(int i = 0; i < n; i++)
+    {
+        if(events[i].data.u64 == COURIER_EV_CONTROL)
+        {
+            uint64_t count;
+
+            if(read(rt->ctl_fd, &count, sizeof(count)) < 0 && (errno != EAGAIN))
+            {
+                perror("read(ctl_fd)");
+            }
+            continue;
+        }
+
+        if(events[i].data.u64 & COURIER_EV_FD)
+        {
+            actor_dispatch_fd(actor, &events[i]);
+            continue;
+        }
+        const size_t idx = (size_t)events[i].data.u64;
+
+        if(!rt->is_ready[idx])
+        {
+            rt->is_ready[idx]         = 1;
+            rt->ready[rt->nb_ready++] = idx;
+        }
+    }
+}
+
+// Default policy: every ready queue gets up to COURIER_POLL_BUDGET messages
+// per poll, in turn. Queues still holding messages stay listed in ready[]
+// for the next poll, so a producer that keeps up cannot starve the actor's
+// other queues and descriptors.
+static void actor_dispatch_fair(CourierActor *actor, struct epoll_event *events, int n, char *buf)
+{
+    struct CourierActorRuntime *rt = actor->rt;
+    size_t kept                    = 0;
+
+    actor_mark_ready(actor, events, n);
+
+    for(size_t i = 0; i < rt->nb_ready; i++)
+    {
+        const size_t idx = rt->ready[i];
+
+        if(actor_close_pending(actor) || !actor_drain(actor, idx, buf, COURIER_POLL_BUDGET))
+        {
+            rt->ready[kept++] = idx;
+        }
+        else
+        {
+            rt->is_ready[idx] = 0;
+        }
+    }
+    rt->nb_ready = kept;
+}
+
+static void actor_requeue(CourierActor *actor)
+{
+    const uint64_t one = 1;
+
+    if(write(actor->rt->ctl_fd, &one, sizeof(one)) < 0)
+    {
+        perror("write(ctl_fd)");
+    }
+}
+
+// Priority policy: always service the highest-priority ready definition,
+// and re-poll between bounded chunks so control messages that arrive during
+// a telemetry flood jump ahead of the remaining bulk messages. A poll
+// dispatches about COURIER_POLL_BUDGET messages per ready queue at most.
+static void actor_dispatch_prioritized(CourierActor *actor, struct epoll_event *events, int n, char *buf)
+{
+    struct CourierActorRuntime *rt = actor->rt;
+
+    actor_mark_ready(actor, events, n);
+    const size_t budget = rt->dispatched + rt->nb_ready * COURIER_POLL_BUDGET;
+
+    while(rt->nb_ready > 0 && (rt->dispatched < budget) && !actor_close_pending(actor))
+    {
+        size_t best = 0;
+
+        for(size_t i = 1; i < rt->nb_ready; i++)
+        {
+            if(actor->msgs[rt->ready[i]].priority > actor->msgs[rt->ready[best]].priority)
+            {
+                best = i;
+            }
+        }
+        const size_t idx = rt->ready[best];
+
+        if(actor_drain(actor, idx, buf, COURIER_PRIO_BUDGET))
+        {
+            rt->is_ready[idx] = 0;
+            rt->ready[best]   = rt->ready[--rt->nb_ready];
+        }
+        int m = epoll_wait(actor->epfd, events, COURIER_EPOLL_BATCH, 0);
+
+        if(m > 0)
+        {
+            actor_mark_ready(actor, events, m);
+        }
+    }
+}
+
+// ----- Cooperative shutdown -----
+// Runs on the actor's own thread (or worker) once a close was requested:
+// dispatch what is already queued until the deadline, then discard and
+// count whatever is left.
+static void actor_shutdown(CourierActor *actor, char *buf)
+{
+    struct CourierActorRuntime *rt = actor->rt;
+    const size_t before            = rt->dispatched;
+    size_t dropped                 = 0;
+
+    rt->draining = 1;
+
+    for(size_t i = 0; i < actor->nb_msgs; i++)
+    {
+        CourierActorMsgDef *def = &actor->msgs[i];
+        const size_t chunk      = def->batch_handler ? def->batch_max : 1;
+
+        while(courier_now_ns() < rt->close_deadline_ns)
+        {
+            if(actor_drain(actor, i, buf, chunk))
+            {
+                break;
+            }
+        }
+
+        CourierMsgSlot *slot;
+        void *msg;
+
+        while((msg = actor_receive(actor, i, buf, NULL, &slot)) != NULL)
+        {
+            if(def_is_blob(def))
+            {
+                CourierBlobHandle handle;
+                memcpy(&handle, msg, sizeof(handle));
+                courier_blob_discard(&handle);
+            }
+
+            if(slot)
+            {
+                courier_slot_release(slot);
+            }
+            dropped++;
+        }
+    }
+    rt->close_stats.processed = rt->dispatched - before;
+    rt->close_stats.dropped   = dropped;
+    rt->stopped               = 1;
+}
+
+// ----- Watermarks -----
+// Reader side of the low mark: once a queue went above its high mark, report
+// when the actor has worked it back down, even if producers stopped sending.
+static void actor_check_watermarks(CourierActor *actor)
+{
+    struct CourierActorRuntime *rt = actor->rt;
+    const unsigned generation      = courier_watermark_generation();
+
+    if(generation != rt->wm_generation)
+    {
+        rt->nb_wms = 0;
+
+        for(size_t i = 0; i < actor->nb_msgs; i++)
+        {
+            rt->wms[i]  = courier_watermark_lookup(actor->msgs[i].queue_name);
+            rt->nb_wms += (rt->wms[i] != NULL);
+        }
+        rt->wm_generation = generation;
+    }
+
+    for(size_t i = 0; (i < actor->nb_msgs) && (rt->nb_wms > 0); i++)
+    {
+        if(!rt->wms[i] || !courier_watermark_above(rt->wms[i]))
+        {
+            continue;
+        }
+        // Local senders use the mailbox, other processes the queue
+        const long queued = platform_queue_depth(actor->msgs[i].mq);
+        long depth        = rt->mboxes[i] ? courier_mailbox_depth(rt->mboxes[i]) : 0;
+        depth            += (queued > 0) ? queued : 0;
+
+        courier_watermark_check(rt->wms[i], depth);
+    }
+}
+
+int courier_actor_poll(CourierActor *actor, int timeout_ms)
+{
+    char buf[COURIER_MAX_MSG_SIZE];
+    struct epoll_event events[COURIER_EPOLL_BATCH];
+
+    int n = epoll_wait(actor->epfd, events, COURIER_EPOLL_BATCH, timeout_ms);
+
+    if(n < 0)
+    {
+        return -1;
+    }
+    current_actor = actor;
+
+    // Only ready queues are visited: cost is independent of nb_msgs
+    if(actor->rt->prioritized)
+    {
+        actor_dispatch_prioritized(actor, events, n, buf);
+    }
+    else
+    {
+        actor_dispatch_fair(actor, events, n, buf);
+    }
+
+    if((actor->rt->nb_ready > 0) && !atomic_load_explicit(&actor->rt->closing, memory_order_relaxed))
+    {
+        // Budget spent: no edge will report the queues left, so wake the
+        // actor's own epoll set and take a turn behind the other ready work
+        actor_requeue(actor);
+    }
+    actor_free_retired(actor->rt);
+    actor_check_watermarks(actor);
+
+    if(atomic_load_explicit(&actor->rt->closing, memory_order_acquire) && !actor->rt->stopped)
+    {
+        actor_shutdown(actor, buf);
+    }
+    current_actor = NULL;
+
+    return n;
+}
 
 // ----- Actor thread loop -----
 static void* actor_loop(void *arg)
 {
-    CourierActor *actor = (CourierActor *)arg;
-    char buf[COURIER_MAX_MSG_SIZE];
+    CourierActor *actor = (CourierActor *)arg;
+
+    // Runs until courier_actor_close raises the stop signal on ctl_fd
+    while(!actor->rt->stopped)
+    {
+        if(courier_actor_poll(actor, -1) < 0) // block
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int actor_epoll_create(CourierActor *actor)
+{
+    actor->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+    if(actor->epfd < 0)
+    {
+        perror("epoll_create1");
+
+        return -1;
+    }
+    struct epoll_event ctl = { .events = EPOLLIN | EPOLLET, .data.u64 = COURIER_EV_CONTROL };
+
+    if(epoll_ctl(actor->epfd, EPOLL_CTL_ADD, actor->rt->ctl_fd, &ctl) < 0)
+    {
+        goto fail;
+    }
+
+    for(size_t i = 0; i < actor->nb_msgs; i++)
+    {
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.u64 = i };
+
+        // Pool workers may leave the platform queue to another worker
+        if((actor->msgs[i].mq != (courrier_mq_t)-1) && (epoll_ctl(actor->epfd, EPOLL_CTL_ADD, platform_queue_fd(actor->msgs[i].mq), &ev) < 0))
+        {
+            goto fail;
+        }
+
+        // Same tag: either source makes the definition ready
+        if(actor->rt->mboxes[i] && (epoll_ctl(actor->epfd, EPOLL_CTL_ADD, courier_mailbox_fd(actor->rt->mboxes[i]), &ev) < 0))
+        {
+            goto fail;
+        }
+    }
+
+    return 0;
+
+fail:
+    perror("epoll_ctl");
+    close(actor->epfd);
+    actor->epfd = -1;
+
+    return -1;
+}
+
+static void actor_runtime_destroy(struct CourierActorRuntime *rt, size_t nb_msgs)
+{
+    if(rt)
+    {
+        if(rt->batch_bufs)
+        {
+            for(size_t i = 0; i < nb_msgs; i++)
+            {
+                free(rt->batch_bufs[i]);
+            }
+            free(rt->batch_bufs);
+        }
+
+        if(rt->ctl_fd >= 0)
+        {
+            close(rt->ctl_fd);
+        }
+        free(rt->ready);
+        free(rt->is_ready);
+        free(rt->stats);
+        free(rt->mboxes);
+        free(rt->wms);
+
+        for(size_t i = 0; rt->types && (i < nb_msgs); i++)
+        {
+            free(rt->types[i].by_type);
+        }
+        free(rt->types);
+
+        if(rt->replies)
+        {
+            courier_reply_channel_destroy(rt->replies);
+        }
+
+        // Descriptors belong to the caller: only the bookkeeping goes
+        fd_sources_free(rt->fd_sources);
+        fd_sources_free(rt->fd_retired);
+        pthread_mutex_destroy(&rt->fd_lock);
+        sem_destroy(&rt->detached);
+        free(rt);
+    }
+}
+
+// Index a channel's types by id. -1 with errno EINVAL on a duplicate id.
+static int type_table_build(CourierTypeTable *table, const CourierMsgType *types, size_t nb_types)
+{
+    for(size_t i = 0; i < nb_types; i++)
+    {
+        table->nb = (types[i].type >= table->nb) ? (size_t)types[i].type + 1 : table->nb;
+    }
+    table->by_type = calloc(table->nb, sizeof(*table->by_type));
+
+    if(!table->by_type)
+    {
+        return -1;
+    }
+
+    for(size_t i = 0; i < nb_types; i++)
+    {
+        if(table->by_type[types[i].type])
+        {
+            errno = EINVAL;
+
+            return -1;
+        }
+        table->by_type[types[i].type] = &types[i];
+    }
+
+    return 0;
+}
+
+static struct CourierActorRuntime* actor_runtime_create(CourierActorMsgDef *msgs, size_t nb_msgs)
+{
+    struct CourierActorRuntime *rt = calloc(1, sizeof(*rt));
+
+    if(!rt)
+    {
+        return NULL;
+    }
+    sem_init(&rt->detached, 0, 0);
+    pthread_mutex_init(&rt->fd_lock, NULL);
+    rt->ctl_fd     = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    rt->batch_bufs = calloc(nb_msgs, sizeof(*rt->batch_bufs));
+    rt->ready      = calloc(nb_msgs, sizeof(*rt->ready));
+    rt->is_ready   = calloc(nb_msgs, sizeof(*rt->is_ready));
+    rt->mboxes     = calloc(nb_msgs, sizeof(*rt->mboxes));
+    rt->wms        = calloc(nb_msgs, sizeof(*rt->wms));
+    rt->types      = calloc(nb_msgs, sizeof(*rt->types));
+
+#ifdef COURIER_STATS
+    rt->stats = calloc(nb_msgs, sizeof(*rt->stats));
+
+    if(!rt->stats)
+    {
+        perror("actor runtime");
+        actor_runtime_destroy(rt, nb_msgs);
+
+        return NULL;
+    }
+#endif // ifdef COURIER_STATS
+
+    if((rt->ctl_fd < 0) || !rt->batch_bufs || !rt->ready || !rt->is_ready || !rt->mboxes || !rt->wms || !rt->types)
+    {
+        perror("actor runtime");
+        actor_runtime_destroy(rt, nb_msgs);
+
+        return NULL;
+    }
+
+    for(size_t i = 0; i < nb_msgs; i++)
+    {
+        if(msgs[i].priority != msgs[0].priority)
+        {
+            rt->prioritized = 1;
+        }
+
+        if(msgs[i].types && (type_table_build(&rt->types[i], msgs[i].types, msgs[i].nb_types) < 0))
+        {
+            const int err = errno;
+            actor_runtime_destroy(rt, nb_msgs);
+            errno = err;
+
+            return NULL;
+        }
+
+        if(!msgs[i].batch_handler)
+        {
+            continue;
+        }
+
+        if(msgs[i].batch_max == 0)
+        {
+            msgs[i].batch_max = COURIER_BATCH_DEFAULT;
+        }
+        rt->batch_bufs[i] = malloc(msgs[i].batch_max * msgs[i].msg_size);
+
+        if(!rt->batch_bufs[i])
+        {
+            perror("malloc(batch)");
+            actor_runtime_destroy(rt, nb_msgs);
+
+            return NULL;
+        }
+    }
+
+    return rt;
+}
+
+// ----- Queue helpers -----
+courrier_mq_t courier_queue_open_reader(const char *queue_name, size_t msg_size, long maxmsg)
+{
+    if(queue_name)
+    {
+        // The reader recreates the queue: cached writers would point at the old one
+        courier_writer_cache_evict(queue_name);
+    }
+
+    return platform_queue_open_reader(queue_name, msg_size + COURIER_WIRE_HDR, maxmsg);
+}
+
+courrier_mq_t courier_queue_open_writer(const char *queue_name, size_t msg_size, long maxmsg)
+{
+    return platform_queue_open_writer(queue_name, msg_size + COURIER_WIRE_HDR, maxmsg);
+}
+
+int courier_send_mq(courrier_mq_t mq, const void *msg, size_t msg_size)
+{
+    return wire_send(mq, msg, msg_size, 0, COURIER_NO_DEADLINE);
+}
+
+int courier_send_mq_prio(courrier_mq_t mq, const void *msg, size_t msg_size, unsigned prio)
+{
+    return wire_send(mq, msg, msg_size, prio, COURIER_NO_DEADLINE);
+}
+
+int courier_send_mq_timed(courrier_mq_t mq, const void *msg, size_t msg_size, int timeout_ms)
+{
+    return wire_send(mq, msg, msg_size, 0, send_deadline(timeout_ms));
+}
+
+static int send_to(const char *queue_name, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns)
+{
+    if(!queue_name || !msg || (msg_size == 0))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    if(msg_size > COURIER_MAX_MSG_SIZE)
+    {
+        // Large message: copied once into shared memory, only its handle is queued
+        void *blob = courier_blob_alloc(msg_size);
+
+        if(!blob)
+        {
+            return -1;
+        }
+        memcpy(blob, msg, msg_size);
+
+        return blob_send(queue_name, blob, prio, deadline_ns);
+    }
+
+    for(;;)
+    {
+        CourierWriter w;
+        int slot = courier_writer_cache_acquire(queue_name, msg_size, &w);
+
+        if(slot == -1)
+        {
+            return -1;
+        }
+        // A full platform queue may be one its reader has since recreated:
+        // wait on it in slices and check it between them
+        uint64_t until = deadline_ns;
+
+        if(!w.mbox && (deadline_ns > 0))
+        {
+            const uint64_t check = courier_now_ns() + COURIER_WRITER_CHECK_MS * 1000000ull;
+            until                = (check < deadline_ns) ? check : deadline_ns;
+        }
+        int ret         = courier_writer_send(&w, msg, msg_size, prio, until);
+        const int err   = errno;
+        const int full  = (ret < 0) && (err == EAGAIN) && !w.mbox;
+        const int stale = full && courier_writer_cache_stale(slot, queue_name, &w);
+        courier_writer_cache_release(slot, &w);
+
+        if(!full || (!stale && (until == deadline_ns)))
+        {
+            errno = err;
+
+            return ret;
+        }
+    }
+}
+
+int courier_send_to(const char *queue_name, const void *msg, size_t msg_size)
+{
+    return send_to(queue_name, msg, msg_size, 0, COURIER_NO_DEADLINE);
+}
+
+int courier_send_to_prio(const char *queue_name, const void *msg, size_t msg_size, unsigned prio)
+{
+    return send_to(queue_name, msg, msg_size, prio, COURIER_NO_DEADLINE);
+}
+
+int courier_try_send_to(const char *queue_name, const void *msg, size_t msg_size)
+{
+    return send_to(queue_name, msg, msg_size, 0, 0);
+}
+
+int courier_send_to_timed(const char *queue_name, const void *msg, size_t msg_size, int timeout_ms)
+{
+    return send_to(queue_name, msg, msg_size, 0, send_deadline(timeout_ms));
+}
+
+long courier_queue_depth(const char *queue_name)
+{
+    if(!queue_name)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    CourierWriter w;
+    int slot = courier_writer_cache_acquire(queue_name, COURIER_MAX_MSG_SIZE, &w);
+
+    if(slot == -1)
+    {
+        return -1;
+    }
+    const long depth = writer_depth(&w);
+    courier_writer_cache_release(slot, &w);
+
+    return depth;
+}
+
+long courier_queue_capacity(const char *queue_name)
+{
+    if(!queue_name)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    CourierWriter w;
+    int slot = courier_writer_cache_acquire(queue_name, COURIER_MAX_MSG_SIZE, &w);
+
+    if(slot == -1)
+    {
+        return -1;
+    }
+    const long capacity = writer_capacity(&w);
+    courier_writer_cache_release(slot, &w);
+
+    return capacity;
+}
+
+// Wrap msg into envelope (COURIER_MAX_MSG_SIZE bytes); returns the bytes to send, or 0 with errno set
+static size_t envelope_pack(char *envelope, uint16_t type, const void *msg, size_t msg_size)
+{
+    const CourierEnvelope env = { .type = type, .size = (uint32_t)msg_size };
+
+    if(!msg || (msg_size == 0) || (msg_size > COURIER_MAX_MSG_SIZE - COURIER_ENVELOPE_HDR))
+    {
+        errno = (msg && msg_size) ? EMSGSIZE : EINVAL;
+
+        return 0;
+    }
+    memcpy(envelope, &env, sizeof(env));
+    memset(envelope + sizeof(env), 0, COURIER_ENVELOPE_HDR - sizeof(env));
+    memcpy(envelope + COURIER_ENVELOPE_HDR, msg, msg_size);
+
+    return COURIER_ENVELOPE_HDR + msg_size;
+}
+
+int courier_send_typed(const char *queue_name, uint16_t type, const void *msg, size_t msg_size)
+{
+    alignas(max_align_t) char envelope[COURIER_MAX_MSG_SIZE];
+    const size_t size = envelope_pack(envelope, type, msg, msg_size);
+
+    if(size == 0)
+    {
+        return -1;
+    }
+
+    return send_to(queue_name, envelope, size, 0, COURIER_NO_DEADLINE);
+}
+
+// ----- Ports -----
+// A bound port holds a writer cache reference, so its descriptor or mailbox
+// stays valid even if the cache evicts the queue in the meantime.
+typedef struct
+{
+    _Atomic int bound;
+    int slot;
+    CourierWriter w;
+} CourierPort;
+
+static CourierPort ports[COURIER_PORTS_MAX];
+
+// The bound port, or NULL with errno set
+static const CourierPort* port_get(int port)
+{
+    if((port < 0) || (port >= COURIER_PORTS_MAX))
+    {
+        errno = EINVAL;
+
+        return NULL;
+    }
+
+    if(!atomic_load_explicit(&ports[port].bound, memory_order_acquire))
+    {
+        errno = EBADF;
+
+        return NULL;
+    }
+
+    return &ports[port];
+}
+
+int courier_port_bind(int port, const char *queue_name, size_t msg_size)
+{
+    if((port < 0) || (port >= COURIER_PORTS_MAX) || !queue_name || (msg_size == 0) || (msg_size > COURIER_MAX_MSG_SIZE))
+    {
+        errno = (msg_size > COURIER_MAX_MSG_SIZE) ? EMSGSIZE : EINVAL;
+
+        return -1;
+    }
+    CourierPort *p = &ports[port];
+
+    if(atomic_load_explicit(&p->bound, memory_order_relaxed))
+    {
+        errno = EBUSY;
+
+        return -1;
+    }
+    p->slot = courier_writer_cache_acquire(queue_name, msg_size, &p->w);
+
+    if(p->slot == -1)
+    {
+        return -1;
+    }
+    atomic_store_explicit(&p->bound, 1, memory_order_release);
+
+    return 0;
+}
+
+int courier_port_unbind(int port)
+{
+    if(!port_get(port))
+    {
+        return -1;
+    }
+    CourierPort *p = &ports[port];
 
-    // Prepare poll fds (Linux-specific: mqd_t is a file descriptor)
-    struct pollfd fds[actor->nb_msgs];
+    atomic_store_explicit(&p->bound, 0, memory_order_relaxed);
+    courier_writer_cache_release(p->slot, &p->w);
 
-    for(size_t i = 0; i < actor->nb_msgs; i++)
+    return 0;
+}
+
+int courier_port_send(int port, const void *msg, size_t msg_size)
+{
+    const CourierPort *p = port_get(port);
+
+    if(!p)
     {
-        // We opened the queues in courier_actor_init; just attach to poll
-        fds[i].fd     = (int)actor->msgs[i].mq; // Linux: mqd_t is an FD (non-portable)
-        fds[i].events = POLLIN;
+        return -1;
     }
 
-    // TODO add a shutdown mechanism instead of relying on pthread_cancel
-    for(;;)
+    if(!msg || (msg_size == 0))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    return courier_writer_send(&p->w, msg, msg_size, 0, COURIER_NO_DEADLINE);
+}
+
+int courier_port_send_typed(int port, uint16_t type, const void *msg, size_t msg_size)
+{
+    alignas(max_align_t) char envelope[COURIER_MAX_MSG_SIZE];
+    const CourierPort *p = port_get(port);
+    const size_t size    = p ? envelope_pack(envelope, type, msg, msg_size) : 0;
+
+    if(size == 0)
+    {
+        return -1;
+    }
+
+    return courier_writer_send(&p->w, envelope, size, 0, COURIER_NO_DEADLINE);
+}
+
+int courier_blob_send(const char *queue_name, void *blob)
+{
+    if(!queue_name || !blob)
     {
-        int ret = poll(fds, actor->nb_msgs, -1); // block
+        courier_blob_free(blob);
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    return blob_send(queue_name, blob, 0, COURIER_NO_DEADLINE);
+}
+
+int courier_msg_publish(void *msg, const char *const *queue_names, size_t count)
+{
+    if(!msg || (!queue_names && (count > 0)))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    CourierMsgSlot *slot = courier_msg_slot(msg);
+    int ret              = 0;
+    int err              = 0;
+#ifdef COURIER_STATS
+    slot->sent_ns = courier_now_ns();
+#endif // ifdef COURIER_STATS
+
+    for(size_t i = 0; i < count; i++)
+    {
+        CourierWriter w;
+        int wslot = courier_writer_cache_acquire(queue_names[i], slot->size, &w);
 
-        if(ret < 0)
+        if(wslot == -1)
         {
-            if(errno == EINTR)
+            ret = -1;
+            err = errno;
+            continue;
+        }
+        int rc;
+
+        if(w.mbox)
+        {
+            // Local subscriber: one more reference on the same slot, no copy
+            atomic_fetch_add_explicit(&slot->refs, 1, memory_order_relaxed);
+            rc = courier_mailbox_push(w.mbox, slot, COURIER_NO_DEADLINE);
+
+            if(rc < 0)
             {
-                continue;
+                err = errno;
+                courier_slot_release(slot);
             }
-            perror("poll");
-            break;
+        }
+        else
+        {
+            rc  = wire_send(w.mq, slot->payload, slot->size, slot->prio, COURIER_NO_DEADLINE);
+            err = (rc < 0) ? errno : err;
         }
 
-        for(size_t i = 0; i < actor->nb_msgs; i++)
+        if(w.wm)
         {
-            if(fds[i].revents & POLLIN)
-            {
-                const size_t sz = actor->msgs[i].msg_size;
+            writer_check(&w);
+        }
+        courier_writer_cache_release(wslot, &w);
+        ret = (rc < 0) ? -1 : ret;
+    }
+    courier_slot_release(slot);
 
-                ssize_t r = mq_receive(actor->msgs[i].mq, buf, sz, NULL);
+    if(ret < 0)
+    {
+        errno = err;
+    }
 
-                if(r < 0)
-                {
-                    perror("mq_receive");
-                    continue;
-                }
+    return ret;
+}
+
+ssize_t courier_queue_receive(courrier_mq_t mq, void *buf, size_t buf_size, unsigned *prio)
+{
+    return wire_receive(mq, buf, buf_size, prio, NULL);
+}
+
+int courier_queue_fd(courrier_mq_t mq)
+{
+    return platform_queue_fd(mq);
+}
+
+int courier_queue_close(courrier_mq_t mq)
+{
+    return platform_queue_close(mq);
+}
+
+int courier_queue_unlink(const char *queue_name)
+{
+    if(!queue_name)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    courier_writer_cache_evict(queue_name);
+
+    return platform_queue_unlink(queue_name);
+}
+
+// Unregister the mailboxes and close & unlink the queues of the first count definitions
+static void actor_queues_close(CourierActor *actor, size_t count)
+{
+    // Queues of a worker pool outlive its actors
+    for(size_t i = 0; (i < count) && !actor->rt->shared; i++)
+    {
+        if(actor->rt->mboxes[i])
+        {
+            courier_mailbox_unregister(actor->rt->mboxes[i]);
+            actor->rt->mboxes[i] = NULL;
+        }
+        courier_queue_close(actor->msgs[i].mq);
+        courier_queue_unlink(actor->msgs[i].queue_name);
+    }
+}
+
+courrier_mq_t courier_def_open_reader(CourierActorMsgDef *def)
+{
+    courrier_mq_t mq = courier_queue_open_reader(def->queue_name, courier_def_queue_size(def), def->depth ? def->depth : COURIER_QUEUE_DEPTH_DEFAULT);
+
+    if((mq != (courrier_mq_t)-1) && def->depth)
+    {
+        // Report the depth obtained, which system limits may have lowered
+        const long capacity = platform_queue_capacity(mq);
+        def->depth          = (capacity > 0) ? capacity : def->depth;
+    }
+
+    return mq;
+}
+
+int courier_actor_msgs_check(CourierActorMsgDef *msgs, size_t nb_msgs)
+{
+    for(size_t i = 0; i < nb_msgs; i++)
+    {
+        if(!msgs[i].handler && !msgs[i].batch_handler && !msgs[i].types)
+        {
+            errno = EINVAL;
 
-                // Optional size check
-                if((size_t)r != sz)
+            return -1;
+        }
+
+        if(msgs[i].types)
+        {
+            // A channel's queue is sized for its largest envelope
+            size_t largest = 0;
+
+            for(size_t t = 0; t < msgs[i].nb_types; t++)
+            {
+                const CourierMsgType *type = &msgs[i].types[t];
+
+                if(!type->handler || (type->msg_size == 0) || (type->msg_size > COURIER_MAX_MSG_SIZE - COURIER_ENVELOPE_HDR))
                 {
-                    fprintf(stderr, "[Courier %s] Warn: received %zd bytes on %s (expected %zu)\n", actor->name, r, actor->msgs[i].queue_name, sz);
+                    errno = (type->msg_size > COURIER_MAX_MSG_SIZE - COURIER_ENVELOPE_HDR) ? EMSGSIZE : EINVAL;
+
+                    return -1;
                 }
-                // Dispatch
-                actor->msgs[i].handler(actor->user_data, buf);
+                largest = (type->msg_size > largest) ? type->msg_size : largest;
             }
+
+            if((msgs[i].nb_types == 0) || msgs[i].batch_handler)
+            {
+                errno = EINVAL;
+
+                return -1;
+            }
+            msgs[i].msg_size = COURIER_ENVELOPE_HDR + largest;
+        }
+
+        if(msgs[i].msg_size > COURIER_MAX_BLOB_SIZE)
+        {
+            errno = EMSGSIZE;
+
+            return -1;
+        }
+
+        // Large messages are dispatched one mapping at a time, and envelopes fit a message
+        if(def_is_blob(&msgs[i]) && (msgs[i].batch_handler || msgs[i].envelopes))
+        {
+            errno = EINVAL;
+
+            return -1;
+        }
+
+        if((msgs[i].depth < 0) || (msgs[i].depth > COURIER_QUEUE_DEPTH_MAX) || (msgs[i].depth_max < 0) ||
+           (msgs[i].depth_max && (msgs[i].depth_max < msgs[i].depth)))
+        {
+            errno = EINVAL;
+
+            return -1;
+        }
+
+        // Conflation keeps plain messages of one kind, keyed within the payload
+        if(msgs[i].conflate &&
+           (def_is_channel(&msgs[i]) || def_is_blob(&msgs[i]) || (msgs[i].conflate > (size_t)COURIER_QUEUE_DEPTH_MAX) ||
+            ((msgs[i].conflate > 1) &&
+             ((msgs[i].key_size == 0) || (msgs[i].key_size > sizeof(uint64_t)) || (msgs[i].key_offset + msgs[i].key_size > msgs[i].msg_size)))))
+        {
+            errno = EINVAL;
+
+            return -1;
         }
     }
 
-    return NULL;
+    return 0;
 }
 
-int courier_actor_init(CourierActor *actor, const char *name, CourierActorMsgDef *msgs, size_t nb_msgs, void *user_data)
+// Run an actor whose queues are open: its own thread, or the M:N scheduler.
+// On failure its queues are closed and its runtime freed.
+static int actor_start(CourierActor *actor)
+{
+    int rc = actor_epoll_create(actor);
+
+    if((rc == 0) && courier_scheduler_running())
+    {
+        // M:N mode: the worker pool multiplexes the actor, no thread of its own
+        rc = courier_scheduler_attach(actor);
+
+        if(rc != 0)
+        {
+            close(actor->epfd);
+        }
+    }
+    else if(rc == 0)
+    {
+        rc = pthread_create(&actor->thread, NULL, actor_loop, actor);
+
+        if(rc != 0)
+        {
+            perror("pthread_create");
+            close(actor->epfd);
+        }
+    }
+
+    if(rc != 0)
+    {
+        actor_queues_close(actor, actor->nb_msgs);
+        actor_runtime_destroy(actor->rt, actor->nb_msgs);
+        actor->rt = NULL;
+
+        return -1;
+    }
+
+    return 0;
+}
+
+// In-process mailbox of a definition. A conflating definition always has one,
+// unregistered without COURIER_INPROC, to conflate its platform queue into.
+static CourierMailbox* actor_mailbox_create(const CourierActorMsgDef *def)
+{
+    if(def->conflate)
+    {
+        return courier_mailbox_create_conflating(COURIER_INPROC ? def->queue_name : NULL, def->msg_size, def->conflate, def->key_offset, def->key_size);
+    }
+
+    return COURIER_INPROC ? courier_mailbox_create(def->queue_name, courier_def_queue_size(def), (size_t)def->depth, (size_t)def->depth_max) : NULL;
+}
+
+// Fill in a new actor and allocate its runtime, queues not opened yet
+static int actor_prepare(CourierActor *actor, const char *name, CourierActorMsgDef *msgs, size_t nb_msgs, void *user_data)
 {
     if(!actor || !name || !msgs || (nb_msgs == 0))
     {
@@ -87,56 +1575,194 @@ int courier_actor_init(CourierActor *actor, const char *name, CourierActorMsgDef
     actor->nb_msgs   = nb_msgs;
     actor->user_data = user_data;
 
+    if(courier_actor_msgs_check(msgs, nb_msgs) < 0)
+    {
+        return -1;
+    }
+    actor->rt = actor_runtime_create(msgs, nb_msgs);
+
+    if(!actor->rt)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+int courier_actor_init(CourierActor *actor, const char *name, CourierActorMsgDef *msgs, size_t nb_msgs, void *user_data)
+{
+    if(actor_prepare(actor, name, msgs, nb_msgs, user_data) < 0)
+    {
+        return -1;
+    }
+
     // Open all queues for reading synchronously *before* starting thread to avoid races
     for(size_t i = 0; i < nb_msgs; i++)
     {
-        courrier_mq_t mq = courier_queue_open_reader(msgs[i].queue_name, msgs[i].msg_size, 10);
+        // Registered first: opening the reader evicts cached writers, so
+        // in-process senders resolve to the mailbox from then on
+        CourierActorMsgDef *def = &msgs[i];
+        actor->rt->mboxes[i]    = actor_mailbox_create(def);
+        courrier_mq_t mq        = courier_def_open_reader(def);
 
         if(mq == (courrier_mq_t)-1)
         {
             // Cleanup previously opened
-            for(size_t j = 0; j < i; j++)
+            if(actor->rt->mboxes[i])
             {
-                courier_queue_close(msgs[j].mq);
-                courier_queue_unlink(msgs[j].queue_name);
+                courier_mailbox_unregister(actor->rt->mboxes[i]);
+                actor->rt->mboxes[i] = NULL;
             }
+            actor_queues_close(actor, i);
+            actor_runtime_destroy(actor->rt, actor->nb_msgs);
+            actor->rt = NULL;
 
             return -1;
         }
         msgs[i].mq = mq;
     }
 
-    int rc = pthread_create(&actor->thread, NULL, actor_loop, actor);
+    return actor_start(actor);
+}
 
-    if(rc != 0)
+int courier_actor_init_shared(CourierActor *actor, const char *name, CourierActorMsgDef *msgs, size_t nb_msgs, void *user_data,
+                              CourierMailbox *const *mboxes)
+{
+    if(actor_prepare(actor, name, msgs, nb_msgs, user_data) < 0)
     {
-        perror("pthread_create");
+        return -1;
+    }
+    actor->rt->shared = 1;
 
-        for(size_t i = 0; i < nb_msgs; i++)
-        {
-            courier_queue_close(msgs[i].mq);
-            courier_queue_unlink(msgs[i].queue_name);
-        }
+    for(size_t i = 0; i < nb_msgs; i++)
+    {
+        actor->rt->mboxes[i] = mboxes ? mboxes[i] : NULL;
+    }
+
+    return actor_start(actor);
+}
+
+int courier_actor_add_fd(CourierActor *actor, int fd, uint32_t events, CourierFdHandler handler)
+{
+    if(!actor || !actor->rt || (fd < 0) || !handler)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    struct CourierActorRuntime *rt = actor->rt;
+    CourierFdSource *src           = calloc(1, sizeof(*src));
+
+    if(!src)
+    {
+        return -1;
+    }
+    src->fd      = fd;
+    src->handler = handler;
+
+    struct epoll_event ev = { .events = events, .data.u64 = COURIER_EV_FD | (uint64_t)(uintptr_t)src };
+
+    pthread_mutex_lock(&rt->fd_lock);
+
+    if(epoll_ctl(actor->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        pthread_mutex_unlock(&rt->fd_lock);
+        free(src);
 
         return -1;
     }
+    src->next      = rt->fd_sources;
+    rt->fd_sources = src;
+    pthread_mutex_unlock(&rt->fd_lock);
 
     return 0;
 }
 
-void courier_actor_close(CourierActor *actor)
+int courier_actor_remove_fd(CourierActor *actor, int fd)
 {
-    if(!actor)
+    if(!actor || !actor->rt)
     {
-        return;
+        errno = EINVAL;
+
+        return -1;
     }
-    // Stop the thread the simple way for now
-    pthread_cancel(actor->thread);
-    pthread_join(actor->thread, NULL);
+    struct CourierActorRuntime *rt = actor->rt;
 
-    for(size_t i = 0; i < actor->nb_msgs; i++)
+    pthread_mutex_lock(&rt->fd_lock);
+
+    for(CourierFdSource **it = &rt->fd_sources; *it; it = &(*it)->next)
     {
-        courier_queue_close(actor->msgs[i].mq);
-        courier_queue_unlink(actor->msgs[i].queue_name);
+        CourierFdSource *src = *it;
+
+        if(src->fd != fd)
+        {
+            continue;
+        }
+        *it = src->next;
+        atomic_store_explicit(&src->removed, 1, memory_order_release);
+
+        if(epoll_ctl(actor->epfd, EPOLL_CTL_DEL, fd, NULL) < 0 && (errno != EBADF))
+        {
+            perror("epoll_ctl(remove fd)");
+        }
+
+        // Events for it may still sit in the actor's current batch
+        src->next      = rt->fd_retired;
+        rt->fd_retired = src;
+        atomic_store_explicit(&rt->has_retired, 1, memory_order_release);
+        pthread_mutex_unlock(&rt->fd_lock);
+
+        return 0;
+    }
+    pthread_mutex_unlock(&rt->fd_lock);
+    errno = ENOENT;
+
+    return -1;
+}
+
+int courier_actor_close_drain(CourierActor *actor, int deadline_ms, CourierCloseStats *stats)
+{
+    if(!actor || !actor->rt)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    struct CourierActorRuntime *rt = actor->rt;
+
+    rt->close_deadline_ns = (deadline_ms < 0) ? UINT64_MAX : courier_now_ns() + (uint64_t)deadline_ms * 1000000ull;
+    atomic_store_explicit(&rt->closing, 1, memory_order_release);
+
+    // Stop signal: wakes the actor through its epoll set
+    const uint64_t one = 1;
+
+    if(write(rt->ctl_fd, &one, sizeof(one)) < 0)
+    {
+        perror("write(ctl_fd)");
+    }
+
+    if(rt->scheduled)
+    {
+        courier_scheduler_detach(actor);
+    }
+    else
+    {
+        pthread_join(actor->thread, NULL);
+    }
+    close(actor->epfd);
+    actor_queues_close(actor, actor->nb_msgs);
+
+    if(stats)
+    {
+        *stats = rt->close_stats;
     }
+    actor_runtime_destroy(rt, actor->nb_msgs);
+    actor->rt = NULL;
+
+    return 0;
+}
+
+void courier_actor_close(CourierActor *actor)
+{
+    courier_actor_close_drain(actor, 0, NULL);
 }
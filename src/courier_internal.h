@@ -0,0 +1,318 @@
+// =============================
+// File: src/courier_internal.h
+// =============================
+#ifndef COURIER_INTERNAL_H
+#define COURIER_INTERNAL_H
+
+#include "courier.h"
+#include <semaphore.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// In-process mailboxes for actors reachable by queue name (0 = always use the platform queue)
+#ifndef COURIER_INPROC
+#define COURIER_INPROC 1
+#endif /* ifndef COURIER_INPROC */
+
+// Platform queue depth of definitions that leave it at 0, and the largest
+// depth accepted (in-process mailboxes included)
+#ifndef COURIER_QUEUE_DEPTH_DEFAULT
+#define COURIER_QUEUE_DEPTH_DEFAULT 10
+#endif /* ifndef COURIER_QUEUE_DEPTH_DEFAULT */
+
+#ifndef COURIER_QUEUE_DEPTH_MAX
+#define COURIER_QUEUE_DEPTH_MAX (1L << 20)
+#endif /* ifndef COURIER_QUEUE_DEPTH_MAX */
+
+// Deadline of a send that waits as long as the queue stays full
+#define COURIER_NO_DEADLINE UINT64_MAX
+
+// ----- Pooled message slots (msg_pool.c) -----
+typedef struct CourierMsgSlot CourierMsgSlot;
+
+struct CourierMsgSlot
+{
+    CourierMsgSlot *next;        // free list link
+    struct CourierMsgPool *pool; // thread pool the slot returns to
+    _Atomic uint32_t refs;
+    uint32_t size;
+    unsigned prio;
+    uint64_t sent_ns;            // COURIER_STATS builds only
+    alignas(max_align_t) unsigned char payload[COURIER_MAX_MSG_SIZE];
+};
+
+// Allocate from the calling thread's pool (one reference held). NULL on error.
+CourierMsgSlot* courier_slot_alloc(void);
+
+// Drop a reference; the last one recycles the slot to its pool. Any thread.
+void courier_slot_release(CourierMsgSlot *slot);
+
+// Slot of a payload returned by courier_msg_alloc
+CourierMsgSlot* courier_msg_slot(void *msg);
+
+// ----- In-process mailboxes (mailbox.c) -----
+typedef struct CourierMailbox CourierMailbox;
+
+// Create and register the mailbox of an in-process reader, holding depth
+// messages (0 = default), grown up to depth_max under bursts when larger.
+// NULL on error (errno EEXIST when another reader of this process already
+// owns the name). A NULL queue_name leaves it out of the registry.
+CourierMailbox* courier_mailbox_create(const char *queue_name, size_t msg_size, size_t depth, size_t depth_max);
+
+// Create and register a conflating mailbox: a send replaces the message
+// still pending for its key (nb_keys == 1: for the whole queue; otherwise
+// the key is the key_size bytes, at most 8, at key_offset), and never waits.
+// Room for at least nb_keys keys; sends of a new key past that fail with
+// errno ENOSPC. NULL queue_name: not registered.
+CourierMailbox* courier_mailbox_create_conflating(const char *queue_name, size_t msg_size, size_t nb_keys, size_t key_offset, size_t key_size);
+
+// Register a worker pool's front under queue_name: sends go to the less
+// loaded of two members, each holding a reference it takes here. Nothing
+// pops from the front itself.
+CourierMailbox* courier_mailbox_create_pool(const char *queue_name, CourierMailbox *const *members, size_t nb_members);
+
+// Remove from the registry, fail pending and future sends, drop the reader's reference.
+void courier_mailbox_unregister(CourierMailbox *mb);
+
+// Find a registered mailbox, with a reference the caller must release.
+CourierMailbox* courier_mailbox_lookup(const char *queue_name);
+void courier_mailbox_release(CourierMailbox *mb);
+
+// Copy msg into a pooled slot and enqueue it; waits while the mailbox is full,
+// up to deadline_ns (courier_now_ns), then fails with errno EAGAIN.
+int courier_mailbox_send(CourierMailbox *mb, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns);
+
+// Enqueue a slot, handing over one reference (kept by the caller on error).
+// Waits for room like courier_mailbox_send.
+int courier_mailbox_push(CourierMailbox *mb, CourierMsgSlot *slot, uint64_t deadline_ns);
+
+// Consumer only: next slot (reference passed to the caller) or NULL and errno
+// EAGAIN when empty, in which case wake_fd is armed for the next send.
+CourierMsgSlot* courier_mailbox_pop(CourierMailbox *mb);
+int courier_mailbox_fd(const CourierMailbox *mb);
+
+// Messages queued, from any thread (approximate while sends are in flight).
+long courier_mailbox_depth(const CourierMailbox *mb);
+
+// Current ring size, from any thread.
+long courier_mailbox_capacity(const CourierMailbox *mb);
+
+// ----- Queue watermarks (backpressure.c) -----
+// One per queue name with registered watermarks; never freed, so writers and
+// actors can keep the pointer.
+typedef struct CourierWatermark CourierWatermark;
+
+// Watermarks of queue_name, or NULL when none were ever registered.
+CourierWatermark* courier_watermark_lookup(const char *queue_name);
+
+// Bumped by every registration: cached lookups are stale when it changes.
+unsigned courier_watermark_generation(void);
+
+// Compare a depth sample with the marks and run the handler on a crossing
+// (high when reaching it, low when falling back to it). Any thread.
+void courier_watermark_check(CourierWatermark *wm, long depth);
+
+// Handler set and above the high mark: the reader should report the way down.
+int courier_watermark_above(const CourierWatermark *wm);
+
+// ----- Large messages (blob.c) -----
+// Definitions with msg_size above COURIER_MAX_MSG_SIZE carry a handle to a
+// shared memory object instead of the payload.
+#ifndef COURIER_MAX_BLOB_SIZE
+#define COURIER_MAX_BLOB_SIZE (64u << 20)
+#endif /* ifndef COURIER_MAX_BLOB_SIZE */
+
+#define COURIER_BLOB_NAME_MAX 48
+
+typedef struct
+{
+    uint64_t size;                    // payload bytes
+    char name[COURIER_BLOB_NAME_MAX]; // shm object holding them
+} CourierBlobHandle;
+
+// Sender: describe a blob from courier_blob_alloc, then unmap it once the
+// handle was sent (sent = 0 also unlinks it).
+void courier_blob_handle(void *blob, CourierBlobHandle *handle);
+void courier_blob_detach(void *blob, int sent);
+
+// Reader: map the payload of a received handle (unlinking the object), zero
+// padded to msg_size. NULL on error. courier_blob_close unmaps it.
+void* courier_blob_open(const CourierBlobHandle *handle, size_t msg_size);
+void courier_blob_close(void *blob, size_t msg_size);
+
+// Reader: drop a handle that will not be dispatched.
+void courier_blob_discard(const CourierBlobHandle *handle);
+
+// ----- Multiplexed channels (courier.c) -----
+_Static_assert(sizeof(CourierEnvelope) <= COURIER_ENVELOPE_HDR, "envelope does not fit its header");
+
+// Dispatch table of a channel: handlers indexed by type id
+typedef struct
+{
+    const CourierMsgType **by_type;
+    size_t nb;                      // largest type id + 1
+} CourierTypeTable;
+
+// ----- Writer descriptor cache (writer_cache.c) -----
+#define COURIER_WRITER_UNCACHED (-2)
+
+// Where courier_send_to delivers: the in-process mailbox of the reader when
+// it lives in this process, the platform queue otherwise.
+typedef struct
+{
+    courrier_mq_t mq;
+    CourierMailbox *mbox;
+    CourierWatermark *wm; // watermarks of the queue, or NULL
+} CourierWriter;
+
+// Get a writer for queue_name, opening and caching it on first use.
+// Returns a slot >= 0 holding a reference, COURIER_WRITER_UNCACHED when the
+// writer could not be cached (the caller still gets a usable *w), or -1
+// on error. Always pair a non-error result with courier_writer_cache_release.
+int courier_writer_cache_acquire(const char *queue_name, size_t msg_size, CourierWriter *w);
+void courier_writer_cache_release(int slot, CourierWriter *w);
+
+// Drop the cached descriptor for queue_name (closed once no sender uses it).
+void courier_writer_cache_evict(const char *queue_name);
+
+// 1 when w, acquired for queue_name, is a platform queue that has since been
+// unlinked or recreated by its reader; slot is then evicted, so the next
+// acquire opens the current queue. 0 otherwise.
+int courier_writer_cache_stale(int slot, const char *queue_name, const CourierWriter *w);
+
+#ifndef COURIER_WRITER_CHECK_MS
+#define COURIER_WRITER_CHECK_MS 100 // a sender waiting on a full platform queue checks it this often
+#endif /* ifndef COURIER_WRITER_CHECK_MS */
+
+// Send through a writer (courier.c), reporting watermark crossings.
+int courier_writer_send(const CourierWriter *w, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns);
+
+// ----- Latency instrumentation (stats.c) -----
+#ifdef COURIER_STATS
+// Every message travels behind its send timestamp (courier_now_ns)
+#define COURIER_WIRE_HDR sizeof(uint64_t)
+#else
+#define COURIER_WIRE_HDR 0
+#endif // ifdef COURIER_STATS
+
+typedef struct
+{
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t min_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint64_t buckets[COURIER_HIST_BUCKETS];
+} CourierHistogramRt;
+
+typedef struct
+{
+    CourierHistogramRt queue_wait;
+    CourierHistogramRt handler;
+} CourierMsgStatsRt;
+
+// Lock-free and allocation-free: safe from any thread, concurrently with snapshots.
+void courier_histogram_record(CourierHistogramRt *hist, uint64_t value_ns);
+
+// ----- Actor runtime (courier.c) -----
+typedef struct CourierReplyChannel CourierReplyChannel;
+
+// Tag of the control eventfd in an actor's epoll set (queues use their index,
+// fd sources their address with COURIER_EV_FD set).
+#define COURIER_EV_CONTROL UINT64_MAX
+#define COURIER_EV_FD      ((uint64_t)1 << 63)
+
+// A raw descriptor watched by an actor (courier_actor_add_fd)
+typedef struct CourierFdSource
+{
+    struct CourierFdSource *next;
+    int fd;
+    _Atomic int removed;       // set by courier_actor_remove_fd: skip pending events
+    CourierFdHandler handler;
+} CourierFdSource;
+
+struct CourierActorRuntime
+{
+    int ctl_fd;          // eventfd in actor->epfd, written to request a close
+    int scheduled;       // driven by scheduler workers instead of its own thread
+    _Atomic int closing; // close requested by courier_actor_close
+    int draining;        // actor_shutdown in progress: dispatch past the close request
+    int stopped;         // shutdown ran on the actor's thread: stop polling
+    uint64_t close_deadline_ns;    // drain queued messages until then (courier_now_ns)
+    CourierCloseStats close_stats; // filled by the shutdown, returned by close_drain
+    size_t dispatched;   // messages handed to handlers so far
+    sem_t detached;      // posted by the worker that removed the actor from the pool
+    char **batch_bufs;   // per msg def: batch_max * msg_size array (batch handlers only)
+    int prioritized;     // msg defs have different priorities: use the priority policy
+    size_t *ready;       // msg def indices with undrained messages
+    char *is_ready;      // per msg def: listed in ready[]
+    size_t nb_ready;
+    CourierMsgStatsRt *stats; // per msg def (COURIER_STATS builds only)
+    CourierMailbox **mboxes;  // per msg def: in-process mailbox, or NULL
+    CourierWatermark **wms;   // per msg def: queue watermarks, or NULL
+    CourierTypeTable *types;  // per msg def: dispatch table of a multiplexed channel
+    size_t nb_wms;            // non-NULL entries of wms
+    unsigned wm_generation;   // courier_watermark_generation() when wms was filled
+    pthread_mutex_t fd_lock;       // guards the two lists below
+    CourierFdSource *fd_sources;   // registered descriptors
+    CourierFdSource *fd_retired;   // removed, freed by the actor between polls
+    _Atomic int has_retired;
+    CourierReplyChannel *replies; // created by the actor's first ask
+    int shared;                   // queues and mailboxes belong to a worker pool
+};
+
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t courier_now_ns(void);
+
+// Wait up to timeout_ms for ready queues of the actor and dispatch them.
+// Returns the number of ready events handled, or -1 on error. Once a close
+// was requested, also runs the actor's shutdown and sets rt->stopped.
+int courier_actor_poll(CourierActor *actor, int timeout_ms);
+
+// Validate the definitions of a new actor, sizing multiplexed channels.
+// -1 with errno EINVAL or EMSGSIZE.
+int courier_actor_msgs_check(CourierActorMsgDef *msgs, size_t nb_msgs);
+
+// Bytes per message on a definition's queue and mailbox
+size_t courier_def_queue_size(const CourierActorMsgDef *def);
+
+// Open the platform queue of a definition for reading, updating def->depth
+// to the depth obtained.
+courrier_mq_t courier_def_open_reader(CourierActorMsgDef *def);
+
+// Start a pool worker over queues opened by the pool: msgs[i].mq is a reader
+// shared with other workers, or -1 when another worker reads the platform
+// queue, and mboxes[i] (NULL = none) the worker's private mailbox. Closing
+// the actor leaves both to the pool.
+int courier_actor_init_shared(CourierActor *actor, const char *name, CourierActorMsgDef *msgs, size_t nb_msgs, void *user_data,
+                              CourierMailbox *const *mboxes);
+
+// Actor whose handlers run on this thread, or NULL.
+CourierActor* courier_current_actor(void);
+
+// ----- Request/reply (ask.c) -----
+// Outstanding asks per reply channel (a power of two)
+#ifndef COURIER_ASK_PENDING_MAX
+#define COURIER_ASK_PENDING_MAX 64
+#endif /* ifndef COURIER_ASK_PENDING_MAX */
+
+// Drop the pending asks, cancel their timers and remove the channel.
+void courier_reply_channel_destroy(CourierReplyChannel *ch);
+
+// ----- Timers (timer.c) -----
+// Timer wheel descriptor (created on first call), readable when timers are due.
+int courier_timer_fd(void);
+
+// Advance the wheel and send what is due. Safe from several threads at once.
+void courier_timers_run(void);
+
+// Make sure pending timers still have a driver (the scheduler is gone).
+void courier_timers_kick(void);
+
+// ----- Scheduler (scheduler.c) -----
+int courier_scheduler_running(void);
+int courier_scheduler_attach(CourierActor *actor);
+void courier_scheduler_detach(CourierActor *actor);
+
+#endif // ifndef COURIER_INTERNAL_H
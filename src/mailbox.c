@@ -0,0 +1,1066 @@
+// =============================
+// File: src/mailbox.c
+// =============================
+#include "courier_internal.h"
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+// In-process mailboxes: when an actor's reader lives in the sending process,
+// courier_send_to hands it a pooled slot through a bounded multi-producer /
+// single-consumer ring of slot pointers (sequence-numbered cells, so senders
+// never lock). The payload is copied once into the slot and the handler runs
+// on the slot itself. As with the shm backend, senders only touch the kernel
+// to wake a consumer parked on its eventfd, or to sleep on a futex while the
+// ring is full.
+//
+// Mailboxes are found by queue name in a process-wide registry. Only the
+// writer cache looks them up, on a miss, so a mutex is enough there.
+//
+// A worker pool registers a front mailbox under its queue name instead: it
+// has no ring of its own and hands each send to the less loaded of two of
+// its members, the private mailboxes of the pool's workers (power of two
+// choices: two depth reads per send, whatever the number of workers). A send
+// still commits to a member whose worker may be stuck in a long handler, so
+// a worker that finds its own ring empty takes the oldest message of a
+// sibling's instead: members pop under a consumer lock, which only their
+// owner and such thieves take, and a send to a member that is not parked
+// wakes a parked sibling to come and steal it.
+//
+// An adaptive mailbox grows its ring when the consumer sees it fill up past
+// three quarters. Positions are global and cells count from their ring's
+// base, so the consumer prepares a ring twice as large, seals the current
+// one (no more claims past its final head), starts the new one there and
+// drains the old one before moving over. Producers that find a sealed ring
+// follow it to its successor. Replaced rings are only freed with the
+// mailbox, as a producer may still be reading one; growth doubles, so they
+// add up to less than the largest ring.
+//
+// A conflating mailbox keeps only the latest message: one slot per key (a
+// single one when conflating per queue) that a send swaps its message into,
+// releasing the one it replaces. A send that fills an empty slot also sets
+// the slot's bit in a dirty bitmap, which the consumer takes whole once per
+// wakeup, so a wakeup hands it at most one message per key and memory stays
+// that of the slots whatever the send rate. Keys are claimed in an
+// open-addressing table that never shrinks.
+
+#ifndef COURIER_MAILBOX_DEPTH
+#define COURIER_MAILBOX_DEPTH 256 // default ring size, must be a power of two
+#endif /* ifndef COURIER_MAILBOX_DEPTH */
+
+#define MAILBOX_CACHE_LINE 64
+#define MAILBOX_NAME_MAX   64
+#define RING_SEALED        ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+typedef struct
+{
+    _Atomic size_t seq;
+    CourierMsgSlot *slot;
+} MailboxCell;
+
+// Latest message of a key in a conflating mailbox
+typedef struct
+{
+    _Atomic uint32_t state;         // CONFLATE_FREE, CONFLATE_CLAIMING or CONFLATE_SET
+    uint64_t key;                   // stable once CONFLATE_SET
+    _Atomic(CourierMsgSlot *) slot; // not taken by the consumer yet, or NULL
+} ConflateEntry;
+
+enum
+{
+    CONFLATE_FREE = 0,
+    CONFLATE_CLAIMING,
+    CONFLATE_SET,
+};
+
+typedef struct MailboxRing
+{
+    _Atomic size_t head;                // next position to claim, RING_SEALED once replaced
+    _Atomic(struct MailboxRing *) next; // successor, published right after sealing
+    struct MailboxRing *older;          // ring this one replaced
+    size_t base;                        // position of the first cell
+    size_t mask;
+    alignas(MAILBOX_CACHE_LINE) MailboxCell cells[];
+} MailboxRing;
+
+struct CourierMailbox
+{
+    char name[MAILBOX_NAME_MAX];
+    size_t msg_size;
+    size_t depth_max;        // adaptive growth bound (ring size when fixed)
+    int wake_fd;
+    _Atomic uint32_t refs;   // registry + cached writers
+    _Atomic int closed;      // reader gone: sends fail with EPIPE
+    struct CourierMailbox *next; // registry chain
+    _Atomic(MailboxRing *) ring; // where sends go
+    struct CourierMailbox **members; // pool front: mailboxes sends are spread over
+    size_t nb_members;
+    _Atomic uint32_t pick;           // pool front: rotating first choice
+    ConflateEntry *entries;          // conflating: latest message per key, instead of a ring
+    size_t nb_entries;               // a power of two (1 = conflating per queue)
+    _Atomic uint64_t *dirty;         // conflating: bit per entry whose slot was filled
+    size_t key_offset;
+    size_t key_size;
+    _Atomic long pending;            // conflating: filled slots
+    struct CourierMailbox **siblings; // pool member: every member of its pool, itself included
+    size_t nb_siblings;
+    size_t member_index;
+
+    // Consumer side (tail is only read elsewhere for depth estimates)
+    alignas(MAILBOX_CACHE_LINE) _Atomic size_t tail;
+    _Atomic uint32_t pop_lock; // pool member: held by whoever pops, owner or thief
+    MailboxRing *draining; // ring the consumer pops from
+    uint64_t *snapshot;    // conflating: dirty bits taken at the start of this wakeup, left to deliver
+    size_t snap_word;      // first snapshot word that may still hold bits
+    int snapped;           // conflating: this wakeup took its snapshot
+
+    // Wakeup state, kept away from the indices
+    alignas(MAILBOX_CACHE_LINE) _Atomic uint32_t parked; // consumer sleeps on wake_fd
+    _Atomic uint32_t space_waiters;                      // producers sleeping on space_seq
+    _Atomic uint32_t space_seq;                          // futex word bumped on pop
+};
+
+static CourierMailbox *registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int futex_wait(_Atomic uint32_t *addr, uint32_t expected, const struct timespec *timeout)
+{
+    return (int)syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+}
+
+static int futex_wake(_Atomic uint32_t *addr)
+{
+    return (int)syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static size_t round_pow2(size_t n)
+{
+    size_t p = 2;
+
+    while(p < n)
+    {
+        p <<= 1;
+    }
+
+    return p;
+}
+
+// A ring of size cells, starting at position base once published
+static MailboxRing* ring_create(size_t size, size_t base)
+{
+    const size_t bytes = sizeof(MailboxRing) + size * sizeof(MailboxCell);
+    MailboxRing *ring  = aligned_alloc(MAILBOX_CACHE_LINE, (bytes + MAILBOX_CACHE_LINE - 1) & ~(size_t)(MAILBOX_CACHE_LINE - 1));
+
+    if(!ring)
+    {
+        return NULL;
+    }
+    ring->base  = base;
+    ring->mask  = size - 1;
+    ring->older = NULL;
+    atomic_init(&ring->head, base);
+    atomic_init(&ring->next, NULL);
+
+    for(size_t i = 0; i < size; i++)
+    {
+        atomic_init(&ring->cells[i].seq, i);
+    }
+
+    return ring;
+}
+
+static CourierMsgSlot* ring_take(CourierMailbox *mb);
+
+static void mailbox_destroy(CourierMailbox *mb)
+{
+    if(mb->members)
+    {
+        for(size_t i = 0; i < mb->nb_members; i++)
+        {
+            courier_mailbox_release(mb->members[i]);
+        }
+        free(mb->members);
+        free(mb);
+
+        return;
+    }
+    if(mb->entries)
+    {
+        for(size_t i = 0; i < mb->nb_entries; i++)
+        {
+            CourierMsgSlot *latest = atomic_load(&mb->entries[i].slot);
+
+            if(latest)
+            {
+                courier_slot_release(latest);
+            }
+        }
+        close(mb->wake_fd);
+        free(mb->entries);
+        free(mb->dirty);
+        free(mb->snapshot);
+        free(mb);
+
+        return;
+    }
+    // Release whatever was sent after the reader stopped draining (siblings
+    // may be gone already: no stealing here)
+    CourierMsgSlot *slot;
+
+    while((slot = ring_take(mb)) != NULL)
+    {
+        courier_slot_release(slot);
+    }
+    close(mb->wake_fd);
+    free(mb->siblings);
+
+    for(MailboxRing *ring = atomic_load(&mb->ring), *older; ring; ring = older)
+    {
+        older = ring->older;
+        free(ring);
+    }
+    free(mb);
+}
+
+// Consumer: replace a ring that filled up by one twice as large
+static void mailbox_grow(CourierMailbox *mb, MailboxRing *ring)
+{
+    MailboxRing *bigger = ring_create((ring->mask + 1) * 2, 0);
+
+    if(!bigger)
+    {
+        return; // keep the current size
+    }
+    // From here on producers go after the successor (yielding until it is published)
+    const size_t final = atomic_fetch_or(&ring->head, RING_SEALED);
+
+    bigger->base  = final;
+    bigger->older = ring;
+    atomic_store_explicit(&bigger->head, final, memory_order_relaxed);
+    atomic_store_explicit(&ring->next, bigger, memory_order_release);
+    atomic_store_explicit(&mb->ring, bigger, memory_order_release);
+
+    // Producers waiting for room retry in the new ring
+    atomic_fetch_add(&mb->space_seq, 1);
+    futex_wake(&mb->space_seq);
+}
+
+// ----- Registry -----
+// Add mb to the registry under its name. -1 with errno EEXIST (and mb
+// destroyed) when the name is taken.
+static int mailbox_register(CourierMailbox *mb)
+{
+    pthread_mutex_lock(&registry_lock);
+
+    for(CourierMailbox *it = registry; it; it = it->next)
+    {
+        if(strcmp(it->name, mb->name) == 0)
+        {
+            // One reader per queue in a process: the second one keeps to the platform queue
+            pthread_mutex_unlock(&registry_lock);
+            mailbox_destroy(mb);
+            errno = EEXIST;
+
+            return -1;
+        }
+    }
+    mb->next = registry;
+    registry = mb;
+    pthread_mutex_unlock(&registry_lock);
+
+    return 0;
+}
+
+static CourierMailbox* mailbox_alloc(void)
+{
+    CourierMailbox *mb = aligned_alloc(MAILBOX_CACHE_LINE, (sizeof(*mb) + MAILBOX_CACHE_LINE - 1) & ~(size_t)(MAILBOX_CACHE_LINE - 1));
+
+    if(mb)
+    {
+        memset(mb, 0, sizeof(*mb));
+    }
+
+    return mb;
+}
+
+CourierMailbox* courier_mailbox_create(const char *queue_name, size_t msg_size, size_t depth, size_t depth_max)
+{
+    if((queue_name && (strlen(queue_name) >= MAILBOX_NAME_MAX)) || (msg_size == 0) || (msg_size > COURIER_MAX_MSG_SIZE) ||
+       (depth > (size_t)COURIER_QUEUE_DEPTH_MAX))
+    {
+        errno = EINVAL;
+
+        return NULL;
+    }
+    CourierMailbox *mb = mailbox_alloc();
+
+    if(!mb)
+    {
+        return NULL;
+    }
+    const size_t size     = round_pow2(depth ? depth : COURIER_MAILBOX_DEPTH);
+    const size_t grown    = (depth_max < (size_t)COURIER_QUEUE_DEPTH_MAX) ? depth_max : (size_t)COURIER_QUEUE_DEPTH_MAX;
+    strcpy(mb->name, queue_name ? queue_name : "");
+    mb->msg_size  = msg_size;
+    mb->depth_max = (grown > size) ? round_pow2(grown) : size;
+    mb->wake_fd   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    mb->draining  = ring_create(size, 0);
+
+    if((mb->wake_fd < 0) || !mb->draining)
+    {
+        if(mb->wake_fd >= 0)
+        {
+            close(mb->wake_fd);
+        }
+        free(mb->draining);
+        free(mb);
+
+        return NULL;
+    }
+    atomic_init(&mb->ring, mb->draining);
+    atomic_init(&mb->refs, 1);
+    atomic_init(&mb->parked, 1); // the reader has not polled yet: the first send wakes it
+
+    if(queue_name && (mailbox_register(mb) < 0))
+    {
+        return NULL;
+    }
+
+    return mb;
+}
+
+CourierMailbox* courier_mailbox_create_conflating(const char *queue_name, size_t msg_size, size_t nb_keys, size_t key_offset, size_t key_size)
+{
+    if((queue_name && (strlen(queue_name) >= MAILBOX_NAME_MAX)) || (msg_size == 0) || (msg_size > COURIER_MAX_MSG_SIZE) || (nb_keys == 0) ||
+       (nb_keys > (size_t)COURIER_QUEUE_DEPTH_MAX) || ((nb_keys > 1) && ((key_size == 0) || (key_size > sizeof(uint64_t)) || (key_offset + key_size > msg_size))))
+    {
+        errno = EINVAL;
+
+        return NULL;
+    }
+    CourierMailbox *mb = mailbox_alloc();
+
+    if(!mb)
+    {
+        return NULL;
+    }
+    // Twice the keys asked for, so that probe chains stay short
+    strcpy(mb->name, queue_name ? queue_name : "");
+    mb->msg_size   = msg_size;
+    mb->nb_entries = (nb_keys == 1) ? 1 : round_pow2(2 * nb_keys);
+    mb->key_offset = key_offset;
+    mb->key_size   = key_size;
+    mb->wake_fd    = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    mb->entries    = calloc(mb->nb_entries, sizeof(*mb->entries));
+    mb->dirty      = calloc((mb->nb_entries + 63) / 64, sizeof(*mb->dirty));
+    mb->snapshot   = calloc((mb->nb_entries + 63) / 64, sizeof(*mb->snapshot));
+
+    if((mb->wake_fd < 0) || !mb->entries || !mb->dirty || !mb->snapshot)
+    {
+        if(mb->wake_fd >= 0)
+        {
+            close(mb->wake_fd);
+        }
+        free(mb->entries);
+        free(mb->dirty);
+        free(mb->snapshot);
+        free(mb);
+
+        return NULL;
+    }
+    atomic_init(&mb->refs, 1);
+    atomic_init(&mb->parked, 1); // the reader has not polled yet: the first send wakes it
+
+    if(queue_name && (mailbox_register(mb) < 0))
+    {
+        return NULL;
+    }
+
+    return mb;
+}
+
+CourierMailbox* courier_mailbox_create_pool(const char *queue_name, CourierMailbox *const *members, size_t nb_members)
+{
+    if(!queue_name || (strlen(queue_name) >= MAILBOX_NAME_MAX) || !members || (nb_members == 0))
+    {
+        errno = EINVAL;
+
+        return NULL;
+    }
+    CourierMailbox *mb = mailbox_alloc();
+
+    if(!mb || !(mb->members = calloc(nb_members, sizeof(*mb->members))))
+    {
+        free(mb);
+
+        return NULL;
+    }
+    strcpy(mb->name, queue_name);
+    mb->msg_size   = members[0]->msg_size;
+    mb->wake_fd    = -1;
+    mb->nb_members = nb_members;
+    atomic_init(&mb->refs, 1);
+
+    for(size_t i = 0; i < nb_members; i++)
+    {
+        atomic_fetch_add_explicit(&members[i]->refs, 1, memory_order_relaxed);
+        mb->members[i] = members[i];
+    }
+
+    // Members outlive neither the pool nor each other's workers: plain pointers
+    for(size_t i = 0; (nb_members > 1) && (i < nb_members); i++)
+    {
+        CourierMailbox *member = members[i];
+
+        if(!member->siblings && !member->entries && !member->members &&
+           (member->siblings = malloc(nb_members * sizeof(*member->siblings))))
+        {
+            memcpy(member->siblings, members, nb_members * sizeof(*member->siblings));
+            member->nb_siblings  = nb_members;
+            member->member_index = i;
+        }
+    }
+
+    if(mailbox_register(mb) < 0)
+    {
+        return NULL;
+    }
+
+    return mb;
+}
+
+CourierMailbox* courier_mailbox_lookup(const char *queue_name)
+{
+    CourierMailbox *found = NULL;
+
+    pthread_mutex_lock(&registry_lock);
+
+    for(CourierMailbox *it = registry; it; it = it->next)
+    {
+        if(strcmp(it->name, queue_name) == 0)
+        {
+            atomic_fetch_add_explicit(&it->refs, 1, memory_order_relaxed);
+            found = it;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    return found;
+}
+
+void courier_mailbox_unregister(CourierMailbox *mb)
+{
+    pthread_mutex_lock(&registry_lock);
+
+    for(CourierMailbox **it = &registry; *it; it = &(*it)->next)
+    {
+        if(*it == mb)
+        {
+            *it = mb->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    // Senders blocked on a full ring give up
+    atomic_store(&mb->closed, 1);
+    atomic_fetch_add(&mb->space_seq, 1);
+    futex_wake(&mb->space_seq);
+    courier_mailbox_release(mb);
+}
+
+void courier_mailbox_release(CourierMailbox *mb)
+{
+    if(mb && (atomic_fetch_sub_explicit(&mb->refs, 1, memory_order_acq_rel) == 1))
+    {
+        mailbox_destroy(mb);
+    }
+}
+
+int courier_mailbox_fd(const CourierMailbox *mb)
+{
+    return mb->wake_fd;
+}
+
+long courier_mailbox_depth(const CourierMailbox *mb)
+{
+    if(mb->members)
+    {
+        long depth = 0;
+
+        for(size_t i = 0; i < mb->nb_members; i++)
+        {
+            depth += courier_mailbox_depth(mb->members[i]);
+        }
+
+        return depth;
+    }
+    if(mb->entries)
+    {
+        return atomic_load_explicit(&((CourierMailbox *)mb)->pending, memory_order_relaxed);
+    }
+    // Claimed cells, some possibly still being filled: close enough for watermarks
+    const MailboxRing *ring = atomic_load_explicit(&((CourierMailbox *)mb)->ring, memory_order_acquire);
+    const size_t head       = atomic_load_explicit(&((MailboxRing *)ring)->head, memory_order_relaxed) & ~RING_SEALED;
+    const size_t tail       = atomic_load_explicit(&((CourierMailbox *)mb)->tail, memory_order_relaxed);
+
+    return (head > tail) ? (long)(head - tail) : 0;
+}
+
+long courier_mailbox_capacity(const CourierMailbox *mb)
+{
+    if(mb->members)
+    {
+        long capacity = 0;
+
+        for(size_t i = 0; i < mb->nb_members; i++)
+        {
+            capacity += courier_mailbox_capacity(mb->members[i]);
+        }
+
+        return capacity;
+    }
+
+    if(mb->entries)
+    {
+        return (long)mb->nb_entries;
+    }
+
+    return (long)atomic_load_explicit(&((CourierMailbox *)mb)->ring, memory_order_acquire)->mask + 1;
+}
+
+// ----- Pool fronts -----
+// Member of a pool front that takes the next send: the shallower of two,
+// the first rotating over all members and the second at a rotating offset
+static CourierMailbox* mailbox_pick(CourierMailbox *front)
+{
+    const size_t n        = front->nb_members;
+    const uint32_t r      = atomic_fetch_add_explicit(&front->pick, 1, memory_order_relaxed);
+    CourierMailbox *first = front->members[r % n];
+
+    if(n == 1)
+    {
+        return first;
+    }
+    CourierMailbox *second = front->members[(r + 1 + (r / n) % (n - 1)) % n];
+
+    return (courier_mailbox_depth(second) < courier_mailbox_depth(first)) ? second : first;
+}
+
+// ----- Wakeups -----
+// After a message was made visible to the consumer: only pay for a syscall
+// when it is actually asleep. Returns 1 when it was.
+static int mailbox_wake(CourierMailbox *mb)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if(atomic_load_explicit(&mb->parked, memory_order_relaxed) && atomic_exchange(&mb->parked, 0))
+    {
+        const uint64_t one = 1;
+
+        if(write(mb->wake_fd, &one, sizeof(one)) < 0)
+        {
+            perror("mailbox wake");
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+// A send went to a pool member whose worker is busy: wake one idle sibling,
+// which steals the message unless the owner gets to it first
+static void mailbox_wake_idle(CourierMailbox *front, const CourierMailbox *busy)
+{
+    const size_t n     = front->nb_members;
+    const size_t start = atomic_load_explicit(&front->pick, memory_order_relaxed);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        CourierMailbox *m = front->members[(start + i) % n];
+
+        if((m != busy) && mailbox_wake(m))
+        {
+            return;
+        }
+    }
+}
+
+// ----- Conflation -----
+// Entry of the key of slot's message, claimed on first use. -1 with errno
+// ENOSPC once every entry belongs to another key.
+static long conflate_entry(CourierMailbox *mb, const CourierMsgSlot *slot)
+{
+    if(mb->nb_entries == 1)
+    {
+        return 0;
+    }
+    // Bytes past a short message count as zero, as they read on the consumer side
+    const size_t avail = (slot->size > mb->key_offset) ? slot->size - mb->key_offset : 0;
+    uint64_t key       = 0;
+    memcpy(&key, slot->payload + mb->key_offset, (avail < mb->key_size) ? avail : mb->key_size);
+
+    // splitmix64 finalizer: sequential ids spread over the table
+    uint64_t h = key ^ (key >> 30);
+    h         *= 0xbf58476d1ce4e5b9ull;
+    h         ^= h >> 27;
+    h         *= 0x94d049bb133111ebull;
+    h         ^= h >> 31;
+
+    for(size_t i = 0; i < mb->nb_entries; i++)
+    {
+        const size_t idx = (size_t)(h + i) & (mb->nb_entries - 1);
+        ConflateEntry *e = &mb->entries[idx];
+        uint32_t state   = atomic_load_explicit(&e->state, memory_order_acquire);
+
+        if((state == CONFLATE_FREE) &&
+           atomic_compare_exchange_strong_explicit(&e->state, &state, CONFLATE_CLAIMING, memory_order_acquire, memory_order_acquire))
+        {
+            e->key = key;
+            atomic_store_explicit(&e->state, CONFLATE_SET, memory_order_release);
+
+            return (long)idx;
+        }
+
+        // Being claimed by another sender: its key is not there yet
+        while(state == CONFLATE_CLAIMING)
+        {
+            sched_yield();
+            state = atomic_load_explicit(&e->state, memory_order_acquire);
+        }
+
+        if(e->key == key)
+        {
+            return (long)idx;
+        }
+    }
+    errno = ENOSPC;
+
+    return -1;
+}
+
+// Replace the pending message of the slot's key; never waits
+static int conflate_push(CourierMailbox *mb, CourierMsgSlot *slot)
+{
+    if(atomic_load_explicit(&mb->closed, memory_order_relaxed))
+    {
+        errno = EPIPE;
+
+        return -1;
+    }
+    const long idx = conflate_entry(mb, slot);
+
+    if(idx < 0)
+    {
+        return -1;
+    }
+    CourierMsgSlot *stale = atomic_exchange_explicit(&mb->entries[idx].slot, slot, memory_order_acq_rel);
+
+    if(stale)
+    {
+        // Superseded before the consumer got to it; the entry is already dirty
+        courier_slot_release(stale);
+
+        return 0;
+    }
+    atomic_fetch_add_explicit(&mb->pending, 1, memory_order_relaxed);
+    atomic_fetch_or_explicit(&mb->dirty[idx / 64], (uint64_t)1 << (idx % 64), memory_order_release);
+    mailbox_wake(mb);
+
+    return 0;
+}
+
+static int conflate_any_dirty(CourierMailbox *mb)
+{
+    for(size_t w = 0; w < (mb->nb_entries + 63) / 64; w++)
+    {
+        if(atomic_load_explicit(&mb->dirty[w], memory_order_acquire))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Consumer: latest message of the next dirty entry. A wakeup takes the whole
+// bitmap once and delivers that snapshot, so a key sent to again meanwhile
+// waits for the next wakeup instead of being handed over twice in this one.
+static CourierMsgSlot* conflate_pop(CourierMailbox *mb)
+{
+    const size_t nb_words = (mb->nb_entries + 63) / 64;
+
+    for(;;)
+    {
+        while(mb->snap_word < nb_words)
+        {
+            uint64_t *bits = &mb->snapshot[mb->snap_word];
+
+            if(!*bits)
+            {
+                mb->snap_word++;
+                continue;
+            }
+            const size_t idx = mb->snap_word * 64 + (size_t)__builtin_ctzll(*bits);
+            *bits           &= *bits - 1;
+
+            // NULL when taken after its sender set the bit, on the previous wakeup
+            CourierMsgSlot *slot = atomic_exchange_explicit(&mb->entries[idx].slot, NULL, memory_order_acq_rel);
+
+            if(slot)
+            {
+                atomic_fetch_sub_explicit(&mb->pending, 1, memory_order_relaxed);
+
+                return slot;
+            }
+        }
+
+        if(!mb->snapped)
+        {
+            int any = 0;
+
+            for(size_t w = 0; w < nb_words; w++)
+            {
+                mb->snapshot[w] = atomic_exchange_explicit(&mb->dirty[w], 0, memory_order_acquire);
+                any            |= (mb->snapshot[w] != 0);
+            }
+            mb->snap_word = 0;
+
+            if(any)
+            {
+                mb->snapped = 1;
+                continue;
+            }
+        }
+        mb->snapped = 0;
+
+        if(atomic_load_explicit(&mb->parked, memory_order_relaxed))
+        {
+            break;
+        }
+        // Same parking protocol as the ring, except that entries dirtied
+        // again are left to the next wakeup, which the consumer then signals
+        // itself: their senders saw it awake
+        uint64_t count;
+
+        while(read(mb->wake_fd, &count, sizeof(count)) == (ssize_t)sizeof(count))
+        {
+        }
+        atomic_store(&mb->parked, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if(conflate_any_dirty(mb) && atomic_exchange(&mb->parked, 0))
+        {
+            const uint64_t one = 1;
+
+            if(write(mb->wake_fd, &one, sizeof(one)) < 0)
+            {
+                perror("mailbox wake");
+            }
+        }
+        break;
+    }
+    errno = EAGAIN;
+
+    return NULL;
+}
+
+// ----- Ring -----
+int courier_mailbox_push(CourierMailbox *mb, CourierMsgSlot *slot, uint64_t deadline_ns)
+{
+    if(slot->size > mb->msg_size)
+    {
+        errno = EMSGSIZE;
+
+        return -1;
+    }
+
+    CourierMailbox *front = NULL;
+
+    if(mb->members)
+    {
+        if(atomic_load_explicit(&mb->closed, memory_order_relaxed))
+        {
+            errno = EPIPE;
+
+            return -1;
+        }
+        front = mb;
+        mb    = mailbox_pick(front);
+    }
+
+    if(mb->entries)
+    {
+        return conflate_push(mb, slot);
+    }
+    MailboxRing *ring = atomic_load_explicit(&mb->ring, memory_order_acquire);
+    size_t pos        = atomic_load_explicit(&ring->head, memory_order_acquire);
+    MailboxCell *cell;
+
+    for(;;)
+    {
+        if(atomic_load_explicit(&mb->closed, memory_order_relaxed))
+        {
+            errno = EPIPE;
+
+            return -1;
+        }
+
+        if(pos & RING_SEALED)
+        {
+            // Replaced by a larger ring: move on once it is published
+            MailboxRing *next = atomic_load_explicit(&ring->next, memory_order_acquire);
+
+            if(!next)
+            {
+                sched_yield();
+                pos = atomic_load_explicit(&ring->head, memory_order_acquire);
+                continue;
+            }
+            ring = next;
+            pos  = atomic_load_explicit(&ring->head, memory_order_acquire);
+            continue;
+        }
+        cell                = &ring->cells[(pos - ring->base) & ring->mask];
+        const size_t seq    = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        const intptr_t diff = (intptr_t)seq - (intptr_t)(pos - ring->base);
+
+        if(diff == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1, memory_order_acquire, memory_order_acquire))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)
+        {
+            // Full: sleep on the futex until the consumer frees a cell or the deadline passes
+            const uint64_t now = (deadline_ns == COURIER_NO_DEADLINE) ? 0 : courier_now_ns();
+
+            if(now >= deadline_ns)
+            {
+                errno = EAGAIN;
+
+                return -1;
+            }
+            const uint64_t left     = deadline_ns - now;
+            struct timespec timeout = { .tv_sec = (time_t)(left / 1000000000ull), .tv_nsec = (long)(left % 1000000000ull) };
+            const uint32_t space    = atomic_load(&mb->space_seq);
+            atomic_fetch_add(&mb->space_waiters, 1);
+
+            if(((intptr_t)atomic_load(&cell->seq) - (intptr_t)(pos - ring->base) < 0) && !(atomic_load(&ring->head) & RING_SEALED))
+            {
+                futex_wait(&mb->space_seq, space, (deadline_ns == COURIER_NO_DEADLINE) ? NULL : &timeout);
+            }
+            atomic_fetch_sub(&mb->space_waiters, 1);
+            pos = atomic_load_explicit(&ring->head, memory_order_acquire);
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->head, memory_order_acquire);
+        }
+    }
+    cell->slot = slot;
+    atomic_store_explicit(&cell->seq, pos - ring->base + 1, memory_order_release);
+
+    if(!mailbox_wake(mb) && front && (front->nb_members > 1))
+    {
+        mailbox_wake_idle(front, mb);
+    }
+
+    return 0;
+}
+
+int courier_mailbox_send(CourierMailbox *mb, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns)
+{
+    if(msg_size > mb->msg_size)
+    {
+        errno = EMSGSIZE;
+
+        return -1;
+    }
+    CourierMsgSlot *slot = courier_slot_alloc();
+
+    if(!slot)
+    {
+        return -1;
+    }
+    memcpy(slot->payload, msg, msg_size);
+    slot->size    = (uint32_t)msg_size;
+    slot->prio    = prio;
+#ifdef COURIER_STATS
+    slot->sent_ns = courier_now_ns();
+#endif // ifdef COURIER_STATS
+
+    if(courier_mailbox_push(mb, slot, deadline_ns) < 0)
+    {
+        courier_slot_release(slot);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+// Consumer: next message of the ring, or NULL when it is empty
+static CourierMsgSlot* ring_take(CourierMailbox *mb)
+{
+    const size_t tail = atomic_load_explicit(&mb->tail, memory_order_relaxed);
+    MailboxRing *ring = mb->draining;
+
+    for(;;)
+    {
+        const size_t rel  = tail - ring->base;
+        MailboxCell *cell = &ring->cells[rel & ring->mask];
+        const size_t seq  = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+        if(seq == rel + 1)
+        {
+            CourierMsgSlot *slot = cell->slot;
+            atomic_store_explicit(&cell->seq, rel + ring->mask + 1, memory_order_release);
+            atomic_store_explicit(&mb->tail, tail + 1, memory_order_relaxed);
+
+            if(mb->depth_max > ring->mask + 1)
+            {
+                // Adaptive: a ring seen three quarters full is too small
+                const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+                if(!(head & RING_SEALED) && ((head - tail) * 4 >= (ring->mask + 1) * 3))
+                {
+                    mailbox_grow(mb, ring);
+                }
+            }
+
+            if(atomic_load_explicit(&mb->space_waiters, memory_order_relaxed))
+            {
+                atomic_fetch_add(&mb->space_seq, 1);
+                futex_wake(&mb->space_seq);
+            }
+
+            return slot;
+        }
+        const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        if((head & RING_SEALED) && ((head & ~RING_SEALED) == tail))
+        {
+            // Replaced and drained: carry on in the successor
+            mb->draining = ring = atomic_load_explicit(&ring->next, memory_order_acquire);
+            continue;
+        }
+
+        return NULL;
+    }
+}
+
+// Consumer, after parking: whether a message became visible in the ring
+static int ring_ready(const CourierMailbox *mb)
+{
+    const size_t tail       = atomic_load_explicit(&((CourierMailbox *)mb)->tail, memory_order_relaxed);
+    const MailboxRing *ring = mb->draining;
+    const size_t rel        = tail - ring->base;
+    const size_t seq        = atomic_load_explicit(&((MailboxRing *)ring)->cells[rel & ring->mask].seq, memory_order_acquire);
+    const size_t head       = atomic_load_explicit(&((MailboxRing *)ring)->head, memory_order_acquire);
+
+    return (seq == rel + 1) || ((head & RING_SEALED) && ((head & ~RING_SEALED) == tail));
+}
+
+// ----- Pool members -----
+static int member_trylock(CourierMailbox *mb)
+{
+    return !atomic_load_explicit(&mb->pop_lock, memory_order_relaxed) &&
+           !atomic_exchange_explicit(&mb->pop_lock, 1, memory_order_acquire);
+}
+
+static void member_unlock(CourierMailbox *mb)
+{
+    atomic_store_explicit(&mb->pop_lock, 0, memory_order_release);
+}
+
+// Own ring first, then the oldest message of the next sibling that has one
+static CourierMsgSlot* member_take(CourierMailbox *mb)
+{
+    CourierMsgSlot *slot;
+
+    while(!member_trylock(mb))
+    {
+        sched_yield(); // a thief, for the length of one pop
+    }
+    slot = ring_take(mb);
+    member_unlock(mb);
+
+    for(size_t i = 1; !slot && (i < mb->nb_siblings); i++)
+    {
+        CourierMailbox *victim = mb->siblings[(mb->member_index + i) % mb->nb_siblings];
+
+        if((courier_mailbox_depth(victim) > 0) && member_trylock(victim))
+        {
+            slot = ring_take(victim);
+            member_unlock(victim);
+        }
+    }
+
+    return slot;
+}
+
+// Whether any member of the pool holds a message (claimed cells included)
+static int member_ready(const CourierMailbox *mb)
+{
+    for(size_t i = 0; i < mb->nb_siblings; i++)
+    {
+        if(courier_mailbox_depth(mb->siblings[i]) > 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+CourierMsgSlot* courier_mailbox_pop(CourierMailbox *mb)
+{
+    if(mb->entries)
+    {
+        return conflate_pop(mb);
+    }
+
+    for(;;)
+    {
+        CourierMsgSlot *slot = mb->siblings ? member_take(mb) : ring_take(mb);
+
+        if(slot)
+        {
+            return slot;
+        }
+
+        if(atomic_load_explicit(&mb->parked, memory_order_relaxed))
+        {
+            // Already parked and nobody woke us: wake_fd holds no stale count
+            break;
+        }
+        // Empty: clear stale wakeups, park, then re-check so a producer that
+        // raced with us either sees parked=1 or its slot is seen here. A pool
+        // member re-checks its siblings too, as sends to them wake it to steal.
+        uint64_t count;
+
+        while(read(mb->wake_fd, &count, sizeof(count)) == (ssize_t)sizeof(count))
+        {
+        }
+        atomic_store(&mb->parked, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if(!(mb->siblings ? member_ready(mb) : ring_ready(mb)))
+        {
+            break;
+        }
+        atomic_store(&mb->parked, 0);
+    }
+    errno = EAGAIN;
+
+    return NULL;
+}
@@ -0,0 +1,188 @@
+// =============================
+// File: src/msg_pool.c
+// =============================
+#include "courier_internal.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Pooled message slots for in-process delivery, also handed out to senders
+// by courier_msg_alloc so one payload can be published to many mailboxes.
+//
+// Each thread allocates from its own pool: a private free list refilled from
+// slabs of COURIER_POOL_SLAB slots. A slot released on another thread goes
+// back to the pool it came from through a lock-free stack that the owner
+// takes over wholesale when its private list runs dry, so there is no ABA.
+// Pools are never freed: when a thread exits, its pool is parked on an
+// orphan list and adopted by the next thread that needs one, which keeps
+// in-flight slots pointing at valid memory.
+
+#ifndef COURIER_POOL_SLAB
+#define COURIER_POOL_SLAB 64
+#endif /* ifndef COURIER_POOL_SLAB */
+
+struct CourierMsgPool
+{
+    CourierMsgSlot *local;            // owner only
+    _Atomic(CourierMsgSlot *) remote; // released by other threads
+    struct CourierMsgPool *next_orphan;
+};
+
+static _Thread_local struct CourierMsgPool *tls_pool;
+static struct CourierMsgPool *orphans;
+static pthread_mutex_t orphans_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+
+static void pool_orphan(void *arg)
+{
+    struct CourierMsgPool *pool = (struct CourierMsgPool *)arg;
+
+    pthread_mutex_lock(&orphans_lock);
+    pool->next_orphan = orphans;
+    orphans           = pool;
+    pthread_mutex_unlock(&orphans_lock);
+}
+
+static void pool_key_create(void)
+{
+    if(pthread_key_create(&pool_key, pool_orphan) != 0)
+    {
+        perror("pthread_key_create(msg pool)");
+    }
+}
+
+static struct CourierMsgPool* pool_get(void)
+{
+    if(tls_pool)
+    {
+        return tls_pool;
+    }
+    pthread_once(&pool_key_once, pool_key_create);
+
+    pthread_mutex_lock(&orphans_lock);
+    struct CourierMsgPool *pool = orphans;
+
+    if(pool)
+    {
+        orphans = pool->next_orphan;
+    }
+    pthread_mutex_unlock(&orphans_lock);
+
+    if(!pool)
+    {
+        pool = calloc(1, sizeof(*pool));
+
+        if(!pool)
+        {
+            return NULL;
+        }
+    }
+    pthread_setspecific(pool_key, pool);
+    tls_pool = pool;
+
+    return pool;
+}
+
+static int pool_grow(struct CourierMsgPool *pool)
+{
+    CourierMsgSlot *slab = aligned_alloc(alignof(CourierMsgSlot), COURIER_POOL_SLAB * sizeof(*slab));
+
+    if(!slab)
+    {
+        return -1;
+    }
+
+    for(size_t i = 0; i < COURIER_POOL_SLAB; i++)
+    {
+        slab[i].pool = pool;
+        slab[i].next = (i + 1 < COURIER_POOL_SLAB) ? &slab[i + 1] : pool->local;
+    }
+    pool->local = slab;
+
+    return 0;
+}
+
+CourierMsgSlot* courier_slot_alloc(void)
+{
+    struct CourierMsgPool *pool = pool_get();
+
+    if(!pool)
+    {
+        return NULL;
+    }
+
+    if(!pool->local)
+    {
+        pool->local = atomic_exchange_explicit(&pool->remote, NULL, memory_order_acquire);
+
+        if(!pool->local && (pool_grow(pool) < 0))
+        {
+            return NULL;
+        }
+    }
+    CourierMsgSlot *slot = pool->local;
+    pool->local          = slot->next;
+    atomic_store_explicit(&slot->refs, 1, memory_order_relaxed);
+
+    return slot;
+}
+
+void courier_slot_release(CourierMsgSlot *slot)
+{
+    if(atomic_fetch_sub_explicit(&slot->refs, 1, memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+    struct CourierMsgPool *pool = slot->pool;
+
+    if(pool == tls_pool)
+    {
+        slot->next  = pool->local;
+        pool->local = slot;
+
+        return;
+    }
+    CourierMsgSlot *head = atomic_load_explicit(&pool->remote, memory_order_relaxed);
+
+    do
+    {
+        slot->next = head;
+    } while(!atomic_compare_exchange_weak_explicit(&pool->remote, &head, slot, memory_order_release, memory_order_relaxed));
+}
+
+// ----- Public message buffers -----
+CourierMsgSlot* courier_msg_slot(void *msg)
+{
+    return (CourierMsgSlot *)((unsigned char *)msg - offsetof(CourierMsgSlot, payload));
+}
+
+void* courier_msg_alloc(size_t size)
+{
+    if((size == 0) || (size > COURIER_MAX_MSG_SIZE))
+    {
+        errno = (size == 0) ? EINVAL : EMSGSIZE;
+
+        return NULL;
+    }
+    CourierMsgSlot *slot = courier_slot_alloc();
+
+    if(!slot)
+    {
+        return NULL;
+    }
+    slot->size = (uint32_t)size;
+    slot->prio = 0;
+    // Subscribers with a larger msg_size share the buffer: zero the tail once here
+    memset(slot->payload + size, 0, COURIER_MAX_MSG_SIZE - size);
+
+    return slot->payload;
+}
+
+void courier_msg_release(void *msg)
+{
+    if(msg)
+    {
+        courier_slot_release(courier_msg_slot(msg));
+    }
+}
@@ -1,13 +1,46 @@
 #ifndef PLATFORM_H
 #define PLATFORM_H
 
+// Transport backend selection. The POSIX mqueue backend is the default; define
+// COURIER_PLATFORM_LINUX_SHM to use the shared-memory ring backend instead.
+#if defined(COURIER_PLATFORM_LINUX_SHM)
+#include "platform_linux_shm.h"
+#else
 #include "platform_linux_mq.h"
+#endif // if defined(COURIER_PLATFORM_LINUX_SHM)
 
-courrier_mq_t courier_queue_open_reader(const char *queue_name, size_t msg_size, long maxmsg);
-courrier_mq_t courier_queue_open_writer(const char *queue_name, size_t msg_size, long maxmsg);
-int courier_send_mq(courrier_mq_t mq, const void *msg, size_t msg_size);
-int courier_send_to(const char *queue_name, const void *msg, size_t msg_size);
-int courier_queue_close(courrier_mq_t mq);
-int courier_queue_unlink(const char *queue_name);
+#include <stdint.h>
+
+// Backend primitives. The public courier_queue_* / courier_send_* API in
+// courier.h is layered on top of these.
+courrier_mq_t platform_queue_open_reader(const char *queue_name, size_t msg_size, long maxmsg);
+courrier_mq_t platform_queue_open_writer(const char *queue_name, size_t msg_size, long maxmsg);
+int platform_queue_send(courrier_mq_t mq, const void *msg, size_t msg_size, unsigned prio);
+
+// Send, waiting for room at most until deadline_ns (CLOCK_MONOTONIC; 0 = do
+// not wait, UINT64_MAX = no limit). Returns -1 with errno EAGAIN when the
+// queue stayed full.
+int platform_queue_send_until(courrier_mq_t mq, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns);
+
+// Number of messages currently queued, or -1 on error. Any descriptor.
+long platform_queue_depth(courrier_mq_t mq);
+
+// Messages the queue holds before senders wait, or -1 on error. Readers are
+// opened with a smaller depth than asked for when system limits require it.
+long platform_queue_capacity(courrier_mq_t mq);
+int platform_queue_close(courrier_mq_t mq);
+int platform_queue_unlink(const char *queue_name);
+
+// 1 when queue_name no longer names the queue mq was opened on (it was
+// unlinked, or a reader recreated it since), 0 when it still does, -1 on
+// error. Costs a few system calls.
+int platform_queue_stale(courrier_mq_t mq, const char *queue_name);
+
+// Non-blocking receive on a reader descriptor. Returns the number of bytes
+// received, or -1 with errno set to EAGAIN when the queue is empty.
+ssize_t platform_queue_receive(courrier_mq_t mq, void *buf, size_t buf_size, unsigned *prio);
+
+// File descriptor that becomes readable when a reader descriptor has messages.
+int platform_queue_fd(courrier_mq_t mq);
 
 #endif // ifndef PLATFORM_H
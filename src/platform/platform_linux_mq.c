@@ -10,7 +10,56 @@ static void fill_attr(struct mq_attr *attr, size_t msg_size, long maxmsg)
     attr->mq_msgsize = msg_size;
 }
 
-courrier_mq_t courier_queue_open_reader(const char *queue_name, size_t msg_size, long maxmsg)
+// A limit from /proc/sys/fs/mqueue, or -1 when unreadable
+static long mq_limit(const char *name)
+{
+    char path[64];
+    long value = -1;
+    snprintf(path, sizeof(path), "/proc/sys/fs/mqueue/%s", name);
+    FILE *f = fopen(path, "r");
+
+    if(f)
+    {
+        if(fscanf(f, "%ld", &value) != 1)
+        {
+            value = -1;
+        }
+        fclose(f);
+    }
+
+    return value;
+}
+
+// The kernel refused maxmsg (above fs.mqueue.msg_max without
+// CAP_SYS_RESOURCE, or past RLIMIT_MSGQUEUE): a smaller depth to retry
+// with, or 0 when there is none. The limits are reported once per process,
+// every queue hits the same ones.
+static long mq_fallback_depth(const char *queue_name, long maxmsg, int err)
+{
+    static atomic_int reported;
+
+    const long msg_max = mq_limit("msg_max");
+    struct rlimit rl   = { 0 };
+    getrlimit(RLIMIT_MSGQUEUE, &rl);
+
+    long depth = ((err == EINVAL) && (msg_max > 0) && (msg_max < maxmsg)) ? msg_max : maxmsg / 2;
+
+    if(((err != EINVAL) && (err != EMFILE) && (err != ENOMEM)) || (depth < 1))
+    {
+        return 0;
+    }
+
+    if(!atomic_exchange(&reported, 1))
+    {
+        fprintf(stderr, "mq_open(%s): depth %ld refused (%s; fs.mqueue.msg_max=%ld, msgsize_max=%ld, RLIMIT_MSGQUEUE=%ld), trying %ld"
+                " (further queues are lowered silently)\n",
+                queue_name, maxmsg, strerror(err), msg_max, mq_limit("msgsize_max"), (long)rl.rlim_cur, depth);
+    }
+
+    return depth;
+}
+
+courrier_mq_t platform_queue_open_reader(const char *queue_name, size_t msg_size, long maxmsg)
 {
     if(!queue_name || (msg_size == 0))
     {
@@ -22,17 +71,27 @@ courrier_mq_t courier_queue_open_reader(const char *queue_name, size_t msg_size,
     fill_attr(&attr, msg_size, maxmsg);
     // Clean old instance to ensure msg_size matches what we expect
     mq_unlink(queue_name);
-    courrier_mq_t mq = mq_open(queue_name, O_RDONLY | O_CREAT, 0644, &attr);
+    // Readers are non-blocking: the actor loop waits in poll() and only
+    // receives once the descriptor is reported readable.
+    courrier_mq_t mq = mq_open(queue_name, O_RDONLY | O_CREAT | O_NONBLOCK, 0644, &attr);
 
-    if(mq == (courrier_mq_t)-1)
+    while(mq == (courrier_mq_t)-1)
     {
-        perror("mq_open(reader)");
+        const long depth = mq_fallback_depth(queue_name, attr.mq_maxmsg, errno);
+
+        if(depth == 0)
+        {
+            perror("mq_open(reader)");
+            break;
+        }
+        attr.mq_maxmsg = depth;
+        mq             = mq_open(queue_name, O_RDONLY | O_CREAT | O_NONBLOCK, 0644, &attr);
     }
 
     return mq;
 }
 
-courrier_mq_t courier_queue_open_writer(const char *queue_name, size_t msg_size, long maxmsg)
+courrier_mq_t platform_queue_open_writer(const char *queue_name, size_t msg_size, long maxmsg)
 {
     if(!queue_name || (msg_size == 0))
     {
@@ -52,7 +111,12 @@ courrier_mq_t courier_queue_open_writer(const char *queue_name, size_t msg_size,
     return mq;
 }
 
-int courier_send_mq(courrier_mq_t mq, const void *msg, size_t msg_size)
+int platform_queue_send(courrier_mq_t mq, const void *msg, size_t msg_size, unsigned prio)
+{
+    return platform_queue_send_until(mq, msg, msg_size, prio, UINT64_MAX);
+}
+
+int platform_queue_send_until(courrier_mq_t mq, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns)
 {
     if((mq == (courrier_mq_t)-1) || !msg || (msg_size == 0))
     {
@@ -60,7 +124,34 @@ int courier_send_mq(courrier_mq_t mq, const void *msg, size_t msg_size)
 
         return -1;
     }
-    int ret = mq_send(mq, (const char *)msg, msg_size, 0);
+    int ret;
+
+    if(deadline_ns == UINT64_MAX)
+    {
+        ret = mq_send(mq, (const char *)msg, msg_size, prio);
+    }
+    else
+    {
+        // Writers stay blocking (the descriptor is shared by every sender
+        // thread): a bounded wait is an mq_timedsend on CLOCK_REALTIME, and
+        // a deadline already past makes it fail at once when full.
+        struct timespec mono, real;
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        clock_gettime(CLOCK_REALTIME, &real);
+        const uint64_t now_ns  = (uint64_t)mono.tv_sec * 1000000000ull + (uint64_t)mono.tv_nsec;
+        const uint64_t wait_ns = (deadline_ns > now_ns) ? deadline_ns - now_ns : 0;
+        const uint64_t abs_ns  = (uint64_t)real.tv_sec * 1000000000ull + (uint64_t)real.tv_nsec + wait_ns;
+        struct timespec abs    = { .tv_sec = (time_t)(abs_ns / 1000000000ull), .tv_nsec = (long)(abs_ns % 1000000000ull) };
+
+        ret = mq_timedsend(mq, (const char *)msg, msg_size, prio, &abs);
+
+        if((ret < 0) && (errno == ETIMEDOUT))
+        {
+            errno = EAGAIN;
+
+            return -1; // queue full: a status, not an error to report
+        }
+    }
 
     if(ret < 0)
     {
@@ -70,32 +161,67 @@ int courier_send_mq(courrier_mq_t mq, const void *msg, size_t msg_size)
     return ret;
 }
 
-int courier_send_to(const char *queue_name, const void *msg, size_t msg_size)
+long platform_queue_capacity(courrier_mq_t mq)
 {
-    if(!queue_name || !msg || (msg_size == 0))
-    {
-        errno = EINVAL;
+    struct mq_attr attr;
 
+    if(mq_getattr(mq, &attr) < 0)
+    {
         return -1;
     }
-    courrier_mq_t mq = courier_queue_open_writer(queue_name, msg_size, 10);
 
-    if(mq == (courrier_mq_t)-1)
+    return attr.mq_maxmsg;
+}
+
+long platform_queue_depth(courrier_mq_t mq)
+{
+    struct mq_attr attr;
+
+    if(mq_getattr(mq, &attr) < 0)
     {
         return -1;
     }
-    int ret = courier_send_mq(mq, msg, msg_size);
-    courier_queue_close(mq);
 
-    return ret;
+    return attr.mq_curmsgs;
+}
+
+ssize_t platform_queue_receive(courrier_mq_t mq, void *buf, size_t buf_size, unsigned *prio)
+{
+    return mq_receive(mq, (char *)buf, buf_size, prio);
+}
+
+int platform_queue_fd(courrier_mq_t mq)
+{
+    return (int)mq; // Linux: mqd_t is an FD (non-portable)
 }
 
-int courier_queue_close(courrier_mq_t mq)
+int platform_queue_close(courrier_mq_t mq)
 {
     return mq_close(mq);
 }
 
-int courier_queue_unlink(const char *queue_name)
+int platform_queue_unlink(const char *queue_name)
 {
     return mq_unlink(queue_name);
 }
+
+int platform_queue_stale(courrier_mq_t mq, const char *queue_name)
+{
+    struct stat held, named;
+
+    if(!queue_name || (fstat((int)mq, &held) < 0))
+    {
+        return -1;
+    }
+    // Open the name again to see which queue it refers to now
+    courrier_mq_t cur = mq_open(queue_name, O_WRONLY);
+
+    if(cur == (courrier_mq_t)-1)
+    {
+        return (errno == ENOENT) ? 1 : -1;
+    }
+    int ret = (fstat((int)cur, &named) < 0) ? -1 : ((held.st_ino != named.st_ino) || (held.st_dev != named.st_dev));
+    mq_close(cur);
+
+    return ret;
+}
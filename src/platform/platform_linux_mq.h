@@ -1,7 +1,9 @@
 #ifndef PLATFORM_LINUX_MQ_H
 #define PLATFORM_LINUX_MQ_H
 
+#ifndef _GNU_SOURCE
 #define _GNU_SOURCE
+#endif /* ifndef _GNU_SOURCE */
 
 #include <mqueue.h>
 #include <pthread.h>
@@ -10,12 +12,18 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 typedef mqd_t courrier_mq_t;
 
+// A reader descriptor can be drained by several threads at once
+#define PLATFORM_SHARED_READER 1
+
 #endif // ifndef PLATFORM_LINUX_MQ_H
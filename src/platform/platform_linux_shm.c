@@ -0,0 +1,737 @@
+
+#include "platform.h"
+
+#include <linux/futex.h>
+#include <limits.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+// Shared-memory backend: every queue is a single-producer/single-consumer ring
+// living in a POSIX shm object. Producers only touch the kernel to wake a
+// consumer that is parked on its wake socket, or to sleep on a futex while the
+// ring is full. Writers serialize on a spin lock in the shared header so
+// several senders may still target the same queue. Rings are strictly FIFO:
+// a message priority is carried to the reader but does not reorder the ring.
+//
+// The reader's wake socket is a datagram socket bound to an abstract UNIX
+// address derived from its pid and a per-process id, both published in the
+// ring header. Any writer, in this process or another, reaches it with one
+// sendto() from its own unbound socket: no rights on the reader process are
+// needed, only the same network namespace (abstract addresses live there).
+
+#define SHM_RING_MAGIC 0x474e5243u // "CRNG"
+#define SHM_CACHE_LINE 64
+#define SHM_NAME_MAX   256
+#define SHM_RING_MAX   (1l << 31) // slots: the capacity is a uint32_t power of two
+
+// ----- Shared layout -----
+typedef struct
+{
+    uint32_t len;
+    uint32_t prio;
+} ShmSlotHdr;
+
+typedef struct
+{
+    _Atomic uint32_t magic; // published last by the creator
+    uint32_t msg_size;      // max payload per slot
+    uint32_t capacity;      // number of slots (power of two)
+    uint32_t slot_stride;   // bytes per slot, header included
+    _Atomic int32_t owner_pid; // reader process (0 when no reader is attached)
+    uint32_t wake_id;          // reader's wake socket, see wake_addr()
+
+    // Producer side
+    alignas(SHM_CACHE_LINE) _Atomic uint64_t head;
+    _Atomic uint32_t producer_lock;
+
+    // Consumer side
+    alignas(SHM_CACHE_LINE) _Atomic uint64_t tail;
+
+    // Wakeup state, kept away from the indices
+    alignas(SHM_CACHE_LINE) _Atomic uint32_t parked; // consumer sleeps on its wake socket
+    _Atomic uint32_t space_waiters;                  // producers sleeping on space_seq
+    _Atomic uint32_t space_seq;                      // futex word bumped on pop
+} ShmRingHdr;
+
+// ----- Process-local handles -----
+typedef struct
+{
+    ShmRingHdr *hdr;
+    unsigned char *slots;
+    size_t map_size;
+    int in_use;
+    int reader;
+    _Atomic int wake_fd; // reader: bound wake socket, writer: unbound socket it sends from
+    atomic_int wake_failed; // wake failure already reported
+    dev_t dev;           // shm object the ring was mapped from
+    ino_t ino;
+    char shm_name[SHM_NAME_MAX];
+} ShmHandle;
+
+static ShmHandle handles[COURIER_SHM_MAX_HANDLES];
+static pthread_mutex_t handles_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static ShmHandle* handle_get(courrier_mq_t mq)
+{
+    if((mq < 0) || (mq >= COURIER_SHM_MAX_HANDLES) || !handles[mq].in_use)
+    {
+        errno = EBADF;
+
+        return NULL;
+    }
+
+    return &handles[mq];
+}
+
+static courrier_mq_t handle_alloc(void)
+{
+    courrier_mq_t mq = (courrier_mq_t)-1;
+
+    pthread_mutex_lock(&handles_lock);
+
+    for(int i = 0; i < COURIER_SHM_MAX_HANDLES; i++)
+    {
+        if(!handles[i].in_use)
+        {
+            memset(&handles[i], 0, sizeof(handles[i]));
+            handles[i].in_use = 1;
+            atomic_init(&handles[i].wake_fd, -1);
+            mq = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&handles_lock);
+
+    if(mq == (courrier_mq_t)-1)
+    {
+        errno = EMFILE;
+    }
+
+    return mq;
+}
+
+static void handle_free(ShmHandle *h)
+{
+    pthread_mutex_lock(&handles_lock);
+    h->in_use = 0;
+    pthread_mutex_unlock(&handles_lock);
+}
+
+// ----- Helpers -----
+static int shm_name_for(char *out, const char *queue_name)
+{
+    // "/sensor_tick" -> "/courier.sensor_tick" (separate namespace from mqueues)
+    const char *base = (queue_name[0] == '/') ? queue_name + 1 : queue_name;
+    int n = snprintf(out, SHM_NAME_MAX, "/courier.%s", base);
+
+    if((n < 0) || (n >= SHM_NAME_MAX) || (strchr(base, '/') != NULL))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static uint32_t ring_capacity(long maxmsg)
+{
+    uint32_t want = (uint32_t)(maxmsg > 0 ? maxmsg : 10);
+    uint32_t cap  = 1;
+
+    while(cap < want)
+    {
+        cap <<= 1;
+    }
+
+    return cap;
+}
+
+static size_t ring_map_size(uint32_t capacity, uint32_t stride)
+{
+    return sizeof(ShmRingHdr) + (size_t)capacity * stride;
+}
+
+static int futex_wait(_Atomic uint32_t *addr, uint32_t expected, const struct timespec *timeout)
+{
+    return (int)syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int futex_wake(_Atomic uint32_t *addr)
+{
+    return (int)syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static void producer_lock(ShmRingHdr *hdr)
+{
+    uint32_t expected = 0;
+
+    while(!atomic_compare_exchange_weak_explicit(&hdr->producer_lock, &expected, 1, memory_order_acquire, memory_order_relaxed))
+    {
+        expected = 0;
+        sched_yield();
+    }
+}
+
+static void producer_unlock(ShmRingHdr *hdr)
+{
+    atomic_store_explicit(&hdr->producer_lock, 0, memory_order_release);
+}
+
+// Abstract UNIX address of the wake socket id of reader pid
+static socklen_t wake_addr(struct sockaddr_un *addr, pid_t pid, uint32_t id)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    const int n      = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "courier.%d.%u", (int)pid, id);
+
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + (size_t)n);
+}
+
+// Reader side: a wake socket bound to a fresh address, its id in *id, or -1
+static int wake_socket_bind(uint32_t *id)
+{
+    static atomic_uint next_id;
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if(fd < 0)
+    {
+        return -1;
+    }
+    *id = atomic_fetch_add(&next_id, 1);
+
+    if(bind(fd, (struct sockaddr *)&addr, wake_addr(&addr, getpid(), *id)) < 0)
+    {
+        const int err = errno;
+        close(fd);
+        errno = err;
+
+        return -1;
+    }
+
+    return fd;
+}
+
+// Writer side: wake a parked reader. parked is cleared by the one sender that
+// writes the datagram, so a parked reader gets a single wakeup. A reader that
+// is gone refuses it, which is fine; any other failure sets parked again for
+// the next sender and is reported once.
+static void ring_wake(ShmHandle *h)
+{
+    ShmRingHdr *hdr = h->hdr;
+    const pid_t pid = (pid_t)atomic_load(&hdr->owner_pid);
+    const int fd    = atomic_load_explicit(&h->wake_fd, memory_order_relaxed);
+
+    if((pid <= 0) || (fd < 0) || !atomic_exchange(&hdr->parked, 0))
+    {
+        return;
+    }
+    struct sockaddr_un addr;
+    const char one          = 1;
+    const socklen_t addrlen = wake_addr(&addr, pid, hdr->wake_id);
+
+    // EAGAIN: the reader's buffer already holds a wakeup it has not read
+    if((sendto(fd, &one, sizeof(one), MSG_DONTWAIT, (struct sockaddr *)&addr, addrlen) < 0) && (errno != EAGAIN) &&
+       (errno != ECONNREFUSED) && (errno != ENOENT))
+    {
+        atomic_store(&hdr->parked, 1);
+
+        if(!atomic_exchange(&h->wake_failed, 1))
+        {
+            perror("ring wake");
+        }
+    }
+}
+
+// ----- Ring lifecycle -----
+static courrier_mq_t ring_create(const char *queue_name, size_t msg_size, long maxmsg, int reader)
+{
+    ShmHandle *h       = NULL;
+    int shm_fd         = -1;
+    courrier_mq_t mq   = handle_alloc();
+    const uint32_t cap = ring_capacity(maxmsg);
+    const uint32_t stride = (uint32_t)((sizeof(ShmSlotHdr) + msg_size + 7u) & ~(size_t)7u);
+
+    if(mq == (courrier_mq_t)-1)
+    {
+        return mq;
+    }
+    h = &handles[mq];
+
+    if(shm_name_for(h->shm_name, queue_name) < 0)
+    {
+        goto fail;
+    }
+
+    if(reader)
+    {
+        // Clean old instance to ensure msg_size matches what we expect
+        shm_unlink(h->shm_name);
+    }
+    shm_fd = shm_open(h->shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+    if(shm_fd < 0)
+    {
+        goto fail;
+    }
+    h->map_size = ring_map_size(cap, stride);
+
+    if(ftruncate(shm_fd, (off_t)h->map_size) < 0)
+    {
+        goto fail;
+    }
+    h->hdr = mmap(NULL, h->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+
+    if(h->hdr == MAP_FAILED)
+    {
+        h->hdr = NULL;
+        goto fail;
+    }
+    struct stat st;
+
+    if(fstat(shm_fd, &st) == 0)
+    {
+        h->dev = st.st_dev;
+        h->ino = st.st_ino;
+    }
+    close(shm_fd);
+    shm_fd = -1;
+
+    h->slots            = (unsigned char *)(h->hdr + 1);
+    h->reader           = reader;
+    h->hdr->msg_size    = (uint32_t)msg_size;
+    h->hdr->capacity    = cap;
+    h->hdr->slot_stride = stride;
+
+    if(reader)
+    {
+        int wfd = wake_socket_bind(&h->hdr->wake_id);
+
+        if(wfd < 0)
+        {
+            goto fail;
+        }
+        atomic_store(&h->wake_fd, wfd);
+        atomic_store(&h->hdr->parked, 1); // empty ring: consumer starts parked
+        atomic_store(&h->hdr->owner_pid, (int32_t)getpid());
+    }
+    else
+    {
+        int wfd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+        if(wfd < 0)
+        {
+            goto fail;
+        }
+        atomic_store(&h->wake_fd, wfd);
+    }
+    atomic_store_explicit(&h->hdr->magic, SHM_RING_MAGIC, memory_order_release);
+
+    return mq;
+
+fail:
+    {
+        int saved = errno;
+
+        if(shm_fd >= 0)
+        {
+            close(shm_fd);
+            shm_unlink(h->shm_name);
+        }
+
+        if(h->hdr)
+        {
+            munmap(h->hdr, h->map_size);
+            shm_unlink(h->shm_name);
+        }
+        handle_free(h);
+        errno = saved;
+    }
+
+    return (courrier_mq_t)-1;
+}
+
+static courrier_mq_t ring_attach(const char *queue_name)
+{
+    courrier_mq_t mq = handle_alloc();
+    ShmHandle *h     = NULL;
+    struct stat st   = { 0 };
+
+    if(mq == (courrier_mq_t)-1)
+    {
+        return mq;
+    }
+    h = &handles[mq];
+
+    if(shm_name_for(h->shm_name, queue_name) < 0)
+    {
+        goto fail;
+    }
+    int shm_fd = shm_open(h->shm_name, O_RDWR, 0);
+
+    if(shm_fd < 0)
+    {
+        goto fail;
+    }
+
+    // The creator may still be sizing the object
+    for(int tries = 0; tries < 1000; tries++)
+    {
+        if((fstat(shm_fd, &st) < 0) || (st.st_size >= (off_t)sizeof(ShmRingHdr)))
+        {
+            break;
+        }
+        sched_yield();
+    }
+
+    if(st.st_size < (off_t)sizeof(ShmRingHdr))
+    {
+        close(shm_fd);
+        errno = EAGAIN;
+        goto fail;
+    }
+    h->map_size = (size_t)st.st_size;
+    h->dev      = st.st_dev;
+    h->ino      = st.st_ino;
+    h->hdr      = mmap(NULL, h->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+
+    if(h->hdr == MAP_FAILED)
+    {
+        h->hdr = NULL;
+        goto fail;
+    }
+
+    for(int tries = 0; atomic_load_explicit(&h->hdr->magic, memory_order_acquire) != SHM_RING_MAGIC; tries++)
+    {
+        if(tries >= 1000)
+        {
+            munmap(h->hdr, h->map_size);
+            errno = EAGAIN;
+            goto fail;
+        }
+        sched_yield();
+    }
+    const int wfd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+    if(wfd < 0)
+    {
+        munmap(h->hdr, h->map_size);
+        goto fail;
+    }
+    atomic_store(&h->wake_fd, wfd);
+    h->slots  = (unsigned char *)(h->hdr + 1);
+    h->reader = 0;
+
+    return mq;
+
+fail:
+    handle_free(h);
+
+    return (courrier_mq_t)-1;
+}
+
+// ----- Queue helpers -----
+courrier_mq_t platform_queue_open_reader(const char *queue_name, size_t msg_size, long maxmsg)
+{
+    if(!queue_name || (msg_size == 0) || (maxmsg > SHM_RING_MAX))
+    {
+        errno = EINVAL;
+
+        return (courrier_mq_t)-1;
+    }
+    courrier_mq_t mq = ring_create(queue_name, msg_size, maxmsg, 1);
+
+    if(mq == (courrier_mq_t)-1)
+    {
+        perror("ring_open(reader)");
+    }
+
+    return mq;
+}
+
+courrier_mq_t platform_queue_open_writer(const char *queue_name, size_t msg_size, long maxmsg)
+{
+    if(!queue_name || (msg_size == 0) || (maxmsg > SHM_RING_MAX))
+    {
+        errno = EINVAL;
+
+        return (courrier_mq_t)-1;
+    }
+    courrier_mq_t mq = ring_attach(queue_name);
+
+    if((mq == (courrier_mq_t)-1) && (errno == ENOENT))
+    {
+        // No reader yet: create the ring like mq_open(O_CREAT) would
+        mq = ring_create(queue_name, msg_size, maxmsg, 0);
+
+        if((mq == (courrier_mq_t)-1) && (errno == EEXIST))
+        {
+            mq = ring_attach(queue_name);
+        }
+    }
+
+    if(mq == (courrier_mq_t)-1)
+    {
+        perror("ring_open(writer)");
+    }
+
+    return mq;
+}
+
+static int ring_send(ShmHandle *h, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns)
+{
+    ShmRingHdr *hdr = h->hdr;
+
+    if(msg_size > hdr->msg_size)
+    {
+        errno = EMSGSIZE;
+
+        return -1;
+    }
+    const uint64_t mask = hdr->capacity - 1;
+
+    producer_lock(hdr);
+    uint64_t head = atomic_load_explicit(&hdr->head, memory_order_relaxed);
+
+    while(head - atomic_load_explicit(&hdr->tail, memory_order_acquire) >= hdr->capacity)
+    {
+        // Full: sleep on the futex until the consumer frees a slot or the deadline passes
+        producer_unlock(hdr);
+        const uint64_t now = (deadline_ns == UINT64_MAX) ? 0 : monotonic_ns();
+
+        if(now >= deadline_ns)
+        {
+            errno = EAGAIN;
+
+            return -1;
+        }
+        const uint64_t left     = deadline_ns - now;
+        struct timespec timeout = { .tv_sec = (time_t)(left / 1000000000ull), .tv_nsec = (long)(left % 1000000000ull) };
+        uint32_t seq            = atomic_load(&hdr->space_seq);
+        atomic_fetch_add(&hdr->space_waiters, 1);
+
+        if(atomic_load(&hdr->head) - atomic_load(&hdr->tail) >= hdr->capacity)
+        {
+            futex_wait(&hdr->space_seq, seq, (deadline_ns == UINT64_MAX) ? NULL : &timeout);
+        }
+        atomic_fetch_sub(&hdr->space_waiters, 1);
+        producer_lock(hdr);
+        head = atomic_load_explicit(&hdr->head, memory_order_relaxed);
+    }
+    unsigned char *slot = h->slots + (head & mask) * hdr->slot_stride;
+    ShmSlotHdr sh       = { .len = (uint32_t)msg_size, .prio = prio };
+    memcpy(slot, &sh, sizeof(sh));
+    memcpy(slot + sizeof(sh), msg, msg_size);
+    atomic_store_explicit(&hdr->head, head + 1, memory_order_release);
+    producer_unlock(hdr);
+
+    // Only pay for a syscall when the consumer is actually asleep
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if(atomic_load_explicit(&hdr->parked, memory_order_relaxed))
+    {
+        ring_wake(h);
+    }
+
+    return 0;
+}
+
+int platform_queue_send(courrier_mq_t mq, const void *msg, size_t msg_size, unsigned prio)
+{
+    return platform_queue_send_until(mq, msg, msg_size, prio, UINT64_MAX);
+}
+
+int platform_queue_send_until(courrier_mq_t mq, const void *msg, size_t msg_size, unsigned prio, uint64_t deadline_ns)
+{
+    if((mq == (courrier_mq_t)-1) || !msg || (msg_size == 0))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    ShmHandle *h = handle_get(mq);
+    int ret      = h ? ring_send(h, msg, msg_size, prio, deadline_ns) : -1;
+
+    if((ret < 0) && (errno != EAGAIN)) // full is a status, not an error to report
+    {
+        perror("ring_send");
+    }
+
+    return ret;
+}
+
+long platform_queue_capacity(courrier_mq_t mq)
+{
+    ShmHandle *h = handle_get(mq);
+
+    return h ? (long)h->hdr->capacity : -1;
+}
+
+long platform_queue_depth(courrier_mq_t mq)
+{
+    ShmHandle *h = handle_get(mq);
+
+    if(!h)
+    {
+        return -1;
+    }
+
+    return (long)(atomic_load_explicit(&h->hdr->head, memory_order_acquire) - atomic_load_explicit(&h->hdr->tail, memory_order_acquire));
+}
+
+ssize_t platform_queue_receive(courrier_mq_t mq, void *buf, size_t buf_size, unsigned *prio)
+{
+    ShmHandle *h = handle_get(mq);
+
+    if(!h)
+    {
+        return -1;
+    }
+
+    if(!h->reader)
+    {
+        errno = EBADF;
+
+        return -1;
+    }
+    ShmRingHdr *hdr     = h->hdr;
+    const uint64_t mask = hdr->capacity - 1;
+    const uint64_t tail = atomic_load_explicit(&hdr->tail, memory_order_relaxed);
+
+    if(atomic_load_explicit(&hdr->head, memory_order_acquire) == tail)
+    {
+        // Empty: clear stale wakeups, park, then re-check so a producer that
+        // raced with us either sees parked=1 or its message is seen here.
+        char wakeup;
+
+        while(recv(atomic_load(&h->wake_fd), &wakeup, sizeof(wakeup), 0) >= 0)
+        {
+        }
+        atomic_store(&hdr->parked, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if(atomic_load_explicit(&hdr->head, memory_order_acquire) == tail)
+        {
+            errno = EAGAIN;
+
+            return -1;
+        }
+        atomic_store(&hdr->parked, 0);
+    }
+    const unsigned char *slot = h->slots + (tail & mask) * hdr->slot_stride;
+    ShmSlotHdr sh;
+    memcpy(&sh, slot, sizeof(sh));
+    const int fits = (sh.len <= buf_size);
+
+    if(fits)
+    {
+        memcpy(buf, slot + sizeof(sh), sh.len);
+
+        if(prio)
+        {
+            *prio = sh.prio;
+        }
+    }
+    // A slot too large for buf is dropped, or it would block the ring for good
+    atomic_store_explicit(&hdr->tail, tail + 1, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if(atomic_load_explicit(&hdr->space_waiters, memory_order_relaxed))
+    {
+        atomic_fetch_add(&hdr->space_seq, 1);
+        futex_wake(&hdr->space_seq);
+    }
+
+    if(!fits)
+    {
+        errno = EMSGSIZE;
+
+        return -1;
+    }
+
+    return (ssize_t)sh.len;
+}
+
+int platform_queue_fd(courrier_mq_t mq)
+{
+    ShmHandle *h = handle_get(mq);
+
+    return (h && h->reader) ? atomic_load(&h->wake_fd) : -1;
+}
+
+int platform_queue_close(courrier_mq_t mq)
+{
+    ShmHandle *h = handle_get(mq);
+
+    if(!h)
+    {
+        return -1;
+    }
+    int fd = atomic_exchange(&h->wake_fd, -1);
+
+    if(h->reader)
+    {
+        atomic_store(&h->hdr->owner_pid, 0);
+    }
+
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+    munmap(h->hdr, h->map_size);
+    handle_free(h);
+
+    return 0;
+}
+
+int platform_queue_unlink(const char *queue_name)
+{
+    char name[SHM_NAME_MAX];
+
+    if(!queue_name || (shm_name_for(name, queue_name) < 0))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    return shm_unlink(name);
+}
+
+int platform_queue_stale(courrier_mq_t mq, const char *queue_name)
+{
+    ShmHandle *h = handle_get(mq);
+    char name[SHM_NAME_MAX];
+    struct stat st;
+
+    if(!h || !queue_name || (shm_name_for(name, queue_name) < 0))
+    {
+        return -1;
+    }
+    int fd = shm_open(name, O_RDONLY, 0);
+
+    if(fd < 0)
+    {
+        return (errno == ENOENT) ? 1 : -1;
+    }
+    int ret = (fstat(fd, &st) < 0) ? -1 : ((st.st_ino != h->ino) || (st.st_dev != h->dev));
+    close(fd);
+
+    return ret;
+}
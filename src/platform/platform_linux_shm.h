@@ -0,0 +1,32 @@
+#ifndef PLATFORM_LINUX_SHM_H
+#define PLATFORM_LINUX_SHM_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif /* ifndef _GNU_SOURCE */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Handle into the process-local table of mapped rings (not a file descriptor).
+typedef int courrier_mq_t;
+
+// Rings have a single consumer: one thread receives from a reader handle
+#define PLATFORM_SHARED_READER 0
+
+#ifndef COURIER_SHM_MAX_HANDLES
+#define COURIER_SHM_MAX_HANDLES 1024
+#endif /* ifndef COURIER_SHM_MAX_HANDLES */
+
+#endif // ifndef PLATFORM_LINUX_SHM_H
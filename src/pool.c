@@ -0,0 +1,240 @@
+// =============================
+// File: src/pool.c
+// =============================
+#include "courier_internal.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Actor pools: several actors competing for the messages of the same queues.
+//
+// An actor owns its queues, so a second actor on the same name would unlink
+// and recreate them. The pool opens them instead, once: the platform queue
+// is shared by the workers (every worker polls the one reader descriptor and
+// the first to receive a message handles it, so an idle worker takes work as
+// soon as it is free), and in-process sends go through a front registered
+// under the queue name, which spreads them over private per-worker mailboxes
+// by depth, and an idle worker steals from its siblings' mailboxes. Workers
+// are ordinary actors started over those queues; they run on their own
+// threads or on the M:N scheduler like any other.
+
+#define POOL_NAME_MAX 64
+
+struct CourierActorPoolRuntime
+{
+    CourierActorMsgDef *defs; // worker w's copy of definition i at w * nb_msgs + i
+    CourierMailbox **mboxes;  // private mailboxes, same layout (NULL without COURIER_INPROC)
+    CourierMailbox **fronts;  // per definition: registered under its queue name
+    CourierMailbox **members; // scratch: one definition's mailboxes, in worker order
+    char (*names)[POOL_NAME_MAX];
+    size_t nb_started;
+};
+
+static void pool_runtime_free(struct CourierActorPoolRuntime *rt)
+{
+    free(rt->defs);
+    free(rt->mboxes);
+    free(rt->fronts);
+    free(rt->members);
+    free(rt->names);
+    free(rt);
+}
+
+// Stop the pool: in-process sends first, then the workers, then the queues
+static int pool_teardown(CourierActorPool *pool, int deadline_ms, CourierCloseStats *stats)
+{
+    struct CourierActorPoolRuntime *rt = pool->rt;
+    CourierCloseStats total            = { 0 };
+    int ret                            = 0;
+
+    for(size_t i = 0; i < pool->nb_msgs; i++)
+    {
+        if(rt->fronts[i])
+        {
+            courier_mailbox_unregister(rt->fronts[i]);
+            courier_writer_cache_evict(pool->msgs[i].queue_name);
+        }
+    }
+
+    for(size_t w = 0; w < rt->nb_started; w++)
+    {
+        CourierCloseStats one = { 0 };
+        ret                   = (courier_actor_close_drain(&pool->workers[w], deadline_ms, &one) < 0) ? -1 : ret;
+        total.processed      += one.processed;
+        total.dropped        += one.dropped;
+    }
+
+    for(size_t m = 0; m < pool->nb_workers * pool->nb_msgs; m++)
+    {
+        if(rt->mboxes[m])
+        {
+            courier_mailbox_unregister(rt->mboxes[m]);
+        }
+    }
+
+    for(size_t i = 0; i < pool->nb_msgs; i++)
+    {
+        if(pool->msgs[i].mq != (courrier_mq_t)-1)
+        {
+            courier_queue_close(pool->msgs[i].mq);
+            courier_queue_unlink(pool->msgs[i].queue_name);
+            pool->msgs[i].mq = (courrier_mq_t)-1;
+        }
+    }
+
+    if(stats)
+    {
+        *stats = total;
+    }
+    free(pool->workers);
+    pool_runtime_free(rt);
+    pool->workers = NULL;
+    pool->rt      = NULL;
+
+    return ret;
+}
+
+// Mailboxes and platform queue of definition i. Registered first, as for a
+// single actor: opening the reader evicts cached writers, so in-process
+// senders resolve to the front from then on.
+static int pool_queue_open(CourierActorPool *pool, size_t i)
+{
+    struct CourierActorPoolRuntime *rt = pool->rt;
+    CourierActorMsgDef *def            = &pool->msgs[i];
+
+    if(COURIER_INPROC)
+    {
+        for(size_t w = 0; w < pool->nb_workers; w++)
+        {
+            CourierMailbox *mb = courier_mailbox_create(NULL, courier_def_queue_size(def), (size_t)def->depth, (size_t)def->depth_max);
+
+            if(!mb)
+            {
+                return -1;
+            }
+            rt->mboxes[w * pool->nb_msgs + i] = mb;
+            rt->members[w]                    = mb;
+        }
+        rt->fronts[i] = courier_mailbox_create_pool(def->queue_name, rt->members, pool->nb_workers);
+
+        if(!rt->fronts[i])
+        {
+            return -1;
+        }
+    }
+    def->mq = courier_def_open_reader(def);
+
+    return (def->mq == (courrier_mq_t)-1) ? -1 : 0;
+}
+
+int courier_actor_pool_init(CourierActorPool *pool, const char *name, CourierActorMsgDef *msgs, size_t nb_msgs, size_t nb_workers,
+                            void *const *user_data)
+{
+    if(!pool || !name || !msgs || (nb_msgs == 0) || (nb_workers == 0))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    pool->name       = name;
+    pool->msgs       = msgs;
+    pool->nb_msgs    = nb_msgs;
+    pool->nb_workers = nb_workers;
+
+    if(courier_actor_msgs_check(msgs, nb_msgs) < 0)
+    {
+        return -1;
+    }
+
+    // Conflation needs all the messages of a queue in one mailbox
+    for(size_t i = 0; i < nb_msgs; i++)
+    {
+        if(msgs[i].conflate)
+        {
+            errno = EINVAL;
+
+            return -1;
+        }
+    }
+    struct CourierActorPoolRuntime *rt = calloc(1, sizeof(*rt));
+    pool->workers                      = calloc(nb_workers, sizeof(*pool->workers));
+
+    if(!rt || !pool->workers || !(rt->defs = calloc(nb_workers * nb_msgs, sizeof(*rt->defs))) ||
+       !(rt->mboxes = calloc(nb_workers * nb_msgs, sizeof(*rt->mboxes))) || !(rt->fronts = calloc(nb_msgs, sizeof(*rt->fronts))) ||
+       !(rt->members = calloc(nb_workers, sizeof(*rt->members))) || !(rt->names = calloc(nb_workers, sizeof(*rt->names))))
+    {
+        free(pool->workers);
+        pool->workers = NULL;
+
+        if(rt)
+        {
+            pool_runtime_free(rt);
+        }
+
+        return -1;
+    }
+    pool->rt = rt;
+
+    for(size_t i = 0; i < nb_msgs; i++)
+    {
+        msgs[i].mq = (courrier_mq_t)-1;
+    }
+
+    for(size_t i = 0; i < nb_msgs; i++)
+    {
+        if(pool_queue_open(pool, i) < 0)
+        {
+            goto fail;
+        }
+    }
+
+    for(size_t w = 0; w < nb_workers; w++)
+    {
+        CourierActorMsgDef *defs = &rt->defs[w * nb_msgs];
+
+        for(size_t i = 0; i < nb_msgs; i++)
+        {
+            defs[i] = msgs[i];
+
+            // A reader only one thread may drain stays with the first worker
+            if(!PLATFORM_SHARED_READER && (w > 0))
+            {
+                defs[i].mq = (courrier_mq_t)-1;
+            }
+        }
+        snprintf(rt->names[w], POOL_NAME_MAX, "%s.%zu", name, w);
+
+        if(courier_actor_init_shared(&pool->workers[w], rt->names[w], defs, nb_msgs, user_data ? user_data[w] : NULL, &rt->mboxes[w * nb_msgs]) < 0)
+        {
+            goto fail;
+        }
+        rt->nb_started++;
+    }
+
+    return 0;
+
+fail:
+    perror("[Courier] pool start");
+    const int err = errno;
+    pool_teardown(pool, 0, NULL);
+    errno = err;
+
+    return -1;
+}
+
+int courier_actor_pool_close_drain(CourierActorPool *pool, int deadline_ms, CourierCloseStats *stats)
+{
+    if(!pool || !pool->rt)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    return pool_teardown(pool, deadline_ms, stats);
+}
+
+void courier_actor_pool_close(CourierActorPool *pool)
+{
+    courier_actor_pool_close_drain(pool, 0, NULL);
+}
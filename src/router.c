@@ -0,0 +1,408 @@
+// =============================
+// File: src/router.c
+// =============================
+#include "courier_internal.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Key-sharded routing over a fixed set of queues.
+//
+// A shard table holds one writer per shard, resolved through the writer cache
+// when the table is built, so a send is a key hash, a jump consistent hash and
+// an index into the table. Resizing builds a new table and publishes it with
+// one atomic store.
+//
+// A table's writers go stale: a shard actor that closes and starts again has a
+// new mailbox (sends to the old one fail with EPIPE) or a new platform queue,
+// and watermarks registered after the table was built are not in its writers.
+// A send that meets either rebuilds the table from the shard names it keeps,
+// the same way as a resize, and retries once.
+//
+// A replaced table may still be read by a send in flight, so it is retired,
+// and freed (releasing its writers) as soon as no send is in progress: the
+// resizer checks after publishing, otherwise the last send out does.
+
+typedef struct
+{
+    int slot; // writer cache reference
+    CourierWriter w;
+    char *name;
+} RouterShard;
+
+typedef struct RouterTable
+{
+    struct RouterTable *retired; // tables replaced and not freed yet
+    unsigned wm_generation;      // courier_watermark_generation() when the writers were resolved
+    size_t nb_shards;
+    RouterShard shards[];
+} RouterTable;
+
+struct CourierRouterRuntime
+{
+    _Atomic(RouterTable *) table;
+    _Atomic(RouterTable *) retired; // chain through RouterTable.retired
+    _Atomic unsigned senders;       // sends between loading the table and done with it
+    pthread_mutex_t lock;           // serializes table changes and frees
+};
+
+// Jump consistent hash (Lamping & Veach): the bucket of key among nb_buckets,
+// which only changes, towards the new bucket, when nb_buckets grows.
+static size_t jump_hash(uint64_t key, size_t nb_buckets)
+{
+    int64_t b = -1;
+    int64_t j = 0;
+
+    while(j < (int64_t)nb_buckets)
+    {
+        b   = j;
+        key = key * 2862933555777941757ull + 1;
+        j   = (int64_t)((double)(b + 1) * ((double)(1ll << 31) / (double)((key >> 33) + 1)));
+    }
+
+    return (size_t)b;
+}
+
+// Spread sequential ids over the whole 64-bit range (splitmix64 finalizer)
+static uint64_t key_mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+
+    return x;
+}
+
+static uint64_t router_key(const CourierRouter *router, const void *msg, size_t msg_size)
+{
+    if(router->key_fn)
+    {
+        return key_mix(router->key_fn(msg, msg_size));
+    }
+    const unsigned char *k = (const unsigned char *)msg + router->key_offset;
+    uint64_t h             = 0;
+
+    if(router->key_size <= sizeof(h))
+    {
+        memcpy(&h, k, router->key_size);
+
+        return key_mix(h);
+    }
+    // Longer keys (names, UUIDs): FNV-1a
+    h = 1469598103934665603ull;
+
+    for(size_t i = 0; i < router->key_size; i++)
+    {
+        h ^= k[i];
+        h *= 1099511628211ull;
+    }
+
+    return key_mix(h);
+}
+
+// The router is set up and msg holds its key; errno EINVAL otherwise
+static int msg_routable(const CourierRouter *router, const void *msg, size_t msg_size)
+{
+    if(!router || !router->rt || !msg || (msg_size == 0) || (!router->key_fn && (router->key_offset + router->key_size > msg_size)))
+    {
+        errno = EINVAL;
+
+        return 0;
+    }
+
+    return 1;
+}
+
+static void table_free(RouterTable *t)
+{
+    for(size_t i = 0; i < t->nb_shards; i++)
+    {
+        courier_writer_cache_release(t->shards[i].slot, &t->shards[i].w);
+        free(t->shards[i].name);
+    }
+    free(t);
+}
+
+// A table with a writer for every shard, or NULL with errno set
+static RouterTable* table_build(const char *const *shards, size_t nb_shards, size_t msg_size)
+{
+    if(!shards || (nb_shards == 0) || (nb_shards > INT32_MAX))
+    {
+        errno = EINVAL;
+
+        return NULL;
+    }
+
+    for(size_t i = 0; i < nb_shards; i++)
+    {
+        if(!shards[i])
+        {
+            errno = EINVAL;
+
+            return NULL;
+        }
+    }
+    RouterTable *t = calloc(1, sizeof(*t) + nb_shards * sizeof(t->shards[0]));
+
+    if(!t)
+    {
+        return NULL;
+    }
+    // Read first: registrations from here on are seen by the next send
+    t->wm_generation = courier_watermark_generation();
+
+    for(size_t i = 0; i < nb_shards; i++)
+    {
+        t->shards[i].name = strdup(shards[i]);
+        t->shards[i].slot = t->shards[i].name ? courier_writer_cache_acquire(shards[i], msg_size, &t->shards[i].w) : -1;
+
+        if(t->shards[i].slot == -1)
+        {
+            free(t->shards[i].name);
+
+            const int err = errno;
+            table_free(t);
+            errno = err;
+
+            return NULL;
+        }
+        t->nb_shards++;
+    }
+
+    return t;
+}
+
+// Free the retired tables if no send can still be reading one. Caller holds
+// the lock.
+static void router_reclaim(struct CourierRouterRuntime *rt)
+{
+    if(atomic_load(&rt->senders) != 0)
+    {
+        return;
+    }
+    RouterTable *t = atomic_exchange(&rt->retired, NULL);
+
+    while(t)
+    {
+        RouterTable *retired = t->retired;
+        table_free(t);
+        t = retired;
+    }
+}
+
+// Replace the current table by t (lock held), retiring the old one
+static void router_publish(struct CourierRouterRuntime *rt, RouterTable *t)
+{
+    RouterTable *old = atomic_load_explicit(&rt->table, memory_order_relaxed);
+    atomic_store(&rt->table, t);
+    old->retired = atomic_load_explicit(&rt->retired, memory_order_relaxed);
+    atomic_store(&rt->retired, old);
+    router_reclaim(rt);
+}
+
+// Rebuild seen, whose writers went stale, from its shard names. 0 when the
+// current table is a fresh one (possibly rebuilt by another sender), -1 with
+// errno set when the writers cannot be resolved.
+static int router_refresh(const CourierRouter *router, const RouterTable *seen)
+{
+    struct CourierRouterRuntime *rt = router->rt;
+    const char **names              = malloc(seen->nb_shards * sizeof(*names));
+
+    if(!names)
+    {
+        return -1;
+    }
+
+    for(size_t i = 0; i < seen->nb_shards; i++)
+    {
+        names[i] = seen->shards[i].name;
+    }
+    int ret = 0;
+    pthread_mutex_lock(&rt->lock);
+
+    if(atomic_load_explicit(&rt->table, memory_order_relaxed) == seen)
+    {
+        // Evicted writers are reopened, the others found in the cache
+        RouterTable *t = table_build(names, seen->nb_shards, router->msg_size);
+
+        if(t)
+        {
+            router_publish(rt, t);
+        }
+        else
+        {
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&rt->lock);
+    free(names);
+
+    return ret;
+}
+
+int courier_router_init(CourierRouter *router, const char *const *shards, size_t nb_shards, size_t msg_size,
+                        size_t key_offset, size_t key_size, CourierKeyFn key_fn)
+{
+    if(!router || (msg_size == 0) || (!key_fn && ((key_size == 0) || (key_offset + key_size > msg_size))))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    if(msg_size > COURIER_MAX_MSG_SIZE)
+    {
+        errno = EMSGSIZE;
+
+        return -1;
+    }
+    router->msg_size   = msg_size;
+    router->key_offset = key_offset;
+    router->key_size   = key_size;
+    router->key_fn     = key_fn;
+    router->rt         = NULL;
+
+    struct CourierRouterRuntime *rt = calloc(1, sizeof(*rt));
+    RouterTable *t                  = rt ? table_build(shards, nb_shards, msg_size) : NULL;
+
+    if(!t)
+    {
+        free(rt);
+
+        return -1;
+    }
+    pthread_mutex_init(&rt->lock, NULL);
+    atomic_init(&rt->table, t);
+    atomic_init(&rt->retired, NULL);
+    atomic_init(&rt->senders, 0);
+    router->rt = rt;
+
+    return 0;
+}
+
+int courier_router_resize(CourierRouter *router, const char *const *shards, size_t nb_shards)
+{
+    if(!router || !router->rt)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    RouterTable *t = table_build(shards, nb_shards, router->msg_size);
+
+    if(!t)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&router->rt->lock);
+    router_publish(router->rt, t);
+    pthread_mutex_unlock(&router->rt->lock);
+
+    return 0;
+}
+
+int courier_router_shard(const CourierRouter *router, const void *msg, size_t msg_size)
+{
+    if(!msg_routable(router, msg, msg_size))
+    {
+        return -1;
+    }
+    const RouterTable *t = atomic_load_explicit(&router->rt->table, memory_order_acquire);
+
+    return (int)jump_hash(router_key(router, msg, msg_size), t->nb_shards);
+}
+
+// Send to one shard. A platform queue is waited on in slices, and checked
+// between them against the queue its name now refers to: EPIPE when stale.
+static int shard_send(const RouterShard *shard, const void *msg, size_t msg_size)
+{
+    if(shard->w.mbox)
+    {
+        return courier_writer_send(&shard->w, msg, msg_size, 0, COURIER_NO_DEADLINE);
+    }
+
+    for(;;)
+    {
+        const uint64_t until = courier_now_ns() + COURIER_WRITER_CHECK_MS * 1000000ull;
+
+        const int ret = courier_writer_send(&shard->w, msg, msg_size, 0, until);
+
+        if((ret == 0) || (errno != EAGAIN))
+        {
+            return ret;
+        }
+
+        if(courier_writer_cache_stale(shard->slot, shard->name, &shard->w))
+        {
+            errno = EPIPE;
+
+            return -1;
+        }
+    }
+}
+
+int courier_router_send(const CourierRouter *router, const void *msg, size_t msg_size)
+{
+    if(!msg_routable(router, msg, msg_size))
+    {
+        return -1;
+    }
+
+    if(msg_size > router->msg_size)
+    {
+        errno = EMSGSIZE;
+
+        return -1;
+    }
+    struct CourierRouterRuntime *rt = router->rt;
+    const uint64_t key              = router_key(router, msg, msg_size);
+    int ret                         = -1;
+
+    // Counted before the table is loaded: a table retired after that waits for us
+    atomic_fetch_add(&rt->senders, 1);
+
+    for(int attempt = 0; attempt < 2; attempt++)
+    {
+        const RouterTable *t = atomic_load(&rt->table);
+
+        if((t->wm_generation != courier_watermark_generation()) && (router_refresh(router, t) == 0))
+        {
+            t = atomic_load(&rt->table);
+        }
+        ret = shard_send(&t->shards[jump_hash(key, t->nb_shards)], msg, msg_size);
+
+        // The shard's reader was recreated since the table was built
+        if((ret == 0) || ((errno != EPIPE) && (errno != EBADF)) || (router_refresh(router, t) < 0))
+        {
+            break;
+        }
+    }
+    const int err = errno;
+
+    if((atomic_fetch_sub(&rt->senders, 1) == 1) && atomic_load_explicit(&rt->retired, memory_order_relaxed) &&
+       (pthread_mutex_trylock(&rt->lock) == 0))
+    {
+        router_reclaim(rt);
+        pthread_mutex_unlock(&rt->lock);
+    }
+    errno = err;
+
+    return ret;
+}
+
+void courier_router_close(CourierRouter *router)
+{
+    if(!router || !router->rt)
+    {
+        return;
+    }
+    table_free(atomic_load(&router->rt->table));
+    router_reclaim(router->rt);
+    pthread_mutex_destroy(&router->rt->lock);
+    free(router->rt);
+    router->rt = NULL;
+}
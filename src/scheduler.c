@@ -0,0 +1,526 @@
+// =============================
+// File: src/scheduler.c
+// =============================
+#include "courier_internal.h"
+#include <stdalign.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// M:N scheduler: a fixed pool of worker threads multiplexes many actors.
+//
+// Every scheduled actor's own epoll set is registered in one shared epoll set
+// with EPOLLONESHOT, so a ready actor is handed out exactly once until it is
+// re-armed after dispatch. That keeps handlers single-threaded per actor
+// without any per-actor lock.
+//
+// Runnable actors are balanced with work stealing: a worker that wakes from
+// the shared epoll set pushes the whole batch onto its own Chase-Lev deque and
+// pops from the bottom, while workers that run dry steal from the top of a
+// randomly chosen victim before going back to sleep. When a worker holds
+// surplus work and someone is asleep, it pokes work_fd so one sleeper wakes up
+// to steal.
+//
+// The timer wheel's timerfd sits in the same set, one-shot as well, so one
+// worker at a time advances it.
+//
+// Closing an actor goes through its control eventfd: the worker that next
+// picks the actor up runs its shutdown, removes it from the pool and posts
+// rt->detached. Since the registration is one-shot, no other worker can be
+// holding the actor.
+
+#ifndef COURIER_SCHED_BATCH
+#define COURIER_SCHED_BATCH 64
+#endif /* ifndef COURIER_SCHED_BATCH */
+
+#define DEQUE_CAPACITY 256 // > COURIER_SCHED_BATCH: a worker only refills an empty deque
+#define DEQUE_MASK (DEQUE_CAPACITY - 1)
+
+// ----- Chase-Lev work-stealing deque (Le et al., PPoPP'13 C11 formulation) -----
+typedef struct
+{
+    alignas(64) _Atomic int64_t top;    // thieves
+    alignas(64) _Atomic int64_t bottom; // owner
+    _Atomic(CourierActor *) items[DEQUE_CAPACITY];
+} WorkDeque;
+
+#define DEQUE_ABORT ((CourierActor *)&deque_abort_marker)
+static const char deque_abort_marker;
+
+static void deque_push(WorkDeque *dq, CourierActor *actor)
+{
+    int64_t b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+    atomic_store_explicit(&dq->items[b & DEQUE_MASK], actor, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+}
+
+static CourierActor* deque_take(WorkDeque *dq)
+{
+    int64_t b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t           = atomic_load_explicit(&dq->top, memory_order_relaxed);
+    CourierActor *actor = NULL;
+
+    if(t <= b)
+    {
+        actor = atomic_load_explicit(&dq->items[b & DEQUE_MASK], memory_order_relaxed);
+
+        if(t == b)
+        {
+            // Last item: race against thieves
+            if(!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            {
+                actor = NULL;
+            }
+            atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+        }
+    }
+    else
+    {
+        atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    }
+
+    return actor;
+}
+
+static CourierActor* deque_steal(WorkDeque *dq)
+{
+    int64_t t = atomic_load_explicit(&dq->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+
+    if(t >= b)
+    {
+        return NULL;
+    }
+    CourierActor *actor = atomic_load_explicit(&dq->items[t & DEQUE_MASK], memory_order_relaxed);
+
+    if(!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+    {
+        return DEQUE_ABORT;
+    }
+
+    return actor;
+}
+
+static int64_t deque_size(WorkDeque *dq)
+{
+    int64_t n = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - atomic_load_explicit(&dq->top, memory_order_relaxed);
+
+    return n > 0 ? n : 0;
+}
+
+// ----- Workers -----
+typedef struct
+{
+    WorkDeque dq;
+    pthread_t thread;
+    uint64_t rng; // xorshift state for victim selection
+    _Atomic uint64_t local_pops;
+    _Atomic uint64_t steals;
+    _Atomic uint64_t steal_attempts;
+    _Atomic uint64_t idle_ns;
+    _Atomic uint64_t wakeups;
+} Worker;
+
+typedef struct
+{
+    int epfd;    // shared epoll set of actor epoll sets
+    int stop_fd; // level-triggered: wakes every worker on stop
+    int work_fd; // edge-triggered: wakes one sleeper to steal
+    int timer_fd; // one-shot: timer wheel due (owned by timer.c)
+    Worker *workers;
+    size_t nb_workers;
+    _Atomic int running;
+    _Atomic int sleeping; // workers blocked in epoll_wait
+} CourierScheduler;
+
+static CourierScheduler sched = { .epfd = -1, .stop_fd = -1, .work_fd = -1, .timer_fd = -1 };
+
+static void stat_add(_Atomic uint64_t *counter, uint64_t v)
+{
+    // Single writer (the owning worker): no RMW needed
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+static void wake_thief(void)
+{
+    // Pairs with the fence in worker_wait: a worker that goes to sleep either
+    // is counted here or sees the surplus just pushed
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if(atomic_load_explicit(&sched.sleeping, memory_order_relaxed) > 0)
+    {
+        const uint64_t one = 1;
+
+        if(write(sched.work_fd, &one, sizeof(one)) < 0)
+        {
+            perror("write(work_fd)");
+        }
+    }
+}
+
+static void worker_run_actor(CourierActor *actor)
+{
+    while((courier_actor_poll(actor, 0) < 0) && (errno == EINTR))
+    {
+    }
+
+    if(actor->rt->stopped)
+    {
+        epoll_ctl(sched.epfd, EPOLL_CTL_DEL, actor->epfd, NULL);
+        sem_post(&actor->rt->detached);
+
+        return; // the actor may be gone from here on
+    }
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = actor };
+
+    if(epoll_ctl(sched.epfd, EPOLL_CTL_MOD, actor->epfd, &ev) < 0)
+    {
+        perror("epoll_ctl(rearm)");
+    }
+}
+
+static CourierActor* worker_steal_from(Worker *self, Worker *victim)
+{
+    stat_add(&self->steal_attempts, 1);
+    CourierActor *actor = deque_steal(&victim->dq);
+
+    if(!actor || (actor == DEQUE_ABORT))
+    {
+        return NULL;
+    }
+
+    if(deque_size(&victim->dq) > 0)
+    {
+        wake_thief(); // victim still has surplus: recruit another sleeper
+    }
+
+    return actor;
+}
+
+static CourierActor* worker_steal(Worker *self)
+{
+    const size_t n = sched.nb_workers;
+
+    // A couple of randomized sweeps over the other workers
+    for(size_t attempt = 0; (n > 1) && (attempt < 2 * n); attempt++)
+    {
+        self->rng ^= self->rng << 13;
+        self->rng ^= self->rng >> 7;
+        self->rng ^= self->rng << 17;
+        Worker *victim      = &sched.workers[self->rng % n];
+        CourierActor *actor = (victim != self) ? worker_steal_from(self, victim) : NULL;
+
+        if(actor)
+        {
+            return actor;
+        }
+    }
+
+    // Then every worker in turn, so no surplus is missed before sleeping
+    for(size_t i = 0; i < n; i++)
+    {
+        Worker *victim      = &sched.workers[i];
+        CourierActor *actor = (victim != self) ? worker_steal_from(self, victim) : NULL;
+
+        if(actor)
+        {
+            return actor;
+        }
+    }
+
+    return NULL;
+}
+
+// Some other worker holds actors it has not started yet
+static int worker_surplus(const Worker *self)
+{
+    for(size_t i = 0; i < sched.nb_workers; i++)
+    {
+        if((&sched.workers[i] != self) && (deque_size(&sched.workers[i].dq) > 0))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Block on the shared epoll set and refill the local deque.
+// Returns 0 to keep going, -1 when the scheduler is stopping.
+static int worker_wait(Worker *self)
+{
+    struct epoll_event events[COURIER_SCHED_BATCH];
+
+    atomic_fetch_add(&sched.sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if(worker_surplus(self))
+    {
+        // Pushed before we were counted as asleep: nobody would wake us for it
+        atomic_fetch_sub(&sched.sleeping, 1);
+
+        return 0;
+    }
+    const uint64_t t0 = courier_now_ns();
+    int n = epoll_wait(sched.epfd, events, COURIER_SCHED_BATCH, -1);
+    stat_add(&self->idle_ns, courier_now_ns() - t0);
+    atomic_fetch_sub(&sched.sleeping, 1);
+
+    if(n < 0)
+    {
+        if(errno == EINTR)
+        {
+            return 0;
+        }
+        perror("epoll_wait(scheduler)");
+
+        return -1;
+    }
+    stat_add(&self->wakeups, 1);
+    int pushed = 0;
+
+    for(int i = 0; i < n; i++)
+    {
+        if(events[i].data.ptr == NULL)
+        {
+            return -1; // stop_fd
+        }
+
+        if(events[i].data.ptr == &sched.work_fd)
+        {
+            uint64_t count;
+
+            if(read(sched.work_fd, &count, sizeof(count)) < 0 && (errno != EAGAIN))
+            {
+                perror("read(work_fd)");
+            }
+            continue; // woken to steal
+        }
+
+        if(events[i].data.ptr == &sched.timer_fd)
+        {
+            courier_timers_run();
+            struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = &sched.timer_fd };
+
+            if(epoll_ctl(sched.epfd, EPOLL_CTL_MOD, sched.timer_fd, &ev) < 0)
+            {
+                perror("epoll_ctl(timer rearm)");
+            }
+            continue;
+        }
+        deque_push(&self->dq, (CourierActor *)events[i].data.ptr);
+        pushed++;
+    }
+
+    if(pushed > 1)
+    {
+        wake_thief();
+    }
+
+    return 0;
+}
+
+static void* worker_loop(void *arg)
+{
+    Worker *self = (Worker *)arg;
+
+    for(;;)
+    {
+        CourierActor *actor = deque_take(&self->dq);
+
+        if(actor)
+        {
+            stat_add(&self->local_pops, 1);
+            worker_run_actor(actor);
+            continue;
+        }
+        actor = worker_steal(self);
+
+        if(actor)
+        {
+            stat_add(&self->steals, 1);
+            worker_run_actor(actor);
+            continue;
+        }
+
+        if(worker_wait(self) < 0)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void scheduler_reset(void)
+{
+    sched = (CourierScheduler){ .epfd = -1, .stop_fd = -1, .work_fd = -1, .timer_fd = -1 };
+}
+
+int courier_scheduler_start(size_t nb_workers)
+{
+    if(atomic_load(&sched.running))
+    {
+        errno = EBUSY;
+
+        return -1;
+    }
+
+    if(nb_workers == 0)
+    {
+        long cpus  = sysconf(_SC_NPROCESSORS_ONLN);
+        nb_workers = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    sched.epfd    = epoll_create1(EPOLL_CLOEXEC);
+    sched.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    sched.work_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    sched.timer_fd = courier_timer_fd();
+    sched.workers = aligned_alloc(64, ((nb_workers * sizeof(Worker)) + 63) & ~(size_t)63);
+
+    if((sched.epfd < 0) || (sched.stop_fd < 0) || (sched.work_fd < 0) || (sched.timer_fd < 0) || !sched.workers)
+    {
+        perror("courier_scheduler_start");
+        goto fail;
+    }
+    memset(sched.workers, 0, nb_workers * sizeof(Worker));
+    struct epoll_event stop = { .events = EPOLLIN, .data.ptr = NULL };
+    struct epoll_event work = { .events = EPOLLIN | EPOLLET, .data.ptr = &sched.work_fd };
+    struct epoll_event tick = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = &sched.timer_fd };
+
+    if((epoll_ctl(sched.epfd, EPOLL_CTL_ADD, sched.stop_fd, &stop) < 0) || (epoll_ctl(sched.epfd, EPOLL_CTL_ADD, sched.work_fd, &work) < 0) ||
+       (epoll_ctl(sched.epfd, EPOLL_CTL_ADD, sched.timer_fd, &tick) < 0))
+    {
+        perror("epoll_ctl");
+        goto fail;
+    }
+
+    // Workers pick steal victims among all nb_workers: publish it before they start
+    sched.nb_workers = nb_workers;
+
+    for(size_t i = 0; i < nb_workers; i++)
+    {
+        sched.workers[i].rng = 0x9e3779b97f4a7c15ull * (i + 1);
+    }
+
+    for(size_t i = 0; i < nb_workers; i++)
+    {
+        if(pthread_create(&sched.workers[i].thread, NULL, worker_loop, &sched.workers[i]) != 0)
+        {
+            perror("pthread_create");
+            sched.nb_workers = i; // only join the ones that started
+            courier_scheduler_stop();
+
+            return -1;
+        }
+    }
+    atomic_store(&sched.running, 1);
+
+    return 0;
+
+fail:
+    if(sched.epfd >= 0)
+    {
+        close(sched.epfd);
+    }
+
+    if(sched.stop_fd >= 0)
+    {
+        close(sched.stop_fd);
+    }
+
+    if(sched.work_fd >= 0)
+    {
+        close(sched.work_fd);
+    }
+    free(sched.workers);
+    scheduler_reset();
+
+    return -1;
+}
+
+void courier_scheduler_stop(void)
+{
+    if(sched.epfd < 0)
+    {
+        return;
+    }
+    atomic_store(&sched.running, 0);
+    const uint64_t one = 1;
+
+    if(write(sched.stop_fd, &one, sizeof(one)) < 0)
+    {
+        perror("write(stop_fd)");
+    }
+
+    for(size_t i = 0; i < sched.nb_workers; i++)
+    {
+        pthread_join(sched.workers[i].thread, NULL);
+    }
+    close(sched.stop_fd);
+    close(sched.work_fd);
+    close(sched.epfd);
+    free(sched.workers);
+    scheduler_reset();
+
+    // Timers armed while the workers drove the wheel need a driver of their own now
+    courier_timers_kick();
+}
+
+size_t courier_scheduler_nb_workers(void)
+{
+    return sched.nb_workers;
+}
+
+int courier_scheduler_stats(size_t worker, CourierWorkerStats *out)
+{
+    if(!out || (worker >= sched.nb_workers))
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+    Worker *w = &sched.workers[worker];
+
+    out->local_pops     = atomic_load_explicit(&w->local_pops, memory_order_relaxed);
+    out->steals         = atomic_load_explicit(&w->steals, memory_order_relaxed);
+    out->steal_attempts = atomic_load_explicit(&w->steal_attempts, memory_order_relaxed);
+    out->idle_ns        = atomic_load_explicit(&w->idle_ns, memory_order_relaxed);
+    out->wakeups        = atomic_load_explicit(&w->wakeups, memory_order_relaxed);
+
+    return 0;
+}
+
+int courier_scheduler_running(void)
+{
+    return atomic_load(&sched.running);
+}
+
+int courier_scheduler_attach(CourierActor *actor)
+{
+    actor->rt->scheduled = 1;
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = actor };
+
+    if(epoll_ctl(sched.epfd, EPOLL_CTL_ADD, actor->epfd, &ev) < 0)
+    {
+        perror("epoll_ctl(attach)");
+        actor->rt->scheduled = 0;
+
+        return -1;
+    }
+
+    return 0;
+}
+
+void courier_scheduler_detach(CourierActor *actor)
+{
+    // The stop signal is already raised on ctl_fd: whichever worker runs the
+    // actor next (or is running it now, once it re-arms) performs the
+    // shutdown and takes it out of the pool.
+    while(sem_wait(&actor->rt->detached) < 0 && (errno == EINTR))
+    {
+    }
+    actor->rt->scheduled = 0;
+}
@@ -0,0 +1,136 @@
+// =============================
+// File: src/stats.c
+// =============================
+#include "courier_internal.h"
+#include <errno.h>
+
+// HDR-style log-linear histograms of queue-wait and handler times.
+//
+// Bucket b < 2^(SUB_BITS+1) holds the value b. Above that, a value with its
+// highest set bit at position msb uses bucket (shift + 1) * SUB + sub, where
+// shift = msb - SUB_BITS and sub are the SUB_BITS bits below the msb. The
+// table is a fixed array of counters, so recording is a handful of relaxed
+// atomic adds and never allocates.
+
+#define HIST_SUB (1u << COURIER_HIST_SUB_BITS)
+
+size_t courier_histogram_bucket(uint64_t value_ns)
+{
+    if(value_ns < 2 * HIST_SUB)
+    {
+        return (size_t)value_ns;
+    }
+
+    if(value_ns >> COURIER_HIST_MAX_BITS)
+    {
+        return COURIER_HIST_BUCKETS - 1;
+    }
+    const unsigned msb   = 63u - (unsigned)__builtin_clzll(value_ns);
+    const unsigned shift = msb - COURIER_HIST_SUB_BITS;
+
+    return (size_t)(shift + 1) * HIST_SUB + (size_t)((value_ns >> shift) & (HIST_SUB - 1));
+}
+
+uint64_t courier_histogram_bucket_max(size_t bucket)
+{
+    if(bucket < 2 * HIST_SUB)
+    {
+        return bucket;
+    }
+
+    if(bucket >= COURIER_HIST_BUCKETS - 1)
+    {
+        return UINT64_MAX;
+    }
+    const unsigned shift = (unsigned)(bucket / HIST_SUB) - 1;
+    const uint64_t sub   = bucket % HIST_SUB;
+
+    return ((HIST_SUB + sub) << shift) + ((1ull << shift) - 1);
+}
+
+void courier_histogram_record(CourierHistogramRt *hist, uint64_t value_ns)
+{
+    atomic_fetch_add_explicit(&hist->buckets[courier_histogram_bucket(value_ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum_ns, value_ns, memory_order_relaxed);
+
+    // min_ns holds ~min so that a zeroed histogram needs no initialization
+    uint64_t inv_min = atomic_load_explicit(&hist->min_ns, memory_order_relaxed);
+
+    while((~value_ns > inv_min) && !atomic_compare_exchange_weak_explicit(&hist->min_ns, &inv_min, ~value_ns, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    uint64_t max = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+
+    while((value_ns > max) && !atomic_compare_exchange_weak_explicit(&hist->max_ns, &max, value_ns, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    // Published last: a snapshot never sees more samples than bucket counts
+    atomic_fetch_add_explicit(&hist->count, 1, memory_order_release);
+}
+
+static void histogram_snapshot(CourierHistogramRt *src, CourierHistogram *dst)
+{
+    dst->count  = atomic_load_explicit(&src->count, memory_order_acquire);
+    dst->sum_ns = atomic_load_explicit(&src->sum_ns, memory_order_relaxed);
+    dst->min_ns = dst->count ? ~atomic_load_explicit(&src->min_ns, memory_order_relaxed) : 0;
+    dst->max_ns = atomic_load_explicit(&src->max_ns, memory_order_relaxed);
+
+    for(size_t i = 0; i < COURIER_HIST_BUCKETS; i++)
+    {
+        dst->buckets[i] = atomic_load_explicit(&src->buckets[i], memory_order_relaxed);
+    }
+}
+
+int courier_actor_stats(const CourierActor *actor, size_t msg_idx, CourierMsgStats *stats)
+{
+    if(!actor || !actor->rt || (msg_idx >= actor->nb_msgs) || !stats)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    if(!actor->rt->stats)
+    {
+        errno = ENOTSUP;
+
+        return -1;
+    }
+    histogram_snapshot(&actor->rt->stats[msg_idx].queue_wait, &stats->queue_wait);
+    histogram_snapshot(&actor->rt->stats[msg_idx].handler,    &stats->handler);
+
+    return 0;
+}
+
+uint64_t courier_histogram_percentile(const CourierHistogram *hist, double percentile)
+{
+    if(!hist || (hist->count == 0))
+    {
+        return 0;
+    }
+    // Sum the buckets instead of trusting count: a snapshot may race a recording
+    uint64_t total = 0;
+
+    for(size_t i = 0; i < COURIER_HIST_BUCKETS; i++)
+    {
+        total += hist->buckets[i];
+    }
+    percentile    = (percentile < 0.0) ? 0.0 : ((percentile > 100.0) ? 100.0 : percentile);
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)total + 0.5);
+    rank          = (rank == 0) ? 1 : rank;
+    uint64_t seen = 0;
+
+    for(size_t i = 0; i < COURIER_HIST_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+
+        if(seen >= rank)
+        {
+            const uint64_t v = courier_histogram_bucket_max(i);
+
+            return (v < hist->max_ns) ? v : hist->max_ns;
+        }
+    }
+
+    return hist->max_ns;
+}
@@ -0,0 +1,555 @@
+// =============================
+// File: src/timer.c
+// =============================
+#include "courier_internal.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// Delayed and periodic sends, kept in a hierarchical timing wheel: four
+// levels of 64 slots, level L holding timers due within 64^(L+1) ticks.
+// Timers sit in intrusive lists, so arming and cancelling are O(1) whatever
+// the number of outstanding timers. When level 0 wraps, the matching slot
+// of the level above is cascaded down (and so on up the levels).
+//
+// The whole wheel runs on a single timerfd armed at the next tick that has
+// work (an expiry or a cascade). While the M:N scheduler runs, the fd is in
+// its shared epoll set and whichever worker picks it up advances the wheel.
+// Otherwise one driver thread, started on first use, waits on it. Any number
+// of drivers may call courier_timers_run: the wheel is advanced under a
+// lock, and messages are sent after releasing it.
+//
+// Timer messages are sent with try_send: a driver may be the only scheduler
+// worker, the one that would drain a full target, and one full queue must
+// not hold back the other due timers. A message that finds its queue full
+// is dropped and counted (courier_timer_dropped).
+
+#ifndef COURIER_TIMER_TICK_NS
+#define COURIER_TIMER_TICK_NS 1000000ull // 1 ms
+#endif /* ifndef COURIER_TIMER_TICK_NS */
+
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1u << WHEEL_BITS)
+#define WHEEL_MASK   ((uint64_t)WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN   ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) // ticks covered by the top level
+
+#define TIMER_CHUNK 1024 // nodes per allocation; ids index into these
+
+enum
+{
+    TIMER_FREE,
+    TIMER_ARMED,     // linked in a wheel slot
+    TIMER_FIRING,    // being sent by a driver, outside the lock
+    TIMER_CANCELLED, // cancelled while firing: freed by that driver
+};
+
+typedef struct TimerNode
+{
+    struct TimerNode *next;   // slot list, fire list or free list
+    struct TimerNode **pprev; // slot list only
+    uint64_t expires;         // tick
+    uint64_t period;          // ticks, 0 = one-shot
+    uint32_t gen;             // bumped on free: stale ids no longer match
+    uint32_t index;
+    uint8_t level;
+    uint8_t slot;
+    uint8_t state;
+    size_t msg_size;
+    char *queue_name;         // name then payload, one allocation
+    void *msg;
+} TimerNode;
+
+static struct
+{
+    pthread_mutex_t lock;
+    int fd;               // CLOCK_MONOTONIC timerfd, -1 until first use
+    int thread_started;   // driver thread for when no scheduler polls fd
+    uint64_t base_ns;     // courier_now_ns of tick 0
+    uint64_t now;         // next tick to process
+    uint64_t armed;       // tick fd is armed for, UINT64_MAX when disarmed
+    size_t pending;       // timers linked in the wheel
+    TimerNode *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t occupied[WHEEL_LEVELS]; // non-empty slots
+    TimerNode **chunks;
+    size_t nb_chunks;
+    TimerNode *free_nodes;
+    atomic_size_t dropped; // sends that found their queue full
+} timers = { .lock = PTHREAD_MUTEX_INITIALIZER, .fd = -1, .armed = UINT64_MAX };
+
+// ----- Wheel -----
+static void wheel_link(TimerNode *t)
+{
+    if(t->expires < timers.now)
+    {
+        t->expires = timers.now;
+    }
+    const uint64_t delta = t->expires - timers.now;
+    // Timers beyond the top level wait in its last reachable slot and are re-placed on cascade
+    const uint64_t at = (delta < WHEEL_SPAN) ? t->expires : timers.now + WHEEL_SPAN - 1;
+    unsigned level    = 0;
+
+    while((level < WHEEL_LEVELS - 1) && ((at - timers.now) >= ((uint64_t)1 << (WHEEL_BITS * (level + 1)))))
+    {
+        level++;
+    }
+    const unsigned slot = (unsigned)((at >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    TimerNode **head    = &timers.slots[level][slot];
+
+    t->level = (uint8_t)level;
+    t->slot  = (uint8_t)slot;
+    t->next  = *head;
+    t->pprev = head;
+
+    if(*head)
+    {
+        (*head)->pprev = &t->next;
+    }
+    *head                    = t;
+    timers.occupied[level] |= (uint64_t)1 << slot;
+}
+
+static void wheel_unlink(TimerNode *t)
+{
+    *t->pprev = t->next;
+
+    if(t->next)
+    {
+        t->next->pprev = t->pprev;
+    }
+
+    if(!timers.slots[t->level][t->slot])
+    {
+        timers.occupied[t->level] &= ~((uint64_t)1 << t->slot);
+    }
+}
+
+// Detach a whole slot list
+static TimerNode* wheel_take(unsigned level, unsigned slot)
+{
+    TimerNode *list = timers.slots[level][slot];
+
+    timers.slots[level][slot] = NULL;
+    timers.occupied[level]   &= ~((uint64_t)1 << slot);
+
+    return list;
+}
+
+// Process every tick up to target, appending due timers at *fire in expiry order
+static void wheel_advance(uint64_t target, TimerNode **fire)
+{
+    if(timers.pending == 0)
+    {
+        timers.now = (target >= timers.now) ? target + 1 : timers.now;
+
+        return;
+    }
+
+    while(timers.now <= target)
+    {
+        if(!timers.occupied[0] && (timers.now & WHEEL_MASK))
+        {
+            // Nothing due before the next cascade
+            const uint64_t next = (timers.now | WHEEL_MASK) + 1;
+            timers.now          = (next <= target) ? next : target + 1;
+            continue;
+        }
+
+        // Level 0 wrapped: bring the next range of each level down
+        for(unsigned level = 1; (level < WHEEL_LEVELS) && !(timers.now & (((uint64_t)1 << (WHEEL_BITS * level)) - 1)); level++)
+        {
+            TimerNode *t = wheel_take(level, (unsigned)((timers.now >> (WHEEL_BITS * level)) & WHEEL_MASK));
+
+            while(t)
+            {
+                TimerNode *next = t->next;
+                wheel_link(t);
+                t = next;
+            }
+        }
+        TimerNode *t = wheel_take(0, (unsigned)(timers.now & WHEEL_MASK));
+
+        while(t)
+        {
+            TimerNode *next = t->next;
+            t->state        = TIMER_FIRING;
+            t->next         = NULL;
+            *fire           = t;
+            fire            = &t->next;
+            timers.pending--;
+            t = next;
+        }
+        timers.now++;
+    }
+}
+
+// Next tick with work: an expiry on level 0 or a cascade above
+static uint64_t wheel_next_tick(void)
+{
+    uint64_t best = UINT64_MAX;
+
+    for(unsigned level = 0; level < WHEEL_LEVELS; level++)
+    {
+        const uint64_t bits = timers.occupied[level];
+
+        if(!bits)
+        {
+            continue;
+        }
+        const unsigned shift = WHEEL_BITS * level;
+        const unsigned cur   = (unsigned)((timers.now >> shift) & WHEEL_MASK);
+        uint64_t rotated     = (bits >> cur) | (cur ? (bits << (WHEEL_SLOTS - cur)) : 0);
+
+        // Above level 0, the current slot was already cascaded unless now sits on its boundary
+        if((level > 0) && (timers.now & (((uint64_t)1 << shift) - 1)))
+        {
+            rotated &= ~(uint64_t)1;
+        }
+        const uint64_t dist = rotated ? (uint64_t)__builtin_ctzll(rotated) : WHEEL_SLOTS;
+        const uint64_t tick = (level == 0) ? timers.now + dist : ((timers.now >> shift) + dist) << shift;
+
+        best = (tick < best) ? tick : best;
+    }
+
+    return best;
+}
+
+static void timers_arm(uint64_t tick)
+{
+    struct itimerspec its = { 0 };
+
+    if(tick != UINT64_MAX)
+    {
+        const uint64_t at = timers.base_ns + tick * COURIER_TIMER_TICK_NS;
+        its.it_value.tv_sec  = (time_t)(at / 1000000000ull);
+        its.it_value.tv_nsec = (long)(at % 1000000000ull);
+
+        if((its.it_value.tv_sec == 0) && (its.it_value.tv_nsec == 0))
+        {
+            its.it_value.tv_nsec = 1; // all zero would disarm
+        }
+    }
+
+    if(timerfd_settime(timers.fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+    {
+        perror("timerfd_settime");
+    }
+    timers.armed = tick;
+}
+
+static uint64_t ticks_from_now(uint64_t delay_ns)
+{
+    const uint64_t ns = courier_now_ns() - timers.base_ns + delay_ns;
+
+    return (ns + COURIER_TIMER_TICK_NS - 1) / COURIER_TIMER_TICK_NS;
+}
+
+// ----- Timer ids -----
+static TimerNode* node_alloc(void)
+{
+    if(!timers.free_nodes)
+    {
+        TimerNode **chunks = realloc(timers.chunks, (timers.nb_chunks + 1) * sizeof(*chunks));
+
+        if(!chunks)
+        {
+            return NULL;
+        }
+        timers.chunks = chunks;
+        TimerNode *chunk = calloc(TIMER_CHUNK, sizeof(*chunk));
+
+        if(!chunk)
+        {
+            return NULL;
+        }
+
+        for(size_t i = TIMER_CHUNK; i-- > 0;)
+        {
+            chunk[i].index    = (uint32_t)(timers.nb_chunks * TIMER_CHUNK + i);
+            chunk[i].next     = timers.free_nodes;
+            timers.free_nodes = &chunk[i];
+        }
+        timers.chunks[timers.nb_chunks++] = chunk;
+    }
+    TimerNode *t      = timers.free_nodes;
+    timers.free_nodes = t->next;
+
+    return t;
+}
+
+static void node_free(TimerNode *t)
+{
+    free(t->queue_name);
+    t->queue_name     = NULL;
+    t->state          = TIMER_FREE;
+    t->gen++;
+    t->next           = timers.free_nodes;
+    timers.free_nodes = t;
+}
+
+static CourierTimerId node_id(const TimerNode *t)
+{
+    return ((uint64_t)t->gen << 32) | ((uint64_t)t->index + 1);
+}
+
+static TimerNode* node_lookup(CourierTimerId id)
+{
+    const uint64_t index = (id & 0xffffffffu) - 1;
+
+    if(((id & 0xffffffffu) == 0) || (index / TIMER_CHUNK >= timers.nb_chunks))
+    {
+        return NULL;
+    }
+    TimerNode *t = &timers.chunks[index / TIMER_CHUNK][index % TIMER_CHUNK];
+
+    return ((t->gen == (uint32_t)(id >> 32)) && (t->state != TIMER_FREE)) ? t : NULL;
+}
+
+// ----- Drivers -----
+static void* timer_thread(void *arg)
+{
+    (void)arg;
+    struct pollfd pfd = { .fd = timers.fd, .events = POLLIN };
+
+    for(;;)
+    {
+        if(poll(&pfd, 1, -1) > 0)
+        {
+            courier_timers_run();
+        }
+    }
+
+    return NULL;
+}
+
+// Called with the lock held, once timers are pending
+static void timers_ensure_driver(void)
+{
+    if(timers.thread_started || courier_scheduler_running())
+    {
+        return;
+    }
+    pthread_t thread;
+
+    if(pthread_create(&thread, NULL, timer_thread, NULL) != 0)
+    {
+        perror("pthread_create(timer)");
+
+        return;
+    }
+    pthread_detach(thread);
+    timers.thread_started = 1;
+}
+
+// Called with the lock held
+static int timers_init(void)
+{
+    if(timers.fd >= 0)
+    {
+        return 0;
+    }
+    timers.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if(timers.fd < 0)
+    {
+        perror("timerfd_create");
+
+        return -1;
+    }
+    timers.base_ns = courier_now_ns();
+
+    return 0;
+}
+
+int courier_timer_fd(void)
+{
+    pthread_mutex_lock(&timers.lock);
+    timers_init();
+    const int fd = timers.fd;
+    pthread_mutex_unlock(&timers.lock);
+
+    return fd;
+}
+
+void courier_timers_run(void)
+{
+    TimerNode *fire = NULL;
+    uint64_t count;
+
+    if((read(timers.fd, &count, sizeof(count)) < 0) && (errno != EAGAIN))
+    {
+        perror("read(timerfd)");
+    }
+    pthread_mutex_lock(&timers.lock);
+    // Only ticks that have fully elapsed: never send early
+    wheel_advance((courier_now_ns() - timers.base_ns) / COURIER_TIMER_TICK_NS, &fire);
+    pthread_mutex_unlock(&timers.lock);
+
+    // Send outside the lock, never waiting for room: a full queue must not
+    // stall scheduling, cancelling or the other due timers
+    for(TimerNode *t = fire; t; t = t->next)
+    {
+        if(courier_try_send_to(t->queue_name, t->msg, t->msg_size) == 0)
+        {
+            continue;
+        }
+
+        if(errno != EAGAIN)
+        {
+            fprintf(stderr, "[Courier timer] send to %s failed: %s\n", t->queue_name, strerror(errno));
+        }
+        else if(atomic_fetch_add(&timers.dropped, 1) == 0)
+        {
+            fprintf(stderr, "[Courier timer] Warn: dropped message to full queue %s (further drops are counted silently)\n", t->queue_name);
+        }
+    }
+    pthread_mutex_lock(&timers.lock);
+
+    while(fire)
+    {
+        TimerNode *t = fire;
+        fire         = t->next;
+
+        if((t->state == TIMER_CANCELLED) || (t->period == 0))
+        {
+            node_free(t);
+            continue;
+        }
+
+        // Periodic: next multiple of the period ahead of the wheel, skipping missed ones
+        t->expires += t->period;
+
+        if(t->expires < timers.now)
+        {
+            t->expires += ((timers.now - t->expires + t->period - 1) / t->period) * t->period;
+        }
+        t->state = TIMER_ARMED;
+        wheel_link(t);
+        timers.pending++;
+    }
+    timers_arm(wheel_next_tick());
+    pthread_mutex_unlock(&timers.lock);
+}
+
+void courier_timers_kick(void)
+{
+    pthread_mutex_lock(&timers.lock);
+
+    if(timers.pending > 0)
+    {
+        timers_ensure_driver();
+    }
+    pthread_mutex_unlock(&timers.lock);
+}
+
+// ----- Public API -----
+static CourierTimerId timer_schedule(const char *queue_name, const void *msg, size_t msg_size, uint64_t delay_ms, uint64_t period_ms)
+{
+    if(!queue_name || !msg || (msg_size == 0))
+    {
+        errno = EINVAL;
+
+        return 0;
+    }
+    const size_t name_len = strlen(queue_name) + 1;
+    char *data            = malloc(name_len + msg_size);
+
+    if(!data)
+    {
+        return 0;
+    }
+    memcpy(data, queue_name, name_len);
+    memcpy(data + name_len, msg, msg_size);
+
+    pthread_mutex_lock(&timers.lock);
+    TimerNode *t = (timers_init() == 0) ? node_alloc() : NULL;
+
+    if(!t)
+    {
+        pthread_mutex_unlock(&timers.lock);
+        free(data);
+
+        return 0;
+    }
+    const uint64_t period_ns = period_ms * 1000000ull;
+    const uint64_t elapsed   = (courier_now_ns() - timers.base_ns) / COURIER_TIMER_TICK_NS;
+
+    if((timers.pending == 0) && (elapsed > timers.now))
+    {
+        // Empty wheel: catch up at once instead of walking the idle ticks later
+        timers.now = elapsed;
+    }
+
+    t->queue_name = data;
+    t->msg        = data + name_len;
+    t->msg_size   = msg_size;
+    t->period     = period_ns ? (period_ns + COURIER_TIMER_TICK_NS - 1) / COURIER_TIMER_TICK_NS : 0;
+    t->expires    = ticks_from_now(delay_ms * 1000000ull);
+    t->state      = TIMER_ARMED;
+    wheel_link(t);
+    timers.pending++;
+
+    // The fd only moves earlier: later timers are picked up on the way
+    if(t->expires < timers.armed)
+    {
+        timers_arm(wheel_next_tick());
+    }
+    timers_ensure_driver();
+    const CourierTimerId id = node_id(t);
+    pthread_mutex_unlock(&timers.lock);
+
+    return id;
+}
+
+CourierTimerId courier_send_after(const char *queue_name, const void *msg, size_t msg_size, uint64_t delay_ms)
+{
+    return timer_schedule(queue_name, msg, msg_size, delay_ms, 0);
+}
+
+CourierTimerId courier_send_every(const char *queue_name, const void *msg, size_t msg_size, uint64_t period_ms)
+{
+    if(period_ms == 0)
+    {
+        errno = EINVAL;
+
+        return 0;
+    }
+
+    return timer_schedule(queue_name, msg, msg_size, period_ms, period_ms);
+}
+
+int courier_timer_cancel(CourierTimerId id)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&timers.lock);
+    TimerNode *t = node_lookup(id);
+
+    if(t && (t->state == TIMER_ARMED))
+    {
+        wheel_unlink(t);
+        timers.pending--;
+        node_free(t);
+    }
+    else if(t && (t->state == TIMER_FIRING) && t->period)
+    {
+        t->state = TIMER_CANCELLED; // the firing driver frees it
+    }
+    else
+    {
+        errno = ENOENT;
+        ret   = -1;
+    }
+    pthread_mutex_unlock(&timers.lock);
+
+    return ret;
+}
+
+size_t courier_timer_dropped(void)
+{
+    return atomic_load(&timers.dropped);
+}
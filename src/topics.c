@@ -0,0 +1,689 @@
+// =============================
+// File: src/topics.c
+// =============================
+#include "courier_internal.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Topic-based publish/subscribe. Subscriptions are patterns over '/'
+// separated levels, kept in a trie: one node per level, children sorted by
+// name for binary search, and the '+' and '#' wildcards as two dedicated
+// children. Matching a topic walks at most two branches per level, so its
+// cost depends on the depth of the topic and on how many patterns actually
+// match, not on the number of subscriptions.
+//
+// Publishers rarely match at all: the resolved subscriber list of a topic
+// (sorted, without duplicates, names copied into one allocation) is a route,
+// cached in a small set-associative table keyed by the topic string. A
+// publish is a hash, a few string compares and one courier_msg_publish over
+// the route. Routes are reference counted so a publisher blocked on a full
+// queue never holds the lock; any subscription change empties the cache.
+
+#ifndef COURIER_TOPIC_CACHE_SLOTS
+#define COURIER_TOPIC_CACHE_SLOTS 1024 // must be a power of two
+#endif /* ifndef COURIER_TOPIC_CACHE_SLOTS */
+
+#define TOPIC_CACHE_WAYS 8 // slots probed per topic
+
+_Static_assert((COURIER_TOPIC_CACHE_SLOTS & (COURIER_TOPIC_CACHE_SLOTS - 1)) == 0, "COURIER_TOPIC_CACHE_SLOTS must be a power of two");
+
+typedef struct TopicNode TopicNode;
+
+typedef struct
+{
+    char *level;
+    TopicNode *node;
+} TopicEdge;
+
+struct TopicNode
+{
+    TopicEdge *children; // sorted by level
+    size_t nb_children;
+    size_t cap_children;
+    TopicNode *plus;  // '+' child
+    TopicNode *multi; // '#' child
+    char **subs;      // queue names subscribed to the pattern ending here
+    size_t nb_subs;
+    size_t cap_subs;
+};
+
+typedef struct
+{
+    _Atomic uint32_t refs;
+    uint64_t hash;
+    const char *topic;
+    size_t count;
+    const char *names[]; // followed by the topic and the names
+} TopicRoute;
+
+// Levels of a topic or pattern, split in place
+typedef struct
+{
+    char buf[COURIER_TOPIC_MAX];
+    const char *levels[COURIER_TOPIC_LEVELS_MAX];
+    size_t nb_levels;
+} TopicLevels;
+
+// Names collected while matching, pointing into the trie
+typedef struct
+{
+    const char **names;
+    size_t count;
+    size_t cap;
+} TopicMatches;
+
+static TopicNode root;
+static TopicRoute *cache[COURIER_TOPIC_CACHE_SLOTS];
+static pthread_rwlock_t topics_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static uint64_t hash_topic(const char *topic)
+{
+    // FNV-1a
+    uint64_t h = 1469598103934665603ull;
+
+    for(const unsigned char *p = (const unsigned char *)topic; *p; p++)
+    {
+        h ^= *p;
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+// Double the capacity of a dynamic array (at least 4 elements)
+static int array_grow(void **array, size_t *cap, size_t elem_size)
+{
+    const size_t new_cap = *cap ? 2 * *cap : 4;
+    void *grown          = realloc(*array, new_cap * elem_size);
+
+    if(!grown)
+    {
+        return -1;
+    }
+    *array = grown;
+    *cap   = new_cap;
+
+    return 0;
+}
+
+// ----- Parsing -----
+// Split text at '/'. Wildcards must fill a whole level, '#' only the last
+// one, and topics (as opposed to patterns) take none.
+static int levels_split(const char *text, int pattern, TopicLevels *out)
+{
+    const size_t len = text ? strlen(text) : 0;
+
+    if((len == 0) || (len >= sizeof(out->buf)))
+    {
+        errno = (len == 0) ? EINVAL : ENAMETOOLONG;
+
+        return -1;
+    }
+    memcpy(out->buf, text, len + 1);
+    out->nb_levels = 0;
+    char *level    = out->buf;
+
+    for(;;)
+    {
+        char *end = strchr(level, '/');
+
+        if(end)
+        {
+            *end = '\0';
+        }
+
+        if(out->nb_levels == COURIER_TOPIC_LEVELS_MAX)
+        {
+            errno = EINVAL;
+
+            return -1;
+        }
+        const int wildcard = (strpbrk(level, "+#") != NULL);
+        const int plus     = !strcmp(level, "+");
+        const int multi    = !strcmp(level, "#");
+
+        if(wildcard && (!pattern || !(plus || multi) || (multi && end)))
+        {
+            errno = EINVAL;
+
+            return -1;
+        }
+        out->levels[out->nb_levels++] = level;
+
+        if(!end)
+        {
+            return 0;
+        }
+        level = end + 1;
+    }
+}
+
+// ----- Trie -----
+// Index of level among node's children, or of where it would be inserted
+static size_t edge_search(const TopicNode *node, const char *level, int *found)
+{
+    size_t lo = 0;
+    size_t hi = node->nb_children;
+
+    while(lo < hi)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        const int cmp    = strcmp(node->children[mid].level, level);
+
+        if(cmp == 0)
+        {
+            *found = 1;
+
+            return mid;
+        }
+
+        if(cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    *found = 0;
+
+    return lo;
+}
+
+static TopicNode* node_find(const TopicNode *node, const char *level)
+{
+    if(!strcmp(level, "+"))
+    {
+        return node->plus;
+    }
+
+    if(!strcmp(level, "#"))
+    {
+        return node->multi;
+    }
+    int found;
+    const size_t idx = edge_search(node, level, &found);
+
+    return found ? node->children[idx].node : NULL;
+}
+
+static TopicNode* node_child(TopicNode *node, const char *level)
+{
+    TopicNode *child = node_find(node, level);
+
+    if(child)
+    {
+        return child;
+    }
+    child = calloc(1, sizeof(*child));
+
+    if(!child)
+    {
+        return NULL;
+    }
+
+    if(!strcmp(level, "+"))
+    {
+        node->plus = child;
+    }
+    else if(!strcmp(level, "#"))
+    {
+        node->multi = child;
+    }
+    else
+    {
+        int found;
+        const size_t idx = edge_search(node, level, &found);
+        char *name       = strdup(level);
+
+        if(!name || ((node->nb_children == node->cap_children) && (array_grow((void **)&node->children, &node->cap_children, sizeof(TopicEdge)) < 0)))
+        {
+            free(name);
+            free(child);
+
+            return NULL;
+        }
+        memmove(&node->children[idx + 1], &node->children[idx], (node->nb_children - idx) * sizeof(TopicEdge));
+        node->children[idx] = (TopicEdge){ name, child };
+        node->nb_children++;
+    }
+
+    return child;
+}
+
+static int node_empty(const TopicNode *node)
+{
+    return !node->nb_children && !node->plus && !node->multi && !node->nb_subs;
+}
+
+static void node_free(TopicNode *node)
+{
+    for(size_t i = 0; i < node->nb_children; i++)
+    {
+        node_free(node->children[i].node);
+        free(node->children[i].level);
+    }
+
+    if(node->plus)
+    {
+        node_free(node->plus);
+    }
+
+    if(node->multi)
+    {
+        node_free(node->multi);
+    }
+
+    for(size_t i = 0; i < node->nb_subs; i++)
+    {
+        free(node->subs[i]);
+    }
+    free(node->children);
+    free(node->subs);
+
+    if(node != &root)
+    {
+        free(node);
+    }
+    else
+    {
+        memset(&root, 0, sizeof(root));
+    }
+}
+
+// Remove queue_name from the pattern levels[depth..] below node, freeing the
+// nodes it leaves empty. Returns 0, or -1 when there was no such subscription.
+static int node_unsubscribe(TopicNode *node, const TopicLevels *pattern, size_t depth, const char *queue_name)
+{
+    if(depth == pattern->nb_levels)
+    {
+        for(size_t i = 0; i < node->nb_subs; i++)
+        {
+            if(!strcmp(node->subs[i], queue_name))
+            {
+                free(node->subs[i]);
+                node->subs[i] = node->subs[--node->nb_subs];
+
+                return 0;
+            }
+        }
+
+        return -1;
+    }
+    const char *level = pattern->levels[depth];
+    TopicNode *child  = node_find(node, level);
+
+    if(!child || (node_unsubscribe(child, pattern, depth + 1, queue_name) < 0))
+    {
+        return -1;
+    }
+
+    if(!node_empty(child))
+    {
+        return 0;
+    }
+    node_free(child);
+
+    if(!strcmp(level, "+"))
+    {
+        node->plus = NULL;
+    }
+    else if(!strcmp(level, "#"))
+    {
+        node->multi = NULL;
+    }
+    else
+    {
+        int found;
+        const size_t idx = edge_search(node, level, &found);
+        free(node->children[idx].level);
+        memmove(&node->children[idx], &node->children[idx + 1], (node->nb_children - idx - 1) * sizeof(TopicEdge));
+        node->nb_children--;
+    }
+
+    return 0;
+}
+
+// ----- Matching -----
+static int matches_add(TopicMatches *m, const TopicNode *node)
+{
+    for(size_t i = 0; i < node->nb_subs; i++)
+    {
+        if((m->count == m->cap) && (array_grow((void **)&m->names, &m->cap, sizeof(*m->names)) < 0))
+        {
+            return -1;
+        }
+        m->names[m->count++] = node->subs[i];
+    }
+
+    return 0;
+}
+
+// '#' also matches the level it hangs from: "a/#" matches "a"
+static int node_match(const TopicNode *node, const TopicLevels *topic, size_t depth, TopicMatches *m)
+{
+    if(node->multi && (matches_add(m, node->multi) < 0))
+    {
+        return -1;
+    }
+
+    if(depth == topic->nb_levels)
+    {
+        return matches_add(m, node);
+    }
+    const TopicNode *exact = node_find(node, topic->levels[depth]);
+
+    if(exact && (node_match(exact, topic, depth + 1, m) < 0))
+    {
+        return -1;
+    }
+
+    if(node->plus && (node_match(node->plus, topic, depth + 1, m) < 0))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int cmp_names(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Resolve a topic into a new route, one reference held by the caller.
+// Called with the lock held for writing.
+static TopicRoute* route_build(const char *topic, uint64_t hash, const TopicLevels *levels)
+{
+    TopicMatches m = { 0 };
+
+    if(node_match(&root, levels, 0, &m) < 0)
+    {
+        free(m.names);
+
+        return NULL;
+    }
+    // A queue subscribed through several matching patterns gets one copy
+    size_t unique = 0;
+    size_t bytes  = strlen(topic) + 1;
+
+    if(m.count > 0)
+    {
+        qsort(m.names, m.count, sizeof(*m.names), cmp_names);
+    }
+
+    for(size_t i = 0; i < m.count; i++)
+    {
+        if((unique == 0) || strcmp(m.names[unique - 1], m.names[i]))
+        {
+            m.names[unique++] = m.names[i];
+            bytes            += strlen(m.names[i]) + 1;
+        }
+    }
+    TopicRoute *route = malloc(sizeof(*route) + unique * sizeof(route->names[0]) + bytes);
+
+    if(!route)
+    {
+        free(m.names);
+
+        return NULL;
+    }
+    char *strings = (char *)&route->names[unique];
+    atomic_init(&route->refs, 1);
+    route->hash  = hash;
+    route->count = unique;
+    route->topic = strings;
+    strings      = stpcpy(strings, topic) + 1;
+
+    for(size_t i = 0; i < unique; i++)
+    {
+        route->names[i] = strings;
+        strings         = stpcpy(strings, m.names[i]) + 1;
+    }
+    free(m.names);
+
+    return route;
+}
+
+static void route_put(TopicRoute *route)
+{
+    if(atomic_fetch_sub_explicit(&route->refs, 1, memory_order_acq_rel) == 1)
+    {
+        free(route);
+    }
+}
+
+// ----- Route cache -----
+// Called with the lock held, for reading or writing
+static TopicRoute* cache_lookup(const char *topic, uint64_t hash)
+{
+    for(size_t i = 0; i < TOPIC_CACHE_WAYS; i++)
+    {
+        TopicRoute *route = cache[(hash + i) & (COURIER_TOPIC_CACHE_SLOTS - 1)];
+
+        if(route && (route->hash == hash) && !strcmp(route->topic, topic))
+        {
+            atomic_fetch_add_explicit(&route->refs, 1, memory_order_relaxed);
+
+            return route;
+        }
+    }
+
+    return NULL;
+}
+
+// Called with the lock held for writing. Takes over the caller's reference
+// on a free slot, or on the first one of the set, evicting its route.
+static void cache_insert(TopicRoute *route)
+{
+    size_t victim = route->hash & (COURIER_TOPIC_CACHE_SLOTS - 1);
+
+    for(size_t i = 0; i < TOPIC_CACHE_WAYS; i++)
+    {
+        const size_t idx = (route->hash + i) & (COURIER_TOPIC_CACHE_SLOTS - 1);
+
+        if(!cache[idx])
+        {
+            victim = idx;
+            break;
+        }
+    }
+
+    if(cache[victim])
+    {
+        route_put(cache[victim]);
+    }
+    atomic_fetch_add_explicit(&route->refs, 1, memory_order_relaxed);
+    cache[victim] = route;
+}
+
+// Called with the lock held for writing
+static void cache_clear(void)
+{
+    for(size_t i = 0; i < COURIER_TOPIC_CACHE_SLOTS; i++)
+    {
+        if(cache[i])
+        {
+            route_put(cache[i]);
+            cache[i] = NULL;
+        }
+    }
+}
+
+// Route of topic, one reference held by the caller. Topics are only split
+// and matched on a cache miss.
+static TopicRoute* route_get(const char *topic)
+{
+    const uint64_t hash = hash_topic(topic);
+
+    pthread_rwlock_rdlock(&topics_lock);
+    TopicRoute *route = cache_lookup(topic, hash);
+    pthread_rwlock_unlock(&topics_lock);
+
+    if(route)
+    {
+        return route;
+    }
+    TopicLevels levels;
+
+    if(levels_split(topic, 0, &levels) < 0)
+    {
+        return NULL;
+    }
+    pthread_rwlock_wrlock(&topics_lock);
+    route = cache_lookup(topic, hash); // resolved meanwhile by another publisher
+
+    if(!route)
+    {
+        route = route_build(topic, hash, &levels);
+
+        if(route)
+        {
+            cache_insert(route);
+        }
+    }
+    pthread_rwlock_unlock(&topics_lock);
+
+    return route;
+}
+
+// ----- Public API -----
+int courier_subscribe(const char *pattern, const char *queue_name)
+{
+    TopicLevels levels;
+
+    if(!queue_name || !*queue_name)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    if(levels_split(pattern, 1, &levels) < 0)
+    {
+        return -1;
+    }
+    int ret = -1;
+    pthread_rwlock_wrlock(&topics_lock);
+    TopicNode *node = &root;
+
+    for(size_t i = 0; (i < levels.nb_levels) && node; i++)
+    {
+        node = node_child(node, levels.levels[i]);
+    }
+
+    if(!node)
+    {
+        errno = ENOMEM;
+        goto out;
+    }
+
+    for(size_t i = 0; i < node->nb_subs; i++)
+    {
+        if(!strcmp(node->subs[i], queue_name))
+        {
+            errno = EEXIST;
+            goto out;
+        }
+    }
+
+    if((node->nb_subs == node->cap_subs) && (array_grow((void **)&node->subs, &node->cap_subs, sizeof(*node->subs)) < 0))
+    {
+        goto out;
+    }
+    char *name = strdup(queue_name);
+
+    if(!name)
+    {
+        goto out;
+    }
+    node->subs[node->nb_subs++] = name;
+    cache_clear();
+    ret = 0;
+
+out:
+    pthread_rwlock_unlock(&topics_lock);
+
+    return ret;
+}
+
+int courier_unsubscribe(const char *pattern, const char *queue_name)
+{
+    TopicLevels levels;
+
+    if(!queue_name)
+    {
+        errno = EINVAL;
+
+        return -1;
+    }
+
+    if(levels_split(pattern, 1, &levels) < 0)
+    {
+        return -1;
+    }
+    pthread_rwlock_wrlock(&topics_lock);
+    const int ret = node_unsubscribe(&root, &levels, 0, queue_name);
+
+    if(ret == 0)
+    {
+        cache_clear();
+    }
+    pthread_rwlock_unlock(&topics_lock);
+
+    if(ret < 0)
+    {
+        errno = ENOENT;
+    }
+
+    return ret;
+}
+
+void courier_topics_clear(void)
+{
+    pthread_rwlock_wrlock(&topics_lock);
+    cache_clear();
+    node_free(&root);
+    pthread_rwlock_unlock(&topics_lock);
+}
+
+int courier_publish_msg(const char *topic, void *msg)
+{
+    // Only valid topics are cached: a wildcard is all a hit has to rule out
+    if(!msg || !topic || strpbrk(topic, "+#"))
+    {
+        courier_msg_release(msg);
+        errno = EINVAL;
+
+        return -1;
+    }
+    TopicRoute *route = route_get(topic);
+
+    if(!route)
+    {
+        courier_msg_release(msg);
+
+        return -1;
+    }
+    const size_t count = route->count;
+    const int ret      = courier_msg_publish(msg, route->names, count);
+    route_put(route);
+
+    return (ret < 0) ? -1 : (int)count;
+}
+
+int courier_publish(const char *topic, const void *msg, size_t msg_size)
+{
+    void *buf = courier_msg_alloc(msg_size);
+
+    if(!buf)
+    {
+        return -1;
+    }
+    memcpy(buf, msg, msg_size);
+
+    return courier_publish_msg(topic, buf);
+}
@@ -0,0 +1,305 @@
+// =============================
+// File: src/writer_cache.c
+// =============================
+#include "courier_internal.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Process-wide cache of open writers keyed by queue name. A writer is either
+// a platform descriptor or a reference on the in-process mailbox of a reader
+// living in this process (looked up on a miss, so local delivery is picked
+// automatically).
+//
+// Slots live in a fixed open-addressing table and are never freed, so senders
+// can probe it without locks: a sender takes a reference with a CAS that only
+// succeeds while the slot is LIVE, then checks the name. Inserts and evictions
+// are serialized by a mutex. An evicted slot loses its LIVE bit and its
+// descriptor is closed by whoever drops the last reference.
+//
+// A reader in another process may unlink and recreate its queue while a
+// descriptor for the old one is cached here. Platform writers are therefore
+// checked against the queue name every COURIER_WRITER_REVALIDATE
+// acquisitions, and by senders that find the queue full.
+
+#ifndef COURIER_WRITER_CACHE_SLOTS
+#define COURIER_WRITER_CACHE_SLOTS 128 // must be a power of two
+#endif /* ifndef COURIER_WRITER_CACHE_SLOTS */
+
+#ifndef COURIER_WRITER_CACHE_NAME_MAX
+#define COURIER_WRITER_CACHE_NAME_MAX 64
+#endif /* ifndef COURIER_WRITER_CACHE_NAME_MAX */
+
+#ifndef COURIER_WRITER_REVALIDATE
+#define COURIER_WRITER_REVALIDATE 256 // acquisitions between checks of a platform writer
+#endif /* ifndef COURIER_WRITER_REVALIDATE */
+
+#define WC_LIVE 0x80000000u
+#define WC_BUSY 0x40000000u // being filled by an inserter
+#define WC_REFS 0x3fffffffu
+
+typedef struct
+{
+    _Atomic uint32_t state; // WC_LIVE/WC_BUSY | reference count
+    _Atomic uint32_t used;  // slot has been part of a probe chain
+    _Atomic uint64_t hash;
+    _Atomic uint32_t uses;  // acquisitions since the last revalidation
+    CourierWriter w;
+    char name[COURIER_WRITER_CACHE_NAME_MAX];
+} WriterSlot;
+
+static WriterSlot slots[COURIER_WRITER_CACHE_SLOTS];
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t hash_name(const char *name)
+{
+    // FNV-1a
+    uint64_t h = 1469598103934665603ull;
+
+    for(const unsigned char *p = (const unsigned char *)name; *p; p++)
+    {
+        h ^= *p;
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+static void writer_close(CourierWriter *w)
+{
+    if(w->mbox)
+    {
+        courier_mailbox_release(w->mbox);
+    }
+    else
+    {
+        platform_queue_close(w->mq);
+    }
+}
+
+static int slot_lookup(const char *queue_name, uint64_t h, CourierWriter *w)
+{
+    for(size_t i = 0; i < COURIER_WRITER_CACHE_SLOTS; i++)
+    {
+        const size_t idx = (size_t)(h + i) & (COURIER_WRITER_CACHE_SLOTS - 1);
+        WriterSlot *s    = &slots[idx];
+
+        if(!atomic_load_explicit(&s->used, memory_order_acquire))
+        {
+            return -1; // end of the probe chain
+        }
+
+        if(atomic_load_explicit(&s->hash, memory_order_relaxed) != h)
+        {
+            continue;
+        }
+        uint32_t st = atomic_load_explicit(&s->state, memory_order_relaxed);
+        int taken   = 0;
+
+        while(st & WC_LIVE)
+        {
+            if(atomic_compare_exchange_weak_explicit(&s->state, &st, st + 1, memory_order_acquire, memory_order_relaxed))
+            {
+                taken = 1;
+                break;
+            }
+        }
+
+        if(!taken)
+        {
+            continue;
+        }
+
+        // Holding a reference: name and writer are stable
+        if((atomic_load_explicit(&s->hash, memory_order_relaxed) == h) && (strcmp(s->name, queue_name) == 0))
+        {
+            *w = s->w;
+
+            return (int)idx;
+        }
+        courier_writer_cache_release((int)idx, &s->w);
+    }
+
+    return -1;
+}
+
+static int slot_insert(const char *queue_name, uint64_t h, const CourierWriter *w)
+{
+    for(size_t i = 0; i < COURIER_WRITER_CACHE_SLOTS; i++)
+    {
+        const size_t idx = (size_t)(h + i) & (COURIER_WRITER_CACHE_SLOTS - 1);
+        WriterSlot *s    = &slots[idx];
+        uint32_t free_st = 0;
+
+        if(!atomic_compare_exchange_strong(&s->state, &free_st, WC_BUSY))
+        {
+            continue;
+        }
+        strcpy(s->name, queue_name);
+        s->w = *w;
+        atomic_store_explicit(&s->uses, 0, memory_order_relaxed);
+        atomic_store_explicit(&s->hash, h, memory_order_relaxed);
+        atomic_store_explicit(&s->used, 1, memory_order_release);
+        // Publish with one reference held by the caller
+        atomic_store_explicit(&s->state, WC_LIVE | 1u, memory_order_release);
+
+        return (int)idx;
+    }
+
+    return -1;
+}
+
+static int writer_open(const char *queue_name, size_t msg_size, CourierWriter *w)
+{
+    w->wm   = courier_watermark_lookup(queue_name);
+    w->mbox = COURIER_INPROC ? courier_mailbox_lookup(queue_name) : NULL;
+
+    if(w->mbox)
+    {
+        return 0;
+    }
+    w->mq = platform_queue_open_writer(queue_name, msg_size + COURIER_WIRE_HDR, COURIER_QUEUE_DEPTH_DEFAULT);
+
+    return (w->mq == (courrier_mq_t)-1) ? -1 : 0;
+}
+
+int courier_writer_cache_acquire(const char *queue_name, size_t msg_size, CourierWriter *w)
+{
+    const int cacheable = strlen(queue_name) < COURIER_WRITER_CACHE_NAME_MAX;
+    const uint64_t h    = hash_name(queue_name);
+
+    if(cacheable)
+    {
+        // Hot path: lock-free
+        int slot = slot_lookup(queue_name, h, w);
+
+        if(slot >= 0)
+        {
+            const int due = !w->mbox && ((atomic_fetch_add_explicit(&slots[slot].uses, 1, memory_order_relaxed) + 1) % COURIER_WRITER_REVALIDATE == 0);
+
+            if(!due || !courier_writer_cache_stale(slot, queue_name, w))
+            {
+                return slot;
+            }
+            courier_writer_cache_release(slot, w); // evicted: reopen below
+        }
+    }
+    pthread_mutex_lock(&cache_lock);
+    int slot = cacheable ? slot_lookup(queue_name, h, w) : -1;
+
+    if(slot < 0)
+    {
+        if(writer_open(queue_name, msg_size, w) < 0)
+        {
+            slot = -1;
+        }
+        else
+        {
+            slot = cacheable ? slot_insert(queue_name, h, w) : -1;
+
+            if(slot < 0)
+            {
+                slot = COURIER_WRITER_UNCACHED; // table full: caller closes after use
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    return slot;
+}
+
+void courier_writer_cache_release(int slot, CourierWriter *w)
+{
+    if(slot == COURIER_WRITER_UNCACHED)
+    {
+        writer_close(w);
+
+        return;
+    }
+
+    if(slot < 0)
+    {
+        return;
+    }
+    CourierWriter held = *w; // w may point into the slot, which is reusable once released
+    uint32_t prev      = atomic_fetch_sub_explicit(&slots[slot].state, 1, memory_order_acq_rel);
+
+    if(prev == 1u)
+    {
+        // Last reference to an evicted slot; the slot is free again now
+        writer_close(&held);
+    }
+}
+
+static void slot_evict(WriterSlot *s)
+{
+    CourierWriter w = s->w;
+    uint32_t prev   = atomic_fetch_and_explicit(&s->state, ~WC_LIVE, memory_order_acq_rel);
+
+    if((prev & WC_LIVE) && ((prev & WC_REFS) == 0))
+    {
+        writer_close(&w);
+    }
+}
+
+int courier_writer_cache_stale(int slot, const char *queue_name, const CourierWriter *w)
+{
+    if(w->mbox || (platform_queue_stale(w->mq, queue_name) != 1))
+    {
+        return 0;
+    }
+
+    if(slot >= 0)
+    {
+        // The caller's reference keeps the slot from being reused meanwhile
+        pthread_mutex_lock(&cache_lock);
+
+        if(atomic_load(&slots[slot].state) & WC_LIVE)
+        {
+            slot_evict(&slots[slot]);
+        }
+        pthread_mutex_unlock(&cache_lock);
+    }
+
+    return 1;
+}
+
+void courier_writer_cache_evict(const char *queue_name)
+{
+    if(strlen(queue_name) >= COURIER_WRITER_CACHE_NAME_MAX)
+    {
+        return;
+    }
+    const uint64_t h = hash_name(queue_name);
+
+    pthread_mutex_lock(&cache_lock);
+
+    for(size_t i = 0; i < COURIER_WRITER_CACHE_SLOTS; i++)
+    {
+        WriterSlot *s = &slots[(size_t)(h + i) & (COURIER_WRITER_CACHE_SLOTS - 1)];
+
+        if(!atomic_load(&s->used))
+        {
+            break;
+        }
+
+        if((atomic_load(&s->state) & WC_LIVE) && (atomic_load(&s->hash) == h) && (strcmp(s->name, queue_name) == 0))
+        {
+            slot_evict(s);
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void courier_writer_cache_flush(void)
+{
+    pthread_mutex_lock(&cache_lock);
+
+    for(size_t i = 0; i < COURIER_WRITER_CACHE_SLOTS; i++)
+    {
+        if(atomic_load(&slots[i].state) & WC_LIVE)
+        {
+            slot_evict(&slots[i]);
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -60,12 +60,12 @@ int main(void)
     SupervisorState supstate = {0};
 
     CourierActorMsgDef sensor_defs[] = {
-        {Q_SENSOR_TICK, sizeof(TickMsg), sensor_handle_tick, (mqd_t)-1},
+        {.queue_name = Q_SENSOR_TICK, .msg_size = sizeof(TickMsg), .handler = sensor_handle_tick, .mq = (courrier_mq_t)-1},
     };
     CourierActor sensor = {.name = "Sensor", .msgs = sensor_defs, .nb_msgs = 1, .user_data = &sstate};
 
     CourierActorMsgDef sup_defs[] = {
-        {Q_SUP_TEMP, sizeof(TempMsg), supervisor_handle_temp, (mqd_t)-1},
+        {.queue_name = Q_SUP_TEMP, .msg_size = sizeof(TempMsg), .handler = supervisor_handle_temp, .mq = (courrier_mq_t)-1},
     };
     CourierActor supervisor = {.name = "Supervisor", .msgs = sup_defs, .nb_msgs = 1, .user_data = &supstate};
 
@@ -0,0 +1,231 @@
+// =============================
+// File: tests/test_ask.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define Q_CALC  "/courier_test_ask_calc"
+#define Q_ASKER "/courier_test_ask_asker"
+#define NB_ASKS 40
+
+enum
+{
+    TYPE_ADD = 1,
+    TYPE_HOLD,   // answered later, from outside the handler
+    TYPE_IGNORE, // never answered
+};
+
+typedef struct
+{
+    int a;
+    int b;
+} AddMsg;
+
+typedef struct
+{
+    int go;
+} StartMsg;
+
+typedef struct
+{
+    atomic_int requests;
+    atomic_uint_fast64_t held; // token of the last TYPE_HOLD request
+    atomic_int no_request;     // courier_reply refused outside a request
+} CalcState;
+
+typedef struct
+{
+    atomic_int replies;
+    atomic_int bad_replies;
+    atomic_int timeouts;
+    atomic_int held_reply;
+    int on_actor;
+    int issued; // TYPE_ADD asks sent so far, from the asking actor only
+} AskerState;
+
+static CourierActor asker_actor;
+
+static void on_sum(void *user_data, const void *reply, size_t reply_size, int error);
+
+// Ask for the next sums until NB_ASKS are sent, or the reply channel holds
+// no more pending asks (EAGAIN): completions make room for the rest
+static void ask_more(AskerState *st)
+{
+    while(st->issued < NB_ASKS)
+    {
+        AddMsg add = { st->issued, 2 * st->issued };
+
+        if(courier_ask(Q_CALC, TYPE_ADD, &add, sizeof(add), 1000, on_sum, st) < 0)
+        {
+            assert(errno == EAGAIN);
+
+            return;
+        }
+        st->issued++;
+    }
+}
+
+static void calc_add(void *user_data, void *msg)
+{
+    CalcState *st   = (CalcState *)user_data;
+    const AddMsg *m = (const AddMsg *)msg;
+    const int sum   = m->a + m->b;
+
+    atomic_fetch_add(&st->requests, 1);
+    assert(courier_msg_ask() != 0);
+    assert(courier_reply(&sum, sizeof(sum)) == 0);
+}
+
+static void calc_hold(void *user_data, void *msg)
+{
+    (void)msg;
+    atomic_store(&((CalcState *)user_data)->held, courier_msg_ask());
+}
+
+static void calc_ignore(void *user_data, void *msg)
+{
+    CalcState *st = (CalcState *)user_data;
+    (void)msg;
+
+    // Plain typed sends carry no token
+    if(courier_msg_ask() == 0)
+    {
+        errno = 0;
+        atomic_store(&st->no_request, (courier_reply(msg, 1) < 0) && (errno == EINVAL));
+    }
+}
+
+static void on_sum(void *user_data, const void *reply, size_t reply_size, int error)
+{
+    AskerState *st = (AskerState *)user_data;
+    int sum;
+
+    // Continuations run on the asking actor, between its messages
+    st->on_actor = (pthread_self() == asker_actor.thread);
+
+    if(error || (reply_size != sizeof(sum)))
+    {
+        atomic_fetch_add(&st->bad_replies, 1);
+
+        return;
+    }
+    memcpy(&sum, reply, sizeof(sum));
+
+    if(sum % 3 != 0)
+    {
+        atomic_fetch_add(&st->bad_replies, 1);
+    }
+    atomic_fetch_add(&st->replies, 1);
+    ask_more(st);
+}
+
+static void on_ignored(void *user_data, const void *reply, size_t reply_size, int error)
+{
+    AskerState *st = (AskerState *)user_data;
+
+    if((error == ETIMEDOUT) && !reply && (reply_size == 0))
+    {
+        atomic_fetch_add(&st->timeouts, 1);
+    }
+    ask_more(st);
+}
+
+static void on_held(void *user_data, const void *reply, size_t reply_size, int error)
+{
+    AskerState *st = (AskerState *)user_data;
+
+    if(!error && (reply_size == sizeof(int)) && (*(const int *)reply == 42))
+    {
+        atomic_store(&st->held_reply, 1);
+    }
+}
+
+static void asker_start(void *user_data, void *msg)
+{
+    AskerState *st = (AskerState *)user_data;
+    AddMsg any     = { 0, 0 };
+    (void)msg;
+
+    assert(courier_ask(Q_CALC, TYPE_IGNORE, &any, sizeof(any), 30, on_ignored, st) == 0);
+    assert(courier_ask(Q_CALC, TYPE_HOLD, &any, sizeof(any), -1, on_held, st) == 0);
+    ask_more(st);
+    assert(st->issued > 0);
+}
+
+int main(void)
+{
+    CalcState calc   = { 0 };
+    AskerState asker = { 0 };
+    const CourierMsgType calc_types[] = {
+        {.type = TYPE_ADD, .msg_size = sizeof(AddMsg), .handler = calc_add},
+        {.type = TYPE_HOLD, .msg_size = sizeof(AddMsg), .handler = calc_hold},
+        {.type = TYPE_IGNORE, .msg_size = sizeof(AddMsg), .handler = calc_ignore},
+    };
+    CourierActorMsgDef calc_defs[] = {
+        {.queue_name = Q_CALC, .mq = (courrier_mq_t)-1, .types = calc_types, .nb_types = 3},
+    };
+    CourierActorMsgDef asker_defs[] = {
+        {.queue_name = Q_ASKER, .msg_size = sizeof(StartMsg), .handler = asker_start, .mq = (courrier_mq_t)-1},
+    };
+    CourierActor calc_actor;
+    assert(courier_actor_init(&calc_actor, "Calc", calc_defs, 1, &calc) == 0);
+    assert(courier_actor_init(&asker_actor, "Asker", asker_defs, 1, &asker) == 0);
+
+    // Continuations need an actor to run on
+    AddMsg add = { 1, 2 };
+    errno      = 0;
+    assert(courier_ask(Q_CALC, TYPE_ADD, &add, sizeof(add), 100, on_sum, &asker) < 0 && errno == EPERM);
+
+    // Blocking asks from a plain thread
+    int sum = 0;
+    assert(courier_ask_wait(Q_CALC, TYPE_ADD, &add, sizeof(add), &sum, sizeof(sum), 1000) == sizeof(sum));
+    assert(sum == 3);
+
+    for(int i = 0; i < 20; i++)
+    {
+        add.a = i;
+        assert(courier_ask_wait(Q_CALC, TYPE_ADD, &add, sizeof(add), &sum, sizeof(sum), 1000) == sizeof(sum));
+        assert(sum == i + 2);
+    }
+    errno = 0;
+    assert(courier_ask_wait(Q_CALC, TYPE_IGNORE, &add, sizeof(add), &sum, sizeof(sum), 30) < 0 && errno == ETIMEDOUT);
+
+    assert(courier_send_typed(Q_CALC, TYPE_IGNORE, &add, sizeof(add)) == 0);
+    wait_for(&calc.no_request, 1);
+    assert(atomic_load(&calc.no_request) == 1);
+
+    // Continuations: replies, a timeout and a deferred reply
+    StartMsg go = { 1 };
+    assert(courier_send_to(Q_ASKER, &go, sizeof(go)) == 0);
+    wait_for(&asker.replies, NB_ASKS);
+    wait_for(&asker.timeouts, 1);
+    assert(atomic_load(&asker.replies) == NB_ASKS);
+    assert(atomic_load(&asker.bad_replies) == 0);
+    assert(atomic_load(&asker.timeouts) == 1);
+    assert(asker.on_actor);
+
+    for(int tries = 0; tries < 200 && !atomic_load(&calc.held); tries++)
+    {
+        usleep(5 * 1000);
+    }
+    const CourierAskToken held = atomic_load(&calc.held);
+    const int answer           = 42;
+    assert(held != 0);
+    assert(courier_reply_to(held, &answer, sizeof(answer)) == 0);
+    wait_for(&asker.held_reply, 1);
+    assert(atomic_load(&asker.held_reply) == 1);
+
+    courier_actor_close(&asker_actor);
+    courier_actor_close(&calc_actor);
+    courier_writer_cache_flush();
+
+    printf("[test_ask] PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+// =============================
+// File: tests/test_backpressure.c
+// =============================
+#include "courier.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define Q_BP "/courier_test_backpressure"
+#define HIGH 8
+#define LOW 2
+#define TIMED_MS 50
+
+typedef struct
+{
+    int value;
+} Msg;
+
+typedef struct
+{
+    atomic_int gate_open; // the handler holds the actor until set
+    atomic_int entered;
+    atomic_int received;
+    atomic_int highs;
+    atomic_int lows;
+} BpState;
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+static void handle_msg(void *user_data, void *msg)
+{
+    BpState *st = (BpState *)user_data;
+    (void)msg;
+
+    atomic_store(&st->entered, 1);
+
+    while(!atomic_load(&st->gate_open))
+    {
+        usleep(1000);
+    }
+    atomic_fetch_add(&st->received, 1);
+}
+
+static void on_watermark(void *user_data, const char *queue_name, int above)
+{
+    BpState *st = (BpState *)user_data;
+
+    assert(strcmp(queue_name, Q_BP) == 0);
+    atomic_fetch_add(above ? &st->highs : &st->lows, 1);
+}
+
+int main(void)
+{
+    BpState st = { 0 };
+
+    errno = 0;
+    assert(courier_queue_watermarks(Q_BP, LOW, HIGH, on_watermark, &st) < 0 && errno == EINVAL);
+    assert(courier_queue_watermarks(Q_BP, HIGH, LOW, on_watermark, &st) == 0);
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_BP, .msg_size = sizeof(Msg), .handler = handle_msg, .mq = (courrier_mq_t)-1},
+    };
+    CourierActor actor;
+    assert(courier_actor_init(&actor, "Backpressure", defs, 1, &st) == 0);
+
+    // Once the handler is stuck, fill the queue without ever blocking
+    Msg m    = { 0 };
+    int sent = 1;
+    int ret  = 0;
+    assert(courier_try_send_to(Q_BP, &m, sizeof(m)) == 0);
+
+    for(int tries = 0; tries < 200 && !atomic_load(&st.entered); tries++)
+    {
+        usleep(5 * 1000);
+    }
+    assert(atomic_load(&st.entered));
+
+    while(sent < 100000)
+    {
+        m.value = sent;
+        ret     = courier_try_send_to(Q_BP, &m, sizeof(m));
+
+        if(ret < 0)
+        {
+            break;
+        }
+        sent++;
+    }
+    assert(ret < 0 && errno == EAGAIN);
+    assert(sent >= HIGH);
+    assert(courier_queue_depth(Q_BP) >= HIGH);
+    printf("[test_backpressure] queue full after %d sends\n", sent);
+
+    // Reported once per episode, however many sends hit the full queue
+    assert(atomic_load(&st.highs) == 1);
+    assert(courier_try_send_to(Q_BP, &m, sizeof(m)) < 0 && errno == EAGAIN);
+    assert(atomic_load(&st.highs) == 1);
+    assert(atomic_load(&st.lows) == 0);
+
+    // A timed send waits for room, then gives up
+    const uint64_t t0 = now_ms();
+    assert(courier_send_to_timed(Q_BP, &m, sizeof(m), TIMED_MS) < 0 && errno == EAGAIN);
+    const uint64_t waited = now_ms() - t0;
+    assert(waited >= TIMED_MS - 5 && waited < 20 * TIMED_MS);
+
+    // Once the actor catches up, the low mark is reported without another send
+    atomic_store(&st.gate_open, 1);
+
+    for(int tries = 0; tries < 200 && atomic_load(&st.lows) == 0; tries++)
+    {
+        usleep(5 * 1000);
+    }
+    assert(atomic_load(&st.lows) == 1);
+
+    for(int tries = 0; tries < 200 && atomic_load(&st.received) < sent; tries++)
+    {
+        usleep(5 * 1000);
+    }
+    assert(atomic_load(&st.received) == sent);
+    assert(courier_queue_depth(Q_BP) == 0);
+
+    // Room again: a timed send goes through at once
+    assert(courier_send_to_timed(Q_BP, &m, sizeof(m), TIMED_MS) == 0);
+
+    courier_actor_close(&actor);
+    assert(courier_queue_watermarks(Q_BP, 0, 0, NULL, NULL) == 0);
+    courier_writer_cache_flush();
+
+    printf("[test_backpressure] PASS\n");
+
+    return 0;
+}
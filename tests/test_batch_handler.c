@@ -0,0 +1,84 @@
+// =============================
+// File: tests/test_batch_handler.c
+// =============================
+#include "courier.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define Q_READINGS "/courier_test_batch"
+#define BATCH_K 4
+#define NB_READINGS 40
+
+typedef struct
+{
+    int seq;
+    float value;
+} ReadingMsg;
+
+typedef struct
+{
+    atomic_int received;
+    int next_seq;
+    int calls;
+    size_t largest_batch;
+    int out_of_order;
+} AggState;
+
+static void agg_handle_batch(void *user_data, void *msgs, size_t count)
+{
+    AggState *st        = (AggState *)user_data;
+    ReadingMsg *reading = (ReadingMsg *)msgs;
+
+    st->calls++;
+
+    if(count > st->largest_batch)
+    {
+        st->largest_batch = count;
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if(reading[i].seq != st->next_seq)
+        {
+            st->out_of_order = 1;
+        }
+        st->next_seq++;
+    }
+    atomic_fetch_add(&st->received, (int)count);
+}
+
+int main(void)
+{
+    AggState st = { 0 };
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_READINGS, .msg_size = sizeof(ReadingMsg), .mq = (courrier_mq_t)-1, .batch_handler = agg_handle_batch, .batch_max = BATCH_K},
+    };
+    CourierActor agg;
+    assert(courier_actor_init(&agg, "Aggregator", defs, 1, &st) == 0);
+
+    for(int i = 0; i < NB_READINGS; i++)
+    {
+        ReadingMsg m = { .seq = i, .value = (float)i };
+        assert(courier_send_to(Q_READINGS, &m, sizeof(m)) == 0);
+    }
+
+    for(int tries = 0; tries < 200 && atomic_load(&st.received) < NB_READINGS; tries++)
+    {
+        usleep(10 * 1000);
+    }
+    printf("[test_batch_handler] received=%d calls=%d largest_batch=%zu\n", atomic_load(&st.received), st.calls, st.largest_batch);
+
+    assert(atomic_load(&st.received) == NB_READINGS);
+    assert(st.largest_batch <= BATCH_K);
+    assert(!st.out_of_order);
+
+    courier_actor_close(&agg);
+    courier_writer_cache_flush();
+
+    printf("[test_batch_handler] PASS\n");
+
+    return 0;
+}
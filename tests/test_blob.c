@@ -0,0 +1,147 @@
+// =============================
+// File: tests/test_blob.c
+// =============================
+#include "courier.h"
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define Q_FRAME "/courier_test_blob_frame"
+#define FRAME_SIZE (512 * 1024)
+#define SHORT_SIZE (100 * 1024)
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t len;
+    unsigned char pixels[FRAME_SIZE - 8];
+} Frame;
+
+typedef struct
+{
+    atomic_int received;
+    int bad;
+} FrameState;
+
+static void fill_frame(Frame *f, uint32_t id, uint32_t len)
+{
+    f->id  = id;
+    f->len = len;
+
+    for(uint32_t i = 0; i < len; i++)
+    {
+        f->pixels[i] = (unsigned char)(id * 31 + i);
+    }
+}
+
+static void handle_frame(void *user_data, void *msg)
+{
+    FrameState *st = (FrameState *)user_data;
+    const Frame *f = (const Frame *)msg;
+
+    for(uint32_t i = 0; i < f->len; i++)
+    {
+        if(f->pixels[i] != (unsigned char)(f->id * 31 + i))
+        {
+            st->bad = 1;
+            break;
+        }
+    }
+
+    // Short frames are zero-padded to msg_size
+    for(size_t i = f->len; i < sizeof(f->pixels); i++)
+    {
+        if(f->pixels[i] != 0)
+        {
+            st->bad = 1;
+            break;
+        }
+    }
+    atomic_fetch_add(&st->received, 1);
+}
+
+// Shared memory objects left behind by this process
+static int count_blobs(void)
+{
+    char prefix[64];
+    int count = 0;
+    DIR *dir  = opendir("/dev/shm");
+
+    snprintf(prefix, sizeof(prefix), "courier_blob_%d_", (int)getpid());
+
+    if(!dir)
+    {
+        return 0;
+    }
+    struct dirent *e;
+
+    while((e = readdir(dir)) != NULL)
+    {
+        count += (strncmp(e->d_name, prefix, strlen(prefix)) == 0);
+    }
+    closedir(dir);
+
+    return count;
+}
+
+int main(void)
+{
+    FrameState st = { 0 };
+
+    // Limits are checked up front
+    CourierActor actor;
+    CourierActorMsgDef huge[] = {
+        {.queue_name = Q_FRAME, .msg_size = (size_t)1 << 40, .handler = handle_frame, .mq = (courrier_mq_t)-1},
+    };
+    errno = 0;
+    assert(courier_actor_init(&actor, "Huge", huge, 1, &st) < 0 && errno == EMSGSIZE);
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_FRAME, .msg_size = sizeof(Frame), .handler = handle_frame, .mq = (courrier_mq_t)-1},
+    };
+    assert(courier_actor_init(&actor, "Frames", defs, 1, &st) == 0);
+
+    // Copied into shared memory by courier_send_to
+    Frame *frame = malloc(sizeof(*frame));
+    assert(frame);
+    fill_frame(frame, 1, sizeof(frame->pixels));
+    assert(courier_send_to(Q_FRAME, frame, sizeof(*frame)) == 0);
+
+    // Built in place, no copy
+    Frame *blob = courier_blob_alloc(sizeof(*blob));
+    assert(blob);
+    fill_frame(blob, 2, sizeof(blob->pixels));
+    assert(courier_blob_send(Q_FRAME, blob) == 0);
+
+    // Shorter than the definition
+    Frame *small = courier_blob_alloc(SHORT_SIZE);
+    assert(small);
+    fill_frame(small, 3, SHORT_SIZE - 8);
+    assert(courier_blob_send(Q_FRAME, small) == 0);
+
+    // Unsent buffers leave nothing behind
+    courier_blob_free(courier_blob_alloc(4096));
+
+    for(int tries = 0; tries < 200 && atomic_load(&st.received) < 3; tries++)
+    {
+        usleep(10 * 1000);
+    }
+    assert(atomic_load(&st.received) == 3);
+    assert(!st.bad);
+
+    courier_actor_close(&actor);
+    courier_writer_cache_flush();
+    free(frame);
+
+    printf("[test_blob] leftover blobs=%d\n", count_blobs());
+    assert(count_blobs() == 0);
+
+    printf("[test_blob] PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+// =============================
+// File: tests/test_conflate.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define Q_TEMP    "/courier_test_conflate_temp"
+#define Q_SENSORS "/courier_test_conflate_sensors"
+#define NB_SENSOR 4
+#define NB_BURST  8 // fits the default platform queue while the reader is held
+
+#ifndef COURIER_INPROC
+#define COURIER_INPROC 1
+#endif /* ifndef COURIER_INPROC */
+
+typedef struct
+{
+    int seq;
+    uint32_t sensor;
+    int hold; // park the handler until released
+} TempMsg;
+
+typedef struct
+{
+    atomic_int received;
+    atomic_int last_seq[NB_SENSOR];
+    atomic_int held;
+    atomic_int release;
+} TempState;
+
+static void handle_temp(void *user_data, void *msg)
+{
+    TempState *st    = (TempState *)user_data;
+    const TempMsg *t = (const TempMsg *)msg;
+
+    if(t->hold)
+    {
+        atomic_store(&st->held, 1);
+
+        while(!atomic_load(&st->release))
+        {
+            usleep(1000);
+        }
+    }
+
+    if(t->sensor < NB_SENSOR)
+    {
+        atomic_store(&st->last_seq[t->sensor], t->seq);
+    }
+    atomic_fetch_add(&st->received, 1);
+}
+
+// Block the actor in its handler, so that the next sends pile up
+static void hold(TempState *st, const char *queue)
+{
+    const TempMsg t = {.seq = 0, .hold = 1};
+    atomic_store(&st->release, 0);
+    assert(courier_send_to(queue, &t, sizeof(t)) == 0);
+    wait_for(&st->held, 1);
+    assert(atomic_load(&st->held));
+}
+
+int main(void)
+{
+    // Conflation keeps plain messages, keyed by at most 8 bytes inside them
+    const CourierMsgType types[] = { {.type = 1, .msg_size = sizeof(TempMsg), .handler = handle_temp} };
+    CourierActorMsgDef bad[] = {
+        {.queue_name = Q_TEMP, .mq = (courrier_mq_t)-1, .types = types, .nb_types = 1, .conflate = 1},
+        {.queue_name = Q_TEMP, .msg_size = sizeof(TempMsg), .handler = handle_temp, .mq = (courrier_mq_t)-1, .conflate = 4, .key_size = 9},
+        {.queue_name = Q_TEMP, .msg_size = sizeof(TempMsg), .handler = handle_temp, .mq = (courrier_mq_t)-1, .conflate = 4,
+         .key_offset = sizeof(TempMsg), .key_size = 4},
+    };
+    CourierActor actor;
+
+    for(size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        errno = 0;
+        assert(courier_actor_init(&actor, "Bad", &bad[i], 1, NULL) < 0 && errno == EINVAL);
+    }
+    CourierActorPool pool;
+    errno = 0;
+    assert(courier_actor_pool_init(&pool, "Bad", &bad[1], 1, 2, NULL) < 0 && errno == EINVAL);
+
+    // Per queue: a reader that fell behind only sees the latest value
+    static TempState temp;
+    CourierActorMsgDef temp_defs[] = {
+        {.queue_name = Q_TEMP, .msg_size = sizeof(TempMsg), .handler = handle_temp, .mq = (courrier_mq_t)-1, .conflate = 1},
+    };
+    CourierActor temp_actor;
+    assert(courier_actor_init(&temp_actor, "Temp", temp_defs, 1, &temp) == 0);
+    hold(&temp, Q_TEMP);
+
+    for(int seq = 1; seq <= NB_BURST; seq++)
+    {
+        const TempMsg t = {.seq = seq};
+        assert(courier_send_to(Q_TEMP, &t, sizeof(t)) == 0);
+    }
+
+    if(COURIER_INPROC)
+    {
+        // Queue memory stays one slot however many sends pile up
+        assert(courier_queue_depth(Q_TEMP) == 1);
+        assert(courier_queue_capacity(Q_TEMP) == 1);
+
+        for(int seq = NB_BURST + 1; seq <= 10000; seq++)
+        {
+            const TempMsg t = {.seq = (seq == 10000) ? NB_BURST : seq};
+            assert(courier_try_send_to(Q_TEMP, &t, sizeof(t)) == 0);
+        }
+        assert(courier_queue_depth(Q_TEMP) == 1);
+    }
+    atomic_store(&temp.release, 1);
+    wait_for(&temp.received, 2);
+    usleep(20 * 1000);
+    assert(atomic_load(&temp.received) == 2);
+    assert(atomic_load(&temp.last_seq[0]) == NB_BURST);
+
+    // Still delivered when nothing is pending
+    const TempMsg fresh = {.seq = NB_BURST + 1};
+    assert(courier_send_to(Q_TEMP, &fresh, sizeof(fresh)) == 0);
+    wait_for(&temp.received, 3);
+    assert(atomic_load(&temp.last_seq[0]) == NB_BURST + 1);
+    courier_actor_close(&temp_actor);
+
+    // Per key: the latest value of every sensor, none of the stale ones
+    static TempState sensors;
+    CourierActorMsgDef sensor_defs[] = {
+        {.queue_name = Q_SENSORS, .msg_size = sizeof(TempMsg), .handler = handle_temp, .mq = (courrier_mq_t)-1, .conflate = NB_SENSOR,
+         .key_offset = offsetof(TempMsg, sensor), .key_size = sizeof(uint32_t)},
+    };
+    CourierActor sensor_actor;
+    assert(courier_actor_init(&sensor_actor, "Sensors", sensor_defs, 1, &sensors) == 0);
+    hold(&sensors, Q_SENSORS);
+
+    for(int seq = 1; seq <= NB_BURST / NB_SENSOR; seq++)
+    {
+        for(uint32_t s = 0; s < NB_SENSOR; s++)
+        {
+            const TempMsg t = {.seq = seq, .sensor = s};
+            assert(courier_send_to(Q_SENSORS, &t, sizeof(t)) == 0);
+        }
+    }
+
+    if(COURIER_INPROC)
+    {
+        assert(courier_queue_depth(Q_SENSORS) == NB_SENSOR);
+    }
+    atomic_store(&sensors.release, 1);
+    wait_for(&sensors.received, 1 + NB_SENSOR);
+    usleep(20 * 1000);
+    assert(atomic_load(&sensors.received) == 1 + NB_SENSOR);
+
+    for(uint32_t s = 0; s < NB_SENSOR; s++)
+    {
+        assert(atomic_load(&sensors.last_seq[s]) == NB_BURST / NB_SENSOR);
+    }
+
+#if COURIER_INPROC
+    // The key table holds at least the keys asked for, and refuses new ones once full
+    int refused = 0;
+
+    for(uint32_t s = 0; s < 64; s++)
+    {
+        const TempMsg t     = {.sensor = s % NB_SENSOR};
+        const TempMsg other = {.sensor = NB_SENSOR + s};
+        errno               = 0;
+
+        if(courier_try_send_to(Q_SENSORS, &other, sizeof(other)) < 0)
+        {
+            assert(errno == ENOSPC);
+            refused++;
+        }
+        assert(courier_try_send_to(Q_SENSORS, &t, sizeof(t)) == 0);
+    }
+    assert(refused > 0);
+#endif // if COURIER_INPROC
+
+    courier_actor_close(&sensor_actor);
+    courier_writer_cache_flush();
+
+    printf("[test_conflate] PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+// =============================
+// File: tests/test_cpp.cpp
+// =============================
+#include "courier.hpp"
+#include "test_util.h"
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+
+#define NB_MSGS 100
+
+struct TempMsg
+{
+    int seq;
+    float celsius;
+};
+
+struct ResetMsg
+{
+    int keep;
+};
+
+struct AlarmMsg
+{
+    int level;
+};
+
+COURIER_MESSAGE(TempMsg, "/courier_test_cpp_temp");
+COURIER_MESSAGE(ResetMsg, "/courier_test_cpp_reset");
+
+// Traits spelled out, with the optional reader settings
+template <>
+struct courier::message_traits<AlarmMsg>
+{
+    static constexpr const char *queue = "/courier_test_cpp_alarm";
+    static constexpr unsigned priority = 5;
+    static constexpr long depth        = 4;
+};
+
+static_assert(courier::message<TempMsg>::size == sizeof(TempMsg));
+static_assert(courier::message<AlarmMsg>::priority == 5 && courier::message<AlarmMsg>::depth == 4);
+static_assert(courier::message<TempMsg>::priority == 0 && courier::message<TempMsg>::depth_max == 0);
+
+struct Supervisor
+{
+    std::atomic<int> temps{ 0 };
+    std::atomic<int> resets{ 0 };
+    std::atomic<int> alarms{ 0 };
+    int next_seq     = 0;
+    int out_of_order = 0;
+    float sum        = 0;
+
+    void handle(const TempMsg &t)
+    {
+        if(t.seq != next_seq)
+        {
+            out_of_order = 1;
+        }
+        next_seq = t.seq + 1;
+        sum     += t.celsius;
+        temps++;
+    }
+
+    void reset(const ResetMsg &r)
+    {
+        if(!r.keep)
+        {
+            sum = 0;
+        }
+        resets++;
+    }
+};
+
+static void on_alarm(Supervisor &s, const AlarmMsg &a)
+{
+    s.alarms += a.level;
+}
+
+int main()
+{
+    Supervisor state;
+    courier::Actor<Supervisor, TempMsg, courier::on<ResetMsg, &Supervisor::reset>, courier::on<AlarmMsg, on_alarm>> actor(state);
+    assert(actor.start("Supervisor") == 0);
+    assert(actor.depth(2) == 4);
+    assert(courier_queue_capacity(courier::message<AlarmMsg>::queue) == 4);
+
+    float expected = 0;
+
+    for(int seq = 0; seq < NB_MSGS; seq++)
+    {
+        const TempMsg t{ seq, seq * 0.5f };
+        expected += t.celsius;
+        assert(courier::send(t) == 0);
+    }
+    wait_for(state.temps, NB_MSGS);
+    assert(state.temps == NB_MSGS);
+    assert(!state.out_of_order);
+    assert(state.sum == expected);
+
+    assert(courier::send(ResetMsg{ 0 }) == 0);
+    assert(courier::try_send(AlarmMsg{ 2 }) == 0);
+    assert(courier::send_timed(AlarmMsg{ 3 }, 100) == 0);
+    assert(courier::send_to("/courier_test_cpp_alarm", AlarmMsg{ 4 }) == 0);
+    wait_for(state.alarms, 2 + 3 + 4);
+    wait_for(state.resets, 1);
+    assert(state.resets == 1 && state.sum == 0);
+    assert(state.alarms == 2 + 3 + 4);
+
+    // Ports take the size from the type as well
+    assert(courier_port_bind(0, courier::message<TempMsg>::queue, sizeof(TempMsg)) == 0);
+    assert(courier::send_port(0, TempMsg{ NB_MSGS, 1.0f }) == 0);
+    wait_for(state.temps, NB_MSGS + 1);
+    assert(state.temps == NB_MSGS + 1 && !state.out_of_order);
+    assert(courier_port_unbind(0) == 0);
+    errno = 0;
+    assert(courier::send_port(0, TempMsg{}) < 0 && errno == EBADF);
+
+    actor.close();
+    courier_writer_cache_flush();
+
+    printf("[test_cpp] PASS\n");
+
+    return 0;
+}
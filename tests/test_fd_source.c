@@ -0,0 +1,179 @@
+// =============================
+// File: tests/test_fd_source.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define Q_FD "/courier_test_fd_source"
+
+typedef struct
+{
+    int value;
+} Msg;
+
+typedef struct
+{
+    pthread_t fd_thread; // thread that ran the fd handler
+    atomic_int msgs;
+    atomic_int bytes;
+    atomic_int ticks;
+    atomic_int self_removed;
+    atomic_int looped;    // relay messages handled
+    atomic_int stop_loop;
+    CourierActor *actor;
+} FdState;
+
+static void handle_msg(void *user_data, void *msg)
+{
+    FdState *st  = (FdState *)user_data;
+    const Msg *m = (const Msg *)msg;
+
+    if(m->value < 0)
+    {
+        // Relay: sends itself again, so the queue never runs dry
+        atomic_fetch_add(&st->looped, 1);
+
+        if(!atomic_load(&st->stop_loop))
+        {
+            assert(courier_send_to(Q_FD, m, sizeof(*m)) == 0);
+        }
+
+        return;
+    }
+    atomic_fetch_add(&st->msgs, 1);
+}
+
+// Pipe: 'q' makes the handler unregister and close its own descriptor
+static void handle_pipe(void *user_data, int fd, uint32_t events)
+{
+    FdState *st = (FdState *)user_data;
+    char c;
+
+    assert(events & EPOLLIN);
+
+    if(read(fd, &c, 1) != 1)
+    {
+        return;
+    }
+
+    if(c == 'q')
+    {
+        assert(courier_actor_remove_fd(st->actor, fd) == 0);
+        close(fd);
+        atomic_store(&st->self_removed, 1);
+
+        return;
+    }
+    st->fd_thread = pthread_self();
+    atomic_fetch_add(&st->bytes, 1);
+}
+
+static void handle_eventfd(void *user_data, int fd, uint32_t events)
+{
+    FdState *st = (FdState *)user_data;
+    uint64_t count;
+    (void)events;
+
+    if(read(fd, &count, sizeof(count)) == (ssize_t)sizeof(count))
+    {
+        atomic_fetch_add(&st->ticks, (int)count);
+    }
+}
+
+static void run(int workers)
+{
+    FdState st = { 0 };
+    int pipefd[2];
+    assert(pipe(pipefd) == 0);
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(efd >= 0);
+
+    if(workers > 0)
+    {
+        assert(courier_scheduler_start((size_t)workers) == 0);
+    }
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_FD, .msg_size = sizeof(Msg), .handler = handle_msg, .mq = (courrier_mq_t)-1},
+    };
+    CourierActor actor;
+    assert(courier_actor_init(&actor, "FdSource", defs, 1, &st) == 0);
+    st.actor = &actor;
+
+    assert(courier_actor_add_fd(&actor, pipefd[0], EPOLLIN, handle_pipe) == 0);
+    assert(courier_actor_add_fd(&actor, efd, EPOLLIN, handle_eventfd) == 0);
+    assert(courier_actor_add_fd(&actor, efd, EPOLLIN, handle_eventfd) < 0 && errno == EEXIST);
+
+    // Descriptor events and queue messages interleave on the actor thread
+    Msg m = { 1 };
+
+    for(int i = 0; i < 10; i++)
+    {
+        assert(write(pipefd[1], "x", 1) == 1);
+        assert(courier_send_to(Q_FD, &m, sizeof(m)) == 0);
+    }
+    const uint64_t three = 3;
+    assert(write(efd, &three, sizeof(three)) == sizeof(three));
+
+    wait_for(&st.bytes, 10);
+    wait_for(&st.msgs, 10);
+    wait_for(&st.ticks, 3);
+    assert(atomic_load(&st.bytes) == 10);
+    assert(atomic_load(&st.msgs) == 10);
+    assert(atomic_load(&st.ticks) == 3);
+
+    if(workers == 0)
+    {
+        // No relay thread: the actor's own thread ran the callback
+        assert(pthread_equal(st.fd_thread, actor.thread));
+    }
+
+    // A queue refilled as fast as it is drained does not starve the descriptors
+    const Msg relay = { -1 };
+    assert(courier_send_to(Q_FD, &relay, sizeof(relay)) == 0);
+    wait_for(&st.looped, 1000);
+    assert(write(efd, &three, sizeof(three)) == sizeof(three));
+    wait_for(&st.ticks, 6);
+    assert(atomic_load(&st.ticks) == 6);
+    atomic_store(&st.stop_loop, 1);
+
+    // Removed from its own handler
+    assert(write(pipefd[1], "q", 1) == 1);
+    wait_for(&st.self_removed, 1);
+    assert(atomic_load(&st.self_removed));
+    assert(courier_actor_remove_fd(&actor, pipefd[0]) < 0 && errno == ENOENT);
+
+    // Removed from another thread: no more callbacks
+    assert(courier_actor_remove_fd(&actor, efd) == 0);
+    assert(write(efd, &three, sizeof(three)) == sizeof(three));
+    usleep(30 * 1000);
+    assert(atomic_load(&st.ticks) == 6);
+
+    courier_actor_close(&actor);
+
+    if(workers > 0)
+    {
+        courier_scheduler_stop();
+    }
+    close(pipefd[1]);
+    close(efd);
+}
+
+int main(void)
+{
+    run(0); // thread per actor
+    run(2); // M:N scheduler
+
+    courier_writer_cache_flush();
+
+    printf("[test_fd_source] PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+// =============================
+// File: tests/test_graph.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define NB_RAW 200
+
+typedef struct
+{
+    int seq;
+    char text[32];
+} RawMsg;
+
+typedef struct
+{
+    int seq;
+    double value;
+} SampleMsg;
+
+typedef struct
+{
+    int keep;
+} ResetMsg;
+
+typedef struct
+{
+    atomic_int parsed;
+} ParserState;
+
+typedef struct
+{
+    atomic_int samples;
+    atomic_int resets;
+    int next_seq;
+    int out_of_order;
+    double sum;
+} StoreState;
+
+// Main -> parser -> store, with a second message type on the store's queue
+#define COURIER_GRAPH_NAME pipe
+#define COURIER_GRAPH(ACTOR, MSG, EDGE)                 \
+    ACTOR(PARSER, "/courier_test_graph_parser", 32)     \
+    ACTOR(STORE,  "/courier_test_graph_store",  32)     \
+    MSG(PARSER, RAW,    RawMsg,    parser_on_raw)       \
+    MSG(STORE,  SAMPLE, SampleMsg, store_on_sample)     \
+    MSG(STORE,  RESET,  ResetMsg,  store_on_reset)      \
+    EDGE(MAIN,   RAW)                                   \
+    EDGE(MAIN,   RESET)                                 \
+    EDGE(PARSER, SAMPLE)
+#include "courier_graph.h"
+
+void parser_on_raw(void *user_data, const RawMsg *msg)
+{
+    ParserState *st = (ParserState *)user_data;
+    SampleMsg s     = { .seq = msg->seq };
+
+    sscanf(msg->text, "%lf", &s.value);
+    assert(pipe_PARSER_send_SAMPLE(&s) == 0);
+    atomic_fetch_add(&st->parsed, 1);
+}
+
+void store_on_sample(void *user_data, const SampleMsg *msg)
+{
+    StoreState *st = (StoreState *)user_data;
+
+    if(msg->seq != st->next_seq)
+    {
+        st->out_of_order = 1;
+    }
+    st->next_seq = msg->seq + 1;
+    st->sum     += msg->value;
+    atomic_fetch_add(&st->samples, 1);
+}
+
+void store_on_reset(void *user_data, const ResetMsg *msg)
+{
+    StoreState *st = (StoreState *)user_data;
+
+    if(!msg->keep)
+    {
+        st->sum = 0;
+    }
+    atomic_fetch_add(&st->resets, 1);
+}
+
+int main(void)
+{
+    // Addresses and ids are constants
+    _Static_assert(pipe_ACTOR_PARSER == 0 && pipe_ACTOR_STORE == 1 && pipe_NB_ACTORS == 2, "actor addresses");
+    _Static_assert(pipe_MSG_RAW == 1 && pipe_MSG_SAMPLE == 2 && pipe_MSG_RESET == 3, "message ids");
+
+    // Ports on their own
+    errno = 0;
+    assert(courier_port_send(5, &errno, sizeof(errno)) < 0 && errno == EBADF);
+    errno = 0;
+    assert(courier_port_bind(COURIER_PORTS_MAX, "/courier_test_graph_store", 8) < 0 && errno == EINVAL);
+    errno = 0;
+    assert(courier_port_bind(5, "/courier_test_graph_store", COURIER_MAX_MSG_SIZE + 1) < 0 && errno == EMSGSIZE);
+
+    ParserState parser = { 0 };
+    StoreState store   = { 0 };
+    void *const user_data[pipe_NB_ACTORS] = { [pipe_ACTOR_PARSER] = &parser, [pipe_ACTOR_STORE] = &store };
+    pipe_Graph graph;
+    assert(pipe_start(&graph, user_data) == 0);
+
+    errno = 0;
+    assert(courier_port_bind(pipe_ACTOR_STORE, "/courier_test_graph_store", 8) < 0 && errno == EBUSY);
+
+    double expected = 0;
+
+    for(int seq = 0; seq < NB_RAW; seq++)
+    {
+        RawMsg raw = { .seq = seq };
+        snprintf(raw.text, sizeof(raw.text), "%d.25", seq);
+        expected += seq + 0.25;
+        assert(pipe_MAIN_send_RAW(&raw) == 0);
+    }
+    wait_for(&store.samples, NB_RAW);
+    assert(atomic_load(&parser.parsed) == NB_RAW);
+    assert(atomic_load(&store.samples) == NB_RAW);
+    assert(!store.out_of_order);
+    assert(store.sum == expected);
+
+    // The store's queue is a plain multiplexed channel for senders outside the graph
+    ResetMsg reset = { .keep = 0 };
+    assert(courier_send_typed("/courier_test_graph_store", pipe_MSG_RESET, &reset, sizeof(reset)) == 0);
+    assert(pipe_MAIN_send_RESET(&reset) == 0);
+    wait_for(&store.resets, 2);
+    assert(atomic_load(&store.resets) == 2);
+    assert(store.sum == 0);
+
+    // Payloads of the wrong size for their id are dropped
+    assert(courier_send_typed("/courier_test_graph_store", pipe_MSG_SAMPLE, &reset, sizeof(reset)) == 0);
+    assert(pipe_MAIN_send_RESET(&reset) == 0);
+    wait_for(&store.resets, 3);
+    assert(atomic_load(&store.samples) == NB_RAW);
+
+    pipe_stop(&graph);
+    errno = 0;
+    assert(pipe_MAIN_send_RAW(&(RawMsg){ 0 }) < 0 && errno == EBADF);
+    courier_writer_cache_flush();
+
+    printf("[test_graph] PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+// =============================
+// File: tests/test_inproc.c
+// =============================
+#include "courier.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define Q_INPROC "/courier_test_inproc"
+#define NB_SENDERS 4
+#define NB_PER_SENDER 2000
+
+typedef struct
+{
+    int sender;
+    int seq;
+} SeqMsg;
+
+typedef struct
+{
+    atomic_int received;
+    int next_seq[NB_SENDERS];
+    int out_of_order;
+} InprocState;
+
+static void handle_seq(void *user_data, void *msg)
+{
+    InprocState *st = (InprocState *)user_data;
+    SeqMsg *m       = (SeqMsg *)msg;
+
+    // FIFO per sender, whichever thread sent it
+    if(m->seq != st->next_seq[m->sender])
+    {
+        st->out_of_order = 1;
+    }
+    st->next_seq[m->sender] = m->seq + 1;
+    atomic_fetch_add(&st->received, 1);
+}
+
+static void* sender_loop(void *arg)
+{
+    const int sender = (int)(intptr_t)arg;
+
+    for(int i = 0; i < NB_PER_SENDER; i++)
+    {
+        SeqMsg m = { .sender = sender, .seq = i };
+        assert(courier_send_to(Q_INPROC, &m, sizeof(m)) == 0);
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    InprocState st = { 0 };
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_INPROC, .msg_size = sizeof(SeqMsg), .handler = handle_seq, .mq = (courrier_mq_t)-1},
+    };
+    CourierActor actor;
+    assert(courier_actor_init(&actor, "Inproc", defs, 1, &st) == 0);
+
+    // Several producers share the mailbox; slots are released on the actor thread
+    pthread_t threads[NB_SENDERS];
+
+    for(int i = 0; i < NB_SENDERS; i++)
+    {
+        assert(pthread_create(&threads[i], NULL, sender_loop, (void *)(intptr_t)i) == 0);
+    }
+
+    for(int i = 0; i < NB_SENDERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    for(int tries = 0; tries < 500 && atomic_load(&st.received) < NB_SENDERS * NB_PER_SENDER; tries++)
+    {
+        usleep(10 * 1000);
+    }
+    printf("[test_inproc] received=%d\n", atomic_load(&st.received));
+
+    assert(atomic_load(&st.received) == NB_SENDERS * NB_PER_SENDER);
+    assert(!st.out_of_order);
+
+    // A second round reuses the slots recycled by the first one
+    st.next_seq[0] = 0;
+    sender_loop((void *)(intptr_t)0);
+
+    for(int tries = 0; tries < 500 && atomic_load(&st.received) < (NB_SENDERS + 1) * NB_PER_SENDER; tries++)
+    {
+        usleep(10 * 1000);
+    }
+    assert(atomic_load(&st.received) == (NB_SENDERS + 1) * NB_PER_SENDER);
+    assert(!st.out_of_order);
+
+    courier_actor_close(&actor);
+    courier_writer_cache_flush();
+
+    printf("[test_inproc] PASS\n");
+
+    return 0;
+}
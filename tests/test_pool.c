@@ -0,0 +1,180 @@
+// =============================
+// File: tests/test_pool.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define Q_WORK     "/courier_test_pool_work"
+#define NB_WORKERS 4
+#define NB_JOBS    400
+#define NB_REMOTE  20
+#define NB_BURST   40
+
+#ifndef COURIER_INPROC
+#define COURIER_INPROC 1
+#endif /* ifndef COURIER_INPROC */
+
+// Without in-process mailboxes, a shm ring is drained by the first worker alone
+#if !COURIER_INPROC && defined(COURIER_PLATFORM_LINUX_SHM)
+#define SPREAD 0
+#else
+#define SPREAD 1
+#endif // if !COURIER_INPROC && defined(COURIER_PLATFORM_LINUX_SHM)
+
+typedef struct
+{
+    int seq;
+    int hold; // park the worker until released
+} JobMsg;
+
+typedef struct
+{
+    atomic_int jobs;
+} WorkerState;
+
+static atomic_int done;
+static atomic_int in_flight;
+static atomic_int max_in_flight;
+static atomic_int held;
+static atomic_int release_hold;
+static atomic_char seen[NB_JOBS + NB_REMOTE + 1];
+
+static void handle_job(void *user_data, void *msg)
+{
+    WorkerState *w   = (WorkerState *)user_data;
+    const JobMsg *j  = (const JobMsg *)msg;
+    const int active = atomic_fetch_add(&in_flight, 1) + 1;
+    int max          = atomic_load(&max_in_flight);
+
+    while(active > max && !atomic_compare_exchange_weak(&max_in_flight, &max, active))
+    {
+    }
+
+    if(j->hold)
+    {
+        atomic_store(&held, 1);
+
+        while(!atomic_load(&release_hold))
+        {
+            usleep(1000);
+        }
+    }
+    else
+    {
+        // CPU-bound work
+        volatile unsigned x = (unsigned)j->seq;
+
+        for(int i = 0; i < 20000; i++)
+        {
+            x = x * 1103515245u + 12345u;
+        }
+    }
+    atomic_fetch_add(&seen[j->seq], 1);
+    atomic_fetch_add(&w->jobs, 1);
+    atomic_fetch_sub(&in_flight, 1);
+    atomic_fetch_add(&done, 1);
+}
+
+int main(void)
+{
+    static WorkerState workers[NB_WORKERS];
+    void *user_data[NB_WORKERS];
+
+    for(int i = 0; i < NB_WORKERS; i++)
+    {
+        user_data[i] = &workers[i];
+    }
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_WORK, .msg_size = sizeof(JobMsg), .handler = handle_job, .mq = (courrier_mq_t)-1},
+    };
+    CourierActorPool pool;
+    errno = 0;
+    assert(courier_actor_pool_init(&pool, "Workers", defs, 1, 0, NULL) < 0 && errno == EINVAL);
+    assert(courier_actor_pool_init(&pool, "Workers", defs, 1, NB_WORKERS, user_data) == 0);
+    assert(defs[0].mq != (courrier_mq_t)-1);
+
+    // Producers keep the queue name: every job handled once, by all workers
+    for(int seq = 1; seq <= NB_JOBS; seq++)
+    {
+        const JobMsg job = { seq, 0 };
+        assert(courier_send_to(Q_WORK, &job, sizeof(job)) == 0);
+    }
+    wait_for(&done, NB_JOBS);
+    assert(atomic_load(&done) == NB_JOBS);
+
+    for(int i = 0; i < NB_WORKERS; i++)
+    {
+        printf("[test_pool] worker %d: %d jobs\n", i, atomic_load(&workers[i].jobs));
+        assert(!SPREAD || atomic_load(&workers[i].jobs) > 0);
+    }
+
+    if(sysconf(_SC_NPROCESSORS_ONLN) > 1)
+    {
+        assert(atomic_load(&max_in_flight) > 1);
+    }
+
+    // Sends that bypass the in-process mailboxes compete on the platform queue
+    courrier_mq_t raw = courier_queue_open_writer(Q_WORK, sizeof(JobMsg), 10);
+    assert(raw != (courrier_mq_t)-1);
+
+    for(int seq = NB_JOBS + 1; seq <= NB_JOBS + NB_REMOTE; seq++)
+    {
+        const JobMsg job = { seq, 0 };
+        assert(courier_send_mq(raw, &job, sizeof(job)) == 0);
+    }
+    courier_queue_close(raw);
+    wait_for(&done, NB_JOBS + NB_REMOTE);
+    assert(atomic_load(&done) == NB_JOBS + NB_REMOTE);
+
+    for(int seq = 1; seq <= NB_JOBS + NB_REMOTE; seq++)
+    {
+        assert(atomic_load(&seen[seq]) == 1);
+    }
+
+    if(!SPREAD)
+    {
+        courier_actor_pool_close(&pool);
+        courier_writer_cache_flush();
+        printf("[test_pool] PASS\n");
+
+        return 0;
+    }
+
+    // Jobs handed to a busy worker are stolen by the idle ones: all of a burst
+    // completes while one worker is held
+    const JobMsg hold = { 0, 1 };
+    assert(courier_send_to(Q_WORK, &hold, sizeof(hold)) == 0);
+
+    for(int tries = 0; tries < 400 && !atomic_load(&held); tries++)
+    {
+        usleep(1000);
+    }
+    assert(atomic_load(&held));
+    const int before = atomic_load(&done);
+
+    for(int seq = 1; seq <= NB_BURST; seq++)
+    {
+        const JobMsg job = { seq, 0 };
+        assert(courier_send_to(Q_WORK, &job, sizeof(job)) == 0);
+    }
+    wait_for(&done, before + NB_BURST);
+    assert(atomic_load(&done) == before + NB_BURST);
+    atomic_store(&release_hold, 1);
+    wait_for(&done, before + NB_BURST + 1);
+    assert(atomic_load(&done) == before + NB_BURST + 1);
+
+    CourierCloseStats stats;
+    assert(courier_actor_pool_close_drain(&pool, 100, &stats) == 0);
+    assert(stats.dropped == 0);
+    assert(pool.rt == NULL);
+    courier_writer_cache_flush();
+
+    printf("[test_pool] PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+// =============================
+// File: tests/test_priority.c
+// =============================
+#include "courier.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define Q_GATE "/courier_test_prio_gate"
+#define Q_BULK "/courier_test_prio_bulk"
+#define Q_CTRL "/courier_test_prio_ctrl"
+#define NB_BULK 8
+
+typedef struct
+{
+    int id;
+} Msg;
+
+typedef struct
+{
+    atomic_int gate_entered;
+    atomic_int gate_open;
+    atomic_int done;
+    char order[32]; // 'B' bulk / 'C' control, in dispatch order
+    unsigned ctrl_prios[2];
+    int nb_ctrl;
+    int len;
+} PrioState;
+
+static void handle_gate(void *user_data, void *msg)
+{
+    PrioState *st = (PrioState *)user_data;
+    (void)msg;
+    atomic_store(&st->gate_entered, 1);
+
+    while(!atomic_load(&st->gate_open))
+    {
+        usleep(1000);
+    }
+}
+
+static void handle_bulk(void *user_data, void *msg)
+{
+    PrioState *st = (PrioState *)user_data;
+    (void)msg;
+    st->order[st->len++] = 'B';
+    atomic_fetch_add(&st->done, 1);
+}
+
+static void handle_ctrl(void *user_data, void *msg)
+{
+    PrioState *st = (PrioState *)user_data;
+    (void)msg;
+    st->order[st->len++]          = 'C';
+    st->ctrl_prios[st->nb_ctrl++] = courier_msg_priority();
+    atomic_fetch_add(&st->done, 1);
+}
+
+int main(void)
+{
+    PrioState st = { 0 };
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_GATE, .msg_size = sizeof(Msg), .handler = handle_gate, .mq = (courrier_mq_t)-1},
+        {.queue_name = Q_BULK, .msg_size = sizeof(Msg), .handler = handle_bulk, .mq = (courrier_mq_t)-1, .priority = 0},
+        {.queue_name = Q_CTRL, .msg_size = sizeof(Msg), .handler = handle_ctrl, .mq = (courrier_mq_t)-1, .priority = 10},
+    };
+    CourierActor actor;
+    assert(courier_actor_init(&actor, "Prio", defs, 3, &st) == 0);
+
+    // Park the actor inside a handler while both queues fill up
+    Msg m = { 0 };
+    assert(courier_send_to(Q_GATE, &m, sizeof(m)) == 0);
+
+    while(!atomic_load(&st.gate_entered))
+    {
+        usleep(1000);
+    }
+
+    for(int i = 0; i < NB_BULK; i++)
+    {
+        assert(courier_send_to(Q_BULK, &m, sizeof(m)) == 0);
+    }
+    // Through the platform queue explicitly: in-process mailboxes are FIFO
+    courrier_mq_t ctrl = courier_queue_open_writer(Q_CTRL, sizeof(Msg), 10);
+    assert(ctrl != (courrier_mq_t)-1);
+    assert(courier_send_mq_prio(ctrl, &m, sizeof(m), 1) == 0);
+    assert(courier_send_mq_prio(ctrl, &m, sizeof(m), 9) == 0);
+    courier_queue_close(ctrl);
+    atomic_store(&st.gate_open, 1);
+
+    for(int tries = 0; tries < 200 && atomic_load(&st.done) < NB_BULK + 2; tries++)
+    {
+        usleep(10 * 1000);
+    }
+    printf("[test_priority] order=%.*s\n", st.len, st.order);
+
+    assert(atomic_load(&st.done) == NB_BULK + 2);
+    // Control definition is serviced before the bulk backlog
+    assert(st.order[0] == 'C' && st.order[1] == 'C');
+#ifndef COURIER_PLATFORM_LINUX_SHM
+    // mqueues also deliver the higher message priority first within a queue
+    assert(st.ctrl_prios[0] == 9 && st.ctrl_prios[1] == 1);
+#endif // ifndef COURIER_PLATFORM_LINUX_SHM
+
+    courier_actor_close(&actor);
+    courier_writer_cache_flush();
+
+    printf("[test_priority] PASS\n");
+
+    return 0;
+}
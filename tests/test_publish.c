@@ -0,0 +1,140 @@
+// =============================
+// File: tests/test_publish.c
+// =============================
+#include "courier.h"
+#include <assert.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NB_SUBSCRIBERS 4
+#define NB_READINGS 1000
+#define Q_REMOTE "/courier_test_publish_raw"
+
+typedef struct
+{
+    int seq;
+    float value;
+} ReadingMsg;
+
+typedef struct
+{
+    atomic_int received;
+    int next_seq;
+    int out_of_order;
+    const void *seen[NB_READINGS]; // buffer each reading was delivered in
+} SubState;
+
+static void handle_reading(void *user_data, void *msg)
+{
+    SubState *st      = (SubState *)user_data;
+    ReadingMsg *r     = (ReadingMsg *)msg;
+    st->out_of_order |= (r->seq != st->next_seq);
+    st->seen[r->seq]  = msg;
+    st->next_seq++;
+    atomic_fetch_add(&st->received, 1);
+}
+
+int main(void)
+{
+    static CourierActor actors[NB_SUBSCRIBERS];
+    static CourierActorMsgDef defs[NB_SUBSCRIBERS][1];
+    static SubState states[NB_SUBSCRIBERS];
+    static char names[NB_SUBSCRIBERS][32];
+    const char *targets[NB_SUBSCRIBERS + 1];
+
+    for(int i = 0; i < NB_SUBSCRIBERS; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "/courier_test_publish_%d", i);
+        defs[i][0] = (CourierActorMsgDef){.queue_name = names[i], .msg_size = sizeof(ReadingMsg), .handler = handle_reading, .mq = (courrier_mq_t)-1};
+        assert(courier_actor_init(&actors[i], names[i], defs[i], 1, &states[i]) == 0);
+        targets[i] = names[i];
+    }
+
+    // A plain reader (no actor mailbox) gets its copy through the platform queue
+    courrier_mq_t raw = courier_queue_open_reader(Q_REMOTE, sizeof(ReadingMsg), 10);
+    assert(raw != (courrier_mq_t)-1);
+    targets[NB_SUBSCRIBERS] = Q_REMOTE;
+
+    struct pollfd pfd = { .fd = courier_queue_fd(raw), .events = POLLIN };
+
+    for(int i = 0; i < NB_READINGS; i++)
+    {
+        ReadingMsg *r = courier_msg_alloc(sizeof(*r));
+        assert(r);
+        r->seq   = i;
+        r->value = (float)i / 10.0f;
+        assert(courier_msg_publish(r, targets, NB_SUBSCRIBERS + 1) == 0);
+
+        ReadingMsg copy;
+
+        while(courier_queue_receive(raw, &copy, sizeof(copy), NULL) != (ssize_t)sizeof(copy))
+        {
+            assert(poll(&pfd, 1, 1000) == 1);
+        }
+        assert(copy.seq == i);
+    }
+
+    for(int tries = 0; tries < 200; tries++)
+    {
+        int done = 1;
+
+        for(int i = 0; i < NB_SUBSCRIBERS; i++)
+        {
+            done &= (atomic_load(&states[i].received) == NB_READINGS);
+        }
+
+        if(done)
+        {
+            break;
+        }
+        usleep(10 * 1000);
+    }
+
+    for(int i = 0; i < NB_SUBSCRIBERS; i++)
+    {
+        assert(atomic_load(&states[i].received) == NB_READINGS);
+        assert(!states[i].out_of_order);
+    }
+
+#if !defined(COURIER_INPROC) || COURIER_INPROC
+    // Written once: every subscriber handled a reading in the same buffer
+    for(int m = 0; m < NB_READINGS; m++)
+    {
+        for(int i = 1; i < NB_SUBSCRIBERS; i++)
+        {
+            assert(states[i].seen[m] == states[0].seen[m]);
+        }
+    }
+
+    // Buffers are recycled once every handler returned: far fewer distinct ones than readings
+    int distinct = 0;
+
+    for(int m = 0; m < NB_READINGS; m++)
+    {
+        int first = 1;
+
+        for(int k = 0; k < m && first; k++)
+        {
+            first = (states[0].seen[k] != states[0].seen[m]);
+        }
+        distinct += first;
+    }
+    printf("[test_publish] %d readings used %d buffers\n", NB_READINGS, distinct);
+    assert(distinct < NB_READINGS / 2);
+#endif // if !defined(COURIER_INPROC) || COURIER_INPROC
+
+    for(int i = 0; i < NB_SUBSCRIBERS; i++)
+    {
+        courier_actor_close(&actors[i]);
+    }
+    courier_queue_close(raw);
+    courier_queue_unlink(Q_REMOTE);
+    courier_writer_cache_flush();
+
+    printf("[test_publish] PASS\n");
+
+    return 0;
+}
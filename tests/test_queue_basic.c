@@ -3,8 +3,12 @@
 // =============================
 #include "courier.h"
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 typedef struct
@@ -19,8 +23,8 @@ int main(void)
     size_t SZ = sizeof(Payload);
 
     // Reader opens first so attr is defined
-    mqd_t r = courier_queue_open_reader(Q, SZ, 4);
-    assert(r != (mqd_t)-1);
+    courrier_mq_t r = courier_queue_open_reader(Q, SZ, 4);
+    assert(r != (courrier_mq_t)-1);
 
     // Writer: open-on-demand helper
     Payload out = {42, 3.14f};
@@ -29,14 +33,45 @@ int main(void)
 
     // Receive
     Payload in = {0};
-    ssize_t recvd = mq_receive(r, (char *)&in, SZ, NULL);
+    ssize_t recvd = courier_queue_receive(r, &in, SZ, NULL);
     assert(recvd == (ssize_t)SZ);
     assert(in.a == out.a);
     assert(in.b == out.b);
 
+    // A writer in another process wakes the reader, even one it has no
+    // rights on: a child writing to its parent
+    fflush(stdout);
+    const pid_t child = fork();
+    assert(child >= 0);
+
+    if(child == 0)
+    {
+        courrier_mq_t w = courier_queue_open_writer(Q, SZ, 4);
+        out.a           = 43;
+        _exit(((w != (courrier_mq_t)-1) && (courier_send_mq(w, &out, SZ) == 0)) ? 0 : 1);
+    }
+    struct pollfd pfd = { .fd = courier_queue_fd(r), .events = POLLIN };
+
+    // The descriptor may also still hold the wakeup of the first send
+    while(courier_queue_receive(r, &in, SZ, NULL) != (ssize_t)SZ)
+    {
+        assert(poll(&pfd, 1, 5000) == 1);
+    }
+    assert(in.a == 43);
+    int status = 0;
+    assert(waitpid(child, &status, 0) == child);
+    assert(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+
+#ifdef COURIER_PLATFORM_LINUX_SHM
+    // Depths past what a ring can hold are refused (POSIX mqueues lower them to msg_max)
+    errno = 0;
+    assert(courier_queue_open_reader("/courier_test_q_huge", SZ, LONG_MAX) == (courrier_mq_t)-1 && errno == EINVAL);
+#endif // ifdef COURIER_PLATFORM_LINUX_SHM
+
     printf("[test_queue_basic] PASS\n");
 
     courier_queue_close(r);
     courier_queue_unlink(Q);
+    courier_writer_cache_flush();
     return 0;
 }
\ No newline at end of file
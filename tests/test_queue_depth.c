@@ -0,0 +1,148 @@
+// =============================
+// File: tests/test_queue_depth.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define Q_FIXED    "/courier_test_depth_fixed"
+#define Q_ADAPTIVE "/courier_test_depth_adaptive"
+#define Q_DEEP     "/courier_test_depth_deep"
+#define NB_BURST   4000
+
+typedef struct
+{
+    int value;
+} Msg;
+
+typedef struct
+{
+    atomic_int gate_open; // handle_gated holds the actor until set
+    atomic_int entered;
+    atomic_int received;
+} DepthState;
+
+static void handle_gated(void *user_data, void *msg)
+{
+    DepthState *st = (DepthState *)user_data;
+    (void)msg;
+
+    atomic_store(&st->entered, 1);
+
+    while(!atomic_load(&st->gate_open))
+    {
+        usleep(1000);
+    }
+    atomic_fetch_add(&st->received, 1);
+}
+
+static void handle_slow(void *user_data, void *msg)
+{
+    DepthState *st = (DepthState *)user_data;
+    (void)msg;
+
+    usleep(20);
+    atomic_fetch_add(&st->received, 1);
+}
+
+// A definition's depth is what senders can queue before waiting
+static void check_fixed(void)
+{
+    DepthState st = { 0 };
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_FIXED, .msg_size = sizeof(Msg), .handler = handle_gated, .mq = (courrier_mq_t)-1, .depth = 4},
+    };
+    CourierActor actor;
+    assert(courier_actor_init(&actor, "Fixed", defs, 1, &st) == 0);
+    assert(defs[0].depth == 4);
+    assert(courier_queue_capacity(Q_FIXED) == 4);
+
+    Msg m = { 0 };
+    assert(courier_send_to(Q_FIXED, &m, sizeof(m)) == 0);
+    wait_for(&st.entered, 1);
+
+    int queued = 0;
+
+    while(courier_try_send_to(Q_FIXED, &m, sizeof(m)) == 0)
+    {
+        queued++;
+    }
+    assert(errno == EAGAIN);
+    assert(queued == 4);
+
+    atomic_store(&st.gate_open, 1);
+    wait_for(&st.received, 1 + queued);
+    assert(atomic_load(&st.received) == 1 + queued);
+    courier_actor_close(&actor);
+}
+
+// An adaptive mailbox grows under a burst, within its bounds, and loses nothing
+static void check_adaptive(void)
+{
+    DepthState st = { 0 };
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_ADAPTIVE, .msg_size = sizeof(Msg), .handler = handle_slow, .mq = (courrier_mq_t)-1, .depth = 4, .depth_max = 64},
+    };
+    CourierActor actor;
+    assert(courier_actor_init(&actor, "Adaptive", defs, 1, &st) == 0);
+    assert(courier_queue_capacity(Q_ADAPTIVE) == 4);
+
+    Msg m = { 0 };
+
+    for(int i = 0; i < NB_BURST; i++)
+    {
+        assert(courier_send_to(Q_ADAPTIVE, &m, sizeof(m)) == 0);
+    }
+    wait_for(&st.received, NB_BURST);
+    assert(atomic_load(&st.received) == NB_BURST);
+
+    const long capacity = courier_queue_capacity(Q_ADAPTIVE);
+    printf("[test_queue_depth] adaptive mailbox: 4 -> %ld\n", capacity);
+#if !defined(COURIER_INPROC) || COURIER_INPROC
+    assert(capacity > 4 && capacity <= 64);
+#else
+    assert(capacity == 4); // platform queues keep their size
+#endif // if !defined(COURIER_INPROC) || COURIER_INPROC
+    courier_actor_close(&actor);
+}
+
+// Depths past the system limits are lowered and reported back
+static void check_limits(void)
+{
+    DepthState st = { 0 };
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_DEEP, .msg_size = sizeof(Msg), .handler = handle_slow, .mq = (courrier_mq_t)-1, .depth = 100000},
+    };
+    CourierActor actor;
+    assert(courier_actor_init(&actor, "Deep", defs, 1, &st) == 0);
+    printf("[test_queue_depth] depth 100000 -> %ld\n", defs[0].depth);
+#if defined(COURIER_PLATFORM_LINUX_SHM)
+    assert(defs[0].depth >= 100000);
+#else
+    assert(defs[0].depth > 0 && defs[0].depth < 100000); // above HARD_MSGMAX even for root
+#endif // if defined(COURIER_PLATFORM_LINUX_SHM)
+    courier_actor_close(&actor);
+
+    CourierActorMsgDef bad[] = {
+        {.queue_name = Q_DEEP, .msg_size = sizeof(Msg), .handler = handle_slow, .mq = (courrier_mq_t)-1, .depth = 16, .depth_max = 8},
+    };
+    errno = 0;
+    assert(courier_actor_init(&actor, "Bad", bad, 1, &st) < 0 && errno == EINVAL);
+}
+
+int main(void)
+{
+    check_fixed();
+    check_adaptive();
+    check_limits();
+
+    courier_writer_cache_flush();
+
+    printf("[test_queue_depth] PASS\n");
+
+    return 0;
+}
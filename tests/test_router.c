@@ -0,0 +1,271 @@
+// =============================
+// File: tests/test_router.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NB_SHARDS  4
+#define NB_SENSORS 64
+#define NB_SEQ     20
+#define NB_KEYS    10000
+#define NB_STALE   100 // sends allowed to reach a shard's recreated queue
+
+typedef struct
+{
+    uint32_t seq;
+    uint32_t sensor; // routing key
+    char name[16];   // routing key of the name router
+    int probe;       // counted per shard, outside the ordering checks
+} ReadingMsg;
+
+typedef struct
+{
+    int index;
+    atomic_int received;
+} ShardState;
+
+static const char *shard_queues[NB_SHARDS + 1] = {
+    "/courier_test_router_0", "/courier_test_router_1", "/courier_test_router_2", "/courier_test_router_3", "/courier_test_router_4",
+};
+
+static atomic_int owner[NB_SENSORS];    // shard index + 1 that handled the sensor
+static atomic_int last_seq[NB_SENSORS];
+static atomic_int misrouted;
+static atomic_int reordered;
+static atomic_int done;
+static atomic_int probes[NB_SHARDS];
+static atomic_int hold_shard; // shard index + 1 whose probes park until cleared
+static atomic_int holding;
+static atomic_int above;
+
+static void handle_reading(void *user_data, void *msg)
+{
+    ShardState *st      = (ShardState *)user_data;
+    const ReadingMsg *r = (const ReadingMsg *)msg;
+    int expected        = 0;
+
+    if(r->probe)
+    {
+        while(atomic_load(&hold_shard) == st->index + 1)
+        {
+            atomic_store(&holding, 1);
+            usleep(1000);
+        }
+        atomic_fetch_add(&probes[st->index], 1);
+
+        return;
+    }
+
+    if(!atomic_compare_exchange_strong(&owner[r->sensor], &expected, st->index + 1) && (expected != st->index + 1))
+    {
+        atomic_fetch_add(&misrouted, 1);
+    }
+
+    if((int)r->seq != atomic_load(&last_seq[r->sensor]) + 1)
+    {
+        atomic_fetch_add(&reordered, 1);
+    }
+    atomic_store(&last_seq[r->sensor], (int)r->seq);
+    atomic_fetch_add(&st->received, 1);
+    atomic_fetch_add(&done, 1);
+}
+
+static void on_watermark(void *user_data, const char *queue_name, int is_above)
+{
+    (void)user_data;
+    (void)queue_name;
+
+    if(is_above)
+    {
+        atomic_fetch_add(&above, 1);
+    }
+}
+
+// A probe routed to shard
+static ReadingMsg probe_for(const CourierRouter *router, int shard)
+{
+    ReadingMsg r = {.probe = 1};
+
+    while(courier_router_shard(router, &r, sizeof(r)) != shard)
+    {
+        r.sensor++;
+    }
+
+    return r;
+}
+
+static uint64_t key_by_sensor(const void *msg, size_t msg_size)
+{
+    (void)msg_size;
+
+    return ((const ReadingMsg *)msg)->sensor;
+}
+
+int main(void)
+{
+    static CourierActor actors[NB_SHARDS];
+    static CourierActorMsgDef defs[NB_SHARDS][1];
+    static ShardState states[NB_SHARDS];
+
+    for(int i = 0; i < NB_SHARDS; i++)
+    {
+        states[i].index = i;
+        defs[i][0]      = (CourierActorMsgDef){.queue_name = shard_queues[i], .msg_size = sizeof(ReadingMsg), .handler = handle_reading, .mq = (courrier_mq_t)-1};
+        assert(courier_actor_init(&actors[i], shard_queues[i], defs[i], 1, &states[i]) == 0);
+    }
+    CourierRouter router;
+    errno = 0;
+    assert(courier_router_init(&router, shard_queues, NB_SHARDS, sizeof(ReadingMsg), sizeof(ReadingMsg) - 2, 4, NULL) < 0 && errno == EINVAL);
+    errno = 0;
+    assert(courier_router_init(&router, shard_queues, 0, sizeof(ReadingMsg), offsetof(ReadingMsg, sensor), 4, NULL) < 0 && errno == EINVAL);
+    assert(courier_router_init(&router, shard_queues, NB_SHARDS, sizeof(ReadingMsg), offsetof(ReadingMsg, sensor), 4, NULL) == 0);
+
+    // Every sensor sticks to one shard, which sees its readings in order
+    for(uint32_t seq = 1; seq <= NB_SEQ; seq++)
+    {
+        for(uint32_t sensor = 0; sensor < NB_SENSORS; sensor++)
+        {
+            const ReadingMsg r = {.seq = seq, .sensor = sensor};
+            assert(courier_router_send(&router, &r, sizeof(r)) == 0);
+        }
+    }
+    wait_for(&done, NB_SENSORS * NB_SEQ);
+    assert(atomic_load(&done) == NB_SENSORS * NB_SEQ);
+    assert(atomic_load(&misrouted) == 0);
+    assert(atomic_load(&reordered) == 0);
+
+    for(uint32_t sensor = 0; sensor < NB_SENSORS; sensor++)
+    {
+        const ReadingMsg r = {.sensor = sensor};
+        assert(atomic_load(&owner[sensor]) == courier_router_shard(&router, &r, sizeof(r)) + 1);
+    }
+
+    for(int i = 0; i < NB_SHARDS; i++)
+    {
+        printf("[test_router] shard %d: %d readings\n", i, atomic_load(&states[i].received));
+        assert(atomic_load(&states[i].received) > 0);
+    }
+    errno = 0;
+    assert(courier_router_send(&router, &(ReadingMsg){ 0 }, offsetof(ReadingMsg, sensor)) < 0 && errno == EINVAL);
+
+    // Growing by one shard only moves keys to the new shard, about 1/5 of them
+    static int before[NB_KEYS];
+    int moved = 0;
+
+    for(uint32_t k = 0; k < NB_KEYS; k++)
+    {
+        const ReadingMsg r = {.sensor = k};
+        before[k]          = courier_router_shard(&router, &r, sizeof(r));
+    }
+    assert(courier_router_resize(&router, shard_queues, NB_SHARDS + 1) == 0);
+
+    for(uint32_t k = 0; k < NB_KEYS; k++)
+    {
+        const ReadingMsg r = {.sensor = k};
+        const int shard    = courier_router_shard(&router, &r, sizeof(r));
+
+        if(shard != before[k])
+        {
+            assert(shard == NB_SHARDS);
+            moved++;
+        }
+    }
+    printf("[test_router] %d of %d keys moved to the new shard\n", moved, NB_KEYS);
+    assert(moved > NB_KEYS / 5 - NB_KEYS / 20 && moved < NB_KEYS / 5 + NB_KEYS / 20);
+
+    // Shrinking back restores the original placement
+    assert(courier_router_resize(&router, shard_queues, NB_SHARDS) == 0);
+
+    for(uint32_t k = 0; k < NB_KEYS; k++)
+    {
+        const ReadingMsg r = {.sensor = k};
+        assert(courier_router_shard(&router, &r, sizeof(r)) == before[k]);
+    }
+    courier_router_close(&router);
+    assert(router.rt == NULL);
+
+    // Keys returned by a callback, or longer than 8 bytes
+    CourierRouter by_fn;
+    CourierRouter by_name;
+    assert(courier_router_init(&by_fn, shard_queues, NB_SHARDS, sizeof(ReadingMsg), 0, 0, key_by_sensor) == 0);
+    assert(courier_router_init(&by_name, shard_queues, NB_SHARDS, sizeof(ReadingMsg), offsetof(ReadingMsg, name), 16, NULL) == 0);
+    const int base = atomic_load(&done);
+
+    for(uint32_t sensor = 0; sensor < NB_SENSORS; sensor++)
+    {
+        const ReadingMsg r = {.seq = NB_SEQ + 1, .sensor = sensor};
+        assert(courier_router_send(&by_fn, &r, sizeof(r)) == 0);
+
+        ReadingMsg a = {.sensor = sensor};
+        ReadingMsg b = {.sensor = (sensor + 1) % NB_SENSORS};
+        snprintf(a.name, sizeof(a.name), "sensor-%u", sensor);
+        memcpy(b.name, a.name, sizeof(a.name));
+        assert(courier_router_shard(&by_name, &a, sizeof(a)) == courier_router_shard(&by_name, &b, sizeof(b)));
+    }
+    wait_for(&done, base + NB_SENSORS);
+    assert(atomic_load(&done) == base + NB_SENSORS);
+    assert(atomic_load(&misrouted) == 0);
+    assert(atomic_load(&reordered) == 0);
+    courier_router_close(&by_fn);
+    courier_router_close(&by_name);
+
+    // A shard actor that starts again is still reached: its old mailbox
+    // refuses sends, and its old platform queue is found out once full
+    CourierRouter live;
+    assert(courier_router_init(&live, shard_queues, NB_SHARDS, sizeof(ReadingMsg), offsetof(ReadingMsg, sensor), 4, NULL) == 0);
+    const ReadingMsg to_1 = probe_for(&live, 1);
+    courier_actor_close(&actors[1]);
+    assert(courier_actor_init(&actors[1], shard_queues[1], defs[1], 1, &states[1]) == 0);
+
+    for(int i = 0; (i < NB_STALE) && (atomic_load(&probes[1]) == 0); i++)
+    {
+        assert(courier_router_send(&live, &to_1, sizeof(to_1)) == 0);
+        usleep(1000);
+    }
+    wait_for(&probes[1], 1);
+    assert(atomic_load(&probes[1]) > 0);
+
+    // Watermarks registered after the router was set up are reported
+    const ReadingMsg to_0 = probe_for(&live, 0);
+    assert(courier_queue_watermarks(shard_queues[0], 3, 1, on_watermark, NULL) == 0);
+    atomic_store(&hold_shard, 1);
+    assert(courier_router_send(&live, &to_0, sizeof(to_0)) == 0);
+    wait_for(&holding, 1);
+
+    for(int i = 0; i < 4; i++)
+    {
+        assert(courier_router_send(&live, &to_0, sizeof(to_0)) == 0);
+    }
+    assert(atomic_load(&above) == 1);
+    atomic_store(&hold_shard, 0);
+    wait_for(&probes[0], 5);
+    assert(atomic_load(&probes[0]) == 5);
+
+    // Tables replaced by resizes are released while the router is in use
+    for(int i = 0; i < 100; i++)
+    {
+        assert(courier_router_resize(&live, shard_queues, NB_SHARDS - (size_t)(i % 2)) == 0);
+        assert(courier_router_send(&live, &to_0, sizeof(to_0)) == 0);
+    }
+    wait_for(&probes[0], 105);
+    assert(atomic_load(&probes[0]) == 105);
+    courier_router_close(&live);
+
+    for(int i = 0; i < NB_SHARDS; i++)
+    {
+        courier_actor_close(&actors[i]);
+    }
+    courier_queue_unlink(shard_queues[NB_SHARDS]);
+    courier_writer_cache_flush();
+
+    printf("[test_router] PASS\n");
+
+    return 0;
+}
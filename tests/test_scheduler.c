@@ -0,0 +1,205 @@
+// =============================
+// File: tests/test_scheduler.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NB_ACTORS 32
+#define NB_MSGS 20
+#define NB_WORKERS 4
+#define NB_BURST 8 // fits the default platform queue while every worker is held
+
+typedef struct
+{
+    int value;
+} PingMsg;
+
+typedef struct
+{
+    atomic_int in_handler; // detects two workers running the same actor
+    atomic_int received;
+    int overlap;
+} WorkerState;
+
+static void handle_ping(void *user_data, void *msg)
+{
+    WorkerState *st = (WorkerState *)user_data;
+    (void)msg;
+
+    if(atomic_fetch_add(&st->in_handler, 1) != 0)
+    {
+        st->overlap = 1;
+    }
+    usleep(100);
+    atomic_fetch_sub(&st->in_handler, 1);
+    atomic_fetch_add(&st->received, 1);
+}
+
+// Blockers hold one worker each until released, in the order they entered
+static atomic_int blocked;
+static atomic_int released;
+
+static void handle_block(void *user_data, void *msg)
+{
+    (void)user_data;
+    (void)msg;
+    const int ticket = atomic_fetch_add(&blocked, 1);
+
+    while(atomic_load(&released) <= ticket)
+    {
+        usleep(1000);
+    }
+}
+
+static int total_received(const WorkerState *states)
+{
+    int total = 0;
+
+    for(int i = 0; i < NB_ACTORS; i++)
+    {
+        total += atomic_load(&states[i].received);
+    }
+
+    return total;
+}
+
+static void worker_runs(uint64_t *runs, uint64_t *steals)
+{
+    for(size_t w = 0; w < NB_WORKERS; w++)
+    {
+        CourierWorkerStats ws;
+        assert(courier_scheduler_stats(w, &ws) == 0);
+        runs[w]   = ws.local_pops + ws.steals;
+        steals[w] = ws.steals;
+    }
+}
+
+int main(void)
+{
+    static CourierActor actors[NB_ACTORS];
+    static CourierActorMsgDef defs[NB_ACTORS][1];
+    static WorkerState states[NB_ACTORS];
+    static char names[NB_ACTORS][32];
+
+    assert(courier_scheduler_start(NB_WORKERS) == 0);
+
+    for(int i = 0; i < NB_ACTORS; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "/courier_test_sched_%d", i);
+        defs[i][0] = (CourierActorMsgDef){.queue_name = names[i], .msg_size = sizeof(PingMsg), .handler = handle_ping, .mq = (courrier_mq_t)-1};
+        assert(courier_actor_init(&actors[i], names[i], defs[i], 1, &states[i]) == 0);
+    }
+
+    for(int m = 0; m < NB_MSGS; m++)
+    {
+        for(int i = 0; i < NB_ACTORS; i++)
+        {
+            PingMsg p = { .value = m };
+            assert(courier_send_to(names[i], &p, sizeof(p)) == 0);
+        }
+    }
+
+    // Wait (bounded) for every actor to see every message
+    int total = 0;
+
+    for(int tries = 0; tries < 500 && total < NB_ACTORS * NB_MSGS; tries++)
+    {
+        usleep(10 * 1000);
+        total = total_received(states);
+    }
+    printf("[test_scheduler] received=%d/%d\n", total, NB_ACTORS * NB_MSGS);
+    assert(total == NB_ACTORS * NB_MSGS);
+
+    // Every actor run came either from a local deque or a steal
+    uint64_t runs = 0;
+
+    for(size_t w = 0; w < courier_scheduler_nb_workers(); w++)
+    {
+        CourierWorkerStats ws;
+        assert(courier_scheduler_stats(w, &ws) == 0);
+        printf("[test_scheduler] worker %zu: local_pops=%llu steals=%llu idle_ms=%llu\n", w, (unsigned long long)ws.local_pops, (unsigned long long)ws.steals, (unsigned long long)(ws.idle_ns / 1000000));
+        runs += ws.local_pops + ws.steals;
+    }
+    assert(runs > 0);
+
+    // Pin a burst on one worker: with every worker held by a blocker, all the
+    // actors become ready at once, then a single worker is let go and takes
+    // the whole burst from the shared epoll set. The others only get work
+    // once released, by stealing it.
+    static CourierActor blockers[NB_WORKERS];
+    static CourierActorMsgDef block_defs[NB_WORKERS][1];
+    static char block_names[NB_WORKERS][32];
+
+    for(int i = 0; i < NB_WORKERS; i++)
+    {
+        snprintf(block_names[i], sizeof(block_names[i]), "/courier_test_sched_block_%d", i);
+        block_defs[i][0] = (CourierActorMsgDef){.queue_name = block_names[i], .msg_size = sizeof(PingMsg), .handler = handle_block, .mq = (courrier_mq_t)-1};
+        assert(courier_actor_init(&blockers[i], block_names[i], block_defs[i], 1, NULL) == 0);
+        PingMsg p = { 0 };
+        assert(courier_send_to(block_names[i], &p, sizeof(p)) == 0);
+    }
+    wait_for(&blocked, NB_WORKERS);
+    assert(atomic_load(&blocked) == NB_WORKERS);
+
+    uint64_t runs_before[NB_WORKERS], steals_before[NB_WORKERS];
+    worker_runs(runs_before, steals_before);
+    const int base = total_received(states);
+
+    for(int m = 0; m < NB_BURST; m++)
+    {
+        for(int i = 0; i < NB_ACTORS; i++)
+        {
+            PingMsg p = { .value = m };
+            assert(courier_send_to(names[i], &p, sizeof(p)) == 0);
+        }
+    }
+    atomic_store(&released, 1);
+
+    for(int tries = 0; tries < 500 && total_received(states) == base; tries++)
+    {
+        usleep(1000);
+    }
+    atomic_store(&released, NB_WORKERS);
+
+    for(int tries = 0; tries < 500 && total_received(states) < base + NB_ACTORS * NB_BURST; tries++)
+    {
+        usleep(10 * 1000);
+    }
+    assert(total_received(states) == base + NB_ACTORS * NB_BURST);
+
+    uint64_t runs_after[NB_WORKERS], steals_after[NB_WORKERS];
+    worker_runs(runs_after, steals_after);
+    uint64_t stolen = 0;
+    int active      = 0;
+
+    for(int w = 0; w < NB_WORKERS; w++)
+    {
+        stolen += steals_after[w] - steals_before[w];
+        active += (runs_after[w] > runs_before[w]);
+    }
+    printf("[test_scheduler] pinned burst: %d workers ran actors, %llu steals\n", active, (unsigned long long)stolen);
+    assert(active > 1);
+    assert(stolen > 0);
+
+    for(int i = 0; i < NB_WORKERS; i++)
+    {
+        courier_actor_close(&blockers[i]);
+    }
+
+    for(int i = 0; i < NB_ACTORS; i++)
+    {
+        assert(!states[i].overlap);
+        courier_actor_close(&actors[i]);
+    }
+    courier_scheduler_stop();
+    courier_writer_cache_flush();
+
+    printf("[test_scheduler] PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+// =============================
+// File: tests/test_stats.c
+// =============================
+#include "courier.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define Q_STATS "/courier_test_stats"
+#define NB_MSGS 8 // below the default queue depth: all queued at once
+#define HANDLER_US 2000
+
+typedef struct
+{
+    int seq;
+} StatMsg;
+
+static atomic_int received;
+
+static void handle_slow(void *user_data, void *msg)
+{
+    (void)user_data;
+    (void)msg;
+    usleep(HANDLER_US);
+    atomic_fetch_add(&received, 1);
+}
+
+static void check_buckets(void)
+{
+    // Buckets are contiguous and every value lands in the bucket that bounds it
+    uint64_t prev_max = 0;
+
+    for(size_t b = 0; b < COURIER_HIST_BUCKETS - 1; b++)
+    {
+        const uint64_t max = courier_histogram_bucket_max(b);
+        assert((b == 0) || (max > prev_max));
+        assert(courier_histogram_bucket(max) == b);
+        assert(courier_histogram_bucket(prev_max + (b > 0)) == b);
+        prev_max = max;
+    }
+    assert(courier_histogram_bucket(UINT64_MAX) == COURIER_HIST_BUCKETS - 1);
+
+    // Relative error stays within 1 / 2^SUB_BITS
+    for(uint64_t v = 1; v < (1ull << 36); v = v * 3 + 1)
+    {
+        const uint64_t max = courier_histogram_bucket_max(courier_histogram_bucket(v));
+        assert(max >= v);
+        assert((max - v) * (1u << COURIER_HIST_SUB_BITS) <= v);
+    }
+
+    CourierHistogram h = { 0 };
+
+    for(uint64_t v = 1; v <= 100; v++)
+    {
+        h.buckets[courier_histogram_bucket(v * 1000)]++;
+        h.count++;
+    }
+    h.max_ns = 100000;
+    const uint64_t p50 = courier_histogram_percentile(&h, 50.0);
+    assert(p50 >= 50000 && p50 <= 50000 + 50000 / 8);
+    assert(courier_histogram_percentile(&h, 100.0) == 100000);
+}
+
+int main(void)
+{
+    check_buckets();
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_STATS, .msg_size = sizeof(StatMsg), .handler = handle_slow, .mq = (courrier_mq_t)-1},
+    };
+    CourierActor actor;
+    assert(courier_actor_init(&actor, "Stats", defs, 1, NULL) == 0);
+
+    for(int i = 0; i < NB_MSGS; i++)
+    {
+        StatMsg m = { .seq = i };
+        assert(courier_send_to(Q_STATS, &m, sizeof(m)) == 0);
+    }
+
+    for(int tries = 0; tries < 200 && atomic_load(&received) < NB_MSGS; tries++)
+    {
+        usleep(10 * 1000);
+    }
+    assert(atomic_load(&received) == NB_MSGS);
+
+    CourierMsgStats st;
+#ifdef COURIER_STATS
+    assert(courier_actor_stats(&actor, 0, &st) == 0);
+    printf("[test_stats] wait p50=%lluns p99=%lluns handler p50=%lluns max=%lluns\n", (unsigned long long)courier_histogram_percentile(&st.queue_wait, 50.0),
+           (unsigned long long)courier_histogram_percentile(&st.queue_wait, 99.0), (unsigned long long)courier_histogram_percentile(&st.handler, 50.0), (unsigned long long)st.handler.max_ns);
+
+    assert(st.queue_wait.count == NB_MSGS);
+    assert(st.handler.count == NB_MSGS);
+    assert(st.handler.min_ns >= HANDLER_US * 1000ull);
+    // Messages queued behind slow handlers: the last one waited for the others
+    assert(st.queue_wait.max_ns >= (NB_MSGS - 2) * HANDLER_US * 1000ull);
+#else
+    assert(courier_actor_stats(&actor, 0, &st) < 0 && errno == ENOTSUP);
+#endif // ifdef COURIER_STATS
+    assert(courier_actor_stats(&actor, 1, &st) < 0 && errno == EINVAL);
+
+    courier_actor_close(&actor);
+    courier_writer_cache_flush();
+
+    printf("[test_stats] PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+// =============================
+// File: tests/test_timer.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define Q_TIMER "/courier_test_timer"
+#define Q_FULL "/courier_test_timer_full"
+#define NB_ORDERED 32
+#define NB_MANY 100000
+
+typedef struct
+{
+    int kind; // 0 = one-shot, 1 = periodic, 2 = must never arrive
+    int delay_ms;
+    uint64_t scheduled_ns;
+} TimerMsg;
+
+typedef struct
+{
+    atomic_int one_shots;
+    atomic_int periodic;
+    atomic_int cancelled;
+    int early;        // a one-shot arrived before its delay
+    int out_of_order; // one-shots arrived out of delay order
+    int last_delay;
+} TimerState;
+
+// A depth-1 target that parks in its handler until released
+typedef struct
+{
+    atomic_int held;
+    atomic_int release;
+} FullState;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void handle_timer(void *user_data, void *msg)
+{
+    TimerState *st    = (TimerState *)user_data;
+    const TimerMsg *m = (const TimerMsg *)msg;
+
+    if(m->kind == 1)
+    {
+        atomic_fetch_add(&st->periodic, 1);
+
+        return;
+    }
+
+    if(m->kind == 2)
+    {
+        atomic_fetch_add(&st->cancelled, 1);
+
+        return;
+    }
+
+    if(now_ns() - m->scheduled_ns < (uint64_t)m->delay_ms * 1000000ull)
+    {
+        st->early = 1;
+    }
+
+    if(m->delay_ms < st->last_delay)
+    {
+        st->out_of_order = 1;
+    }
+    st->last_delay = m->delay_ms;
+    atomic_fetch_add(&st->one_shots, 1);
+}
+
+static void handle_full(void *user_data, void *msg)
+{
+    FullState *st = (FullState *)user_data;
+    (void)msg;
+
+    atomic_store(&st->held, 1);
+
+    while(!atomic_load(&st->release))
+    {
+        usleep(1000);
+    }
+}
+
+// One-shots scheduled in scrambled order arrive by delay, never early
+static void check_one_shots(TimerState *st)
+{
+    atomic_store(&st->one_shots, 0);
+    st->last_delay = 0;
+
+    for(int i = 0; i < NB_ORDERED; i++)
+    {
+        TimerMsg m = { .kind = 0, .delay_ms = 5 + ((i * 7) % NB_ORDERED) * 4, .scheduled_ns = now_ns() };
+        assert(courier_send_after(Q_TIMER, &m, sizeof(m), (uint64_t)m.delay_ms) != 0);
+    }
+    wait_for_ms(&st->one_shots, NB_ORDERED, 2000);
+    assert(atomic_load(&st->one_shots) == NB_ORDERED);
+    assert(!st->early);
+    assert(!st->out_of_order);
+}
+
+int main(void)
+{
+    TimerState st = { 0 };
+
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_TIMER, .msg_size = sizeof(TimerMsg), .handler = handle_timer, .mq = (courrier_mq_t)-1},
+    };
+    CourierActor actor;
+    assert(courier_actor_init(&actor, "Timers", defs, 1, &st) == 0);
+
+    TimerMsg m = { 0 };
+    errno      = 0;
+    assert(courier_send_every(Q_TIMER, &m, sizeof(m), 0) == 0 && errno == EINVAL);
+    assert(courier_timer_cancel(0) < 0 && errno == ENOENT);
+
+    // Driven by the scheduler's workers while it runs...
+    assert(courier_scheduler_start(2) == 0);
+    check_one_shots(&st);
+    courier_scheduler_stop();
+
+    // ...and by a driver thread otherwise
+    check_one_shots(&st);
+
+    // Periodic: keeps ticking until cancelled
+    m.kind                = 1;
+    CourierTimerId every = courier_send_every(Q_TIMER, &m, sizeof(m), 10);
+    assert(every != 0);
+    wait_for_ms(&st.periodic, 5, 2000);
+    assert(courier_timer_cancel(every) == 0);
+    usleep(30 * 1000); // let a send already in flight land
+    const int ticks = atomic_load(&st.periodic);
+    usleep(60 * 1000);
+    assert(atomic_load(&st.periodic) == ticks);
+    assert(courier_timer_cancel(every) < 0);
+
+    // Cancelled before firing: never delivered
+    m.kind               = 2;
+    CourierTimerId never = courier_send_after(Q_TIMER, &m, sizeof(m), 20);
+    assert(courier_timer_cancel(never) == 0);
+
+    // A full target loses its timer message, and holds back neither the
+    // other timers nor the only worker driving them
+    static FullState full;
+    CourierActorMsgDef full_defs[] = {
+        {.queue_name = Q_FULL, .msg_size = sizeof(TimerMsg), .handler = handle_full, .mq = (courrier_mq_t)-1, .depth = 1},
+    };
+    CourierActor full_actor;
+    assert(courier_actor_init(&full_actor, "Full", full_defs, 1, &full) == 0);
+    assert(courier_send_to(Q_FULL, &m, sizeof(m)) == 0);
+    wait_for(&full.held, 1);
+    assert(atomic_load(&full.held));
+
+    for(int i = 0; (i < 64) && (courier_try_send_to(Q_FULL, &m, sizeof(m)) == 0); i++)
+    {
+    }
+    assert(courier_try_send_to(Q_FULL, &m, sizeof(m)) < 0 && errno == EAGAIN);
+
+    assert(courier_scheduler_start(1) == 0);
+    const size_t dropped = courier_timer_dropped();
+    const int one_shots  = atomic_load(&st.one_shots);
+    assert(courier_send_after(Q_FULL, &m, sizeof(m), 5) != 0);
+    TimerMsg due = { .kind = 0, .delay_ms = 20, .scheduled_ns = now_ns() };
+    st.last_delay = 0;
+    assert(courier_send_after(Q_TIMER, &due, sizeof(due), (uint64_t)due.delay_ms) != 0);
+    wait_for_ms(&st.one_shots, one_shots + 1, 500);
+    assert(atomic_load(&st.one_shots) == one_shots + 1);
+    assert(!st.early);
+    assert(courier_timer_dropped() == dropped + 1);
+    courier_scheduler_stop();
+    atomic_store(&full.release, 1);
+    courier_actor_close(&full_actor);
+
+    // Lots of outstanding timers: arming and cancelling stay cheap
+    static CourierTimerId many[NB_MANY];
+    uint64_t t0 = now_ns();
+
+    for(int i = 0; i < NB_MANY; i++)
+    {
+        many[i] = courier_send_after(Q_TIMER, &m, sizeof(m), 60000 + (uint64_t)(i % 5000) * 1000);
+        assert(many[i] != 0);
+    }
+    const uint64_t arm_ns = now_ns() - t0;
+    t0                    = now_ns();
+
+    for(int i = 0; i < NB_MANY; i++)
+    {
+        assert(courier_timer_cancel(many[i]) == 0);
+    }
+    const uint64_t cancel_ns = now_ns() - t0;
+    printf("[test_timer] %d timers: arm %.0f ns, cancel %.0f ns each\n", NB_MANY, (double)arm_ns / NB_MANY, (double)cancel_ns / NB_MANY);
+
+    usleep(40 * 1000);
+    assert(atomic_load(&st.cancelled) == 0);
+
+    courier_actor_close(&actor);
+    courier_writer_cache_flush();
+
+    printf("[test_timer] PASS\n");
+
+    return 0;
+}
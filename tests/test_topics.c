@@ -0,0 +1,138 @@
+// =============================
+// File: tests/test_topics.c
+// =============================
+#include "courier.h"
+#include "test_util.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define Q_ROOMS   "/courier_test_topics_rooms"   // sensors/+/temp
+#define Q_ALL     "/courier_test_topics_all"     // sensors/#
+#define Q_KITCHEN "/courier_test_topics_kitchen" // sensors/kitchen/temp and sensors/+/temp
+#define NB_NOISE  20000
+
+typedef struct
+{
+    int seq;
+    float value;
+} ReadingMsg;
+
+typedef struct
+{
+    atomic_int received;
+    atomic_int last_seq;
+} SubState;
+
+static void handle_reading(void *user_data, void *msg)
+{
+    SubState *st        = (SubState *)user_data;
+    const ReadingMsg *r = (const ReadingMsg *)msg;
+
+    atomic_store(&st->last_seq, r->seq);
+    atomic_fetch_add(&st->received, 1);
+}
+
+int main(void)
+{
+    static const char *queues[] = { Q_ROOMS, Q_ALL, Q_KITCHEN };
+    static CourierActor actors[3];
+    static CourierActorMsgDef defs[3][1];
+    static SubState states[3];
+    SubState *rooms   = &states[0];
+    SubState *all     = &states[1];
+    SubState *kitchen = &states[2];
+
+    for(int i = 0; i < 3; i++)
+    {
+        defs[i][0] = (CourierActorMsgDef){.queue_name = queues[i], .msg_size = sizeof(ReadingMsg), .handler = handle_reading, .mq = (courrier_mq_t)-1};
+        assert(courier_actor_init(&actors[i], queues[i], defs[i], 1, &states[i]) == 0);
+    }
+
+    // Wildcards fill whole levels, '#' only the last one, and never appear in topics
+    const char *bad_patterns[] = { "", "sensors/#/temp", "sensors/te+", "sensors/#x" };
+
+    for(size_t i = 0; i < sizeof(bad_patterns) / sizeof(bad_patterns[0]); i++)
+    {
+        errno = 0;
+        assert(courier_subscribe(bad_patterns[i], Q_ALL) < 0 && errno == EINVAL);
+    }
+    ReadingMsg r = { 0, 21.5f };
+    errno        = 0;
+    assert(courier_publish("sensors/+/temp", &r, sizeof(r)) < 0 && errno == EINVAL);
+
+    assert(courier_subscribe("sensors/+/temp", Q_ROOMS) == 0);
+    assert(courier_subscribe("sensors/#", Q_ALL) == 0);
+    assert(courier_subscribe("sensors/kitchen/temp", Q_KITCHEN) == 0);
+    assert(courier_subscribe("sensors/+/temp", Q_KITCHEN) == 0);
+    errno = 0;
+    assert(courier_subscribe("sensors/#", Q_ALL) < 0 && errno == EEXIST);
+
+    // Matched through two patterns, Q_KITCHEN still gets one copy
+    r.seq = 1;
+    assert(courier_publish("sensors/kitchen/temp", &r, sizeof(r)) == 3);
+    r.seq = 2;
+    assert(courier_publish("sensors/hall/temp", &r, sizeof(r)) == 3);
+    r.seq = 3;
+    assert(courier_publish("sensors/hall/humidity", &r, sizeof(r)) == 1);
+    r.seq = 4;
+    assert(courier_publish("sensors", &r, sizeof(r)) == 1); // '#' matches its parent level
+    assert(courier_publish("sensors/kitchen/temp/raw", &r, sizeof(r)) == 1);
+    assert(courier_publish("actuators/hall/valve", &r, sizeof(r)) == 0);
+
+    wait_for(&all->received, 5);
+    wait_for(&rooms->received, 2);
+    wait_for(&kitchen->received, 2);
+    assert(atomic_load(&all->received) == 5);
+    assert(atomic_load(&rooms->received) == 2);
+    assert(atomic_load(&kitchen->received) == 2);
+    assert(atomic_load(&kitchen->last_seq) == 2);
+
+    // Pooled buffers are handed over without a copy
+    ReadingMsg *buf = courier_msg_alloc(sizeof(*buf));
+    assert(buf);
+    *buf = (ReadingMsg){ 5, 19.0f };
+    assert(courier_publish_msg("sensors/attic/temp", buf) == 3);
+    wait_for(&rooms->received, 3);
+    assert(atomic_load(&rooms->last_seq) == 5);
+
+    // Subscription changes invalidate cached routes
+    assert(courier_unsubscribe("sensors/+/temp", Q_KITCHEN) == 0);
+    errno = 0;
+    assert(courier_unsubscribe("sensors/+/temp", Q_KITCHEN) < 0 && errno == ENOENT);
+    assert(courier_publish("sensors/hall/temp", &r, sizeof(r)) == 2);
+    assert(courier_unsubscribe("sensors/#", Q_ALL) == 0);
+    assert(courier_publish("sensors/hall/humidity", &r, sizeof(r)) == 0);
+
+    // Matching cost does not grow with unrelated subscriptions
+    char pattern[COURIER_TOPIC_MAX];
+
+    for(int i = 0; i < NB_NOISE; i++)
+    {
+        snprintf(pattern, sizeof(pattern), "devices/%d/%s", i, (i % 2) ? "+" : "#");
+        assert(courier_subscribe(pattern, "/courier_test_topics_unused") == 0);
+    }
+    assert(courier_subscribe("devices/+/alarm", Q_ROOMS) == 0);
+    const int before = atomic_load(&rooms->received);
+    r.seq            = 6;
+    assert(courier_publish("devices/12345/alarm", &r, sizeof(r)) == 2);
+    assert(courier_publish("devices/none/alarm", &r, sizeof(r)) == 1);
+    wait_for(&rooms->received, before + 2);
+    assert(atomic_load(&rooms->received) == before + 2);
+
+    courier_topics_clear();
+    assert(courier_publish("sensors/kitchen/temp", &r, sizeof(r)) == 0);
+    courier_queue_unlink("/courier_test_topics_unused");
+
+    for(int i = 0; i < 3; i++)
+    {
+        courier_actor_close(&actors[i]);
+    }
+    courier_writer_cache_flush();
+
+    printf("[test_topics] PASS\n");
+
+    return 0;
+}
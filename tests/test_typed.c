@@ -0,0 +1,183 @@
+// =============================
+// File: tests/test_typed.c
+// =============================
+#include "courier.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define Q_CHANNEL "/courier_test_typed"
+#define NB_MSGS   300
+
+enum
+{
+    TYPE_PING  = 1,
+    TYPE_TEMP  = 7,
+    TYPE_FRAME = 300,
+};
+
+typedef struct
+{
+    int seq;
+} PingMsg;
+
+typedef struct
+{
+    int seq;
+    double celsius;
+} TempMsg;
+
+typedef struct
+{
+    int seq;
+    unsigned char bytes[200];
+} FrameMsg;
+
+typedef struct
+{
+    atomic_int received;
+    int next_seq;     // messages of all types arrive in send order
+    int out_of_order;
+    int bad_payload;
+    int counts[3];
+} TypedState;
+
+static void record(TypedState *st, int seq, int kind, uint16_t type)
+{
+    if(seq != st->next_seq)
+    {
+        st->out_of_order = 1;
+    }
+    st->next_seq = seq + 1;
+
+    if(courier_msg_type() != type)
+    {
+        st->bad_payload = 1;
+    }
+    st->counts[kind]++;
+    atomic_fetch_add(&st->received, 1);
+}
+
+static void handle_ping(void *user_data, void *msg)
+{
+    record((TypedState *)user_data, ((PingMsg *)msg)->seq, 0, TYPE_PING);
+}
+
+static void handle_temp(void *user_data, void *msg)
+{
+    const TempMsg *t = (const TempMsg *)msg;
+
+    if(t->celsius != t->seq * 0.5)
+    {
+        ((TypedState *)user_data)->bad_payload = 1;
+    }
+    record((TypedState *)user_data, t->seq, 1, TYPE_TEMP);
+}
+
+static void handle_frame(void *user_data, void *msg)
+{
+    const FrameMsg *f = (const FrameMsg *)msg;
+
+    for(size_t i = 0; i < sizeof(f->bytes); i++)
+    {
+        if(f->bytes[i] != (unsigned char)(f->seq + i))
+        {
+            ((TypedState *)user_data)->bad_payload = 1;
+            break;
+        }
+    }
+    record((TypedState *)user_data, f->seq, 2, TYPE_FRAME);
+}
+
+int main(void)
+{
+    TypedState st = { 0 };
+    CourierActor actor;
+
+    // Channel tables are checked up front
+    const CourierMsgType dup[] = {
+        {.type = TYPE_PING, .msg_size = sizeof(PingMsg), .handler = handle_ping},
+        {.type = TYPE_PING, .msg_size = sizeof(TempMsg), .handler = handle_temp},
+    };
+    CourierActorMsgDef bad[] = {
+        {.queue_name = Q_CHANNEL, .mq = (courrier_mq_t)-1, .types = dup, .nb_types = 2},
+    };
+    errno = 0;
+    assert(courier_actor_init(&actor, "Dup", bad, 1, &st) < 0 && errno == EINVAL);
+
+    const CourierMsgType huge[] = {
+        {.type = TYPE_PING, .msg_size = 4096, .handler = handle_ping},
+    };
+    bad[0].types    = huge;
+    bad[0].nb_types = 1;
+    errno           = 0;
+    assert(courier_actor_init(&actor, "Huge", bad, 1, &st) < 0 && errno == EMSGSIZE);
+
+    // Three types, one queue
+    const CourierMsgType types[] = {
+        {.type = TYPE_PING, .msg_size = sizeof(PingMsg), .handler = handle_ping},
+        {.type = TYPE_TEMP, .msg_size = sizeof(TempMsg), .handler = handle_temp},
+        {.type = TYPE_FRAME, .msg_size = sizeof(FrameMsg), .handler = handle_frame},
+    };
+    CourierActorMsgDef defs[] = {
+        {.queue_name = Q_CHANNEL, .mq = (courrier_mq_t)-1, .types = types, .nb_types = 3},
+    };
+    assert(courier_actor_init(&actor, "Typed", defs, 1, &st) == 0);
+
+    // Unknown types are dropped, oversized payloads refused
+    PingMsg stray = { -1 };
+    assert(courier_send_typed(Q_CHANNEL, 99, &stray, sizeof(stray)) == 0);
+    static unsigned char too_big[1024];
+    errno = 0;
+    assert(courier_send_typed(Q_CHANNEL, TYPE_FRAME, too_big, sizeof(too_big)) < 0 && errno == EMSGSIZE);
+
+    for(int seq = 0; seq < NB_MSGS; seq++)
+    {
+        switch(seq % 3)
+        {
+            case 0:
+            {
+                PingMsg p = { seq };
+                assert(courier_send_typed(Q_CHANNEL, TYPE_PING, &p, sizeof(p)) == 0);
+                break;
+            }
+
+            case 1:
+            {
+                TempMsg t = { seq, seq * 0.5 };
+                assert(courier_send_typed(Q_CHANNEL, TYPE_TEMP, &t, sizeof(t)) == 0);
+                break;
+            }
+
+            default:
+            {
+                FrameMsg f = { .seq = seq };
+
+                for(size_t i = 0; i < sizeof(f.bytes); i++)
+                {
+                    f.bytes[i] = (unsigned char)(seq + i);
+                }
+                assert(courier_send_typed(Q_CHANNEL, TYPE_FRAME, &f, sizeof(f)) == 0);
+                break;
+            }
+        }
+    }
+
+    for(int tries = 0; tries < 400 && atomic_load(&st.received) < NB_MSGS; tries++)
+    {
+        usleep(5 * 1000);
+    }
+    assert(atomic_load(&st.received) == NB_MSGS);
+    assert(!st.out_of_order);
+    assert(!st.bad_payload);
+    assert(st.counts[0] == NB_MSGS / 3 && st.counts[1] == NB_MSGS / 3 && st.counts[2] == NB_MSGS / 3);
+
+    courier_actor_close(&actor);
+    courier_writer_cache_flush();
+
+    printf("[test_typed] PASS\n");
+
+    return 0;
+}
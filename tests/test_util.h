@@ -0,0 +1,49 @@
+// =============================
+// File: tests/test_util.h
+// =============================
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <unistd.h>
+
+#ifndef TEST_WAIT_MS
+#define TEST_WAIT_MS 5000 // how long wait_for() gives a counter to reach its target
+#endif /* ifndef TEST_WAIT_MS */
+
+// Poll every 5 ms until counter reaches target or timeout_ms passes. Callers
+// assert on the counter afterwards, so a timeout shows up as a failed check.
+#ifdef __cplusplus
+#include <atomic>
+
+static inline void wait_for_ms(const std::atomic<int> &counter, int target, int timeout_ms)
+{
+    for(int waited = 0; waited < timeout_ms && counter.load() < target; waited += 5)
+    {
+        usleep(5 * 1000);
+    }
+}
+
+static inline void wait_for(const std::atomic<int> &counter, int target)
+{
+    wait_for_ms(counter, target, TEST_WAIT_MS);
+}
+
+#else
+#include <stdatomic.h>
+
+static inline void wait_for_ms(atomic_int *counter, int target, int timeout_ms)
+{
+    for(int waited = 0; waited < timeout_ms && atomic_load(counter) < target; waited += 5)
+    {
+        usleep(5 * 1000);
+    }
+}
+
+static inline void wait_for(atomic_int *counter, int target)
+{
+    wait_for_ms(counter, target, TEST_WAIT_MS);
+}
+
+#endif // ifdef __cplusplus
+
+#endif // ifndef TEST_UTIL_H
@@ -0,0 +1,220 @@
+// =============================
+// File: tests/test_writer_cache.c
+// =============================
+#include "courier.h"
+#include <assert.h>
+#include <dirent.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SEQ_REOPEN -1 // the child recreates its queue
+#define SEQ_EXIT   -2
+#define NB_STALE   600 // sends allowed to reach the recreated queue
+
+typedef struct
+{
+    int seq;
+} SeqMsg;
+
+static int drain(courrier_mq_t r, int expected_first, int count)
+{
+    struct pollfd pfd = { .fd = courier_queue_fd(r), .events = POLLIN };
+    int next = expected_first;
+
+    while(next < expected_first + count)
+    {
+        assert(poll(&pfd, 1, 1000) == 1);
+        SeqMsg m;
+
+        while(courier_queue_receive(r, &m, sizeof(m), NULL) == (ssize_t)sizeof(m))
+        {
+            assert(m.seq == next);
+            next++;
+        }
+    }
+
+    return next - expected_first;
+}
+
+static int open_fds(void)
+{
+    DIR *d = opendir("/proc/self/fd");
+    int n  = 0;
+    assert(d);
+
+    while(readdir(d))
+    {
+        n++;
+    }
+    closedir(d);
+
+    return n;
+}
+
+// Forked reader: reports every sequence number it receives on report, and
+// recreates its queue when asked to, like an actor closed and initialized again
+static void reader_child(const char *queue, int report)
+{
+    courrier_mq_t r = courier_queue_open_reader(queue, sizeof(SeqMsg), 10);
+    int ready       = 0;
+
+    if((r == (courrier_mq_t)-1) || (write(report, &ready, sizeof(ready)) != sizeof(ready)))
+    {
+        _exit(1);
+    }
+
+    for(;;)
+    {
+        struct pollfd pfd = { .fd = courier_queue_fd(r), .events = POLLIN };
+
+        if(poll(&pfd, 1, 5000) != 1)
+        {
+            _exit(2);
+        }
+        SeqMsg m;
+
+        while(courier_queue_receive(r, &m, sizeof(m), NULL) == (ssize_t)sizeof(m))
+        {
+            if(m.seq == SEQ_EXIT)
+            {
+                courier_queue_close(r);
+                courier_queue_unlink(queue);
+                _exit(0);
+            }
+
+            if(m.seq == SEQ_REOPEN)
+            {
+                courier_queue_close(r);
+                r = courier_queue_open_reader(queue, sizeof(SeqMsg), 10);
+            }
+
+            if(write(report, &m.seq, sizeof(m.seq)) != sizeof(m.seq))
+            {
+                _exit(3);
+            }
+        }
+    }
+}
+
+// Next sequence number reported by the child, or INT32_MIN after timeout_ms
+static int read_report(int report, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = report, .events = POLLIN };
+    int seq           = INT32_MIN;
+
+    if(poll(&pfd, 1, timeout_ms) == 1)
+    {
+        assert(read(report, &seq, sizeof(seq)) == sizeof(seq));
+    }
+
+    return seq;
+}
+
+int main(void)
+{
+    const char *Q = "/courier_test_wcache";
+
+    courrier_mq_t r = courier_queue_open_reader(Q, sizeof(SeqMsg), 10);
+    assert(r != (courrier_mq_t)-1);
+
+    // Repeated sends reuse one cached writer descriptor
+    for(int i = 0; i < 5; i++)
+    {
+        SeqMsg m = { .seq = i };
+        assert(courier_send_to(Q, &m, sizeof(m)) == 0);
+    }
+    assert(drain(r, 0, 5) == 5);
+    const int fds = open_fds();
+
+    for(int i = 5; i < 10; i++)
+    {
+        SeqMsg m = { .seq = i };
+        assert(courier_send_to(Q, &m, sizeof(m)) == 0);
+    }
+    assert(drain(r, 5, 5) == 5);
+    assert(open_fds() == fds);
+
+    // Recreating the reader evicts the cached writer: sends reach the new queue
+    courier_queue_close(r);
+    r = courier_queue_open_reader(Q, sizeof(SeqMsg), 10);
+    assert(r != (courrier_mq_t)-1);
+
+    for(int i = 10; i < 15; i++)
+    {
+        SeqMsg m = { .seq = i };
+        assert(courier_send_to(Q, &m, sizeof(m)) == 0);
+    }
+    assert(drain(r, 10, 5) == 5);
+
+    // Same after an explicit unlink
+    courier_queue_close(r);
+    courier_queue_unlink(Q);
+    r = courier_queue_open_reader(Q, sizeof(SeqMsg), 10);
+    assert(r != (courrier_mq_t)-1);
+    SeqMsg m = { .seq = 15 };
+    assert(courier_send_to(Q, &m, sizeof(m)) == 0);
+    assert(drain(r, 15, 1) == 1);
+
+    courier_writer_cache_flush();
+    courier_queue_close(r);
+    courier_queue_unlink(Q);
+
+    // A reader in another process recreates its queue: the cached writer
+    // still points at the old one, and is found out and reopened
+    const char *QF = "/courier_test_wcache_fork";
+    int report[2];
+    assert(pipe(report) == 0);
+    fflush(stdout);
+    const pid_t child = fork();
+    assert(child >= 0);
+
+    if(child == 0)
+    {
+        close(report[0]);
+        reader_child(QF, report[1]);
+    }
+    close(report[1]);
+    assert(read_report(report[0], 5000) == 0);
+
+    for(int i = 0; i < 5; i++)
+    {
+        m.seq = i;
+        assert(courier_send_to(QF, &m, sizeof(m)) == 0);
+        assert(read_report(report[0], 5000) == i);
+    }
+    m.seq = SEQ_REOPEN;
+    assert(courier_send_to(QF, &m, sizeof(m)) == 0);
+    assert(read_report(report[0], 5000) == SEQ_REOPEN);
+
+    int got = INT32_MIN;
+
+    for(int i = 0; (i < NB_STALE) && (got == INT32_MIN); i++)
+    {
+        m.seq = 100 + i;
+        assert(courier_send_to(QF, &m, sizeof(m)) == 0); // must not block on the old queue
+        got = read_report(report[0], 0);
+    }
+
+    if(got == INT32_MIN)
+    {
+        got = read_report(report[0], 1000);
+    }
+    printf("[test_writer_cache] recreated queue reached from seq %d\n", got);
+    assert(got >= 100);
+
+    m.seq = SEQ_EXIT;
+    assert(courier_send_to(QF, &m, sizeof(m)) == 0);
+    int status = 0;
+    assert(waitpid(child, &status, 0) == child);
+    assert(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+    close(report[0]);
+    courier_writer_cache_flush();
+
+    printf("[test_writer_cache] PASS\n");
+
+    return 0;
+}